@@ -2,8 +2,11 @@
 #define AST_H
 
 #include <memory>
+#include <vector>
+#include <cstdint>
 
 #include "lexer.h"
+#include "trace.h"
 
 namespace mico { namespace ast {
 
@@ -15,11 +18,62 @@ namespace mico { namespace ast {
         STATE_LET,
         STATE_RETURN,
         STATE_EXPR,
+        STATE_BLOCK,
 
         EXPRESSION_IDENT,
         EXPRESSION_INT,
+        EXPRESSION_BOOL,
         EXPRESSION_PREFIX,
         EXPRESSION_INFIX,
+        EXPRESSION_ARRAY,
+        EXPRESSION_INDEX,
+        EXPRESSION_CALL,
+        EXPRESSION_STRING,
+        EXPRESSION_HASH,
+        EXPRESSION_IF,
+        EXPRESSION_FUNCTION,
+    };
+
+    /// Specializations the evaluator installs into expressions after
+    /// they have run once (quickening). A failed assumption rewrites the
+    /// node back to NONE; after quick_limit rewrites it stays GENERIC.
+    enum class quick_type: std::uint8_t {
+        NONE = 0,
+        GENERIC,
+
+        INT_ADD,
+        INT_SUB,
+        INT_MUL,
+        INT_DIV,
+        INT_LT,
+        INT_GT,
+        INT_EQ,
+        INT_NOT_EQ,
+        INT_NEG,
+
+        IDENT_SLOT,
+
+        NATIVE,
+    };
+
+    static const std::uint8_t quick_limit = 4;
+
+    /// Where a variable lives; filled by scope::resolver.
+    /// GLOBAL:  looked up by name in the globals
+    /// LOCAL:   slot 'index' of the frame of the running function
+    /// CAPTURE: entry 'index' of the captures of the running function
+    /// 'cell' is set when the slot holds a cell with the value, because
+    /// the variable is captured and may change after it was captured
+    enum class var_scope: std::uint8_t {
+        GLOBAL = 0,
+        LOCAL,
+        CAPTURE,
+    };
+
+    struct var_ref {
+        var_scope     scope = var_scope::GLOBAL;
+        bool          cell  = false;
+        std::uint32_t index = 0;
     };
 
     struct node {
@@ -27,6 +81,21 @@ namespace mico { namespace ast {
         using uptr = std::unique_ptr<node>;
 
         virtual ~node( ) { }
+
+        /// every node the parser makes goes through here; see trace.h
+        static
+        void *operator new( std::size_t size )
+        {
+            trace::count( size );
+            return ::operator new( size );
+        }
+
+        static
+        void operator delete( void *ptr )
+        {
+            ::operator delete( ptr );
+        }
+
         virtual node_type type( ) const
         {
             return node_type::NONE;
@@ -44,6 +113,10 @@ namespace mico { namespace ast {
 
         virtual std::string literal( ) const = 0;
         virtual std::string to_string( ) const = 0;
+
+        /// the token it starts at; an infix, a call or an index is at
+        /// its operator
+        lexer::tokens::position pos;
     };
 
     struct statement: public node {
@@ -92,6 +165,15 @@ namespace mico { namespace ast {
             return true;
         }
 
+        /// quickening state; owned by the evaluator
+        mutable quick_type   quick        = quick_type::NONE;
+        mutable std::uint8_t quick_misses = 0;
+
+        /// IDENT_SLOT: slot 'cache_slot' of the environment 'cache_owner'
+        /// NATIVE:     compiled code 'cache_slot' of the runtime whose
+        ///             globals are 'cache_owner'
+        mutable std::uint64_t cache_owner = 0;
+        mutable std::size_t   cache_slot  = 0;
     };
 
     struct ident_statement: public statement {
@@ -135,6 +217,7 @@ namespace mico { namespace ast {
 
         std::unique_ptr<ident_statement> ident;
         std::unique_ptr<expression> expr;
+        var_ref ref;
     };
 
     struct return_statement: public statement {
@@ -180,6 +263,32 @@ namespace mico { namespace ast {
         expression::uptr expr;
     };
 
+    struct block_statement: public statement {
+
+        node_type type( ) const
+        {
+            return node_type::STATE_BLOCK;
+        }
+
+        lexer::tokens::type token( ) const
+        {
+            return lexer::tokens::type::LBRACE;
+        }
+
+        std::string to_string( ) const
+        {
+            std::ostringstream oss;
+            oss << "{ ";
+            for( auto &s: states ) {
+                oss << s->to_string( ) << " ";
+            }
+            oss << "}";
+            return oss.str( );
+        }
+
+        std::vector<statement::uptr> states;
+    };
+
     struct ident_expression: public expression {
 
         node_type type( ) const
@@ -198,6 +307,7 @@ namespace mico { namespace ast {
         }
 
         std::string value;
+        var_ref     ref;
     };
 
     struct int_expression: public expression {
@@ -222,6 +332,26 @@ namespace mico { namespace ast {
         std::int64_t value;
     };
 
+    struct bool_expression: public expression {
+
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_BOOL;
+        }
+
+        std::string literal( ) const
+        {
+            return value ? "true" : "false";
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        bool value = false;
+    };
+
     struct prefix_expression: public expression {
         node_type type( ) const
         {
@@ -270,6 +400,211 @@ namespace mico { namespace ast {
         lexer::tokens::type token;
         expression::uptr    right;
     };
+
+    struct array_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_ARRAY;
+        }
+
+        std::string literal( ) const
+        {
+            std::ostringstream oss;
+            oss << "[";
+            for( std::size_t i = 0; i < elements.size( ); ++i ) {
+                oss << ( i ? ", " : "" ) << elements[i]->to_string( );
+            }
+            oss << "]";
+            return oss.str( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        std::vector<expression::uptr> elements;
+    };
+
+    struct index_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_INDEX;
+        }
+
+        std::string literal( ) const
+        {
+            std::ostringstream oss;
+            oss << "(" << left->to_string( )
+                << "[" << index->to_string( ) << "])";
+            return oss.str( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        expression::uptr left;
+        expression::uptr index;
+    };
+
+    struct call_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_CALL;
+        }
+
+        std::string literal( ) const
+        {
+            std::ostringstream oss;
+            oss << func->to_string( ) << "(";
+            for( std::size_t i = 0; i < args.size( ); ++i ) {
+                oss << ( i ? ", " : "" ) << args[i]->to_string( );
+            }
+            oss << ")";
+            return oss.str( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        expression::uptr              func;
+        std::vector<expression::uptr> args;
+        /// the last thing its function does; filled by scope::resolver
+        bool                          tail = false;
+    };
+
+    struct string_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_STRING;
+        }
+
+        std::string literal( ) const
+        {
+            return value;
+        }
+
+        std::string to_string( ) const
+        {
+            return "\"" + value + "\"";
+        }
+
+        std::string value;
+    };
+
+    struct hash_expression: public expression {
+
+        using pair = std::pair<expression::uptr, expression::uptr>;
+
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_HASH;
+        }
+
+        std::string literal( ) const
+        {
+            std::ostringstream oss;
+            oss << "{";
+            for( std::size_t i = 0; i < pairs.size( ); ++i ) {
+                oss << ( i ? ", " : "" ) << pairs[i].first->to_string( )
+                    << ": " << pairs[i].second->to_string( );
+            }
+            oss << "}";
+            return oss.str( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        std::vector<pair> pairs;
+    };
+
+    struct if_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_IF;
+        }
+
+        std::string literal( ) const
+        {
+            std::ostringstream oss;
+            oss << "if(" << cond->to_string( ) << ") "
+                << then_block->to_string( );
+            if( else_block ) {
+                oss << " else " << else_block->to_string( );
+            }
+            return oss.str( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        expression::uptr                 cond;
+        std::unique_ptr<block_statement> then_block;
+        std::unique_ptr<block_statement> else_block;
+    };
+
+    /// Everything a function value needs from its literal. Shared with
+    /// the function values, so they outlive the program they came from
+    struct function_info {
+
+        std::string to_string( ) const
+        {
+            std::ostringstream oss;
+            oss << "fn(";
+            for( std::size_t i = 0; i < params.size( ); ++i ) {
+                oss << ( i ? ", " : "" ) << params[i];
+            }
+            oss << ") { ";
+            for( auto &s: body ) {
+                oss << s->to_string( ) << " ";
+            }
+            oss << "}";
+            return oss.str( );
+        }
+
+        std::vector<std::string>     params;
+        std::vector<statement::uptr> body;
+        /// the name a let gives the literal, if any, and where the
+        /// literal is; for reports
+        std::string                  name;
+        lexer::tokens::position      pos;
+
+        /// filled by scope::resolver.
+        /// the frame has 'locals' slots, the parameters come first.
+        /// 'captures' says where every captured value is taken from in
+        /// the frame that runs the literal
+        std::size_t          locals = 0;
+        std::vector<bool>    cells;
+        std::vector<var_ref> captures;
+    };
+
+    struct function_expression: public expression {
+        node_type type( ) const
+        {
+            return node_type::EXPRESSION_FUNCTION;
+        }
+
+        std::string literal( ) const
+        {
+            return info->to_string( );
+        }
+
+        std::string to_string( ) const
+        {
+            return literal( );
+        }
+
+        std::shared_ptr<function_info> info;
+    };
 }}
 
 
@@ -0,0 +1,576 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "runtime.h"
+
+namespace mico { namespace batch {
+
+    enum class column_type: std::uint8_t {
+        INT = 0,
+        BOOL,
+    };
+
+    /// an input column; bools are 0 or 1
+    struct field {
+        std::string name;
+        column_type type;
+    };
+
+    struct column {
+        const std::int64_t *ints  = nullptr;
+        const std::uint8_t *bools = nullptr;
+    };
+
+    struct output {
+        column_type               type = column_type::INT;
+        std::vector<std::int64_t> ints;
+        std::vector<std::uint8_t> bools;
+    };
+
+    /// One expression of integers and booleans, evaluated over columns
+    /// instead of one row at a time: identifiers, int and bool literals,
+    /// prefix ! - + and infix + - * / < > == !=, with the results and
+    /// the errors of the interpreter (ints wrap, see eval::int_ops).
+    ///
+    /// compile turns the tree into a list of operations on registers,
+    /// post-order, with the types checked once. run goes through the
+    /// rows a block at a time; each operation is one loop over a block
+    /// with no branch and no dispatch inside, which the compiler turns
+    /// into SIMD code. Columns and constants are read where they are;
+    /// only intermediate results need buffers
+    class program {
+
+    public:
+
+        static const std::size_t block = 1024;
+
+        /// false with 'err' set if the expression uses anything else, a
+        /// name that is not a field or mixes types like the interpreter
+        /// would refuse to
+        static
+        bool compile( const ast::expression &expr,
+                      const std::vector<field> &fields,
+                      program &res, std::string &err )
+        {
+            program next;
+            next.fields_ = fields;
+            std::size_t out = 0;
+            if( !next.emit( expr, out, err ) ) {
+                return false;
+            }
+            next.result_ = out;
+            res = std::move(next);
+            return true;
+        }
+
+        /// 'source' has to be a single expression
+        static
+        bool compile( const std::string &source,
+                      const std::vector<field> &fields,
+                      program &res, std::string &err )
+        {
+            auto tt  = lexer::tokens::all( );
+            auto lst = lexer::tokens::get_list( tt, source.begin( ),
+                                                source.end( ) );
+            parser::token_reader reader(std::move(lst));
+            auto prog = reader.parse( );
+            if( !reader.errors_.empty( ) ) {
+                err = reader.errors_.front( );
+                return false;
+            }
+            if( prog.states.size( ) != 1
+             || prog.states[0]->type( ) != ast::node_type::STATE_EXPR )
+            {
+                err = "not a single expression";
+                return false;
+            }
+            auto &stmt = static_cast<const ast::expr_statement &>(
+                                                        *prog.states[0] );
+            return compile( *stmt.expr, fields, res, err );
+        }
+
+        column_type result_type( ) const
+        {
+            return regs_[result_].type;
+        }
+
+        /// one column for every field, each with 'rows' values; false
+        /// with 'err' set at the first row that divides by zero
+        bool run( const std::vector<column> &columns, std::size_t rows,
+                  output &out, std::string &err ) const
+        {
+            if( columns.size( ) != fields_.size( ) ) {
+                err = "expected " + std::to_string( fields_.size( ) )
+                    + " columns";
+                return false;
+            }
+            for( std::size_t i = 0; i < columns.size( ); ++i ) {
+                bool ints = ( fields_[i].type == column_type::INT );
+                if( rows && ( ints ? !columns[i].ints : !columns[i].bools ) ) {
+                    err = "no data for " + fields_[i].name;
+                    return false;
+                }
+            }
+
+            out.type = result_type( );
+            out.ints.clear( );
+            out.bools.clear( );
+            if( out.type == column_type::INT ) {
+                out.ints.resize( rows );
+            } else {
+                out.bools.resize( rows );
+            }
+
+            /// a block for every temp, and for every constant a block
+            /// of the same value, made once
+            std::vector<std::vector<std::int64_t> > ints( regs_.size( ) );
+            std::vector<std::vector<std::uint8_t> > bools( regs_.size( ) );
+            for( std::size_t i = 0; i < regs_.size( ); ++i ) {
+                auto &r = regs_[i];
+                if( r.kind == reg_kind::COLUMN ) {
+                    continue;
+                }
+                if( r.type == column_type::INT ) {
+                    ints[i].assign( block, r.value );
+                } else {
+                    bools[i].assign( block,
+                                     static_cast<std::uint8_t>(r.value) );
+                }
+            }
+
+            std::vector<const std::int64_t *> iptr( regs_.size( ), nullptr );
+            std::vector<const std::uint8_t *> bptr( regs_.size( ), nullptr );
+            for( std::size_t first = 0; first < rows; first += block ) {
+                auto n = std::min( std::size_t( block ), rows - first );
+                for( std::size_t i = 0; i < regs_.size( ); ++i ) {
+                    auto &r = regs_[i];
+                    if( r.kind == reg_kind::COLUMN ) {
+                        iptr[i] = columns[r.column].ints
+                                ? columns[r.column].ints + first : nullptr;
+                        bptr[i] = columns[r.column].bools
+                                ? columns[r.column].bools + first : nullptr;
+                    } else {
+                        iptr[i] = ints[i].data( );
+                        bptr[i] = bools[i].data( );
+                    }
+                }
+                for( auto &o: ops_ ) {
+                    if( !apply( o, n, ints, bools, iptr, bptr ) ) {
+                        auto row = first + zero_row( iptr[o.b], n );
+                        err = "Division by zero in row "
+                            + std::to_string( row );
+                        return false;
+                    }
+                }
+                auto &res = regs_[result_];
+                if( res.type == column_type::INT ) {
+                    std::copy( iptr[result_], iptr[result_] + n,
+                               out.ints.begin( ) + first );
+                } else {
+                    std::copy( bptr[result_], bptr[result_] + n,
+                               out.bools.begin( ) + first );
+                }
+            }
+            return true;
+        }
+
+        /// operations a block goes through
+        std::size_t size( ) const
+        {
+            return ops_.size( );
+        }
+
+    private:
+
+        using type = lexer::tokens::type;
+
+        enum class reg_kind: std::uint8_t {
+            COLUMN,
+            CONSTANT,
+            TEMP,
+        };
+
+        struct reg {
+            reg_kind     kind   = reg_kind::TEMP;
+            column_type  type   = column_type::INT;
+            std::size_t  column = 0;
+            std::int64_t value  = 0;
+        };
+
+        enum class op_code: std::uint8_t {
+            ADD,
+            SUB,
+            MUL,
+            DIV,
+            NEG,
+            LT,
+            GT,
+            EQ,
+            NOT_EQ,
+            BOOL_EQ,
+            BOOL_NOT_EQ,
+            NOT,
+        };
+
+        /// regs_[dst] = a op b; 'b' is unused by unary ones
+        struct op {
+            op_code     code;
+            std::size_t dst;
+            std::size_t a;
+            std::size_t b;
+        };
+
+        static
+        const char *type_name( column_type t )
+        {
+            return ( t == column_type::INT ) ? "INTEGER" : "BOOLEAN";
+        }
+
+        std::size_t add_reg( reg r )
+        {
+            regs_.push_back( r );
+            return regs_.size( ) - 1;
+        }
+
+        std::size_t constant( column_type t, std::int64_t v )
+        {
+            reg r;
+            r.kind  = reg_kind::CONSTANT;
+            r.type  = t;
+            r.value = v;
+            return add_reg( r );
+        }
+
+        std::size_t temp( column_type t )
+        {
+            reg r;
+            r.type = t;
+            return add_reg( r );
+        }
+
+        void add_op( op_code code, std::size_t dst, std::size_t a,
+                     std::size_t b = 0 )
+        {
+            op next = { code, dst, a, b };
+            ops_.push_back( next );
+        }
+
+        bool emit( const ast::expression &expr, std::size_t &res,
+                   std::string &err )
+        {
+            switch( expr.type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+                res = constant( column_type::INT,
+                    static_cast<const ast::int_expression &>(expr).value );
+                return true;
+            case ast::node_type::EXPRESSION_BOOL:
+                res = constant( column_type::BOOL,
+                    static_cast<const ast::bool_expression &>(expr).value );
+                return true;
+            case ast::node_type::EXPRESSION_IDENT: {
+                auto &name = static_cast<const ast::ident_expression &>(
+                                                                expr).value;
+                for( std::size_t i = 0; i < fields_.size( ); ++i ) {
+                    if( fields_[i].name == name ) {
+                        reg r;
+                        r.kind   = reg_kind::COLUMN;
+                        r.type   = fields_[i].type;
+                        r.column = i;
+                        res = add_reg( r );
+                        return true;
+                    }
+                }
+                err = "Identifier not found: " + name;
+                return false;
+            }
+            case ast::node_type::EXPRESSION_PREFIX:
+                return emit_prefix(
+                    static_cast<const ast::prefix_expression &>(expr),
+                    res, err );
+            case ast::node_type::EXPRESSION_INFIX:
+                return emit_infix(
+                    static_cast<const ast::infix_expression &>(expr),
+                    res, err );
+            default:
+                break;
+            }
+            err = "cannot evaluate in a batch: " + expr.to_string( );
+            return false;
+        }
+
+        bool emit_prefix( const ast::prefix_expression &expr,
+                          std::size_t &res, std::string &err )
+        {
+            std::size_t val = 0;
+            if( !emit( *expr.expr, val, err ) ) {
+                return false;
+            }
+            auto t = regs_[val].type;
+            switch( expr.token ) {
+            case type::BANG:
+                /// every int is truthy
+                if( t == column_type::INT ) {
+                    res = constant( column_type::BOOL, 0 );
+                } else {
+                    res = temp( column_type::BOOL );
+                    add_op( op_code::NOT, res, val );
+                }
+                return true;
+            case type::MINUS:
+                if( t == column_type::INT ) {
+                    res = temp( column_type::INT );
+                    add_op( op_code::NEG, res, val );
+                    return true;
+                }
+                break;
+            case type::PLUS:
+                if( t == column_type::INT ) {
+                    res = val;
+                    return true;
+                }
+                break;
+            default:
+                break;
+            }
+            std::ostringstream oss;
+            oss << "Unknown operator: " << expr.token << type_name( t );
+            err = oss.str( );
+            return false;
+        }
+
+        bool emit_infix( const ast::infix_expression &expr,
+                         std::size_t &res, std::string &err )
+        {
+            std::size_t left  = 0;
+            std::size_t right = 0;
+            if( !emit( *expr.left, left, err )
+             || !emit( *expr.right, right, err ) )
+            {
+                return false;
+            }
+            auto lt  = regs_[left].type;
+            auto rt  = regs_[right].type;
+            auto tok = expr.token;
+
+            if( lt == column_type::INT && rt == column_type::INT ) {
+                auto code = op_code::ADD;
+                auto out  = column_type::INT;
+                bool known = true;
+                switch( tok ) {
+                case type::PLUS:     code = op_code::ADD;    break;
+                case type::MINUS:    code = op_code::SUB;    break;
+                case type::ASTERISK: code = op_code::MUL;    break;
+                case type::SLASH:    code = op_code::DIV;    break;
+                case type::LT:
+                    code = op_code::LT;
+                    out  = column_type::BOOL;
+                    break;
+                case type::GT:
+                    code = op_code::GT;
+                    out  = column_type::BOOL;
+                    break;
+                case type::EQ:
+                    code = op_code::EQ;
+                    out  = column_type::BOOL;
+                    break;
+                case type::NOT_EQ:
+                    code = op_code::NOT_EQ;
+                    out  = column_type::BOOL;
+                    break;
+                default:
+                    known = false;
+                    break;
+                }
+                if( known ) {
+                    res = temp( out );
+                    add_op( code, res, left, right );
+                    return true;
+                }
+            } else if( tok == type::EQ || tok == type::NOT_EQ ) {
+                if( lt != rt ) {
+                    /// an int is never the same as a bool
+                    res = constant( column_type::BOOL, tok == type::NOT_EQ );
+                } else {
+                    res = temp( column_type::BOOL );
+                    add_op( tok == type::EQ ? op_code::BOOL_EQ
+                                            : op_code::BOOL_NOT_EQ,
+                            res, left, right );
+                }
+                return true;
+            }
+
+            std::ostringstream oss;
+            oss << ( ( lt == rt ) ? "Unknown operator: " : "Type mismatch: " )
+                << type_name( lt ) << " " << tok << " " << type_name( rt );
+            err = oss.str( );
+            return false;
+        }
+
+        /// the kernels; 'r' never aliases an input, every temp is
+        /// written by one operation only
+        static
+        void add( std::int64_t *r, const std::int64_t *a,
+                  const std::int64_t *b, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = eval::int_ops::add( a[i], b[i] );
+            }
+        }
+
+        static
+        void sub( std::int64_t *r, const std::int64_t *a,
+                  const std::int64_t *b, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = eval::int_ops::sub( a[i], b[i] );
+            }
+        }
+
+        static
+        void mul( std::int64_t *r, const std::int64_t *a,
+                  const std::int64_t *b, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = eval::int_ops::mul( a[i], b[i] );
+            }
+        }
+
+        static
+        void neg( std::int64_t *r, const std::int64_t *a, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = eval::int_ops::neg( a[i] );
+            }
+        }
+
+        /// there is no SIMD division; the zero check is one pass first
+        static
+        bool div( std::int64_t *r, const std::int64_t *a,
+                  const std::int64_t *b, std::size_t n )
+        {
+            std::uint8_t zero = 0;
+            for( std::size_t i = 0; i < n; ++i ) {
+                zero |= ( b[i] == 0 );
+            }
+            if( zero ) {
+                return false;
+            }
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = eval::int_ops::div( a[i], b[i] );
+            }
+            return true;
+        }
+
+        template <op_code Code>
+        static
+        void compare( std::uint8_t *r, const std::int64_t *a,
+                      const std::int64_t *b, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                switch( Code ) {
+                case op_code::LT: r[i] = ( a[i] <  b[i] ); break;
+                case op_code::GT: r[i] = ( a[i] >  b[i] ); break;
+                case op_code::EQ: r[i] = ( a[i] == b[i] ); break;
+                default:          r[i] = ( a[i] != b[i] ); break;
+                }
+            }
+        }
+
+        /// bools are 0 or 1, so == is 1 ^ a ^ b and != is a ^ b
+        static
+        void bool_xor( std::uint8_t *r, const std::uint8_t *a,
+                       const std::uint8_t *b, std::uint8_t flip,
+                       std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = a[i] ^ b[i] ^ flip;
+            }
+        }
+
+        static
+        void bool_not( std::uint8_t *r, const std::uint8_t *a, std::size_t n )
+        {
+            for( std::size_t i = 0; i < n; ++i ) {
+                r[i] = a[i] ^ 1;
+            }
+        }
+
+        static
+        std::size_t zero_row( const std::int64_t *b, std::size_t n )
+        {
+            return static_cast<std::size_t>(std::find( b, b + n, 0 ) - b);
+        }
+
+        /// false if a DIV met a zero. The destination is always a
+        /// temp, so its block is in 'ints' or 'bools'
+        static
+        bool apply( const op &o, std::size_t n,
+                    std::vector<std::vector<std::int64_t> > &ints,
+                    std::vector<std::vector<std::uint8_t> > &bools,
+                    const std::vector<const std::int64_t *> &iptr,
+                    const std::vector<const std::uint8_t *> &bptr )
+        {
+            auto ia = iptr[o.a];
+            auto ib = iptr[o.b];
+            auto ba = bptr[o.a];
+            auto bb = bptr[o.b];
+            auto ri = ints[o.dst].data( );
+            auto rb = bools[o.dst].data( );
+            switch( o.code ) {
+            case op_code::ADD:
+                add( ri, ia, ib, n );
+                break;
+            case op_code::SUB:
+                sub( ri, ia, ib, n );
+                break;
+            case op_code::MUL:
+                mul( ri, ia, ib, n );
+                break;
+            case op_code::DIV:
+                return div( ri, ia, ib, n );
+            case op_code::NEG:
+                neg( ri, ia, n );
+                break;
+            case op_code::LT:
+                compare<op_code::LT>( rb, ia, ib, n );
+                break;
+            case op_code::GT:
+                compare<op_code::GT>( rb, ia, ib, n );
+                break;
+            case op_code::EQ:
+                compare<op_code::EQ>( rb, ia, ib, n );
+                break;
+            case op_code::NOT_EQ:
+                compare<op_code::NOT_EQ>( rb, ia, ib, n );
+                break;
+            case op_code::BOOL_EQ:
+                bool_xor( rb, ba, bb, 1, n );
+                break;
+            case op_code::BOOL_NOT_EQ:
+                bool_xor( rb, ba, bb, 0, n );
+                break;
+            case op_code::NOT:
+                bool_not( rb, ba, n );
+                break;
+            }
+            return true;
+        }
+
+        std::vector<field> fields_;
+        std::vector<reg>   regs_;
+        std::vector<op>    ops_;
+        std::size_t        result_ = 0;
+    };
+
+}}
+
+#endif // BATCH_H
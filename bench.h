@@ -0,0 +1,301 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define MICO_BENCH_RUSAGE 1
+#else
+#define MICO_BENCH_RUSAGE 0
+#endif
+
+#include "lexer.h"
+#include "parser.h"
+
+namespace mico { namespace bench {
+
+    using clock = std::chrono::steady_clock;
+
+    struct timer {
+
+        timer( )
+            :start_(clock::now( ))
+        { }
+
+        void reset( )
+        {
+            start_ = clock::now( );
+        }
+
+        double seconds( ) const
+        {
+            return std::chrono::duration<double>(clock::now( ) - start_)
+                  .count( );
+        }
+
+        double milliseconds( ) const
+        {
+            return seconds( ) * 1000.0;
+        }
+
+    private:
+        clock::time_point start_;
+    };
+
+    inline
+    void header( std::ostream &o, const std::string &name )
+    {
+        o << "\n== " << name << " ==\n";
+    }
+
+    template <typename T>
+    void row( std::ostream &o, const std::string &name, T val,
+              const std::string &unit = "" )
+    {
+        o << "  " << std::left << std::setw(32) << name
+          << std::right << std::setw(14) << val
+          << (unit.empty( ) ? "" : " ") << unit << "\n";
+    }
+
+    inline
+    parser::program parse( const std::string &input )
+    {
+        auto tt  = lexer::tokens::all( );
+        auto lst = lexer::tokens::get_list( tt, input.begin( ), input.end( ) );
+        parser::token_reader reader(std::move(lst));
+        return reader.parse( );
+    }
+
+    /// 'lets' * 2 statements of integer and boolean arithmetic.
+    /// values stay small, so no encoding has to promote them
+    inline
+    std::string arithmetic_script( std::size_t lets )
+    {
+        std::ostringstream oss;
+        oss << "let v0 = 1;\n";
+        for( std::size_t i = 1; i < lets; ++i ) {
+            oss << "let v" << i << " = (v" << i - 1 << " * 3 + " << i
+                << " - v" << i - 1 << " / 2) / 4;\n"
+                << "let b" << i << " = v" << i << " > " << i
+                << " == !false;\n";
+        }
+        return oss.str( );
+    }
+
+    /// what the command line of monkey_bench sets; see bench_main.cpp
+    struct settings {
+        bool          corpus_only = false;
+        std::size_t   bytes       = 1024 * 1024;
+        std::uint64_t seed        = 1;
+        /// where the results go and the ones they are compared with;
+        /// empty for none
+        std::string   json;
+        std::string   baseline;
+        /// in percent
+        double        tolerance   = 10.0;
+    };
+
+    /// Every operator new of the bench binary; bench_main.cpp replaces
+    /// the global ones to count them. 'peak' is the most that was live
+    /// at once since the last reset_peak( )
+    struct allocations {
+        std::uint64_t count = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t live  = 0;
+        std::uint64_t peak  = 0;
+    };
+
+    allocations allocated( );
+    void reset_peak( );
+
+    /// the largest resident set the process had, in bytes; 0 if the
+    /// system does not tell
+    inline
+    std::uint64_t peak_rss( )
+    {
+#if MICO_BENCH_RUSAGE
+        struct rusage ru;
+        if( getrusage( RUSAGE_SELF, &ru ) != 0 ) {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return static_cast<std::uint64_t>(ru.ru_maxrss);
+#else
+        return static_cast<std::uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    struct result {
+        std::string name;
+        double      value  = 0;
+        std::string unit;
+        bool        higher = true;
+    };
+
+    /// Results as JSON, one result an object on its own line:
+    ///   {"results": [
+    ///     {"name": "lexer.deep", "value": 41.5, "unit": "MB/s",
+    ///      "higher_is_better": true},
+    ///     ...
+    ///   ]}
+    /// read( ) takes what json( ) writes; it is not a JSON parser
+    struct results {
+
+        void add( const std::string &name, double value,
+                  const std::string &unit, bool higher )
+        {
+            result next;
+            next.name   = name;
+            next.value  = value;
+            next.unit   = unit;
+            next.higher = higher;
+            all.push_back( next );
+        }
+
+        const result *find( const std::string &name ) const
+        {
+            for( auto &r: all ) {
+                if( r.name == name ) {
+                    return &r;
+                }
+            }
+            return nullptr;
+        }
+
+        std::string json( ) const
+        {
+            std::ostringstream oss;
+            oss << "{\"results\": [\n";
+            for( std::size_t i = 0; i < all.size( ); ++i ) {
+                auto &r = all[i];
+                oss << "  {\"name\": \"" << r.name << "\", \"value\": "
+                    << std::setprecision(17) << r.value
+                    << ", \"unit\": \"" << r.unit
+                    << "\", \"higher_is_better\": "
+                    << ( r.higher ? "true" : "false" ) << "}"
+                    << ( i + 1 < all.size( ) ? "," : "" ) << "\n";
+            }
+            oss << "]}\n";
+            return oss.str( );
+        }
+
+        static
+        results read( const std::string &text )
+        {
+            results res;
+            std::istringstream iss(text);
+            std::string line;
+            while( std::getline( iss, line ) ) {
+                result next;
+                if( !field( line, "name", next.name ) ) {
+                    continue;
+                }
+                std::string value;
+                std::string higher;
+                field( line, "value", value );
+                field( line, "unit", next.unit );
+                field( line, "higher_is_better", higher );
+                next.value  = std::strtod( value.c_str( ), nullptr );
+                next.higher = ( higher != "false" );
+                res.all.push_back( next );
+            }
+            return res;
+        }
+
+        /// the results worse than the same ones of 'base' by more than
+        /// 'tolerance' percent, described
+        std::vector<std::string> regressions( const results &base,
+                                              double tolerance ) const
+        {
+            std::vector<std::string> res;
+            for( auto &r: all ) {
+                auto b = base.find( r.name );
+                if( !b || b->value == 0 ) {
+                    continue;
+                }
+                auto change = ( r.value - b->value ) / b->value * 100.0;
+                bool worse = r.higher ? ( change < -tolerance )
+                                      : ( change > tolerance );
+                if( worse ) {
+                    std::ostringstream oss;
+                    oss << r.name << ": " << b->value << " -> " << r.value
+                        << " " << r.unit << " (" << std::showpos
+                        << std::fixed << std::setprecision(1) << change
+                        << "%)";
+                    res.push_back( oss.str( ) );
+                }
+            }
+            return res;
+        }
+
+        std::vector<result> all;
+
+    private:
+
+        /// the value of "key" in 'line', a string without its quotes
+        static
+        bool field( const std::string &line, const std::string &key,
+                    std::string &out )
+        {
+            auto pos = line.find( "\"" + key + "\"" );
+            if( pos == std::string::npos ) {
+                return false;
+            }
+            pos = line.find( ':', pos + key.size( ) + 2 );
+            if( pos == std::string::npos ) {
+                return false;
+            }
+            pos = line.find_first_not_of( " \t", pos + 1 );
+            if( pos == std::string::npos ) {
+                return false;
+            }
+            if( line[pos] == '"' ) {
+                auto end = line.find( '"', pos + 1 );
+                if( end == std::string::npos ) {
+                    return false;
+                }
+                out = line.substr( pos + 1, end - pos - 1 );
+            } else {
+                auto end = line.find_first_of( ",} \t", pos );
+                out = line.substr( pos, end - pos );
+            }
+            return true;
+        }
+    };
+
+    inline
+    bool read_file( const std::string &path, std::string &out )
+    {
+        std::ifstream f(path, std::ios::binary);
+        if( !f ) {
+            return false;
+        }
+        std::ostringstream oss;
+        oss << f.rdbuf( );
+        out = oss.str( );
+        return true;
+    }
+
+    inline
+    bool write_file( const std::string &path, const std::string &data )
+    {
+        std::ofstream f(path, std::ios::binary);
+        f << data;
+        return static_cast<bool>(f);
+    }
+
+}}
+
+#endif // BENCH_H
@@ -0,0 +1,61 @@
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = monkey_bench
+
+SOURCES += bench_main.cpp \
+    bench_gc.cpp \
+    bench_values.cpp \
+    bench_engines.cpp \
+    bench_jit.cpp \
+    bench_vector.cpp \
+    bench_hash.cpp \
+    bench_string.cpp \
+    bench_function.cpp \
+    bench_vm.cpp \
+    bench_image.cpp \
+    bench_snapshot.cpp \
+    bench_executor.cpp \
+    bench_batch.cpp \
+    bench_parallel.cpp \
+    bench_sequence.cpp \
+    bench_lets.cpp \
+    bench_native.cpp \
+    bench_profile.cpp \
+    bench_corpus.cpp \
+    bench_trace.cpp
+
+INCLUDEPATH += etool/include/
+
+HEADERS += \
+    bench.h \
+    lexer.h \
+    parser.h \
+    ast.h \
+    objects.h \
+    gc.h \
+    runtime.h \
+    native.h \
+    eval.h \
+    engine.h \
+    closure.h \
+    jit.h \
+    vector.h \
+    hash.h \
+    function.h \
+    sequence.h \
+    scope.h \
+    deps.h \
+    bytecode.h \
+    peephole.h \
+    vm.h \
+    profile.h \
+    trace.h \
+    corpus.h \
+    image.h \
+    snapshot.h \
+    pool.h \
+    executor.h \
+    batch.h
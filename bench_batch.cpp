@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "bench.h"
+#include "batch.h"
+#include "vm.h"
+
+using namespace mico;
+
+void bench_batch( )
+{
+    using value = objects::value;
+
+    const char *expr = "a + b * c - d / f";
+    const std::size_t rows     = 1 << 20;
+    const std::size_t row_rows = 1 << 17;
+    const char *names[] = { "a", "b", "c", "d", "f" };
+
+    std::mt19937_64 gen(1);
+    std::uniform_int_distribution<std::int64_t> dist(1, 1000);
+    std::vector<std::vector<std::int64_t> > data( 5 );
+    std::vector<batch::field>  fields;
+    std::vector<batch::column> columns;
+    for( std::size_t i = 0; i < 5; ++i ) {
+        for( std::size_t r = 0; r < rows; ++r ) {
+            data[i].push_back( dist( gen ) );
+        }
+        batch::field f = { names[i], batch::column_type::INT };
+        fields.push_back( f );
+        batch::column c;
+        c.ints = data[i].data( );
+        columns.push_back( c );
+    }
+
+    /// the interpreter, once per row
+    gc::heap heap;
+    engines::vm_engine<value> vm(heap);
+    vm.load( bench::parse( expr ) );
+    auto env = vm.context( ).globals( );
+    std::int64_t row_sum = 0;
+    bench::timer t;
+    for( std::size_t r = 0; r < row_rows; ++r ) {
+        for( std::size_t i = 0; i < 5; ++i ) {
+            env->set( names[i], value::from_int( data[i][r] ) );
+        }
+        row_sum += vm.run( ).as_int( );
+    }
+    auto row_secs = t.seconds( );
+
+    std::string err;
+    batch::program prog;
+    batch::program::compile( expr, fields, prog, err );
+    batch::output out;
+    t.reset( );
+    prog.run( columns, rows, out, err );
+    auto batch_secs = t.seconds( );
+
+    std::int64_t batch_sum = 0;
+    for( std::size_t r = 0; r < row_rows; ++r ) {
+        batch_sum += out.ints[r];
+    }
+
+    bench::header( std::cout, std::string( "batch evaluation of " ) + expr );
+    bench::row( std::cout, "row at a time (vm)", row_rows / row_secs / 1e6,
+                "M rows/s" );
+    bench::row( std::cout, "batch", rows / batch_secs / 1e6, "M rows/s" );
+    bench::row( std::cout, "speedup", ( rows / batch_secs )
+                                    / ( row_rows / row_secs ), "x" );
+    bench::row( std::cout, "same result",
+                row_sum == batch_sum ? "yes" : "no" );
+}
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "bench.h"
+#include "corpus.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    /// the fastest of 'rounds' runs of 'fn', in seconds; 'fn' may reset
+    /// 't' to leave its setup out
+    template <typename FuncT>
+    double best_of( std::size_t rounds, FuncT fn )
+    {
+        double res = 0;
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            bench::timer t;
+            fn( t );
+            auto secs = t.seconds( );
+            res = ( i == 0 ) ? secs : std::min( res, secs );
+        }
+        return res;
+    }
+
+    /// the allocations 'fn' makes and the most it holds at once
+    template <typename FuncT>
+    bench::allocations counted( FuncT fn )
+    {
+        bench::reset_peak( );
+        auto before = bench::allocated( );
+        fn( );
+        auto after = bench::allocated( );
+        bench::allocations res;
+        res.count = after.count - before.count;
+        res.bytes = after.bytes - before.bytes;
+        res.peak  = after.peak - before.live;
+        return res;
+    }
+
+    void shape( corpus::shape kind, const bench::settings &opts,
+                bench::results &res )
+    {
+        const std::size_t rounds = 5;
+
+        corpus::options co;
+        co.kind  = kind;
+        co.bytes = opts.bytes;
+        co.seed  = opts.seed;
+        auto src = corpus::generate( co );
+        std::string name(corpus::name( kind ));
+
+        auto tt = lexer::tokens::all( );
+        std::vector<lexer::tokens::info> tokens;
+        auto lex_secs = best_of( rounds, [&]( bench::timer & ) {
+            tokens = lexer::tokens::get_list( tt, src.begin( ), src.end( ) );
+        } );
+        auto lex_allocs = counted( [&]( ) {
+            lexer::tokens::get_list( tt, src.begin( ), src.end( ) );
+        } );
+
+        std::size_t statements = 0;
+        auto parse_secs = best_of( rounds, [&]( bench::timer &t ) {
+            parser::token_reader reader(tokens);
+            t.reset( );
+            statements = reader.parse( ).states.size( );
+        } );
+        auto parse_allocs = counted( [&]( ) {
+            parser::token_reader reader(tokens);
+            reader.parse( );
+        } );
+
+        auto prog = bench::parse( src );
+        std::string value;
+        auto eval_secs = best_of( rounds, [&]( bench::timer &t ) {
+            gc::heap heap;
+            engines::vm_engine<objects::value> vm(heap);
+            vm.load( prog );
+            t.reset( );
+            value = objects::inspect( vm.run( ) );
+        } );
+
+        auto mb = src.size( ) / ( 1024.0 * 1024.0 );
+        bench::header( std::cout, "corpus, " + name + ", "
+                                + std::to_string( src.size( ) ) + " bytes" );
+        bench::row( std::cout, "tokens", tokens.size( ) );
+        bench::row( std::cout, "statements", statements );
+        bench::row( std::cout, "lexer", mb / lex_secs, "MB/s" );
+        bench::row( std::cout, "lexer allocations", lex_allocs.count );
+        bench::row( std::cout, "lexer peak", lex_allocs.peak, "bytes" );
+        bench::row( std::cout, "parser", statements / parse_secs,
+                    "statements/s" );
+        bench::row( std::cout, "parser allocations", parse_allocs.count );
+        bench::row( std::cout, "parser peak", parse_allocs.peak, "bytes" );
+        bench::row( std::cout, "vm", statements / eval_secs,
+                    "statements/s" );
+        bench::row( std::cout, "vm result", value );
+
+        res.add( "lexer." + name, mb / lex_secs, "MB/s", true );
+        res.add( "lexer." + name + ".allocations",
+                 static_cast<double>(lex_allocs.count), "count", false );
+        res.add( "lexer." + name + ".peak",
+                 static_cast<double>(lex_allocs.peak), "bytes", false );
+        res.add( "parser." + name, statements / parse_secs,
+                 "statements/s", true );
+        res.add( "parser." + name + ".allocations",
+                 static_cast<double>(parse_allocs.count), "count", false );
+        res.add( "parser." + name + ".peak",
+                 static_cast<double>(parse_allocs.peak), "bytes", false );
+        res.add( "vm." + name, statements / eval_secs,
+                 "statements/s", true );
+    }
+}
+
+/// The lexer, the parser and the vm over generated scripts of every
+/// shape (see corpus.h). Writes the results as JSON to opts.json and
+/// compares them with opts.baseline, if they are set; returns the
+/// number of regressions
+std::size_t bench_corpus( const bench::settings &opts )
+{
+    bench::results res;
+
+    auto table_secs = [ ]( ) {
+        bench::timer t;
+        for( int i = 0; i < 1000; ++i ) {
+            lexer::tokens::all( );
+        }
+        return t.seconds( ) / 1000;
+    }( );
+    bench::header( std::cout, "corpus, token table" );
+    bench::row( std::cout, "tokens::all", table_secs * 1e6, "us" );
+    res.add( "lexer.table", table_secs * 1e6, "us", false );
+
+    for( auto kind: { corpus::shape::DEEP, corpus::shape::LETS,
+                      corpus::shape::STRINGS, corpus::shape::NUMBERS,
+                      corpus::shape::MIXED } )
+    {
+        shape( kind, opts, res );
+    }
+
+    auto rss = bench::peak_rss( );
+    bench::row( std::cout, "peak rss", rss / 1024, "KB" );
+    res.add( "process.peak_rss", static_cast<double>(rss), "bytes", false );
+
+    if( !opts.json.empty( ) && !bench::write_file( opts.json, res.json( ) ) ) {
+        std::cerr << "cannot write " << opts.json << "\n";
+    }
+
+    if( opts.baseline.empty( ) ) {
+        return 0;
+    }
+    std::string text;
+    if( !bench::read_file( opts.baseline, text ) ) {
+        std::cerr << "cannot read " << opts.baseline << "\n";
+        return 0;
+    }
+    auto worse = res.regressions( bench::results::read( text ),
+                                  opts.tolerance );
+    bench::header( std::cout, "corpus, against " + opts.baseline );
+    bench::row( std::cout, "regressions", worse.size( ) );
+    for( auto &w: worse ) {
+        std::cout << "  " << w << "\n";
+    }
+    return worse.size( );
+}
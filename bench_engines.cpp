@@ -0,0 +1,52 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "engine.h"
+#include "closure.h"
+
+using namespace mico;
+
+namespace {
+
+    using value      = objects::value;
+    using engine_ptr = std::unique_ptr<engines::engine<value> >;
+
+    void run( engines::engine<value> &eng, const parser::program &prog,
+              std::size_t rounds, std::size_t statements )
+    {
+        bench::timer load;
+        eng.load( prog );
+        auto load_time = load.milliseconds( );
+
+        bench::timer t;
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            eng.run( );
+        }
+        auto elapsed = t.seconds( );
+
+        bench::header( std::cout, std::string("engine: ") + eng.name( ) );
+        bench::row( std::cout, "load", load_time, "ms" );
+        bench::row( std::cout, "statements/s",
+                    static_cast<std::uint64_t>(rounds * statements / elapsed) );
+        bench::row( std::cout, "errors", eng.context( ).errors_.size( ) );
+    }
+}
+
+void bench_engines( )
+{
+    const std::size_t lets = 2000;
+    auto input = bench::arithmetic_script( lets );
+
+    gc::heap heap;
+    std::vector<engine_ptr> all;
+    all.emplace_back( new engines::tree_engine<value>(heap) );
+    all.emplace_back( new engines::closure_engine<value>(heap) );
+
+    for( auto &eng: all ) {
+        /// each engine gets its own tree; the tree walker rewrites it
+        auto prog = bench::parse( input );
+        run( *eng, prog, 200, lets * 2 );
+    }
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <atomic>
+
+#include "bench.h"
+#include "executor.h"
+
+using namespace mico;
+
+namespace {
+
+    /// one request: some calls, a few objects, a string
+    const char *request =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "let row = fn(i) { {\"id\": i, \"fib\": fib(i), \"tag\": \"r\" + \"-\"} }; "
+        "let rows = fn(i, acc) { if (i == 18) { acc } "
+        "else { rows(i + 1, push(acc, row(i))) } }; "
+        "len(rows(0, []))";
+}
+
+void bench_executor( )
+{
+    const std::size_t jobs = 400;
+    std::string err;
+    auto prog = exec::program::compile( request, err );
+
+    bench::header( std::cout, "executor, " + std::to_string( jobs )
+                            + " runs of one shared program" );
+    bench::row( std::cout, "hardware threads", exec::executor::default_threads( ) );
+
+    double single = 0;
+    for( std::size_t threads = 1; threads <= 8; threads *= 2 ) {
+        std::atomic<std::size_t> good(0);
+        exec::executor ex(threads);
+        bench::timer t;
+        for( std::size_t i = 0; i < jobs; ++i ) {
+            ex.submit( prog, [&]( const exec::result &res ) {
+                good += ( res.value == "18" ) ? 1 : 0;
+            } );
+        }
+        ex.wait( );
+        auto secs = t.seconds( );
+        single = ( threads == 1 ) ? secs : single;
+
+        std::uint64_t stolen = 0;
+        for( auto &st: ex.stats( ) ) {
+            stolen += st.stolen;
+        }
+        auto name = std::to_string( threads ) + " threads";
+        bench::row( std::cout, name + ", runs/s", jobs / secs );
+        bench::row( std::cout, name + ", speedup", single / secs, "x" );
+        bench::row( std::cout, name + ", stolen", stolen );
+        bench::row( std::cout, name + ", all correct",
+                    good == jobs ? "yes" : "no" );
+    }
+}
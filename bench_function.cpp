@@ -0,0 +1,102 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "engine.h"
+#include "closure.h"
+
+using namespace mico;
+
+namespace {
+
+    using value      = objects::value;
+    using engine_ptr = std::unique_ptr<engines::engine<value> >;
+
+    /// fib(n) makes fib(n + 1) * 2 - 1 calls
+    std::uint64_t fib_calls( std::uint64_t n )
+    {
+        std::uint64_t a = 1;
+        std::uint64_t b = 1;
+        for( std::uint64_t i = 0; i < n; ++i ) {
+            auto next = a + b;
+            a = b;
+            b = next;
+        }
+        return a * 2 - 1;
+    }
+
+    /// 'n' callbacks made in a frame that also holds a large array;
+    /// every callback captures one integer
+    std::string callbacks_script( std::size_t n )
+    {
+        std::ostringstream oss;
+        oss << "let make = fn(i) { let big = [i, i, i, i, i, i, i, i]; "
+               "let big = push(push(push(push(big, i), i), i), i); "
+               "fn(x) { x + i } };\n";
+        oss << "let all = [];\n";
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let all = push(all, make(" << i << "));\n";
+        }
+        oss << "all[" << n / 2 << "](1)\n";
+        return oss.str( );
+    }
+}
+
+void bench_function( )
+{
+    const std::uint64_t n = 22;
+    std::string fib = "let fib = fn(n) { if (n < 2) { n } "
+                      "else { fib(n - 1) + fib(n - 2) } }; fib("
+                    + std::to_string( n ) + ")";
+
+    gc::heap heap;
+    std::vector<engine_ptr> all;
+    all.emplace_back( new engines::tree_engine<value>(heap) );
+    all.emplace_back( new engines::closure_engine<value>(heap) );
+
+    for( auto &eng: all ) {
+        auto prog = bench::parse( fib );
+        eng->load( prog );
+        bench::timer t;
+        auto res = eng->run( );
+        auto elapsed = t.seconds( );
+
+        bench::header( std::cout, std::string("recursive calls: ")
+                                + eng->name( ) );
+        bench::row( std::cout, "calls/s",
+                    static_cast<std::uint64_t>(fib_calls( n ) / elapsed) );
+        bench::row( std::cout, "result", objects::inspect( res ) );
+    }
+
+    const std::uint64_t loops = 1000000;
+    std::string count = "let count = fn(n, acc) { if (n == 0) { return acc; } "
+                        "count(n - 1, acc + 1) }; count("
+                      + std::to_string( loops ) + ", 0)";
+    for( auto &eng: all ) {
+        auto prog = bench::parse( count );
+        eng->load( prog );
+        bench::timer t;
+        auto res = eng->run( );
+        auto elapsed = t.seconds( );
+
+        bench::header( std::cout, std::string("tail calls: ")
+                                + eng->name( ) );
+        bench::row( std::cout, "calls/s",
+                    static_cast<std::uint64_t>(loops / elapsed) );
+        bench::row( std::cout, "result", objects::inspect( res ) );
+    }
+
+    const std::size_t callbacks = 5000;
+    gc::heap cb_heap;
+    eval::tagged_evaluator evaluator(cb_heap);
+    auto prog = bench::parse( callbacks_script( callbacks ) );
+    auto res = evaluator.eval( prog );
+    cb_heap.collect( );
+
+    bench::header( std::cout, "flat closures, "
+                            + std::to_string( callbacks ) + " callbacks" );
+    bench::row( std::cout, "live bytes per callback",
+                cb_heap.get_stats( ).live_bytes / callbacks );
+    bench::row( std::cout, "result", objects::inspect( res ) );
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "gc.h"
+
+using namespace mico;
+
+namespace {
+
+    /// keeps 'live' arrays reachable and keeps replacing them,
+    /// so every allocation produces garbage
+    void churn( gc::heap &heap, std::size_t live, std::size_t rounds )
+    {
+        gc::value_stack stack;
+        heap.add_root( &stack );
+
+        stack.values.resize( live + 1 );
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            auto arr = heap.make<objects::array>( );
+            stack.values[live] = objects::value::from_object( arr );
+            for( int e = 0; e < 4; ++e ) {
+                auto str = heap.make<objects::string>( "element" );
+                auto val = objects::value::from_object( str );
+                arr->elements.push_back( val );
+                heap.write_barrier( arr, val );
+            }
+            stack.values[i % live] = stack.values[live];
+        }
+
+        heap.remove_root( &stack );
+    }
+
+    void report( const char *name, gc::config conf )
+    {
+        gc::heap heap(conf);
+
+        bench::timer t;
+        churn( heap, 100000, 2000000 );
+        auto elapsed = t.milliseconds( );
+
+        auto &st = heap.get_stats( );
+        bench::header( std::cout, name );
+        bench::row( std::cout, "total time",   elapsed, "ms" );
+        bench::row( std::cout, "collections",  st.collections );
+        bench::row( std::cout, "steps",        st.steps );
+        bench::row( std::cout, "max pause",
+                    st.max_pause.count( ) / 1000.0, "us" );
+        bench::row( std::cout, "total pause",
+                    st.total_pause.count( ) / 1000000.0, "ms" );
+        bench::row( std::cout, "max root scan",
+                    st.max_root_scan.count( ) / 1000.0, "us" );
+        bench::row( std::cout, "heap size",    st.heap_bytes / 1024, "KB" );
+
+        std::cout << "  pause histogram:\n";
+        for( std::size_t i = 0; i < st.pauses.size( ); ++i ) {
+            if( st.pauses[i] == 0 ) {
+                continue;
+            }
+            std::string name = ( i + 1 < st.pauses.size( ) )
+                    ? "< " + std::to_string( 1LL << i ) + " us"
+                    : ">= " + std::to_string( 1LL << (i - 1) ) + " us";
+            bench::row( std::cout, "  " + name, st.pauses[i] );
+        }
+    }
+}
+
+void bench_gc_pauses( )
+{
+    gc::config conf;
+    conf.initial_threshold = 8 * 1024 * 1024;
+
+    report( "gc throughput mode", conf );
+
+    conf.collection = gc::mode::INCREMENTAL;
+    conf.max_pause  = std::chrono::microseconds(1000);
+    report( "gc incremental mode, 1ms steps", conf );
+
+    conf.max_pause  = std::chrono::microseconds(100);
+    conf.step_bytes = 16 * 1024;
+    report( "gc incremental mode, 100us steps", conf );
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    /// one hash literal with 'keys' string keys and 'lookups' reads of it
+    std::string lookup_script( std::size_t keys, std::size_t lookups )
+    {
+        std::ostringstream oss;
+        oss << "let h = {";
+        for( std::size_t i = 0; i < keys; ++i ) {
+            oss << ( i ? ", " : "" ) << "\"key" << i << "\": " << i;
+        }
+        oss << "};\n";
+        for( std::size_t i = 0; i < lookups; ++i ) {
+            oss << "let v = h[\"key" << (i * 7) % keys << "\"] + "
+                << "h[\"key" << (i * 13) % keys << "\"];\n";
+        }
+        return oss.str( );
+    }
+
+    void tables( std::size_t keys, std::size_t rounds )
+    {
+        gc::heap heap;
+        gc::value_stack stack;
+        heap.add_root( &stack );
+
+        objects::hash swiss;
+        std::unordered_map<std::string, objects::value> node;
+        for( std::size_t i = 0; i < keys; ++i ) {
+            auto name = "key" + std::to_string( i );
+            auto str  = heap.make<objects::string>( name );
+            stack.push( objects::value::from_object( str ) );
+            swiss.insert( stack.top( ), objects::value::from_int( i ) );
+            node[name] = objects::value::from_int( i );
+        }
+
+        /// probes are separate objects, as a script would have them
+        std::vector<objects::value> probes;
+        for( std::size_t i = 0; i < keys; ++i ) {
+            auto str = heap.make<objects::string>( "key" + std::to_string( i ) );
+            stack.push( objects::value::from_object( str ) );
+            probes.push_back( stack.top( ) );
+        }
+
+        std::int64_t sum = 0;
+        bench::timer t;
+        for( std::size_t r = 0; r < rounds; ++r ) {
+            for( auto &p: probes ) {
+                sum += swiss.find( p )->as_int( );
+            }
+        }
+        auto swiss_time = t.seconds( );
+
+        t.reset( );
+        for( std::size_t r = 0; r < rounds; ++r ) {
+            for( auto &p: probes ) {
+                auto str = static_cast<objects::string *>(p.as_object( ));
+                sum -= node.find( str->str( ) )->second.as_int( );
+            }
+        }
+        auto node_time = t.seconds( );
+
+        auto total = static_cast<double>(rounds * keys);
+        bench::header( std::cout, "hash lookups, "
+                                  + std::to_string( keys ) + " string keys" );
+        bench::row( std::cout, "open addressing lookups/s",
+                    static_cast<std::uint64_t>(total / swiss_time) );
+        bench::row( std::cout, "unordered_map lookups/s",
+                    static_cast<std::uint64_t>(total / node_time) );
+        bench::row( std::cout, "checksum", sum );
+        heap.remove_root( &stack );
+    }
+}
+
+void bench_hash( )
+{
+    tables( 100, 100000 );
+    tables( 100000, 100 );
+
+    const std::size_t lookups = 5000;
+    auto prog = bench::parse( lookup_script( 1000, lookups ) );
+    gc::heap heap;
+    eval::tagged_evaluator evaluator(heap);
+    evaluator.eval( prog );
+
+    bench::timer t;
+    const std::size_t rounds = 50;
+    for( std::size_t i = 0; i < rounds; ++i ) {
+        evaluator.eval( prog );
+    }
+    auto elapsed = t.seconds( );
+
+    bench::header( std::cout, "hash lookup script" );
+    bench::row( std::cout, "script lookups/s",
+                static_cast<std::uint64_t>(rounds * lookups * 2 / elapsed) );
+    bench::row( std::cout, "errors", evaluator.errors_.size( ) );
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+#include "bench.h"
+#include "vm.h"
+#include "image.h"
+
+using namespace mico;
+
+namespace {
+
+    using value = objects::value;
+
+    /// a library of 'n' small functions and a call of each
+    std::string library_script( std::size_t n )
+    {
+        std::ostringstream oss;
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let f" << i << " = fn(a, b) { if (a < b) { a * " << i
+                << " + b } else { let c = a - b; [c, \"f" << i
+                << "\", {\"k\": c}] } };\n";
+        }
+        oss << "let total = 0;\n";
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let total = total + f" << i << "(1, 2);\n";
+        }
+        oss << "total\n";
+        return oss.str( );
+    }
+}
+
+void bench_image( )
+{
+    const std::size_t functions = 2000;
+    const std::string path = "bench_image.tmp";
+    auto script = library_script( functions );
+    auto hash   = image::hash( script );
+
+    {
+        auto prog = bench::parse( script );
+        image::save( path, image::writer::write( prog, hash ) );
+    }
+
+    bench::timer t;
+    gc::heap heap;
+    engines::vm_engine<value> compiled(heap);
+    auto prog = bench::parse( script );
+    compiled.load( prog );
+    auto from_source = t.milliseconds( );
+    auto res = compiled.run( );
+
+    t.reset( );
+    std::string err;
+    engines::vm_engine<value> mapped(heap);
+    auto img = image::file::open( path, hash, err );
+    mapped.load( img );
+    auto from_image = t.milliseconds( );
+    auto res2 = mapped.run( );
+
+    bench::header( std::cout, "program image, "
+                            + std::to_string( functions ) + " functions" );
+    bench::row( std::cout, "source bytes", script.size( ) );
+    bench::row( std::cout, "image bytes", img->size( ) );
+    bench::row( std::cout, "lex + parse + compile", from_source, "ms" );
+    bench::row( std::cout, "map + load", from_image, "ms" );
+    bench::row( std::cout, "same result",
+                objects::inspect( res ) == objects::inspect( res2 )
+                    ? "yes" : "no" );
+    std::remove( path.c_str( ) );
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    /// long int-only expressions over a few globals;
+    /// the case the jit is meant for
+    std::string kernel_script( std::size_t lets )
+    {
+        std::ostringstream oss;
+        oss << "let x = 3; let y = 5; let z = 7;\n";
+        for( std::size_t i = 0; i < lets; ++i ) {
+            oss << "let r" << i << " = ((x * " << i + 1 << " + y) - z / 3)"
+                << " * (x - y) + (y * z - x) / (z - " << i + 10 << ")"
+                << " - -(x * x + y * y + z * z) / 2;\n";
+        }
+        return oss.str( );
+    }
+
+    double run( const char *name, const parser::program &prog,
+                std::size_t rounds, std::size_t statements, bool jit )
+    {
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        evaluator.set_jit( jit );
+
+        bench::timer t;
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            evaluator.eval( prog );
+        }
+        auto elapsed = t.seconds( );
+        auto &stats  = evaluator.get_jit_stats( );
+
+        bench::header( std::cout, name );
+        bench::row( std::cout, "statements/s",
+                    static_cast<std::uint64_t>(rounds * statements / elapsed) );
+        bench::row( std::cout, "compiled", stats.compiled );
+        bench::row( std::cout, "native calls", stats.calls );
+        bench::row( std::cout, "deopts", stats.deopts );
+        bench::row( std::cout, "machine code", stats.code, "bytes" );
+        bench::row( std::cout, "errors", evaluator.errors_.size( ) );
+        return elapsed;
+    }
+
+    void compare( const char *name, const std::string &input,
+                  std::size_t rounds, std::size_t statements )
+    {
+        /// separate trees; both modes rewrite the one they run on
+        auto interp = bench::parse( input );
+        auto native = bench::parse( input );
+
+        auto slow = run( ( std::string( name ) + ": interpreter" ).c_str( ),
+                         interp, rounds, statements, false );
+        auto fast = run( ( std::string( name ) + ": jit" ).c_str( ),
+                         native, rounds, statements, true );
+        bench::row( std::cout, "speedup", slow / fast, "x" );
+    }
+}
+
+void bench_jit( )
+{
+    if( !jit::compiler::available( ) ) {
+        bench::header( std::cout, "jit" );
+        std::cout << "  not available on this platform\n";
+        return;
+    }
+
+    const std::size_t lets = 2000;
+    compare( "int kernels", kernel_script( lets ), 200, lets + 3 );
+
+    /// short statements: a win while the generated code stays in cache,
+    /// a loss once one straight-line function per statement does not
+    compare( "arithmetic, 200 lets", bench::arithmetic_script( 200 ),
+             2000, 200 * 2 );
+    compare( "arithmetic, 2000 lets", bench::arithmetic_script( lets ),
+             200, lets * 2 );
+}
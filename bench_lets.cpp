@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    /// a configuration: 'n' settings that each cost something, and a
+    /// few that put them together
+    std::string config( std::size_t n )
+    {
+        std::string res = "let fib = fn(n) { if (n < 2) { n } "
+                          "else { fib(n - 1) + fib(n - 2) } }; ";
+        std::string all;
+        for( std::size_t i = 0; i < n; ++i ) {
+            auto name = "s" + std::to_string( i );
+            res += "let " + name + " = fib(" + std::to_string( 16 + i % 3 )
+                 + ") + " + std::to_string( i ) + "; ";
+            all += ( i ? ", " : "" ) + name;
+        }
+        res += "let all = [" + all + "]; ";
+        res += "len(all)";
+        return res;
+    }
+}
+
+void bench_lets( )
+{
+    const std::size_t n = 32;
+    bench::header( std::cout, "top level lets, " + std::to_string( n )
+                            + " independent ones" );
+    bench::row( std::cout, "hardware threads",
+                exec::pool<int>::default_threads( ) );
+    auto prog = bench::parse( config( n ) );
+    double single = 0;
+    for( std::size_t threads = 1; threads <= 8; threads *= 2 ) {
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        vm.set_parallel( threads );
+        vm.set_parallel_lets( true );
+        vm.load( prog );
+        bench::timer t;
+        auto res  = objects::inspect( vm.run( ) );
+        auto secs = t.seconds( );
+        single = ( threads == 1 ) ? secs : single;
+        auto label = std::to_string( threads ) + " threads";
+        bench::row( std::cout, label + ", ms", secs * 1000.0 );
+        bench::row( std::cout, label + ", speedup", single / secs, "x" );
+        bench::row( std::cout, label + ", waves", vm.let_waves( ) );
+        bench::row( std::cout, label + ", result", res );
+    }
+}
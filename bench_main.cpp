@@ -0,0 +1,220 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <atomic>
+
+#include "bench.h"
+
+void bench_gc_pauses( );
+void bench_value_encodings( );
+void bench_quickening( );
+void bench_engines( );
+void bench_jit( );
+void bench_vector( );
+void bench_hash( );
+void bench_string( );
+void bench_function( );
+void bench_vm( );
+void bench_image( );
+void bench_snapshot( );
+void bench_executor( );
+void bench_batch( );
+void bench_parallel( );
+void bench_sequence( );
+void bench_lets( );
+void bench_native( );
+void bench_profile( );
+void bench_trace( );
+std::size_t bench_corpus( const mico::bench::settings &opts );
+
+namespace {
+
+    std::atomic<std::uint64_t> alloc_count(0);
+    std::atomic<std::uint64_t> alloc_bytes(0);
+    std::atomic<std::uint64_t> alloc_live(0);
+    std::atomic<std::uint64_t> alloc_peak(0);
+
+    /// every block starts with its size; the header keeps the rest of
+    /// it aligned as malloc would
+    const std::size_t header = alignof(std::max_align_t);
+
+    void *allocate( std::size_t size )
+    {
+        auto mem = static_cast<char *>(std::malloc( size + header ));
+        if( !mem ) {
+            return nullptr;
+        }
+        *reinterpret_cast<std::size_t *>(mem) = size;
+        alloc_count++;
+        alloc_bytes += size;
+        auto live = ( alloc_live += size );
+        auto peak = alloc_peak.load( );
+        while( live > peak
+           && !alloc_peak.compare_exchange_weak( peak, live ) )
+        { }
+        return mem + header;
+    }
+
+    void release( void *ptr )
+    {
+        if( !ptr ) {
+            return;
+        }
+        auto mem = static_cast<char *>(ptr) - header;
+        alloc_live -= *reinterpret_cast<std::size_t *>(mem);
+        std::free( mem );
+    }
+
+    void *allocate_or_throw( std::size_t size )
+    {
+        auto res = allocate( size );
+        if( !res ) {
+            throw std::bad_alloc( );
+        }
+        return res;
+    }
+}
+
+void *operator new( std::size_t size )
+{
+    return allocate_or_throw( size );
+}
+
+void *operator new[]( std::size_t size )
+{
+    return allocate_or_throw( size );
+}
+
+void *operator new( std::size_t size, const std::nothrow_t & ) noexcept
+{
+    return allocate( size );
+}
+
+void *operator new[]( std::size_t size, const std::nothrow_t & ) noexcept
+{
+    return allocate( size );
+}
+
+void operator delete( void *ptr ) noexcept
+{
+    release( ptr );
+}
+
+void operator delete[]( void *ptr ) noexcept
+{
+    release( ptr );
+}
+
+void operator delete( void *ptr, const std::nothrow_t & ) noexcept
+{
+    release( ptr );
+}
+
+void operator delete[]( void *ptr, const std::nothrow_t & ) noexcept
+{
+    release( ptr );
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete( void *ptr, std::size_t ) noexcept
+{
+    release( ptr );
+}
+
+void operator delete[]( void *ptr, std::size_t ) noexcept
+{
+    release( ptr );
+}
+#endif
+
+namespace mico { namespace bench {
+
+    allocations allocated( )
+    {
+        allocations res;
+        res.count = alloc_count.load( );
+        res.bytes = alloc_bytes.load( );
+        res.live  = alloc_live.load( );
+        res.peak  = alloc_peak.load( );
+        return res;
+    }
+
+    void reset_peak( )
+    {
+        alloc_peak = alloc_live.load( );
+    }
+
+}}
+
+namespace {
+
+    void usage( const char *self )
+    {
+        std::cerr
+            << "usage: " << self << " [options]\n"
+            << "  --corpus-only     run only the generated corpus suite\n"
+            << "  --size BYTES      the size of a generated script\n"
+            << "  --seed N          the seed of the generator\n"
+            << "  --json FILE       write the corpus results there\n"
+            << "  --baseline FILE   compare them with the ones in FILE\n"
+            << "  --tolerance PCT   what is a regression; 10 by default\n";
+    }
+}
+
+/// exits with 1 when a corpus result is worse than its baseline and
+/// with 2 on a bad command line
+int main( int argc, char *argv[] )
+{
+    mico::bench::settings opts;
+    for( int i = 1; i < argc; ++i ) {
+        std::string arg(argv[i]);
+        bool has_value = ( i + 1 < argc );
+        if( arg == "--corpus-only" ) {
+            opts.corpus_only = true;
+        } else if( arg == "--size" && has_value ) {
+            opts.bytes = std::strtoull( argv[++i], nullptr, 10 );
+        } else if( arg == "--seed" && has_value ) {
+            opts.seed = std::strtoull( argv[++i], nullptr, 10 );
+        } else if( arg == "--json" && has_value ) {
+            opts.json = argv[++i];
+        } else if( arg == "--baseline" && has_value ) {
+            opts.baseline = argv[++i];
+        } else if( arg == "--tolerance" && has_value ) {
+            opts.tolerance = std::strtod( argv[++i], nullptr );
+        } else {
+            usage( argv[0] );
+            return 2;
+        }
+    }
+
+    /// first, while the peak resident set is still its own
+    auto regressions = bench_corpus( opts );
+    if( opts.corpus_only ) {
+        return regressions ? 1 : 0;
+    }
+
+    bench_gc_pauses( );
+    bench_value_encodings( );
+    bench_quickening( );
+    bench_engines( );
+    bench_jit( );
+    bench_vector( );
+    bench_hash( );
+    bench_string( );
+    bench_function( );
+    bench_vm( );
+    bench_image( );
+    bench_snapshot( );
+    bench_executor( );
+    bench_batch( );
+    bench_parallel( );
+    bench_sequence( );
+    bench_lets( );
+    bench_native( );
+    bench_profile( );
+    bench_trace( );
+
+    return regressions ? 1 : 0;
+}
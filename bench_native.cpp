@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    std::int64_t add( std::int64_t a, std::int64_t b )
+    {
+        return a + b;
+    }
+
+    std::string upper( const std::string &s )
+    {
+        std::string res(s);
+        for( auto &c: res ) {
+            c = ( c >= 'a' && c <= 'z' ) ? static_cast<char>(c - 32) : c;
+        }
+        return res;
+    }
+
+    /// 'n' rounds of a loop whose body calls 'call' once; 'call' reads
+    /// i and acc
+    std::string loop( std::size_t n, const std::string &call )
+    {
+        return "let plus = fn(a, b) { a + b }; "
+               "let go = fn(i, acc) { if (i == " + std::to_string( n ) + ") "
+               "{ acc } else { go(i + 1, " + call + ") } }; "
+               "go(0, 0)";
+    }
+}
+
+void bench_native( )
+{
+    const std::size_t n = 200000;
+    struct {
+        const char *name;
+        const char *call;
+    } calls[] = {
+        { "no call",              "acc + i" },
+        { "native add",           "add(acc, i)" },
+        { "script function",      "plus(acc, i)" },
+        { "builtin len",          "acc + len(\"abc\")" },
+        { "native upper, string", "acc + len(upper(\"abc\"))" },
+    };
+
+    bench::header( std::cout, "host calls, vm, "
+                            + std::to_string( n ) + " calls" );
+    double empty = 0;
+    for( auto &c: calls ) {
+        auto prog = bench::parse( loop( n, c.call ) );
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        vm.context( ).bind( "add", &add );
+        vm.context( ).bind( "upper", &upper );
+        vm.load( prog );
+        bench::timer t;
+        auto res  = objects::inspect( vm.run( ) );
+        auto secs = t.seconds( );
+        empty = empty ? empty : secs;
+        std::string name(c.name);
+        bench::row( std::cout, name + ", ms", secs * 1000.0 );
+        bench::row( std::cout, name + ", ns per call",
+                    ( secs - empty ) * 1e9 / n );
+        bench::row( std::cout, name + ", allocations",
+                    heap.get_stats( ).allocations );
+        bench::row( std::cout, name + ", result", res );
+    }
+}
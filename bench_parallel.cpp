@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    /// an array of 'n' ints, and a function that is worth a thread
+    std::string setup( std::size_t n )
+    {
+        return "let range = fn(n) { "
+               "   let go = fn(i, acc) { "
+               "       if (i == n) { acc } else { go(i + 1, push(acc, i)) } "
+               "   }; "
+               "   go(0, []) "
+               "}; "
+               "let xs = range(" + std::to_string( n ) + "); "
+               "let fib = fn(n) { if (n < 2) { n } "
+               "else { fib(n - 1) + fib(n - 2) } }; "
+               "let work = fn(x) { fib(12) + x }; ";
+    }
+}
+
+void bench_parallel( )
+{
+    const std::size_t n = 20000;
+    struct {
+        const char *name;
+        const char *call;
+    } calls[] = {
+        { "pmap",    "len(pmap(xs, work))" },
+        { "pfilter", "len(pfilter(xs, fn(x) { work(x) / 2 * 2 == x }))" },
+        { "preduce", "preduce(xs, 0, fn(a, b) { a + b + fib(10) })" },
+    };
+
+    bench::header( std::cout, "pmap, pfilter, preduce over "
+                            + std::to_string( n ) + " elements" );
+    bench::row( std::cout, "hardware threads",
+                exec::pool<int>::default_threads( ) );
+    auto init = bench::parse( setup( n ) );
+    for( auto &c: calls ) {
+        auto prog = bench::parse( c.call );
+        double single = 0;
+        std::string expect;
+        for( std::size_t threads = 1; threads <= 8; threads *= 2 ) {
+            gc::heap heap;
+            engines::vm_engine<objects::value> vm(heap);
+            vm.set_parallel( threads );
+            vm.load( init );
+            vm.run( );
+            /// only the call is timed
+            vm.load( prog );
+            bench::timer t;
+            auto res  = objects::inspect( vm.run( ) );
+            auto secs = t.seconds( );
+            single = ( threads == 1 ) ? secs : single;
+            expect = ( threads == 1 ) ? res : expect;
+            auto label = std::string(c.name) + ", "
+                       + std::to_string( threads ) + " threads";
+            bench::row( std::cout, label + ", ms", secs * 1000.0 );
+            bench::row( std::cout, label + ", speedup", single / secs, "x" );
+            bench::row( std::cout, label + ", same result",
+                        res == expect ? "yes" : "no" );
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+void bench_profile( )
+{
+    const std::string src =
+        "let fib = fn(n) {\n"
+        "  if (n < 2) { return n; }\n"
+        "  fib(n - 1) + fib(n - 2)\n"
+        "};\n"
+        "fib(25)\n";
+    struct {
+        const char    *name;
+        profile::mode  mode;
+    } modes[] = {
+        { "off",          profile::mode::OFF },
+        { "sampling",     profile::mode::SAMPLE },
+        { "instrumented", profile::mode::INSTRUMENT },
+    };
+
+    bench::header( std::cout, "profiler, vm, fib(25)" );
+    auto prog = bench::parse( src );
+    double plain = 0;
+    for( auto &m: modes ) {
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        if( !vm.set_profiler( m.mode ) ) {
+            bench::row( std::cout, std::string( m.name ) + ", ms",
+                        "no timer" );
+            continue;
+        }
+        vm.load( prog );
+        bench::timer t;
+        auto res  = objects::inspect( vm.run( ) );
+        auto secs = t.seconds( );
+        vm.set_profiler( profile::mode::OFF );
+        plain = plain ? plain : secs;
+        auto rep = vm.profile_report( );
+        std::string name(m.name);
+        bench::row( std::cout, name + ", ms", secs * 1000.0 );
+        bench::row( std::cout, name + ", slowdown", secs / plain );
+        bench::row( std::cout, name + ", stacks", rep.stacks.size( ) );
+        bench::row( std::cout, name + ", samples", rep.samples );
+        bench::row( std::cout, name + ", result", res );
+    }
+}
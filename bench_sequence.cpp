@@ -0,0 +1,53 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    /// three steps over one data set; 'map' and 'filter' are either the
+    /// lazy builtins or the array ones
+    std::string pipeline( std::size_t n, const std::string &map,
+                          const std::string &filter )
+    {
+        return "let data = array(range(0, " + std::to_string( n ) + ")); "
+               "let rows = " + map + "(data, fn(x) { [x, x * 7] }); "
+               "let odd  = " + filter + "(rows, fn(r) { r[1] / 2 * 2 != r[1] }); "
+               "let vals = " + map + "(odd, fn(r) { r[0] + r[1] }); "
+               "reduce(vals, 0, fn(a, b) { a + b })";
+    }
+}
+
+void bench_sequence( )
+{
+    const std::size_t n = 200000;
+    struct {
+        const char *name;
+        const char *map;
+        const char *filter;
+    } kinds[] = {
+        { "arrays",    "pmap", "pfilter" },
+        { "sequences", "map",  "filter" },
+    };
+
+    bench::header( std::cout, "map, filter, map, reduce over "
+                            + std::to_string( n ) + " elements" );
+    for( auto &k: kinds ) {
+        auto prog = bench::parse( pipeline( n, k.map, k.filter ) );
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        bench::timer t;
+        auto res  = evaluator.eval( prog );
+        auto secs = t.seconds( );
+        auto &st  = heap.get_stats( );
+        std::string name(k.name);
+        bench::row( std::cout, name + ", ms", secs * 1000.0 );
+        bench::row( std::cout, name + ", allocations", st.allocations );
+        bench::row( std::cout, name + ", heap KB", st.heap_bytes / 1024 );
+        bench::row( std::cout, name + ", collections", st.collections );
+        bench::row( std::cout, name + ", result", objects::inspect( res ) );
+    }
+}
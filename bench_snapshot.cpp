@@ -0,0 +1,81 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    using value = objects::value;
+
+    /// 'n' functions, and tables the prelude computes once: what every
+    /// instance would have to redo at startup without a snapshot
+    std::string prelude_script( std::size_t n )
+    {
+        std::ostringstream oss;
+        oss << "let fib = fn(k) { if (k < 2) { k } "
+               "else { fib(k - 1) + fib(k - 2) } };\n"
+               "let table = fn(i, acc) { if (i == 200) { acc } "
+               "else { table(i + 1, push(acc, {\"n\": i, \"fib\": fib(i - i / 16 * 16), "
+               "\"name\": \"row\" + \"-\" + \"x\"})) } };\n"
+               "let rows = table(0, []);\n";
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let f" << i << " = fn(a) { a + " << i << " };\n";
+        }
+        return oss.str( );
+    }
+
+    const char *use = "rows[199][\"fib\"] + f7(1)";
+}
+
+void bench_snapshot( )
+{
+    const std::size_t functions = 1000;
+    const std::size_t instances = 20;
+    const std::string path = "bench_snapshot.tmp";
+    auto prelude = prelude_script( functions );
+
+    {
+        gc::heap heap;
+        engines::vm_engine<value> vm(heap);
+        vm.load( bench::parse( prelude ) );
+        vm.run( );
+        std::string err;
+        vm.save_snapshot( path, err );
+    }
+
+    std::string res_eval;
+    bench::timer t;
+    for( std::size_t i = 0; i < instances; ++i ) {
+        gc::heap heap;
+        engines::vm_engine<value> vm(heap);
+        vm.load( bench::parse( prelude ) );
+        vm.run( );
+        vm.load( bench::parse( use ) );
+        res_eval = objects::inspect( vm.run( ) );
+    }
+    auto from_prelude = t.milliseconds( ) / instances;
+
+    std::string res_snap;
+    t.reset( );
+    for( std::size_t i = 0; i < instances; ++i ) {
+        gc::heap heap;
+        engines::vm_engine<value> vm(heap);
+        std::string err;
+        vm.load_snapshot( path, err );
+        vm.load( bench::parse( use ) );
+        res_snap = objects::inspect( vm.run( ) );
+    }
+    auto from_snapshot = t.milliseconds( ) / instances;
+
+    bench::header( std::cout, "heap snapshot, prelude of "
+                            + std::to_string( functions ) + " functions" );
+    bench::row( std::cout, "evaluate prelude", from_prelude, "ms/instance" );
+    bench::row( std::cout, "load snapshot", from_snapshot, "ms/instance" );
+    bench::row( std::cout, "same result", res_eval == res_snap ? "yes" : "no" );
+    std::remove( path.c_str( ) );
+}
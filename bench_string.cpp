@@ -0,0 +1,59 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    /// let s = s + "..." 'n' times; then reads the result once
+    std::string concat_script( std::size_t n )
+    {
+        std::ostringstream oss;
+        oss << "let s = \"\";\n";
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let s = s + \"item " << i % 10 << ", \";\n";
+        }
+        oss << "len(s) + len(s[0])\n";
+        return oss.str( );
+    }
+
+    /// what the loop costs when every '+' copies both halves
+    double flat_copies( std::size_t n )
+    {
+        std::string cur;
+        bench::timer t;
+        for( std::size_t i = 0; i < n; ++i ) {
+            std::string next = cur + "item " + std::to_string( i % 10 ) + ", ";
+            cur.swap( next );
+        }
+        return t.seconds( );
+    }
+}
+
+void bench_string( )
+{
+    for( std::size_t n: { 1000, 10000, 50000 } ) {
+        auto prog = bench::parse( concat_script( n ) );
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        bench::timer t;
+        auto res = evaluator.eval( prog );
+        auto elapsed = t.seconds( );
+        auto flat = flat_copies( n );
+
+        bench::header( std::cout, "string accumulation, "
+                                  + std::to_string( n ) + " concatenations" );
+        bench::row( std::cout, "rope concatenations/s",
+                    static_cast<std::uint64_t>(n / elapsed) );
+        bench::row( std::cout, "flat copy concatenations/s",
+                    static_cast<std::uint64_t>(n / flat) );
+        bench::row( std::cout, "heap allocations",
+                    heap.get_stats( ).allocations );
+        bench::row( std::cout, "result", objects::inspect( res ) );
+    }
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "corpus.h"
+#include "vm.h"
+#include "trace.h"
+
+using namespace mico;
+
+namespace {
+
+    double pipeline( const std::string &src, std::size_t rounds )
+    {
+        bench::timer t;
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            auto prog = bench::parse( src );
+            gc::heap heap;
+            engines::vm_engine<objects::value> vm(heap);
+            vm.load( prog );
+            vm.run( );
+        }
+        return t.seconds( );
+    }
+}
+
+/// what the phases cost with no recorder and with one, and the stats
+/// of the traced runs
+void bench_trace( )
+{
+    const std::size_t rounds = 20;
+
+    corpus::options co;
+    co.bytes = 64 * 1024;
+    auto src = corpus::generate( co );
+
+    bench::header( std::cout, "trace, mixed corpus, 64KB x "
+                            + std::to_string( rounds ) );
+    auto plain = pipeline( src, rounds );
+    trace::recorder rec;
+    double traced = 0;
+    {
+        trace::session s(rec);
+        traced = pipeline( src, rounds );
+    }
+    bench::row( std::cout, "no recorder, ms", plain * 1000.0 );
+    bench::row( std::cout, "recorder, ms", traced * 1000.0 );
+    bench::row( std::cout, "slowdown", traced / plain );
+    bench::row( std::cout, "events", rec.events( ).size( ) );
+    std::cout << rec.stats( ).text( );
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    template <typename EvalT>
+    void run( const char *name, const parser::program &prog,
+              std::size_t rounds, std::size_t statements,
+              bool quickening = true )
+    {
+        gc::heap heap;
+        EvalT evaluator(heap);
+        evaluator.set_quickening( quickening );
+
+        bench::timer t;
+        for( std::size_t i = 0; i < rounds; ++i ) {
+            evaluator.eval( prog );
+        }
+        auto elapsed = t.seconds( );
+
+        bench::header( std::cout, name );
+        bench::row( std::cout, "sizeof(value)",
+                    sizeof(typename EvalT::value), "bytes" );
+        bench::row( std::cout, "statements/s",
+                    static_cast<std::uint64_t>(rounds * statements / elapsed) );
+        bench::row( std::cout, "heap allocations",
+                    heap.get_stats( ).allocations );
+        bench::row( std::cout, "errors", evaluator.errors_.size( ) );
+    }
+}
+
+void bench_value_encodings( )
+{
+    const std::size_t lets = 2000;
+    auto input  = bench::arithmetic_script( lets );
+    auto tagged = bench::parse( input );
+    auto boxed  = bench::parse( input );
+
+    run<eval::tagged_evaluator>( "tagged values", tagged, 200, lets * 2 );
+    run<eval::boxed_evaluator>( "boxed values", boxed, 200, lets * 2 );
+}
+
+void bench_quickening( )
+{
+    const std::size_t lets = 2000;
+    auto input = bench::arithmetic_script( lets );
+
+    /// separate trees; quickening rewrites the one it runs on
+    auto generic = bench::parse( input );
+    auto quick   = bench::parse( input );
+
+    run<eval::tagged_evaluator>( "generic nodes", generic,
+                                 200, lets * 2, false );
+    run<eval::tagged_evaluator>( "quickened nodes", quick,
+                                 200, lets * 2, true );
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "eval.h"
+
+using namespace mico;
+
+namespace {
+
+    /// let a = push(a, i) 'n' times; then reads a few elements back
+    std::string accumulate_script( std::size_t n )
+    {
+        std::ostringstream oss;
+        oss << "let a = [];\n";
+        for( std::size_t i = 0; i < n; ++i ) {
+            oss << "let a = push(a, " << i << ");\n";
+        }
+        oss << "len(a) + a[0] + a[" << n / 2 << "] + last(a)\n";
+        return oss.str( );
+    }
+
+    /// what push costs when every call copies a flat array
+    double flat_copies( std::size_t n )
+    {
+        std::vector<objects::value> cur;
+        bench::timer t;
+        for( std::size_t i = 0; i < n; ++i ) {
+            std::vector<objects::value> next( cur );
+            next.push_back( objects::value::from_int(
+                                    static_cast<std::int64_t>(i) ) );
+            cur.swap( next );
+        }
+        return t.seconds( );
+    }
+}
+
+void bench_vector( )
+{
+    for( std::size_t n: { 1000, 10000, 50000 } ) {
+        auto prog = bench::parse( accumulate_script( n ) );
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        bench::timer t;
+        auto res = evaluator.eval( prog );
+        auto elapsed = t.seconds( );
+        auto flat = flat_copies( n );
+
+        bench::header( std::cout, "push accumulation, "
+                                  + std::to_string( n ) + " elements" );
+        bench::row( std::cout, "persistent pushes/s",
+                    static_cast<std::uint64_t>(n / elapsed) );
+        bench::row( std::cout, "flat copy pushes/s",
+                    static_cast<std::uint64_t>(n / flat) );
+        bench::row( std::cout, "heap allocations",
+                    heap.get_stats( ).allocations );
+        bench::row( std::cout, "result", objects::inspect( res ) );
+    }
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    using value = objects::value;
+
+    struct measure {
+        double        seconds    = 0;
+        std::uint64_t dispatches = 0;
+        std::size_t   code_size  = 0;
+        std::string   result;
+    };
+
+    measure run_vm( const std::string &script, bool fused, bool profile )
+    {
+        gc::heap heap;
+        engines::vm_engine<value> vm(heap);
+        vm.set_peephole( fused );
+        vm.set_profiling( profile );
+
+        auto prog = bench::parse( script );
+        vm.load( prog );
+
+        measure res;
+        for( auto &p: vm.module( ).protos ) {
+            res.code_size += p.code.size( );
+        }
+        bench::timer t;
+        res.result     = objects::inspect( vm.run( ) );
+        res.seconds    = t.seconds( );
+        res.dispatches = vm.dispatches( );
+        return res;
+    }
+
+    void compare( const std::string &name, const std::string &script,
+                  std::uint64_t calls )
+    {
+        for( auto fused: { false, true } ) {
+            auto timed   = run_vm( script, fused, false );
+            auto counted = run_vm( script, fused, true );
+            bench::header( std::cout, name + ( fused ? ": vm, peephole"
+                                                     : ": vm, plain" ) );
+            bench::row( std::cout, "calls/s",
+                        static_cast<std::uint64_t>(calls / timed.seconds) );
+            bench::row( std::cout, "instructions", timed.code_size );
+            bench::row( std::cout, "dispatches per call",
+                        counted.dispatches / calls );
+            bench::row( std::cout, "result", timed.result );
+        }
+    }
+
+    void call_caches( std::uint64_t loops )
+    {
+        std::string script =
+            "let add = fn(a, b) { a + b }; let five = 5; let ten = 10; "
+            "let loop = fn(n, acc) { if (n == 0) { acc } "
+            "else { loop(n - 1, acc + add(five, ten) - len([1])) } }; "
+            "loop(" + std::to_string( loops ) + ", 0)";
+
+        for( auto on: { false, true } ) {
+            gc::heap heap;
+            engines::vm_engine<value> vm(heap);
+            vm.set_call_caches( on );
+            auto prog = bench::parse( script );
+            vm.load( prog );
+
+            bench::timer t;
+            auto res = vm.run( );
+            auto elapsed = t.seconds( );
+
+            bench::header( std::cout, on ? "call sites: inline caches"
+                                         : "call sites: generic" );
+            /// add, len and loop run once per iteration
+            bench::row( std::cout, "calls/s",
+                        static_cast<std::uint64_t>(loops * 3 / elapsed) );
+            for( auto &site: vm.call_sites( ) ) {
+                auto all = site.hits + site.poly_hits + site.misses;
+                bench::row( std::cout, "hit rate " + site.callee,
+                            all ? ( site.hits + site.poly_hits ) * 100 / all
+                                : 0, "%" );
+            }
+            bench::row( std::cout, "result", objects::inspect( res ) );
+        }
+    }
+}
+
+void bench_vm( )
+{
+    /// fib(22) makes 57313 calls
+    compare( "recursive calls",
+             "let fib = fn(n) { if (n < 2) { n } "
+             "else { fib(n - 1) + fib(n - 2) } }; fib(22)", 57313 );
+
+    const std::uint64_t loops = 1000000;
+    compare( "tail calls",
+             "let count = fn(n, acc) { if (n == 0) { return acc; } "
+             "count(n - 1, acc + 1) }; count("
+             + std::to_string( loops ) + ", 0)", loops );
+
+    call_caches( loops );
+}
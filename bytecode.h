@@ -0,0 +1,560 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "ast.h"
+#include "parser.h"
+
+namespace mico { namespace bytecode {
+
+    /// Stack machine instructions. 'a' and 'b' are operands: an index
+    /// into the constants, the names, the locals or the captures of the
+    /// function, a count, a call site, or the target of a jump (always
+    /// in 'a')
+    enum class opcode: std::uint8_t {
+        NOP = 0,
+        CONST,
+        NIL,
+        TRUE,
+        FALSE,
+        POP,
+
+        GET_GLOBAL,
+        SET_GLOBAL,
+        GET_LOCAL,
+        SET_LOCAL,
+        GET_LOCAL_CELL,
+        SET_LOCAL_CELL,
+        GET_CAPTURE,
+        GET_CAPTURE_CELL,
+
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        LT,
+        GT,
+        EQ,
+        NOT_EQ,
+        NEG,
+        PLUS,
+        NOT,
+
+        JUMP,
+        JUMP_IF_FALSE,
+
+        ARRAY,
+        HASH,
+        INDEX,
+        CALL,
+        TAIL_CALL,
+        RETURN,
+        CLOSURE,
+
+        /// superinstructions; only the peephole pass makes them
+        ADD_CONST,
+        SUB_CONST,
+        LT_CONST,
+        GT_CONST,
+        EQ_CONST,
+        LOCAL_ADD_CONST,
+        LOCAL_SUB_CONST,
+        GET_LOCAL2,
+        JUMP_UNLESS_LT,
+        JUMP_UNLESS_GT,
+        JUMP_UNLESS_EQ,
+        JUMP_UNLESS_LT_CONST,
+        JUMP_UNLESS_GT_CONST,
+        JUMP_UNLESS_EQ_CONST,
+        JUMP_IF_TRUE,
+        TEE_LOCAL,
+        TEE_GLOBAL,
+
+        LAST,
+    };
+
+    static const std::size_t opcode_count =
+                                static_cast<std::size_t>(opcode::LAST);
+
+    inline
+    const char *name( opcode op )
+    {
+        static const char *names[] = {
+            "NOP", "CONST", "NIL", "TRUE", "FALSE", "POP",
+            "GET_GLOBAL", "SET_GLOBAL", "GET_LOCAL", "SET_LOCAL",
+            "GET_LOCAL_CELL", "SET_LOCAL_CELL",
+            "GET_CAPTURE", "GET_CAPTURE_CELL",
+            "ADD", "SUB", "MUL", "DIV", "LT", "GT", "EQ", "NOT_EQ",
+            "NEG", "PLUS", "NOT",
+            "JUMP", "JUMP_IF_FALSE",
+            "ARRAY", "HASH", "INDEX", "CALL", "TAIL_CALL", "RETURN",
+            "CLOSURE",
+            "ADD_CONST", "SUB_CONST", "LT_CONST", "GT_CONST", "EQ_CONST",
+            "LOCAL_ADD_CONST", "LOCAL_SUB_CONST", "GET_LOCAL2",
+            "JUMP_UNLESS_LT", "JUMP_UNLESS_GT", "JUMP_UNLESS_EQ",
+            "JUMP_UNLESS_LT_CONST", "JUMP_UNLESS_GT_CONST",
+            "JUMP_UNLESS_EQ_CONST", "JUMP_IF_TRUE",
+            "TEE_LOCAL", "TEE_GLOBAL",
+        };
+        static_assert( sizeof(names) / sizeof(names[0]) == opcode_count,
+                       "every opcode needs a name" );
+        auto id = static_cast<std::size_t>(op);
+        return ( id < opcode_count ) ? names[id] : "?";
+    }
+
+    inline
+    bool is_jump( opcode op )
+    {
+        switch( op ) {
+        case opcode::JUMP:
+        case opcode::JUMP_IF_FALSE:
+        case opcode::JUMP_UNLESS_LT:
+        case opcode::JUMP_UNLESS_GT:
+        case opcode::JUMP_UNLESS_EQ:
+        case opcode::JUMP_UNLESS_LT_CONST:
+        case opcode::JUMP_UNLESS_GT_CONST:
+        case opcode::JUMP_UNLESS_EQ_CONST:
+        case opcode::JUMP_IF_TRUE:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    struct instr {
+        opcode       op = opcode::NOP;
+        std::int32_t a  = 0;
+        std::int32_t b  = 0;
+    };
+
+    /// literals of the program; the engine turns them into values
+    struct constant {
+        enum class kind: std::uint8_t {
+            INT = 0,
+            STRING,
+        };
+        kind         type = kind::INT;
+        std::int64_t num  = 0;
+        std::string  str;
+    };
+
+    /// one function literal; 'info' is nullptr for the top level
+    struct proto {
+        std::shared_ptr<const ast::function_info> info;
+        std::vector<instr>                         code;
+        /// the source line of every instruction; empty if unknown
+        std::vector<std::uint32_t>                 lines;
+    };
+
+    /// a compiled program; protos[0] is the top level
+    struct module {
+
+        std::string disassemble( std::size_t id ) const
+        {
+            std::ostringstream oss;
+            auto &code = protos[id].code;
+            for( std::size_t i = 0; i < code.size( ); ++i ) {
+                oss << i << "\t" << name( code[i].op )
+                    << " " << code[i].a << " " << code[i].b << "\n";
+            }
+            return oss.str( );
+        }
+
+        std::vector<constant>    constants;
+        std::vector<std::string> names;
+        std::vector<proto>       protos;
+        /// the callee of every CALL and TAIL_CALL, as written; 'b' of
+        /// the instruction is the index
+        std::vector<std::string> sites;
+    };
+
+    /// Compiles a resolved program (see scope::resolver) into a module.
+    /// Every statement leaves nothing on the stack, except the last one
+    /// of a block whose value is used; that one leaves exactly one value
+    class compiler {
+
+    public:
+
+        static
+        module compile( const parser::program &prog )
+        {
+            compiler c;
+            c.mod_.protos.emplace_back( );
+            c.block( prog.states, true );
+            c.emit( opcode::RETURN );
+            return std::move(c.mod_);
+        }
+
+        /// statements [from, to) of 'prog' as a program of their own;
+        /// their value is the one of the last
+        static
+        module compile( const parser::program &prog,
+                        std::size_t from, std::size_t to )
+        {
+            compiler c;
+            c.mod_.protos.emplace_back( );
+            if( from == to ) {
+                c.emit( opcode::NIL );
+            }
+            for( auto i = from; i < to; ++i ) {
+                c.statement( prog.states[i].get( ), i + 1 == to );
+            }
+            c.emit( opcode::RETURN );
+            return std::move(c.mod_);
+        }
+
+    private:
+
+        std::vector<instr> &code( )
+        {
+            return mod_.protos[current_].code;
+        }
+
+        std::size_t emit( opcode op, std::int32_t a = 0, std::int32_t b = 0 )
+        {
+            instr next;
+            next.op = op;
+            next.a  = a;
+            next.b  = b;
+            code( ).push_back( next );
+            mod_.protos[current_].lines.push_back( line_ );
+            return code( ).size( ) - 1;
+        }
+
+        /// what is emitted while it lives is at the line of 'n'
+        struct line_scope {
+
+            line_scope( compiler &c, const ast::node *n )
+                :c_(c)
+                ,saved_(c.line_)
+            {
+                if( n && n->pos.line ) {
+                    c_.line_ = n->pos.line;
+                }
+            }
+
+            ~line_scope( )
+            {
+                c_.line_ = saved_;
+            }
+
+            compiler      &c_;
+            std::uint32_t  saved_;
+        };
+
+        /// the jump at 'pos' goes to the next instruction emitted
+        void patch( std::size_t pos )
+        {
+            code( )[pos].a = static_cast<std::int32_t>(code( ).size( ));
+        }
+
+        std::int32_t int_constant( std::int64_t val )
+        {
+            auto found = ints_.find( val );
+            if( found != ints_.end( ) ) {
+                return found->second;
+            }
+            constant next;
+            next.type = constant::kind::INT;
+            next.num  = val;
+            return ints_[val] = add_constant( next );
+        }
+
+        std::int32_t string_constant( const std::string &val )
+        {
+            auto found = strings_.find( val );
+            if( found != strings_.end( ) ) {
+                return found->second;
+            }
+            constant next;
+            next.type = constant::kind::STRING;
+            next.str  = val;
+            return strings_[val] = add_constant( next );
+        }
+
+        std::int32_t add_constant( const constant &c )
+        {
+            mod_.constants.push_back( c );
+            return static_cast<std::int32_t>(mod_.constants.size( ) - 1);
+        }
+
+        std::int32_t name_index( const std::string &name )
+        {
+            auto found = names_.find( name );
+            if( found != names_.end( ) ) {
+                return found->second;
+            }
+            mod_.names.push_back( name );
+            auto res = static_cast<std::int32_t>(mod_.names.size( ) - 1);
+            return names_[name] = res;
+        }
+
+        void block( const std::vector<ast::statement::uptr> &states, bool keep )
+        {
+            if( states.empty( ) && keep ) {
+                emit( opcode::NIL );
+            }
+            for( std::size_t i = 0; i < states.size( ); ++i ) {
+                statement( states[i].get( ), keep && ( i + 1 == states.size( ) ) );
+            }
+        }
+
+        void statement( const ast::statement *stmt, bool keep )
+        {
+            line_scope at(*this, stmt);
+            switch( stmt->type( ) ) {
+            case ast::node_type::STATE_LET: {
+                auto let = static_cast<const ast::let_statement *>(stmt);
+                expression( let->expr.get( ) );
+                store( let );
+                if( keep ) {
+                    emit( opcode::NIL );
+                }
+                break;
+            }
+            case ast::node_type::STATE_RETURN: {
+                auto ret = static_cast<const ast::return_statement *>(stmt);
+                expression( ret->expr.get( ) );
+                emit( opcode::RETURN );
+                break;
+            }
+            case ast::node_type::STATE_EXPR: {
+                auto expr = static_cast<const ast::expr_statement *>(stmt)
+                           ->expr.get( );
+                /// if (x) { return y; } leaves nothing to pop
+                if( !keep && expr
+                 && expr->type( ) == ast::node_type::EXPRESSION_IF )
+                {
+                    if_expression( static_cast<const ast::if_expression *>(
+                                                            expr ), false );
+                    break;
+                }
+                expression( expr );
+                if( !keep ) {
+                    emit( opcode::POP );
+                }
+                break;
+            }
+            case ast::node_type::STATE_BLOCK:
+                block( static_cast<const ast::block_statement *>(stmt)->states,
+                       keep );
+                break;
+            default:
+                if( keep ) {
+                    emit( opcode::NIL );
+                }
+                break;
+            }
+        }
+
+        void store( const ast::let_statement *let )
+        {
+            auto &ref = let->ref;
+            if( ref.scope == ast::var_scope::LOCAL ) {
+                emit( ref.cell ? opcode::SET_LOCAL_CELL : opcode::SET_LOCAL,
+                      static_cast<std::int32_t>(ref.index) );
+            } else {
+                emit( opcode::SET_GLOBAL, name_index( let->ident->value ) );
+            }
+        }
+
+        void load( const ast::ident_expression *ident )
+        {
+            auto &ref  = ident->ref;
+            auto index = static_cast<std::int32_t>(ref.index);
+            switch( ref.scope ) {
+            case ast::var_scope::LOCAL:
+                emit( ref.cell ? opcode::GET_LOCAL_CELL : opcode::GET_LOCAL,
+                      index );
+                break;
+            case ast::var_scope::CAPTURE:
+                emit( ref.cell ? opcode::GET_CAPTURE_CELL : opcode::GET_CAPTURE,
+                      index );
+                break;
+            default:
+                emit( opcode::GET_GLOBAL, name_index( ident->value ) );
+                break;
+            }
+        }
+
+        void expressions( const std::vector<ast::expression::uptr> &exprs )
+        {
+            for( auto &e: exprs ) {
+                expression( e.get( ) );
+            }
+        }
+
+        void expression( const ast::expression *expr )
+        {
+            line_scope at(*this, expr);
+            if( !expr ) {
+                emit( opcode::NIL );
+                return;
+            }
+
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+                emit( opcode::CONST, int_constant(
+                    static_cast<const ast::int_expression *>(expr)->value ) );
+                break;
+            case ast::node_type::EXPRESSION_BOOL:
+                emit( static_cast<const ast::bool_expression *>(expr)->value
+                      ? opcode::TRUE : opcode::FALSE );
+                break;
+            case ast::node_type::EXPRESSION_STRING:
+                emit( opcode::CONST, string_constant(
+                    static_cast<const ast::string_expression *>(expr)->value ) );
+                break;
+            case ast::node_type::EXPRESSION_IDENT:
+                load( static_cast<const ast::ident_expression *>(expr) );
+                break;
+            case ast::node_type::EXPRESSION_PREFIX:
+                prefix( static_cast<const ast::prefix_expression *>(expr) );
+                break;
+            case ast::node_type::EXPRESSION_INFIX:
+                infix( static_cast<const ast::infix_expression *>(expr) );
+                break;
+            case ast::node_type::EXPRESSION_ARRAY: {
+                auto arr = static_cast<const ast::array_expression *>(expr);
+                expressions( arr->elements );
+                emit( opcode::ARRAY,
+                      static_cast<std::int32_t>(arr->elements.size( )) );
+                break;
+            }
+            case ast::node_type::EXPRESSION_HASH: {
+                auto hash = static_cast<const ast::hash_expression *>(expr);
+                for( auto &p: hash->pairs ) {
+                    expression( p.first.get( ) );
+                    expression( p.second.get( ) );
+                }
+                emit( opcode::HASH,
+                      static_cast<std::int32_t>(hash->pairs.size( ) * 2) );
+                break;
+            }
+            case ast::node_type::EXPRESSION_INDEX: {
+                auto idx = static_cast<const ast::index_expression *>(expr);
+                expression( idx->left.get( ) );
+                expression( idx->index.get( ) );
+                emit( opcode::INDEX );
+                break;
+            }
+            case ast::node_type::EXPRESSION_CALL: {
+                auto call = static_cast<const ast::call_expression *>(expr);
+                expression( call->func.get( ) );
+                expressions( call->args );
+                auto site = static_cast<std::int32_t>(mod_.sites.size( ));
+                mod_.sites.push_back( call->func->to_string( ) );
+                emit( call->tail ? opcode::TAIL_CALL : opcode::CALL,
+                      static_cast<std::int32_t>(call->args.size( )), site );
+                break;
+            }
+            case ast::node_type::EXPRESSION_IF:
+                if_expression( static_cast<const ast::if_expression *>(expr),
+                               true );
+                break;
+            case ast::node_type::EXPRESSION_FUNCTION:
+                function( static_cast<const ast::function_expression *>(expr) );
+                break;
+            default:
+                emit( opcode::NIL );
+                break;
+            }
+        }
+
+        void prefix( const ast::prefix_expression *pref )
+        {
+            expression( pref->expr.get( ) );
+            switch( pref->token ) {
+            case lexer::tokens::type::MINUS:
+                emit( opcode::NEG );
+                break;
+            case lexer::tokens::type::PLUS:
+                emit( opcode::PLUS );
+                break;
+            default:
+                emit( opcode::NOT );
+                break;
+            }
+        }
+
+        void infix( const ast::infix_expression *inf )
+        {
+            expression( inf->left.get( ) );
+            expression( inf->right.get( ) );
+            switch( inf->token ) {
+            case lexer::tokens::type::PLUS:
+                emit( opcode::ADD );
+                break;
+            case lexer::tokens::type::MINUS:
+                emit( opcode::SUB );
+                break;
+            case lexer::tokens::type::ASTERISK:
+                emit( opcode::MUL );
+                break;
+            case lexer::tokens::type::SLASH:
+                emit( opcode::DIV );
+                break;
+            case lexer::tokens::type::LT:
+                emit( opcode::LT );
+                break;
+            case lexer::tokens::type::GT:
+                emit( opcode::GT );
+                break;
+            case lexer::tokens::type::EQ:
+                emit( opcode::EQ );
+                break;
+            default:
+                emit( opcode::NOT_EQ );
+                break;
+            }
+        }
+
+        /// 'keep': the value of the if is used
+        void if_expression( const ast::if_expression *cond, bool keep )
+        {
+            expression( cond->cond.get( ) );
+            auto to_else = emit( opcode::JUMP_IF_FALSE );
+            block( cond->then_block->states, keep );
+            auto to_end = emit( opcode::JUMP );
+            patch( to_else );
+            if( cond->else_block ) {
+                block( cond->else_block->states, keep );
+            } else if( keep ) {
+                emit( opcode::NIL );
+            }
+            patch( to_end );
+        }
+
+        void function( const ast::function_expression *fn )
+        {
+            auto parent = current_;
+            current_ = mod_.protos.size( );
+            mod_.protos.emplace_back( );
+            mod_.protos.back( ).info = fn->info;
+
+            block( fn->info->body, true );
+            emit( opcode::RETURN );
+
+            auto id  = static_cast<std::int32_t>(current_);
+            current_ = parent;
+            emit( opcode::CLOSURE, id );
+        }
+
+        module                              mod_;
+        std::size_t                         current_ = 0;
+        std::uint32_t                       line_    = 0;
+        std::map<std::int64_t, std::int32_t> ints_;
+        std::map<std::string, std::int32_t>  strings_;
+        std::map<std::string, std::int32_t>  names_;
+    };
+
+}}
+
+#endif // BYTECODE_H
@@ -0,0 +1,167 @@
+#include <string>
+#include <vector>
+#include <random>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "batch.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const std::vector<batch::field> fields = {
+        { "a", batch::column_type::INT },
+        { "b", batch::column_type::INT },
+        { "c", batch::column_type::INT },
+        { "d", batch::column_type::INT },
+        { "f", batch::column_type::INT },
+        { "p", batch::column_type::BOOL },
+        { "q", batch::column_type::BOOL },
+    };
+
+    struct table {
+        std::vector<std::vector<std::int64_t> > ints;
+        std::vector<std::vector<std::uint8_t> > bools;
+        std::vector<batch::column>              columns;
+    };
+
+    /// 'f' is never 0
+    table make_table( std::size_t rows )
+    {
+        std::mt19937_64 gen(42);
+        std::uniform_int_distribution<std::int64_t> small(-50, 50);
+        table res;
+        res.ints.resize( 5 );
+        res.bools.resize( 2 );
+        for( std::size_t r = 0; r < rows; ++r ) {
+            for( std::size_t i = 0; i < 5; ++i ) {
+                auto v = small( gen );
+                if( i == 4 && v == 0 ) {
+                    v = 7;
+                }
+                /// some values that wrap around
+                if( r % 97 == 0 && i == 0 ) {
+                    v = 0x7FFFFFFFFFFFFFFFLL;
+                }
+                res.ints[i].push_back( v );
+            }
+            res.bools[0].push_back( gen( ) & 1 );
+            res.bools[1].push_back( gen( ) & 1 );
+        }
+        for( auto &c: res.ints ) {
+            batch::column next;
+            next.ints = c.data( );
+            res.columns.push_back( next );
+        }
+        for( auto &c: res.bools ) {
+            batch::column next;
+            next.bools = c.data( );
+            res.columns.push_back( next );
+        }
+        return res;
+    }
+
+    /// the interpreter, one row at a time
+    std::string row_value( engines::vm_engine<objects::value> &vm,
+                           const table &t, std::size_t row )
+    {
+        using value = objects::value;
+        auto env = vm.context( ).globals( );
+        const char *names[] = { "a", "b", "c", "d", "f" };
+        for( std::size_t i = 0; i < 5; ++i ) {
+            env->set( names[i], value::from_int( t.ints[i][row] ) );
+        }
+        env->set( "p", value::from_bool( t.bools[0][row] != 0 ) );
+        env->set( "q", value::from_bool( t.bools[1][row] != 0 ) );
+        auto res = vm.run( );
+        return vm.errors_.empty( ) ? objects::inspect( res ) : "error";
+    }
+
+    std::string batch_value( const batch::output &out, std::size_t row )
+    {
+        if( out.type == batch::column_type::INT ) {
+            return std::to_string( out.ints[row] );
+        }
+        return out.bools[row] ? "true" : "false";
+    }
+}
+
+TEST_CASE( "batch evaluation", "[batch]" ) {
+
+    SECTION( "Columns give what the interpreter gives row by row", "[1]" ) {
+
+        const char *exprs[] = {
+            "a + b * c - d / f",
+            "-a * 3 + +b",
+            "a < b == (c > d)",
+            "!p != q",
+            "!(a == b) == p",
+            "a == p",
+            "a != p",
+            "!a",
+            "a",
+            "true == q",
+            "1 + 2 * 3",
+            "a * a * a * a / f",
+        };
+        /// more than one block, and a partial one at the end
+        const std::size_t rows = batch::program::block * 2 + 37;
+        auto t = make_table( rows );
+
+        gc::heap heap;
+        for( auto e: exprs ) {
+            batch::program prog;
+            std::string err;
+            REQUIRE( batch::program::compile( e, fields, prog, err ) );
+            batch::output out;
+            REQUIRE( prog.run( t.columns, rows, out, err ) );
+
+            engines::vm_engine<objects::value> vm(heap);
+            vm.load( parse( e ) );
+            for( std::size_t r = 0; r < rows; r += 7 ) {
+                REQUIRE( batch_value( out, r ) == row_value( vm, t, r ) );
+            }
+        }
+    }
+
+    SECTION( "Division by zero names the row", "[2]" ) {
+
+        std::vector<std::int64_t> a( 3000, 1 );
+        std::vector<std::int64_t> b( 3000, 2 );
+        b[2500] = 0;
+        std::vector<batch::column> cols( 2 );
+        cols[0].ints = a.data( );
+        cols[1].ints = b.data( );
+        std::vector<batch::field> ab = { { "a", batch::column_type::INT },
+                                         { "b", batch::column_type::INT } };
+        batch::program prog;
+        std::string err;
+        REQUIRE( batch::program::compile( "a / b", ab, prog, err ) );
+        batch::output out;
+        REQUIRE_FALSE( prog.run( cols, a.size( ), out, err ) );
+        REQUIRE( err == "Division by zero in row 2500" );
+
+        REQUIRE( prog.run( cols, 2500, out, err ) );
+        REQUIRE( out.ints[2499] == 0 );
+    }
+
+    SECTION( "What the interpreter refuses does not compile", "[3]" ) {
+
+        batch::program prog;
+        std::string err;
+        REQUIRE_FALSE( batch::program::compile( "a + p", fields, prog, err ) );
+        REQUIRE( err == "Type mismatch: INTEGER + BOOLEAN" );
+        REQUIRE_FALSE( batch::program::compile( "p < q", fields, prog, err ) );
+        REQUIRE( err == "Unknown operator: BOOLEAN < BOOLEAN" );
+        REQUIRE_FALSE( batch::program::compile( "-p", fields, prog, err ) );
+        REQUIRE( err == "Unknown operator: -BOOLEAN" );
+        REQUIRE_FALSE( batch::program::compile( "x + 1", fields, prog, err ) );
+        REQUIRE( err == "Identifier not found: x" );
+        REQUIRE_FALSE( batch::program::compile( "len(a)", fields, prog, err ) );
+        REQUIRE_FALSE( batch::program::compile( "let x = 1;", fields, prog,
+                                                err ) );
+    }
+}
@@ -0,0 +1,76 @@
+#include <string>
+#include <algorithm>
+
+#include "catch/catch.hpp"
+#include "corpus.h"
+#include "vm.h"
+
+using namespace mico;
+
+namespace {
+
+    const corpus::shape shapes[] = {
+        corpus::shape::DEEP, corpus::shape::LETS, corpus::shape::STRINGS,
+        corpus::shape::NUMBERS, corpus::shape::MIXED,
+    };
+}
+
+TEST_CASE( "corpus", "[corpus]" ) {
+
+    SECTION( "The same options give the same script", "[1]" ) {
+        for( auto kind: shapes ) {
+            corpus::options opts;
+            opts.kind  = kind;
+            opts.bytes = 4096;
+            auto a = corpus::generate( opts );
+            REQUIRE( a == corpus::generate( opts ) );
+            REQUIRE( a.size( ) >= opts.bytes );
+            REQUIRE( a.size( ) < opts.bytes * 2 );
+            opts.seed = 2;
+            REQUIRE( a != corpus::generate( opts ) );
+        }
+    }
+
+    SECTION( "Scripts parse and run without errors", "[2]" ) {
+        for( auto kind: shapes ) {
+            corpus::options opts;
+            opts.kind  = kind;
+            opts.bytes = 16 * 1024;
+            opts.seed  = 7;
+            auto src = corpus::generate( opts );
+
+            auto tt  = lexer::tokens::all( );
+            auto lst = lexer::tokens::get_list( tt, src.begin( ), src.end( ) );
+            for( auto &t: lst ) {
+                REQUIRE( t.name != lexer::tokens::type::ILLEGAL );
+            }
+            parser::token_reader reader(std::move(lst));
+            auto prog = reader.parse( );
+            REQUIRE( reader.errors_.empty( ) );
+            REQUIRE( prog.states.size( ) > 0 );
+
+            gc::heap heap;
+            engines::vm_engine<objects::value> vm(heap);
+            vm.load( prog );
+            vm.run( );
+            REQUIRE( vm.errors_.empty( ) );
+        }
+    }
+
+    SECTION( "Deep scripts nest as deep as asked", "[3]" ) {
+        corpus::options opts;
+        opts.kind  = corpus::shape::DEEP;
+        opts.bytes = 64 * 1024;
+        opts.depth = 40;
+        auto src = corpus::generate( opts );
+        std::size_t depth = 0;
+        std::size_t most  = 0;
+        for( auto c: src ) {
+            depth += ( c == '(' );
+            depth -= ( c == ')' );
+            most = std::max( most, depth );
+        }
+        REQUIRE( most > 30 );
+        REQUIRE( most <= 40 );
+    }
+}
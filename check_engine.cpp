@@ -0,0 +1,124 @@
+#include <memory>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "engine.h"
+#include "closure.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    /// every engine has to produce the same result as the tree walker
+    template <typename ValueT>
+    void check_same( engines::engine<ValueT> &eng, const std::string &input )
+    {
+        gc::heap heap;
+        engines::tree_engine<ValueT> tree(heap);
+
+        auto prog = parse( input );
+        tree.load( prog );
+        auto expected = tree.run( );
+
+        auto other = parse( input );
+        eng.load( other );
+        auto res = eng.run( );
+
+        REQUIRE( eng.context( ).errors_.size( )
+              == tree.context( ).errors_.size( ) );
+        REQUIRE( objects::inspect( res ) == objects::inspect( expected ) );
+    }
+
+    const char *scripts[] = {
+        "5",
+        "-5 + 10 * 2",
+        "2 * (3 + 4) - 10 / 2",
+        "let a = 5; let b = a * 2; b + a",
+        "let a = 5; return a; 8",
+        "1 < 2 == true",
+        "!5 == false",
+        "!!true != false",
+        "0x7FFFFFFFFFFFFFFF + 1",
+        "0x4000000000000000 * 2 / 4",
+        "let x = 1; x / 0",
+        "let x = true; x + 1",
+        "unknown * 2",
+        "[1, 2 * 3, [true]]",
+        "let a = [1, 2, 3]; a[0] + a[2] * len(a)",
+        "let a = push([1], 2); [first(a), last(a), rest(a), a[5], a[-1]]",
+        "let a = []; let b = push(a, 1); let c = push(a, 2); [a, b, c]",
+        "len(1)",
+        "push([1])",
+        "5(1)",
+        "1[0]",
+        "let h = {1: 2, true: [3], \"k\": 4}; [h[1], h[true][0], h[\"k\"], h[5]]",
+        "{[1]: 2}",
+        "{1: 2}[[1]]",
+        "let s = \"abc\" + \"def\"; [s == \"abcdef\", s[2], len(s)]",
+        "\"x\" == \"y\"",
+        "\"x\" * 2",
+        "let adder = fn(x) { fn(y) { x + y } }; adder(2)(3)",
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(12)",
+        "let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f()",
+        "let f = fn(x) { if (x > 0) { return x; } -1 }; [f(3), f(-3)]",
+        "let s = fn(n) { let go = fn(k) { if (k < 1) { 0 } else { k + go(k - 1) } }; go(n) }; s(20)",
+        "fn(a, b) { a }(1)",
+        "if (1 < 2) { 1 } else { 2 }",
+        "let f = fn(x) { x }; f",
+        "pmap([1, 2, 3], fn(x) { x * x })",
+        "pfilter([1, 2, 3, 4], fn(x) { x > 2 })",
+        "preduce([1, 2, 3], 10, fn(a, b) { a + b })",
+        "pmap([[1], [2, 3], []], len)",
+        "let k = 3; pmap([1, 2], fn(x) { fn(y) { x * y + k } })[1](5)",
+        "pmap([1, 2], fn(x) { x / (x - 1) })",
+        "pmap(1, len)",
+        "pmap([1], fn(a, b) { a })",
+        "preduce([1], fn(a, b) { a })",
+        "reduce(filter(map(range(0, 20), fn(x) { x * x }), "
+        "fn(x) { x / 2 * 2 == x }), 0, fn(a, b) { a + b })",
+        "let s = map([1, 2, 3], fn(x) { x + 1 }); "
+        "[s[0], len(s), first(s), last(s), rest(s), array(s)]",
+        "first(map(range(0, 10), fn(x) { if (x == 5) { x + true } else { x } }))",
+        "array(map(range(0, 10), fn(x) { if (x == 5) { x + true } else { x } }))",
+        "len(map(range(0, 3), fn(x) { x + true }))",
+        "array(map(range(0, 3), len))",
+        "range(1, true)",
+        "filter([1], 2)",
+    };
+
+    template <typename ValueT>
+    void check_engine( )
+    {
+        gc::heap heap;
+        engines::closure_engine<ValueT> closures(heap);
+        engines::vm_engine<ValueT>      vm(heap);
+        for( auto s: scripts ) {
+            check_same<ValueT>( closures, s );
+            check_same<ValueT>( vm, s );
+        }
+    }
+}
+
+TEST_CASE( "engines", "[engine]" ) {
+
+    SECTION( "Closure and vm engines with tagged values", "[1]" ) {
+        check_engine<objects::value>( );
+    }
+
+    SECTION( "Closure and vm engines with boxed values", "[2]" ) {
+        check_engine<objects::boxed_value>( );
+    }
+
+    SECTION( "Programs run many times after one load", "[3]" ) {
+        gc::heap heap;
+        std::unique_ptr<engines::engine<objects::value> >
+                            eng(new engines::closure_engine<objects::value>(heap));
+        auto prog = parse( "let a = 1; let b = a + 1; a + b" );
+        eng->load( prog );
+        REQUIRE( eng->run( ).as_int( ) == 3 );
+        REQUIRE( eng->run( ).as_int( ) == 3 );
+        REQUIRE( eng->context( ).globals( )->get( "b" )->as_int( ) == 2 );
+    }
+}
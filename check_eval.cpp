@@ -0,0 +1,158 @@
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "eval.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    template <typename EvalT>
+    void check_common( )
+    {
+        runner<EvalT> r;
+
+        REQUIRE( r.run_int( "5" ) == 5 );
+        REQUIRE( r.run_int( "-5 + 10" ) == 5 );
+        REQUIRE( r.run_int( "2 * (3 + 4) - 10 / 2" ) == 9 );
+        REQUIRE( r.run_int( "0x10 + 0b11 + 010" ) == 27 );
+        REQUIRE( r.run_int( "1_000_000_000 * 3" ) == 3000000000 );
+        REQUIRE( r.run_int( "let a = 5; let b = a * 2; b + a" ) == 15 );
+        REQUIRE( r.run_int( "return 7; 8" ) == 7 );
+
+        REQUIRE( r.run_bool( "1 < 2" ) );
+        REQUIRE( r.run_bool( "5 > 4 == 3 < 4" ) );
+        REQUIRE( r.run_bool( "!false" ) );
+        REQUIRE_FALSE( r.run_bool( "!5" ) );
+        REQUIRE( r.run_bool( "true != false" ) );
+
+        /// 2^62 and above do not fit into a small boxed integer
+        REQUIRE( r.run_int( "0x4000000000000000" ) == 0x4000000000000000LL );
+        REQUIRE( r.run_int( "0x3FFFFFFFFFFFFFFF + 1" )
+                                           == 0x4000000000000000LL );
+        REQUIRE( r.run_int( "0x7FFFFFFFFFFFFFFF + 1" )
+                                    == std::numeric_limits<std::int64_t>::min( ) );
+        REQUIRE( r.run_bool( "0x4000000000000000 == 0x4000000000000000" ) );
+        REQUIRE( r.run_int( "(0x4000000000000000 - 1) / 2" )
+                                           == 0x1FFFFFFFFFFFFFFFLL );
+
+        r.eval( "0x8000000000000000" );
+        REQUIRE( r.parse_errors.size( ) == 1 );
+
+        r.eval( "5 / 0" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+
+        r.eval( "5 + true" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+
+        r.eval( "unknown" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+
+        REQUIRE( objects::inspect( r.eval( "[1, 2 + 3, [true]]" ) )
+                                    == "[1, 5, [true]]" );
+        REQUIRE( r.run_int( "let a = [10, 20, 30]; a[1] + a[1 + 1]" ) == 50 );
+        REQUIRE( r.eval( "[1][1]" ).is_null( ) );
+        REQUIRE( r.eval( "[1][-1]" ).is_null( ) );
+        REQUIRE( r.run_int( "len([1, 2, 3])" ) == 3 );
+        REQUIRE( r.run_int( "first([4, 5])" ) == 4 );
+        REQUIRE( r.run_int( "last([4, 5])" ) == 5 );
+        REQUIRE( r.eval( "first([])" ).is_null( ) );
+        REQUIRE( r.eval( "rest([])" ).is_null( ) );
+        REQUIRE( objects::inspect( r.eval( "rest(rest([1, 2, 3]))" ) )
+                                    == "[3]" );
+        REQUIRE( objects::inspect( r.eval( "let a = [1]; push(a, 2); a" ) )
+                                    == "[1]" );
+
+        r.eval( "len(1)" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+        r.eval( "push([1])" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+        r.eval( "first(1)" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+        r.eval( "1(2)" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+
+        REQUIRE( r.run_int( "let h = {\"a\": 1, \"b\": 2, 3: 4}; "
+                            "h[\"b\"] * h[3]" ) == 8 );
+        REQUIRE( r.run_int( "{true: 1, false: 2}[1 > 2]" ) == 2 );
+        REQUIRE( r.eval( "{}[\"a\"]" ).is_null( ) );
+        REQUIRE( objects::inspect( r.eval( "{\"a\": [1]}" ) )
+                                    == "{\"a\": [1]}" );
+
+        r.eval( "{[1]: 2}" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+        r.eval( "{1: 2}[{}]" );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+    }
+}
+
+TEST_CASE( "evaluator", "[eval]" ) {
+
+    SECTION( "Tagged values", "[1]" ) {
+        check_common<eval::tagged_evaluator>( );
+    }
+
+    SECTION( "Boxed values", "[2]" ) {
+        check_common<eval::boxed_evaluator>( );
+        REQUIRE( sizeof(objects::boxed_value) == 8 );
+    }
+}
+
+TEST_CASE( "quickening", "[eval]" ) {
+
+    runner<eval::tagged_evaluator> r;
+
+    SECTION( "Nodes specialize after the first run", "[1]" ) {
+
+        auto prog = parse( "let a = 1; a + 2 < 10" );
+        auto expr = static_cast<ast::expr_statement *>(
+                                prog.states[1].get( ) )->expr.get( );
+        auto cmp  = static_cast<ast::infix_expression *>(expr);
+        auto add  = static_cast<ast::infix_expression *>(cmp->left.get( ));
+
+        REQUIRE( cmp->quick == ast::quick_type::NONE );
+        REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+        REQUIRE( cmp->quick == ast::quick_type::INT_LT );
+        REQUIRE( add->quick == ast::quick_type::INT_ADD );
+        REQUIRE( add->left->quick == ast::quick_type::IDENT_SLOT );
+
+        REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+        REQUIRE( cmp->quick == ast::quick_type::INT_LT );
+    }
+
+    SECTION( "Failed assumptions despecialize", "[2]" ) {
+
+        auto prog = parse( "a == b" );
+        r.eval( "let a = 1; let b = 1;" );
+        REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+
+        auto cmp = static_cast<ast::infix_expression *>(
+                    static_cast<ast::expr_statement *>(
+                                prog.states[0].get( ) )->expr.get( ) );
+        REQUIRE( cmp->quick == ast::quick_type::INT_EQ );
+
+        r.eval( "let a = true; let b = true;" );
+        REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+        REQUIRE( cmp->quick == ast::quick_type::NONE );
+
+        for( int i = 0; i < ast::quick_limit; ++i ) {
+            r.eval( "let a = 1; let b = 1;" );
+            REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+            r.eval( "let a = true; let b = false;" );
+            REQUIRE_FALSE( r.evaluator.eval( prog ).as_bool( ) );
+        }
+        REQUIRE( cmp->quick == ast::quick_type::GENERIC );
+    }
+
+    SECTION( "Slot caches are bound to one environment", "[3]" ) {
+
+        auto prog = parse( "x * 2" );
+        r.eval( "let x = 21;" );
+        REQUIRE( r.evaluator.eval( prog ).as_int( ) == 42 );
+
+        runner<eval::tagged_evaluator> other;
+        other.eval( "let y = 0; let x = 4;" );
+        REQUIRE( other.evaluator.eval( prog ).as_int( ) == 8 );
+        REQUIRE( r.evaluator.eval( prog ).as_int( ) == 42 );
+    }
+}
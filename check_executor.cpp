@@ -0,0 +1,102 @@
+#include <string>
+#include <set>
+#include <mutex>
+#include <atomic>
+
+#include "catch/catch.hpp"
+#include "executor.h"
+
+using namespace mico;
+
+namespace {
+
+    const char *fib =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "let h = {\"k\": [fib(12), \"s\" + \"t\"]}; "
+        "[h[\"k\"][0], h[\"k\"][1]]";
+}
+
+TEST_CASE( "executor", "[executor]" ) {
+
+    SECTION( "A program compiles once and runs anywhere", "[1]" ) {
+
+        std::string err;
+        REQUIRE_FALSE( exec::program::compile( "let = ;", err ) );
+        REQUIRE_FALSE( err.empty( ) );
+
+        auto prog = exec::program::compile( fib, err );
+        REQUIRE( prog );
+        exec::context ctx;
+        auto res = ctx.run( *prog );
+        REQUIRE( res.ok( ) );
+        REQUIRE( res.value == "[144, \"st\"]" );
+        REQUIRE( ctx.run( *prog ).value == res.value );
+        REQUIRE( ctx.runs( ) == 2 );
+
+        auto bad = exec::program::compile( "unknown(1)", err );
+        REQUIRE_FALSE( ctx.run( *bad ).ok( ) );
+    }
+
+    SECTION( "Every job runs once, on the context of its worker", "[2]" ) {
+
+        std::string err;
+        auto prog = exec::program::compile( fib, err );
+        const std::size_t jobs = 400;
+
+        std::mutex lock;
+        std::set<gc::heap *> heaps;
+        std::atomic<std::size_t> good(0);
+        std::atomic<std::size_t> runs(0);
+
+        exec::executor ex(4);
+        REQUIRE( ex.threads( ) == 4 );
+        for( std::size_t i = 0; i < jobs; ++i ) {
+            ex.submit( prog, [&]( const exec::result &res ) {
+                good += ( res.value == "[144, \"st\"]" ) ? 1 : 0;
+            } );
+            ex.submit( [&]( exec::context &ctx ) {
+                std::lock_guard<std::mutex> lck(lock);
+                heaps.insert( &ctx.heap( ) );
+                ++runs;
+            } );
+        }
+        ex.wait( );
+        REQUIRE( good == jobs );
+        REQUIRE( runs == jobs );
+        REQUIRE( heaps.size( ) <= 4 );
+
+        std::uint64_t executed = 0;
+        for( auto &st: ex.stats( ) ) {
+            executed += st.executed;
+        }
+        REQUIRE( executed == 2 * jobs );
+    }
+
+    SECTION( "Jobs submitted by jobs are waited for", "[3]" ) {
+
+        std::atomic<std::size_t> leaves(0);
+        exec::executor ex(3);
+
+        /// a tree of jobs, 4 levels of 5 children
+        std::function<void( exec::context &, int )> grow;
+        grow = [&]( exec::context &, int level ) {
+            if( level == 0 ) {
+                ++leaves;
+                return;
+            }
+            for( int i = 0; i < 5; ++i ) {
+                ex.submit( [&, level]( exec::context &ctx ) {
+                    grow( ctx, level - 1 );
+                } );
+            }
+        };
+        ex.submit( [&]( exec::context &ctx ) { grow( ctx, 4 ); } );
+        ex.wait( );
+        REQUIRE( leaves == 625 );
+
+        /// the executor can be used again after a wait
+        ex.submit( [&]( exec::context & ) { ++leaves; } );
+        ex.wait( );
+        REQUIRE( leaves == 626 );
+    }
+}
@@ -0,0 +1,233 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "eval.h"
+#include "engine.h"
+#include "closure.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    /// the literal of 'let name = fn...' in 'prog'
+    const ast::function_info *literal( const parser::program &prog,
+                                       std::size_t id )
+    {
+        auto let = static_cast<const ast::let_statement *>(
+                                            prog.states[id].get( ) );
+        return static_cast<const ast::function_expression *>(
+                                            let->expr.get( ) )->info.get( );
+    }
+
+    template <typename EvalT>
+    void check_calls( )
+    {
+        runner<EvalT> r;
+        REQUIRE( r.run( "fn(x) { x * 2 }(21)" ) == "42" );
+        REQUIRE( r.run( "let adder = fn(x) { fn(y) { x + y } }; "
+                        "let add2 = adder(2); add2(3) + adder(10)(1)" ) == "16" );
+        REQUIRE( r.run( "let fib = fn(n) { if (n < 2) { n } "
+                        "else { fib(n - 1) + fib(n - 2) } }; fib(15)" ) == "610" );
+        REQUIRE( r.run( "let sum = fn(n) { let go = fn(k) { if (k < 1) { 0 } "
+                        "else { k + go(k - 1) } }; go(n) }; sum(10)" ) == "55" );
+        REQUIRE( r.run( "let f = fn(x) { if (x > 0) { return 1; } 2 }; "
+                        "[f(1), f(0)]" ) == "[1, 2]" );
+        REQUIRE( r.run( "let f = fn() { let x = 1; let g = fn() { x }; "
+                        "let x = 2; g() }; f()" ) == "2" );
+        REQUIRE( r.run( "let g = 5; let f = fn() { let g = g + 1; g }; "
+                        "[f(), g]" ) == "[6, 5]" );
+        REQUIRE( r.run( "let f = fn(a, b) { a }; f(1)" ) == "error" );
+        REQUIRE( r.run( "if (1 > 2) { 10 }" ) == "null" );
+        REQUIRE( r.run( "if (false) { 10 } else { let a = 20; a }" ) == "20" );
+        REQUIRE( r.run( "let reduce = fn(a, acc, f) { if (len(a) == 0) { acc } "
+                        "else { reduce(rest(a), f(acc, first(a)), f) } }; "
+                        "reduce([1, 2, 3, 4], 0, fn(s, x) { s + x })" ) == "10" );
+        REQUIRE( r.run( "5()" ) == "error" );
+    }
+
+    const char *deep_tail =
+        "let count = fn(n, acc) { if (n == 0) { return acc; } "
+        "count(n - 1, acc + 1) }; "
+        "let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } }; "
+        "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; "
+        "[count(300000, 0), even(100001)]";
+
+    const char *deep_plain =
+        "let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; "
+        "sum(1000000)";
+
+    template <typename ValueT>
+    void check_depth( engines::engine<ValueT> &eng )
+    {
+        auto prog = parse( deep_tail );
+        eng.load( prog );
+        REQUIRE( objects::inspect( eng.run( ) ) == "[300000, false]" );
+        REQUIRE( eng.context( ).errors_.empty( ) );
+        REQUIRE( eng.context( ).depth( ) == 0 );
+
+        auto plain = parse( deep_plain );
+        eng.load( plain );
+        eng.run( );
+        REQUIRE( eng.context( ).errors_.size( ) == 1 );
+        REQUIRE( eng.context( ).errors_[0].find( "stack overflow" )
+                    != std::string::npos );
+
+        auto some = parse( "sum(3000)" );
+        eng.load( some );
+        REQUIRE( eng.run( ).as_int( ) == 4501500 );
+
+        /// the depth is clamped by the C++ stack where calls recurse
+        eng.context( ).set_max_depth( 1000000 );
+        auto deeper = parse( "sum(200000)" );
+        eng.load( deeper );
+        auto res = eng.run( );
+        if( std::string( eng.name( ) ) != "vm" ) {
+            REQUIRE( eng.context( ).errors_.size( ) == 1 );
+            REQUIRE( eng.context( ).errors_[0].find( "stack overflow" )
+                        != std::string::npos );
+        } else {
+            REQUIRE( res.as_int( ) == 20000100000 );
+        }
+        REQUIRE( eng.context( ).depth( ) == 0 );
+
+        /// a builtin that calls back recurses on the C++ stack everywhere
+        auto back = parse( "let g = fn(n) { if (n == 0) { 0 } else { "
+                           "reduce([1], 0, fn(a, x) { g(n - 1) + 1 }) } }; "
+                           "[g(100), g(100000)]" );
+        eng.load( back );
+        eng.run( );
+        REQUIRE( eng.context( ).errors_.size( ) == 1 );
+        REQUIRE( eng.context( ).errors_[0].find( "stack overflow" )
+                    != std::string::npos );
+        auto shallow = parse( "g(100)" );
+        eng.load( shallow );
+        REQUIRE( eng.run( ).as_int( ) == 100 );
+
+        eng.context( ).set_max_depth( 50 );
+        auto small = parse( "let f = fn(n) { if (n == 0) { 0 } "
+                            "else { 1 + f(n - 1) } }; [f(49), f(50)]" );
+        eng.load( small );
+        eng.run( );
+        REQUIRE( eng.context( ).errors_.size( ) == 1 );
+        auto ok = parse( "f(49)" );
+        eng.load( ok );
+        REQUIRE( eng.run( ).as_int( ) == 49 );
+    }
+}
+
+TEST_CASE( "functions", "[function]" ) {
+
+    SECTION( "Free variables are resolved to flat captures", "[1]" ) {
+
+        auto prog = parse( "let f = fn(a) { let b = a; "
+                           "let g = fn() { a + b + c }; g }" );
+        auto outer = literal( prog, 0 );
+        REQUIRE( outer->locals == 3 );
+        REQUIRE( outer->captures.empty( ) );
+        REQUIRE( outer->cells == std::vector<bool>( 3, false ) );
+
+        auto body  = static_cast<const ast::let_statement *>(
+                                            outer->body[1].get( ) );
+        auto inner = static_cast<const ast::function_expression *>(
+                                            body->expr.get( ) )->info.get( );
+        REQUIRE( inner->locals == 0 );
+        REQUIRE( inner->captures.size( ) == 2 );
+        REQUIRE( inner->captures[0].scope == ast::var_scope::LOCAL );
+        REQUIRE( inner->captures[0].index == 0 );
+        REQUIRE( inner->captures[1].index == 1 );
+        REQUIRE_FALSE( inner->captures[0].cell );
+    }
+
+    SECTION( "Captures that may change get cells", "[2]" ) {
+
+        auto prog = parse( "let f = fn() { let x = 1; let y = 2; "
+                           "let g = fn() { x + y }; let x = 3; g }; "
+                           "let r = fn() { let h = fn() { h }; h }" );
+
+        auto f = literal( prog, 0 );
+        REQUIRE( f->cells[0] );
+        REQUIRE_FALSE( f->cells[1] );
+
+        auto r = literal( prog, 1 );
+        REQUIRE( r->cells[0] );
+    }
+
+    SECTION( "Calls, closures and recursion", "[3]" ) {
+        check_calls<eval::tagged_evaluator>( );
+        check_calls<eval::boxed_evaluator>( );
+    }
+
+    SECTION( "Tail calls reuse the frame", "[5]" ) {
+
+        auto prog = parse( "let f = fn(n) { if (n > 0) { return g(n); } "
+                           "let x = h(n); k(x) }" );
+        auto f = literal( prog, 0 );
+        auto cond = static_cast<const ast::if_expression *>(
+            static_cast<const ast::expr_statement *>(
+                                    f->body[0].get( ) )->expr.get( ) );
+        auto ret = static_cast<const ast::return_statement *>(
+                                    cond->then_block->states[0].get( ) );
+        REQUIRE( static_cast<const ast::call_expression *>(
+                                    ret->expr.get( ) )->tail );
+        auto let = static_cast<const ast::let_statement *>(
+                                    f->body[1].get( ) );
+        REQUIRE_FALSE( static_cast<const ast::call_expression *>(
+                                    let->expr.get( ) )->tail );
+        auto last = static_cast<const ast::expr_statement *>(
+                                    f->body[2].get( ) );
+        REQUIRE( static_cast<const ast::call_expression *>(
+                                    last->expr.get( ) )->tail );
+    }
+
+    SECTION( "Deep recursion is an error, not a crash", "[6]" ) {
+        gc::heap heap;
+        engines::tree_engine<objects::value>         tree(heap);
+        engines::tree_engine<objects::boxed_value>   boxed(heap);
+        engines::closure_engine<objects::value>      closures(heap);
+        engines::vm_engine<objects::value>           vm(heap);
+        check_depth( tree );
+        check_depth( boxed );
+        check_depth( closures );
+        check_depth( vm );
+    }
+
+    SECTION( "Reloading keeps constants of earlier bodies", "[7]" ) {
+        gc::heap heap;
+        engines::closure_engine<objects::boxed_value> closures(heap);
+
+        auto first = parse( "let f = fn() { 0x7FFFFFFFFFFFFFFF }; f()" );
+        closures.load( first );
+        closures.run( );
+        auto other = parse( "let junk = [1, 2, 3]; 1" );
+        closures.load( other );
+        closures.run( );
+        heap.collect( );
+
+        auto call = parse( "let a = [\"" + std::string( 64, 'x' ) + "\", "
+                           "1, 2, 3, 4, 5, 6, 7]; f()" );
+        closures.load( call );
+        REQUIRE( closures.run( ).as_int( ) == 0x7FFFFFFFFFFFFFFF );
+        REQUIRE( closures.context( ).errors_.empty( ) );
+    }
+
+    SECTION( "Closures keep only what they capture", "[4]" ) {
+
+        auto retained = [ ]( const std::string &captured ) {
+            runner<eval::tagged_evaluator> r;
+            r.run( "let make = fn() { let big = [\"x\"]; let small = 1; "
+                   "let big = push(big, \"a\" + \"0123456789012345678901234567"
+                   "89012345678901234567890123456789\"); "
+                   "fn() { " + captured + " } }; let f = make();" );
+            r.heap.collect( );
+            auto f = static_cast<objects::function *>(
+                r.evaluator.globals( )->get( "f" )->as_object( ) );
+            REQUIRE( f->captured.size( ) == 1 );
+            return r.heap.get_stats( ).live_objects;
+        };
+
+        REQUIRE( retained( "small" ) + 4 <= retained( "big" ) );
+    }
+}
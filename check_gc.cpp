@@ -0,0 +1,173 @@
+#include "catch/catch.hpp"
+#include "gc.h"
+
+using namespace mico;
+
+TEST_CASE( "heap", "[gc]" ) {
+
+    gc::config conf;
+    conf.initial_threshold = 1024 * 1024 * 1024;
+
+    gc::heap heap(conf);
+    gc::value_stack stack;
+    heap.add_root( &stack );
+
+    SECTION( "Unreachable objects are freed", "[1]" ) {
+
+        for( int i = 0; i < 100; ++i ) {
+            heap.make<objects::string>( "garbage" );
+        }
+        auto keep = heap.make<objects::string>( "keep" );
+        stack.push( objects::value::from_object( keep ) );
+
+        REQUIRE( heap.get_stats( ).live_objects == 101 );
+        heap.collect( );
+        REQUIRE( heap.get_stats( ).live_objects == 1 );
+        REQUIRE( heap.get_stats( ).freed == 100 );
+        REQUIRE( heap.get_stats( ).collections == 1 );
+        REQUIRE( keep->str( ) == "keep" );
+    }
+
+    SECTION( "Arrays keep their elements and cycles are collected", "[2]" ) {
+
+        auto outer = heap.make<objects::array>( );
+        stack.push( objects::value::from_object( outer ) );
+
+        auto inner = heap.make<objects::array>( );
+        inner->elements.push_back( objects::value::from_object( outer ) );
+        outer->elements.push_back( objects::value::from_object( inner ) );
+        outer->elements.push_back( objects::value::from_int( 10 ) );
+
+        heap.collect( );
+        REQUIRE( heap.get_stats( ).live_objects == 2 );
+
+        stack.pop( );
+        heap.collect( );
+        REQUIRE( heap.get_stats( ).live_objects == 0 );
+        REQUIRE( heap.get_stats( ).live_bytes == 0 );
+    }
+
+    SECTION( "Environments are traced through parents", "[3]" ) {
+
+        auto globals = heap.make<objects::environment>( );
+        stack.push( objects::value::from_object( globals ) );
+
+        auto str = heap.make<objects::string>( "value" );
+        globals->set( "x", objects::value::from_object( str ) );
+
+        auto local = heap.make<objects::environment>( globals );
+        stack.push( objects::value::from_object( local ) );
+        stack.values[0] = objects::value::null( );
+
+        heap.collect( );
+        REQUIRE( heap.get_stats( ).live_objects == 3 );
+        REQUIRE( local->get( "x" )->as_object( ) == str );
+    }
+
+    SECTION( "Heap grows and collects by itself", "[4]" ) {
+
+        gc::config small;
+        small.initial_threshold = 4096;
+        small.min_threshold     = 4096;
+        gc::heap auto_heap(small);
+
+        for( int i = 0; i < 10000; ++i ) {
+            auto_heap.make<objects::string>( "temp" );
+        }
+        REQUIRE( auto_heap.get_stats( ).collections > 0 );
+        REQUIRE( auto_heap.get_stats( ).live_bytes <= 4096 );
+    }
+}
+
+TEST_CASE( "incremental heap", "[gc]" ) {
+
+    gc::config conf;
+    conf.collection        = gc::mode::INCREMENTAL;
+    conf.initial_threshold = 16 * 1024;
+    conf.min_threshold     = 16 * 1024;
+    conf.step_bytes        = 1024;
+    conf.max_pause         = std::chrono::microseconds(10);
+
+    gc::heap heap(conf);
+    gc::value_stack stack;
+    heap.add_root( &stack );
+
+    SECTION( "Barrier keeps objects moved into marked ones", "[1]" ) {
+
+        auto src = heap.make<objects::array>( );
+        stack.push( objects::value::from_object( src ) );
+        auto dst = heap.make<objects::array>( );
+        stack.push( objects::value::from_object( dst ) );
+
+        for( int i = 0; i < 1000; ++i ) {
+            auto str = heap.make<objects::string>( std::to_string( i ) );
+            auto val = objects::value::from_object( str );
+            src->elements.push_back( val );
+            heap.write_barrier( src, val );
+        }
+
+        while( !src->elements.empty( ) ) {
+            for( int g = 0; g < 20; ++g ) {
+                heap.make<objects::string>( "garbage" );
+            }
+            auto val = src->elements.back( );
+            dst->elements.push_back( val );
+            heap.write_barrier( dst, val );
+            src->elements.pop_back( );
+        }
+
+        REQUIRE( heap.get_stats( ).steps > 0 );
+        REQUIRE( heap.get_stats( ).collections > 0 );
+
+        for( int i = 0; i < 1000; ++i ) {
+            auto str = static_cast<objects::string *>(
+                                dst->elements[999 - i].as_object( ) );
+            REQUIRE( str->str( ) == std::to_string( i ) );
+        }
+
+        heap.collect( );
+        REQUIRE( heap.get_stats( ).live_objects == 1002 );
+    }
+
+    SECTION( "The rescan of the roots is sliced too", "[2]" ) {
+
+        /// every step stops at its first look at the clock
+        auto zero = conf;
+        zero.max_pause = std::chrono::microseconds(0);
+        gc::heap sliced(zero);
+        gc::value_stack late;
+        sliced.add_root( &late );
+
+        objects::array *arr = nullptr;
+        {
+            gc::no_collect guard(sliced);
+            arr = sliced.make<objects::array>( );
+            for( int i = 0; i < 5000; ++i ) {
+                auto str = sliced.make<objects::string>( std::to_string( i ) );
+                arr->elements.push_back( objects::value::from_object( str ) );
+            }
+        }
+        sliced.make<objects::string>( "begins a cycle" );
+        REQUIRE( sliced.in_cycle( ) );
+
+        /// roots have no barrier, only the rescan finds it
+        late.push( objects::value::from_object( arr ) );
+
+        std::uint64_t steps = 0;
+        while( sliced.in_cycle( ) ) {
+            sliced.step( );
+            ++steps;
+        }
+        REQUIRE( steps > 5000 / 64 );
+
+        for( int i = 0; i < 5000; ++i ) {
+            auto str = static_cast<objects::string *>(
+                                arr->elements[i].as_object( ) );
+            REQUIRE( str->str( ) == std::to_string( i ) );
+        }
+
+        sliced.collect( );
+        REQUIRE( sliced.get_stats( ).live_objects == 5001 );
+        sliced.remove_root( &late );
+    }
+}
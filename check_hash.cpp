@@ -0,0 +1,91 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "hash.h"
+#include "gc.h"
+
+using namespace mico;
+
+namespace {
+
+    template <typename ValueT>
+    void check_keys( )
+    {
+        gc::heap heap;
+        gc::basic_value_stack<ValueT> stack;
+        heap.add_root( &stack );
+
+        auto tbl = heap.make<objects::basic_hash<ValueT> >( );
+        stack.push( ValueT::from_object( tbl ) );
+
+        const std::int64_t n = 5000;
+        for( std::int64_t i = 0; i < n; ++i ) {
+            tbl->insert( ValueT::from_int( heap, i * 7919 ),
+                         ValueT::from_int( heap, i ) );
+        }
+        tbl->insert( ValueT::from_bool( true ), ValueT::from_int( heap, -1 ) );
+        tbl->insert( ValueT::from_int( heap, 0x4000000000000000LL ),
+                     ValueT::from_int( heap, -2 ) );
+        REQUIRE( tbl->size( ) == n + 2 );
+
+        for( std::int64_t i = 0; i < n; ++i ) {
+            auto found = tbl->find( ValueT::from_int( heap, i * 7919 ) );
+            REQUIRE( found );
+            REQUIRE( found->as_int( ) == i );
+        }
+        REQUIRE( tbl->find( ValueT::from_bool( true ) )->as_int( ) == -1 );
+        REQUIRE( tbl->find( ValueT::from_bool( false ) ) == nullptr );
+        REQUIRE( tbl->find( ValueT::from_int( heap, 1 ) ) == nullptr );
+
+        /// a different cell with the same big integer
+        auto big = ValueT::from_int( heap, 0x4000000000000000LL );
+        REQUIRE( tbl->find( big )->as_int( ) == -2 );
+
+        heap.remove_root( &stack );
+    }
+}
+
+TEST_CASE( "hash", "[hash]" ) {
+
+    SECTION( "Integer and boolean keys", "[1]" ) {
+        check_keys<objects::value>( );
+        check_keys<objects::boxed_value>( );
+    }
+
+    SECTION( "Strings are found by content", "[2]" ) {
+
+        gc::heap heap;
+        objects::hash tbl;
+        for( int i = 0; i < 1000; ++i ) {
+            auto key = heap.make<objects::string>( "key" + std::to_string( i ) );
+            tbl.insert( objects::value::from_object( key ),
+                        objects::value::from_int( i ) );
+        }
+
+        auto key = heap.make<objects::string>( "key500" );
+        REQUIRE( tbl.find( objects::value::from_object( key ) )->as_int( )
+                                                                    == 500 );
+        /// the hash is computed once and kept on the object
+        REQUIRE( key->hash( ) == objects::string( "key500" ).hash( ) );
+
+        auto miss = heap.make<objects::string>( "key1000" );
+        REQUIRE( tbl.find( objects::value::from_object( miss ) ) == nullptr );
+
+        /// 1 and "1" are different keys
+        tbl.insert( objects::value::from_int( 1 ),
+                    objects::value::from_int( -1 ) );
+        auto one = heap.make<objects::string>( "key1" );
+        REQUIRE( tbl.find( objects::value::from_object( one ) )->as_int( ) == 1 );
+        REQUIRE( tbl.size( ) == 1001 );
+    }
+
+    SECTION( "Inserting an existing key replaces the value", "[3]" ) {
+
+        objects::hash tbl;
+        tbl.insert( objects::value::from_int( 3 ), objects::value::from_int( 1 ) );
+        tbl.insert( objects::value::from_int( 3 ), objects::value::from_int( 2 ) );
+        REQUIRE( tbl.size( ) == 1 );
+        REQUIRE( tbl.find( objects::value::from_int( 3 ) )->as_int( ) == 2 );
+        REQUIRE( tbl.inspect( ) == "{3: 2}" );
+    }
+}
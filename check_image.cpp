@@ -0,0 +1,203 @@
+#include <string>
+#include <cstdio>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "vm.h"
+#include "image.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const char *scripts[] = {
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "fib(15)",
+        "let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f()",
+        "let adder = fn(x) { fn(y) { x + y } }; adder(2)(3)",
+        "let s = \"abc\" + \"def\"; let h = {s: 1, \"k\": [2]}; "
+        "[h[\"abcdef\"], h[\"k\"][0], s[1], len(s)]",
+        "0x7FFFFFFFFFFFFFFF + 1",
+        "unknown(1)",
+    };
+
+    std::string run( engines::vm_engine<objects::value> &vm )
+    {
+        auto res = objects::inspect( vm.run( ) );
+        return vm.errors_.empty( ) ? res : "error";
+    }
+
+    template <typename T>
+    T *items( std::string &bytes, image::section id )
+    {
+        auto head = reinterpret_cast<image::header *>( &bytes[0] );
+        auto &rec = head->sections[static_cast<std::size_t>(id)];
+        return reinterpret_cast<T *>( &bytes[rec.offset] );
+    }
+
+    std::size_t count( std::string &bytes, image::section id )
+    {
+        auto head = reinterpret_cast<image::header *>( &bytes[0] );
+        return head->sections[static_cast<std::size_t>(id)].count;
+    }
+
+    /// makes the checksum right again after an edit
+    void reseal( std::string &bytes )
+    {
+        auto head = reinterpret_cast<image::header *>( &bytes[0] );
+        head->checksum = image::hash( bytes.data( ) + sizeof(image::header),
+                                      bytes.size( ) - sizeof(image::header) );
+    }
+
+    /// the operand 'a' of these is an index or a jump target
+    bool indexed( bytecode::opcode op )
+    {
+        using bytecode::opcode;
+        switch( op ) {
+        case opcode::CONST:          case opcode::GET_GLOBAL:
+        case opcode::SET_GLOBAL:     case opcode::TEE_GLOBAL:
+        case opcode::GET_LOCAL:      case opcode::SET_LOCAL:
+        case opcode::TEE_LOCAL:      case opcode::GET_LOCAL2:
+        case opcode::GET_LOCAL_CELL: case opcode::SET_LOCAL_CELL:
+        case opcode::GET_CAPTURE:    case opcode::GET_CAPTURE_CELL:
+        case opcode::ADD_CONST:      case opcode::SUB_CONST:
+        case opcode::LT_CONST:       case opcode::GT_CONST:
+        case opcode::EQ_CONST:       case opcode::LOCAL_ADD_CONST:
+        case opcode::LOCAL_SUB_CONST:
+        case opcode::CLOSURE:
+            return true;
+        default:
+            return bytecode::is_jump( op );
+        }
+    }
+}
+
+TEST_CASE( "program images", "[image]" ) {
+
+    SECTION( "Images run like the program they were made from", "[1]" ) {
+
+        for( auto s: scripts ) {
+            gc::heap heap;
+            engines::vm_engine<objects::value> source(heap);
+            engines::vm_engine<objects::value> mapped(heap);
+
+            auto prog = parse( s );
+            source.load( prog );
+
+            auto hash  = image::hash( s );
+            auto bytes = image::writer::write( prog, hash );
+            std::string err;
+            auto img = image::file::from_bytes( bytes, hash, err );
+            REQUIRE( img );
+            mapped.load( img );
+
+            REQUIRE( run( mapped ) == run( source ) );
+            REQUIRE( run( mapped ) == run( source ) );
+        }
+    }
+
+    SECTION( "The same program always makes the same image", "[2]" ) {
+        auto a = parse( scripts[0] );
+        auto b = parse( scripts[0] );
+        REQUIRE( image::writer::write( a, 1 ) == image::writer::write( b, 1 ) );
+    }
+
+    SECTION( "Images are mapped from files", "[3]" ) {
+
+        std::string path = "check_image.tmp";
+        auto hash = image::hash( scripts[0] );
+        auto prog = parse( scripts[0] );
+        REQUIRE( image::save( path, image::writer::write( prog, hash ) ) );
+
+        std::string err;
+        {
+            auto img = image::file::open( path, hash, err );
+            REQUIRE( img );
+#if !defined(_WIN32)
+            REQUIRE( img->mapped( ) );
+#endif
+            gc::heap heap;
+            engines::vm_engine<objects::value> vm(heap);
+            vm.load( img );
+            /// the vm keeps the mapping
+            img.reset( );
+            REQUIRE( run( vm ) == "610" );
+        }
+
+        REQUIRE_FALSE( image::file::open( path, hash + 1, err ) );
+        REQUIRE( err == "image of another source" );
+        std::remove( path.c_str( ) );
+        REQUIRE_FALSE( image::file::open( path, hash, err ) );
+    }
+
+    SECTION( "Damaged images are rejected", "[4]" ) {
+
+        auto prog  = parse( scripts[1] );
+        auto bytes = image::writer::write( prog, 7 );
+        std::string err;
+
+        auto flipped = bytes;
+        flipped[flipped.size( ) - 1] ^= 1;
+        REQUIRE_FALSE( image::file::from_bytes( flipped, 7, err ) );
+        REQUIRE( err == "damaged image" );
+
+        REQUIRE_FALSE( image::file::from_bytes(
+                        bytes.substr( 0, bytes.size( ) / 2 ), 7, err ) );
+        REQUIRE( err == "damaged image" );
+
+        auto other = bytes;
+        other[8] ^= 1;
+        REQUIRE_FALSE( image::file::from_bytes( other, 7, err ) );
+        REQUIRE( err == "image of another version or byte order" );
+
+        REQUIRE_FALSE( image::file::from_bytes( "short", 7, err ) );
+        REQUIRE( err == "not an image" );
+    }
+
+    SECTION( "Operands out of their sections are rejected", "[5]" ) {
+
+        std::string err;
+        std::size_t edits = 0;
+        for( auto s: scripts ) {
+            auto bytes = image::writer::write( parse( s ), 7 );
+            auto n     = count( bytes, image::section::CODE );
+            for( std::size_t i = 0; i < n; ++i ) {
+                auto op = items<bytecode::instr>( bytes,
+                                                  image::section::CODE )[i].op;
+                auto bad = bytes;
+                auto &ins = items<bytecode::instr>( bad,
+                                                    image::section::CODE )[i];
+                if( indexed( op ) ) {
+                    ins.a = 1 << 30;
+                } else if( op == bytecode::opcode::CALL
+                        || op == bytecode::opcode::TAIL_CALL )
+                {
+                    ins.b = 1 << 30;
+                } else {
+                    continue;
+                }
+                reseal( bad );
+                REQUIRE_FALSE( image::file::from_bytes( bad, 7, err ) );
+                REQUIRE( err == "damaged image" );
+                if( op == bytecode::opcode::CLOSURE ) {
+                    ins.a = 0;
+                    reseal( bad );
+                    REQUIRE_FALSE( image::file::from_bytes( bad, 7, err ) );
+                }
+                ++edits;
+            }
+            reseal( bytes );
+            REQUIRE( image::file::from_bytes( bytes, 7, err ) );
+        }
+        REQUIRE( edits > 20 );
+
+        /// adder captures 'x' as a plain value
+        auto bytes = image::writer::write( parse( scripts[2] ), 7 );
+        REQUIRE( count( bytes, image::section::CAPTURES ) == 1 );
+        items<image::capture_rec>( bytes, image::section::CAPTURES )[0].cell = 1;
+        reseal( bytes );
+        REQUIRE_FALSE( image::file::from_bytes( bytes, 7, err ) );
+        REQUIRE( err == "damaged image" );
+    }
+}
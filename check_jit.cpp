@@ -0,0 +1,98 @@
+#include <limits>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "eval.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const char *scripts[] = {
+        "let a = 7; let b = 3; a * b - a / b + -a",
+        "let a = 7; let b = 3; (a + b) * (a - b) > a * a",
+        "let a = 7; let b = 7; a == b != (a < b)",
+        "let a = 1; !(a > 2) == true",
+        "let a = 0x7FFFFFFFFFFFFFFF; a + 1",
+        "let a = -0x7FFFFFFFFFFFFFFF - 1; a * -1",
+        "let a = -0x7FFFFFFFFFFFFFFF - 1; a / -1",
+        "let a = 0x3FFFFFFFFFFFFFFF; a + 1",
+        "let z = 0; 10 / z",
+        "let a = true; a + 1",
+        "let a = 5; a + b",
+        "let a = 2; let b = a * a; let c = b * b * b; c - a",
+    };
+
+    template <typename EvalT>
+    void check_same_results( )
+    {
+        for( auto s: scripts ) {
+            runner<EvalT> interp;
+            runner<EvalT> native;
+            native.evaluator.set_jit( true );
+            auto expected = interp.run( s );
+            REQUIRE( native.run( s ) == expected );
+            REQUIRE( native.run( s ) == expected );
+        }
+    }
+}
+
+TEST_CASE( "jit", "[jit]" ) {
+
+    if( !jit::compiler::available( ) ) {
+        return;
+    }
+
+    SECTION( "Same results as the interpreter", "[1]" ) {
+        check_same_results<eval::tagged_evaluator>( );
+        check_same_results<eval::boxed_evaluator>( );
+    }
+
+    SECTION( "Int-only statements are compiled once", "[2]" ) {
+
+        runner<eval::tagged_evaluator> r;
+        r.evaluator.set_jit( true );
+        auto prog = parse( "let a = 6; let b = a * 7; b - 2 > a" );
+        for( int i = 0; i < 10; ++i ) {
+            REQUIRE( r.evaluator.eval( prog ).as_bool( ) );
+        }
+        auto &stats = r.evaluator.get_jit_stats( );
+        REQUIRE( stats.compiled == 2 );
+        REQUIRE( stats.calls == 20 );
+        REQUIRE( stats.deopts == 0 );
+    }
+
+    SECTION( "Failed guards fall back to the interpreter", "[3]" ) {
+
+        runner<eval::tagged_evaluator> r;
+        r.evaluator.set_jit( true );
+        auto prog = parse( "a * 2" );
+
+        r.run( "let a = 21;" );
+        REQUIRE( r.evaluator.eval( prog ).as_int( ) == 42 );
+        REQUIRE( prog.states[0]->type( ) == ast::node_type::STATE_EXPR );
+
+        r.run( "let a = 0x4000000000000000;" );
+        REQUIRE( r.evaluator.eval( prog ).as_int( )
+                    == std::numeric_limits<std::int64_t>::min( ) );
+        REQUIRE( r.evaluator.get_jit_stats( ).deopts == 1 );
+
+        r.run( "let a = true;" );
+        r.evaluator.eval( prog );
+        REQUIRE( r.evaluator.errors_.size( ) == 1 );
+        REQUIRE( r.evaluator.get_jit_stats( ).deopts == 2 );
+
+        r.run( "let a = 2;" );
+        REQUIRE( r.evaluator.eval( prog ).as_int( ) == 4 );
+        REQUIRE( r.evaluator.get_jit_stats( ).compiled == 1 );
+    }
+
+    SECTION( "Expressions that are not int-only are not compiled", "[4]" ) {
+
+        runner<eval::tagged_evaluator> r;
+        r.evaluator.set_jit( true );
+        r.run( "let a = 1; let b = true; a; b == true; !a" );
+        REQUIRE( r.evaluator.get_jit_stats( ).compiled == 0 );
+    }
+}
@@ -0,0 +1,139 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "deps.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    using vm_type = engines::vm_engine<objects::value>;
+
+    /// the value of the program, or its first error; and the globals
+    /// 'names' after it
+    std::string run( vm_type &vm, const std::string &input,
+                     const std::string &names = "" )
+    {
+        auto prog = parse( input );
+        vm.load( prog );
+        auto res = objects::inspect( vm.run( ) );
+        if( !vm.errors_.empty( ) ) {
+            res = "error: " + vm.errors_.front( );
+        }
+        auto tail = parse( "[" + names + "]" );
+        vm.load( tail );
+        return res + " " + objects::inspect( vm.run( ) );
+    }
+
+    /// the same in order and with parallel lets
+    std::string both( const std::string &input, const std::string &names = "",
+                      std::uint64_t *waves = nullptr )
+    {
+        gc::heap heap;
+        vm_type plain(heap);
+        vm_type lets(heap);
+        lets.set_parallel( 4 );
+        lets.set_parallel_lets( true );
+        auto expected = run( plain, input, names );
+        auto res      = run( lets, input, names );
+        REQUIRE( res == expected );
+        if( waves ) {
+            *waves = lets.let_waves( );
+        }
+        return res;
+    }
+
+    const std::string fib =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; ";
+}
+
+TEST_CASE( "parallel lets", "[lets]" ) {
+
+    SECTION( "Dependency graph", "[1]" ) {
+        auto prog = parse( "let a = 1; "
+                           "let f = fn(x) { x + b }; "
+                           "let b = a + 1; "
+                           "let c = f(2); "
+                           "let d = [a, len(\"x\")]; "
+                           "if (d[0] == 1) { return c; } "
+                           "let e = c; " );
+        auto g = deps::graph::build( prog );
+        REQUIRE( g.size( ) == 7 );
+        REQUIRE( g[0].after.empty( ) );
+        /// 'b' is read only when f runs; that is later
+        REQUIRE( g[1].after.empty( ) );
+        REQUIRE( g[1].outer == std::vector<std::string>{ "b" } );
+        REQUIRE( g[2].after == std::vector<std::size_t>{ 0 } );
+        /// f reads b, and b reads a
+        REQUIRE( g[3].after == ( std::vector<std::size_t>{ 0, 1, 2 } ) );
+        REQUIRE( g[4].after == std::vector<std::size_t>{ 0 } );
+        REQUIRE( g[4].outer == std::vector<std::string>{ "len" } );
+        REQUIRE( g[5].exits );
+        REQUIRE( g.prefix( ) == 5 );
+
+        auto lvl = g.levels( );
+        REQUIRE( lvl.size( ) == 4 );
+        REQUIRE( lvl[0] == ( std::vector<std::size_t>{ 0, 1 } ) );
+        REQUIRE( lvl[1] == ( std::vector<std::size_t>{ 2, 4 } ) );
+
+        /// a let in an if sets a global too
+        prog = parse( "let x = 1; if (x) { let y = 2; }; let z = y; " );
+        g    = deps::graph::build( prog );
+        REQUIRE( !g[1].simple );
+        REQUIRE( g[2].after == ( std::vector<std::size_t>{ 0, 1 } ) );
+    }
+
+    SECTION( "Same values and globals as in order", "[2]" ) {
+        std::uint64_t waves = 0;
+        REQUIRE( both( fib + "let a = fib(15); let b = fib(14); "
+                       "let c = [a, b]; let d = a + b; d",
+                       "a, b, c, d", &waves )
+                 == "987 [610, 377, [610, 377], 987]" );
+        REQUIRE( waves > 0 );
+
+        both( "let f = fn(x) { x + k }; let k = 10; let r = f(1); r", "k, r" );
+        both( "let s = \"ab\" + \"cd\"; let h = {s: [1, 2]}; "
+              "let t = h[s]; let u = len(s); t", "s, t, u" );
+        /// later lets of the same name win
+        both( "let x = 1; let y = x; let x = 2; let z = x; [y, z]", "x" );
+        both( "let a = 1; if (a == 1) { let b = 5; }; let c = b + a; c",
+              "a, b, c" );
+        both( "let a = 1; let b = 2; if (a < b) { return 7; } let c = 3; c",
+              "a, b" );
+        both( "let g = fn(x) { fn(y) { x + y } }; let h = g(3); "
+              "let i = g(4); [h(1), i(1)]", "h(2)" );
+        both( "let r = range(0, 5); let m = map(r, fn(x) { x * 2 }); "
+              "let s = array(m); s", "len(s)" );
+        both( "let a = 3; a + 1" );
+        both( "" );
+    }
+
+    SECTION( "Globals from before the program", "[3]" ) {
+        gc::heap heap;
+        vm_type plain(heap);
+        vm_type lets(heap);
+        lets.set_parallel( 4 );
+        lets.set_parallel_lets( true );
+        for( auto vm: { &plain, &lets } ) {
+            run( *vm, "let base = 100; let len = fn(x) { 42 }; " );
+        }
+        const std::string prog = "let a = base + 1; let b = len([]); "
+                                 "let c = first([5]); [a, b, c]";
+        REQUIRE( run( lets, prog, "a" ) == run( plain, prog, "a" ) );
+        REQUIRE( run( lets, prog, "a" ) == "[101, 42, 5] [101]" );
+    }
+
+    SECTION( "The first error in order is the one reported", "[4]" ) {
+        auto res = both( fib + "let a = fib(10); let b = a + true; "
+                         "let c = fib(12); let d = c + \"x\"; d", "a" );
+        REQUIRE( res.find( "BOOLEAN" ) != std::string::npos );
+        REQUIRE( res.find( "[55]" ) != std::string::npos );
+        /// globals of the statements before the failed one are set
+        both( "let a = 1; let b = zz; let c = 2; c", "a" );
+        both( "let a = 1; let b = zz; let c = 2; c", "c" );
+        both( "let a = 1; let b = [a][5] + 1; b" );
+    }
+}
@@ -138,4 +138,27 @@ TEST_CASE( "mico", "[lexer]" ) {
         }
     }
 
+    SECTION( "Token positions", "[2]" ) {
+
+        std::string input = "let a = 1;\n"
+                            "  a + \"x\ny\";\n"
+                            "\n"
+                            "fn(b) { b }";
+
+        auto lst = lexer::tokens::get_list( tt, input.begin( ), input.end( ) );
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t> > results = {
+            { 1, 1 }, { 1, 5 }, { 1, 7 }, { 1, 9 }, { 1, 10 },
+            { 2, 3 }, { 2, 5 }, { 2, 7 }, { 3, 3 },
+            { 5, 1 }, { 5, 3 }, { 5, 4 }, { 5, 5 }, { 5, 7 }, { 5, 9 },
+            { 5, 11 }, { 5, 12 },
+        };
+
+        REQUIRE( lst.size( ) == results.size( ) );
+        for( std::size_t i = 0; i < lst.size( ); ++i ) {
+            REQUIRE( lst[i].pos.line   == results[i].first );
+            REQUIRE( lst[i].pos.column == results[i].second );
+        }
+    }
+
 }
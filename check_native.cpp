@@ -0,0 +1,170 @@
+#include <string>
+#include <cstdint>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "engine.h"
+#include "closure.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    std::int64_t add( std::int64_t a, std::int64_t b )
+    {
+        return a + b;
+    }
+
+    std::string repeat( const std::string &s, int n )
+    {
+        std::string res;
+        for( int i = 0; i < n; ++i ) {
+            res += s;
+        }
+        return res;
+    }
+
+    bool even( std::uint32_t x )
+    {
+        return x % 2 == 0;
+    }
+
+    std::uint64_t wide( std::uint64_t x )
+    {
+        return 2 * x;
+    }
+
+    std::size_t seen = 0;
+
+    void touch( )
+    {
+        ++seen;
+    }
+
+    template <typename ValueT>
+    ValueT pick( bool which, ValueT a, const ValueT &b )
+    {
+        return which ? a : b;
+    }
+
+    template <typename ValueT>
+    void bind_all( eval::runtime<ValueT> &rt )
+    {
+        rt.bind( "add", &add );
+        rt.bind( "repeat", &repeat );
+        rt.bind( "even", &even );
+        rt.bind( "touch", &touch );
+        rt.bind( "pick", &pick<ValueT> );
+        rt.bind( "neg", +[ ]( long x ) { return -x; } );
+        rt.bind( "wide", &wide );
+    }
+
+    template <typename ValueT>
+    std::string run( engines::engine<ValueT> &eng, const std::string &input )
+    {
+        auto prog = parse( input );
+        eng.load( prog );
+        auto res = objects::inspect( eng.run( ) );
+        auto &errs = eng.context( ).errors_;
+        return errs.empty( ) ? res : "error: " + errs.front( );
+    }
+
+    template <typename ValueT>
+    void check_engine( engines::engine<ValueT> &eng )
+    {
+        bind_all( eng.context( ) );
+        REQUIRE( run( eng, "add(2, 40)" ) == "42" );
+        REQUIRE( run( eng, "let f = fn(x) { add(x, 1) }; f(f(1))" ) == "3" );
+        REQUIRE( run( eng, "repeat(\"ab\", 3)" ) == "\"ababab\"" );
+        REQUIRE( run( eng, "repeat(\"a\" + \"b\", 2) == \"abab\"" ) == "true" );
+        REQUIRE( run( eng, "[even(4), even(7)]" ) == "[true, false]" );
+        REQUIRE( run( eng, "touch()" ) == "null" );
+        REQUIRE( run( eng, "pick(false, [1], {1: 2})" ) == "{1: 2}" );
+        REQUIRE( run( eng, "neg(5) + neg(-2)" ) == "-3" );
+        REQUIRE( run( eng, "let a = add; a(1, 2)" ) == "3" );
+        REQUIRE( run( eng, "reduce(range(0, 5), 0, add)" ) == "10" );
+        REQUIRE( run( eng, "array(map([1, 2, 3], even))" )
+                 == "[false, true, false]" );
+
+        REQUIRE( run( eng, "add(1)" )
+                 == "error: wrong number of arguments to `add`. got=1, want=2" );
+        REQUIRE( run( eng, "add(1, true)" )
+                 == "error: argument 2 to `add` must be INTEGER, got BOOLEAN" );
+        REQUIRE( run( eng, "repeat(1, 2)" )
+                 == "error: argument 1 to `repeat` must be STRING, got INTEGER" );
+        REQUIRE( run( eng, "even(\"x\")" )
+                 == "error: argument 1 to `even` must be "
+                    "INTEGER from 0 to 4294967295, got STRING" );
+
+        /// nothing is truncated on the way in or out
+        REQUIRE( run( eng, "[wide(3), even(4294967295)]" ) == "[6, false]" );
+        REQUIRE( run( eng, "even(-1)" )
+                 == "error: argument 1 to `even` must be "
+                    "INTEGER from 0 to 4294967295, got INTEGER" );
+        REQUIRE( run( eng, "repeat(\"a\", 0x10000000000)" )
+                 == "error: argument 2 to `repeat` must be "
+                    "INTEGER from -2147483648 to 2147483647, got INTEGER" );
+        REQUIRE( run( eng, "wide(-1)" )
+                 == "error: argument 1 to `wide` must be "
+                    "INTEGER from 0 to 18446744073709551615, got INTEGER" );
+        REQUIRE( run( eng, "wide(0x7FFFFFFFFFFFFFFF)" )
+                 == "error: result of `wide` is not an INTEGER" );
+    }
+}
+
+TEST_CASE( "native functions", "[native]" ) {
+
+    SECTION( "Every engine calls them", "[1]" ) {
+        gc::heap heap;
+        engines::tree_engine<objects::value>    tree(heap);
+        engines::closure_engine<objects::value> closures(heap);
+        engines::vm_engine<objects::value>      vm(heap);
+        check_engine( tree );
+        check_engine( closures );
+        check_engine( vm );
+
+        engines::tree_engine<objects::boxed_value> boxed(heap);
+        check_engine( boxed );
+    }
+
+    SECTION( "Void functions run once per call", "[2]" ) {
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        bind_all( vm.context( ) );
+        seen = 0;
+        REQUIRE( run( vm, "let go = fn(i) { if (i > 0) { touch(); go(i - 1) } }; "
+                          "go(100)" ) == "null" );
+        REQUIRE( seen == 100 );
+    }
+
+    SECTION( "Results survive the collector", "[3]" ) {
+        gc::config conf;
+        conf.initial_threshold = 4 * 1024;
+        conf.min_threshold     = 4 * 1024;
+        gc::heap heap(conf);
+        engines::vm_engine<objects::value> vm(heap);
+        bind_all( vm.context( ) );
+        REQUIRE( run( vm, "let go = fn(i, acc) { if (i == 0) { acc } "
+                          "else { go(i - 1, push(acc, repeat(\"xy\", 20))) } }; "
+                          "let all = go(500, []); "
+                          "[len(all), all[0] == all[499], len(all[250])]" )
+                 == "[500, true, 40]" );
+        REQUIRE( heap.get_stats( ).collections > 0 );
+    }
+
+    SECTION( "Workers leave them to the engine", "[4]" ) {
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        vm.set_parallel( 4, 16 );
+        vm.set_parallel_lets( true );
+        bind_all( vm.context( ) );
+        REQUIRE( run( vm, "let xs = array(range(0, 100)); "
+                          "let ys = pmap(xs, fn(x) { add(x, 1) }); "
+                          "let zs = pmap(xs, neg); "
+                          "[ys[99], zs[99], len(pfilter(xs, even))]" )
+                 == "[100, -99, 50]" );
+        REQUIRE( vm.parallel_runs( ) == 0 );
+    }
+}
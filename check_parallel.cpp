@@ -0,0 +1,123 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "engine.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const std::string range =
+        "let range = fn(n) { "
+        "   let go = fn(i, acc) { "
+        "       if (i == n) { acc } else { go(i + 1, push(acc, i)) } "
+        "   }; "
+        "   go(0, []) "
+        "}; "
+        "let xs = range(3000); ";
+
+    struct outcome {
+        std::string              value;
+        std::vector<std::string> errors;
+        std::uint64_t            parallel = 0;
+    };
+
+    template <typename ValueT>
+    outcome run( const std::string &input, std::size_t threads )
+    {
+        gc::heap heap;
+        engines::vm_engine<ValueT> vm(heap);
+        vm.set_parallel( threads, 64 );
+        vm.load( parse( range + input ) );
+        outcome res;
+        res.value    = objects::inspect( vm.run( ) );
+        res.errors   = vm.errors_;
+        res.parallel = vm.parallel_runs( );
+        return res;
+    }
+
+    const char *scripts[] = {
+        "pmap(xs, fn(x) { x * x })",
+        "pfilter(xs, fn(x) { x / 7 * 7 == x })",
+        "preduce(xs, 5, fn(a, b) { a + b })",
+        "let k = 10; let scale = fn(x) { x * k }; pmap(xs, fn(x) { scale(x) + 1 })",
+        "pmap(xs, fn(x) { [x, \"s\" + \"t\", {\"k\": x, x: \"v\"}] })",
+        "let adders = pmap(xs, fn(x) { fn(y) { x + y } }); "
+        "pmap(adders, fn(f) { f(1) })",
+        "let f = fn() { let c = 1; let g = fn(x) { x + c }; let c = 2; "
+        "pmap(xs, g) }; f()",
+        "let shared = [1, 2, 3]; let same = pmap(xs, fn(x) { shared }); "
+        "len(pfilter(same, fn(v) { v == same[0] }))",
+        "pmap(range(100), fn(i) { len(pmap(range(i), fn(x) { x })) })",
+        "pmap(xs, fn(x) { 0x7FFFFFFFFFFFFFFF + x })",
+    };
+
+    template <typename ValueT>
+    void check_scripts( )
+    {
+        for( auto s: scripts ) {
+            auto seq = run<ValueT>( s, 0 );
+            auto par = run<ValueT>( s, 4 );
+            REQUIRE( seq.errors.empty( ) );
+            REQUIRE( par.errors.empty( ) );
+            REQUIRE( par.value == seq.value );
+            REQUIRE( seq.parallel == 0 );
+            REQUIRE( par.parallel > 0 );
+        }
+    }
+}
+
+TEST_CASE( "parallel builtins", "[parallel]" ) {
+
+    SECTION( "Workers give what one thread gives", "[1]" ) {
+        check_scripts<objects::value>( );
+        check_scripts<objects::boxed_value>( );
+    }
+
+    SECTION( "The error is the one of the first element that fails", "[2]" ) {
+
+        const char *failing =
+            "pmap(xs, fn(x) { if (x == 2500) { x + true } "
+            "else { if (x > 2900) { x / 0 } else { x } } })";
+        auto seq = run<objects::value>( failing, 0 );
+        auto par = run<objects::value>( failing, 4 );
+        REQUIRE( par.parallel == 1 );
+        REQUIRE( seq.errors.size( ) == 1 );
+        REQUIRE( par.errors == seq.errors );
+        REQUIRE( par.errors[0] == "Type mismatch: INTEGER + BOOLEAN" );
+    }
+
+    SECTION( "What cannot be shared stays on the calling thread", "[3]" ) {
+
+        /// small, a builtin, a name that is not there
+        const char *local[] = {
+            "pmap(range(10), fn(x) { x })",
+            "pmap(pmap(xs, fn(x) { [x] }), len)",
+            "pmap(xs, fn(x) { missing })",
+        };
+        for( auto s: local ) {
+            auto seq = run<objects::value>( s, 0 );
+            auto par = run<objects::value>( s, 4 );
+            REQUIRE( par.value == seq.value );
+            REQUIRE( par.errors == seq.errors );
+        }
+        REQUIRE( run<objects::value>( local[0], 4 ).parallel == 0 );
+        REQUIRE( run<objects::value>( local[1], 4 ).parallel == 1 );
+        REQUIRE( run<objects::value>( local[2], 4 ).parallel == 0 );
+
+        /// a function of another engine has no code here
+        gc::heap heap;
+        engines::vm_engine<objects::value>   vm(heap);
+        engines::tree_engine<objects::value> tree(heap);
+        vm.set_parallel( 4, 64 );
+        auto foreign = parse( "fn(x) { x }" );
+        tree.load( foreign );
+        vm.context( ).globals( )->set( "foreign", tree.run( ) );
+        vm.load( parse( range + "len(pmap(xs, fn(x) { foreign }))" ) );
+        REQUIRE( vm.run( ).as_int( ) == 3000 );
+        REQUIRE( vm.parallel_runs( ) == 0 );
+    }
+}
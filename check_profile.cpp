@@ -0,0 +1,188 @@
+#include <string>
+#include <cstdint>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    using vm_type = engines::vm_engine<objects::value>;
+
+    std::string run( vm_type &vm, const std::string &input )
+    {
+        auto prog = parse( input );
+        vm.load( prog );
+        return objects::inspect( vm.run( ) );
+    }
+
+    const profile::function_row *find( const profile::report &rep,
+                                       const std::string &name )
+    {
+        for( auto &f: rep.functions ) {
+            if( f.name == name ) {
+                return &f;
+            }
+        }
+        return nullptr;
+    }
+
+    std::uint64_t line_count( const profile::report &rep, std::uint32_t line )
+    {
+        for( auto &l: rep.lines ) {
+            if( l.line == line ) {
+                return l.self.count;
+            }
+        }
+        return 0;
+    }
+
+    const std::string fib =
+        "let fib = fn(n) {\n"
+        "  if (n < 2) { return n; }\n"
+        "  fib(n - 1) + fib(n - 2)\n"
+        "};\n";
+
+    void host_tick( int ) { }
+}
+
+TEST_CASE( "profiler", "[profile]" ) {
+
+    SECTION( "Nodes know where they are", "[1]" ) {
+        auto prog = parse( "let a = 1;\n"
+                           "let f = fn(x) {\n"
+                           "  x + a\n"
+                           "};\n"
+                           "f(2)" );
+        REQUIRE( prog.states.size( ) == 3 );
+        REQUIRE( prog.states[0]->pos.line == 1 );
+        REQUIRE( prog.states[1]->pos.line == 2 );
+        REQUIRE( prog.states[2]->pos.line == 5 );
+
+        auto let = static_cast<ast::let_statement *>(prog.states[1].get( ));
+        auto fun = static_cast<ast::function_expression *>(let->expr.get( ));
+        REQUIRE( fun->pos.line == 2 );
+        REQUIRE( fun->pos.column == 9 );
+        REQUIRE( fun->info->name == "f" );
+        REQUIRE( fun->info->pos.line == 2 );
+
+        auto body = static_cast<ast::expr_statement *>(
+                                        fun->info->body[0].get( ));
+        /// an infix is at its operator
+        REQUIRE( body->expr->pos.line == 3 );
+        REQUIRE( body->expr->pos.column == 5 );
+
+        auto mod = bytecode::compiler::compile( prog );
+        for( auto &p: mod.protos ) {
+            REQUIRE( p.lines.size( ) == p.code.size( ) );
+        }
+        REQUIRE( mod.protos[1].lines.front( ) == 3 );
+    }
+
+    SECTION( "Instrumenting counts calls and lines", "[2]" ) {
+        for( bool peephole: { true, false } ) {
+            gc::heap heap;
+            vm_type vm(heap);
+            vm.set_peephole( peephole );
+            REQUIRE( vm.set_profiler( profile::mode::INSTRUMENT ) );
+            REQUIRE( run( vm, fib + "fib(10)" ) == "55" );
+
+            auto rep = vm.profile_report( );
+            REQUIRE( rep.mode == profile::mode::INSTRUMENT );
+
+            auto f = find( rep, "fib" );
+            REQUIRE( f != nullptr );
+            REQUIRE( f->calls == 177 );
+            REQUIRE( f->line == 1 );
+            REQUIRE( f->self.count > 177 );
+            auto m = find( rep, "main" );
+            REQUIRE( m != nullptr );
+            REQUIRE( m->calls == 1 );
+
+            /// every call runs the test, 88 of them go further
+            REQUIRE( line_count( rep, 2 ) >= 177 );
+            REQUIRE( line_count( rep, 3 ) >= 88 );
+            REQUIRE( line_count( rep, 5 ) > 0 );
+            REQUIRE( !rep.ops.empty( ) );
+
+            REQUIRE( rep.stacks.count( "main" ) == 1 );
+            REQUIRE( rep.stacks.count( "main;fib" ) == 1 );
+            REQUIRE( rep.stacks.count( "main;fib;fib;fib" ) == 1 );
+            auto folded = rep.folded( );
+            REQUIRE( folded.find( "main;fib;fib " ) != std::string::npos );
+            REQUIRE( rep.text( ).find( "fib" ) != std::string::npos );
+
+            /// off keeps what was collected, on starts again
+            REQUIRE( vm.set_profiler( profile::mode::OFF ) );
+            run( vm, "fib(5)" );
+            REQUIRE( find( vm.profile_report( ), "fib" )->calls == 177 );
+            vm.set_profiler( profile::mode::INSTRUMENT );
+            run( vm, "fib(5)" );
+            REQUIRE( find( vm.profile_report( ), "fib" )->calls == 15 );
+        }
+    }
+
+    SECTION( "Anonymous and builtin callers", "[3]" ) {
+        gc::heap heap;
+        vm_type vm(heap);
+        vm.set_profiler( profile::mode::INSTRUMENT );
+        REQUIRE( run( vm, "let xs = array(map([1, 2, 3],\n"
+                          "  fn(x) { x * 2 }));\n"
+                          "xs" ) == "[2, 4, 6]" );
+        auto rep = vm.profile_report( );
+        auto f   = find( rep, "fn@2" );
+        REQUIRE( f != nullptr );
+        REQUIRE( f->calls == 3 );
+        REQUIRE( rep.stacks.count( "main;fn@2" ) == 1 );
+    }
+
+    SECTION( "Sampling", "[4]" ) {
+        gc::heap heap;
+        vm_type vm(heap);
+        if( !vm.set_profiler( profile::mode::SAMPLE, 200 ) ) {
+            WARN( "no timer to sample with" );
+            return;
+        }
+        REQUIRE( run( vm, fib + "fib(24)" ) == "46368" );
+        vm.set_profiler( profile::mode::OFF );
+
+        auto rep = vm.profile_report( );
+        REQUIRE( rep.mode == profile::mode::SAMPLE );
+        REQUIRE( rep.samples > 0 );
+        auto f = find( rep, "fib" );
+        REQUIRE( f != nullptr );
+        REQUIRE( f->calls == 0 );
+
+        std::uint64_t total = 0;
+        for( auto &s: rep.stacks ) {
+            REQUIRE( s.first.find( "main" ) == 0 );
+            total += s.second;
+        }
+        REQUIRE( total == rep.samples );
+    }
+
+#if MICO_PROFILE_SIGNALS
+    SECTION( "The host's handler is put back", "[5]" ) {
+        struct sigaction host;
+        host.sa_handler = &host_tick;
+        sigemptyset( &host.sa_mask );
+        host.sa_flags = 0;
+        struct sigaction before;
+        REQUIRE( sigaction( SIGPROF, &host, &before ) == 0 );
+
+        gc::heap heap;
+        vm_type vm(heap);
+        if( vm.set_profiler( profile::mode::SAMPLE, 200 ) ) {
+            REQUIRE( run( vm, fib + "fib(10)" ) == "55" );
+            vm.set_profiler( profile::mode::OFF );
+        }
+
+        struct sigaction now;
+        REQUIRE( sigaction( SIGPROF, &before, &now ) == 0 );
+        REQUIRE( now.sa_handler == &host_tick );
+    }
+#endif
+}
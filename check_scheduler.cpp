@@ -0,0 +1,95 @@
+#include <string>
+#include <vector>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "scheduler.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const char *fib =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "fib(15)";
+
+    const char *spin = "let spin = fn(n) { spin(n + 1) }; spin(0)";
+}
+
+TEST_CASE( "scheduler", "[scheduler]" ) {
+
+    SECTION( "Endless scripts do not keep the others from running", "[1]" ) {
+
+        exec::scheduler sched(3, 500);
+        const std::size_t tasks = 40;
+        for( std::size_t i = 0; i < tasks; ++i ) {
+            sched.add( parse( ( i % 2 ) ? spin : fib ), 20000 );
+        }
+        sched.run( );
+
+        std::uint64_t fib_fuel = 0;
+        for( std::size_t i = 0; i < tasks; ++i ) {
+            auto &rep = sched.get( i );
+            REQUIRE( rep.slices > 1 );
+            if( i % 2 ) {
+                REQUIRE_FALSE( rep.done );
+                REQUIRE( rep.errors.size( ) == 1 );
+                REQUIRE( rep.fuel >= 20000 );
+            } else {
+                REQUIRE( rep.done );
+                REQUIRE( rep.value == "610" );
+                /// the same script burns the same fuel
+                fib_fuel = fib_fuel ? fib_fuel : rep.fuel;
+                REQUIRE( rep.fuel == fib_fuel );
+            }
+        }
+    }
+
+    SECTION( "Failed scripts report their errors", "[2]" ) {
+
+        exec::scheduler sched(2);
+        auto ok  = sched.add( parse( "1 + 2" ) );
+        auto bad = sched.add( parse( "let f = fn(x) { x }; f(1, 2)" ) );
+        sched.run( );
+        REQUIRE( sched.get( ok ).done );
+        REQUIRE( sched.get( ok ).value == "3" );
+        REQUIRE_FALSE( sched.get( bad ).done );
+        REQUIRE_FALSE( sched.get( bad ).errors.empty( ) );
+
+        /// tasks added later run on the next run; finished ones do not
+        auto late = sched.add( parse( fib ) );
+        sched.run( );
+        REQUIRE( sched.get( late ).value == "610" );
+        REQUIRE( sched.get( ok ).slices == 1 );
+    }
+
+    SECTION( "Callbacks burn fuel and are cut off", "[3]" ) {
+
+        /// a builtin cannot wait for the next slice, so no max_fuel is
+        /// needed: a callback that outlives the slice fails the task
+        exec::scheduler sched(2, 1000);
+        const char *endless[] = {
+            "let spin = fn(n) { spin(n + 1) }; "
+            "array(map([1], fn(x) { spin(x) }))",
+            "let spin = fn(n) { spin(n + 1) }; pmap([1], fn(x) { spin(x) })",
+            "reduce(range(0, 3000000), 0, fn(a, x) { a + x })",
+        };
+        std::vector<std::size_t> ids;
+        for( auto e: endless ) {
+            ids.push_back( sched.add( parse( e ) ) );
+        }
+        auto ok = sched.add( parse( "reduce([1, 2, 3], 0, fn(a, x) { a + x })" ) );
+        sched.run( );
+
+        for( auto id: ids ) {
+            auto &rep = sched.get( id );
+            REQUIRE_FALSE( rep.done );
+            REQUIRE( rep.errors.size( ) == 1 );
+            REQUIRE( rep.errors[0].find( "out of fuel in a callback" ) == 0 );
+            REQUIRE( rep.fuel < 1100 * rep.slices );
+        }
+        REQUIRE( sched.get( ok ).done );
+        REQUIRE( sched.get( ok ).value == "6" );
+    }
+}
@@ -0,0 +1,175 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "eval.h"
+#include "closure.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    /// fails for the element 'bad' only
+    const std::string picky =
+        "let picky = fn(bad) { fn(x) { if (x == bad) { x + true } "
+        "else { x } } }; ";
+
+    template <typename EvalT>
+    void check_scripts( )
+    {
+        runner<EvalT> r;
+        REQUIRE( r.run( "array(range(2, 6))" ) == "[2, 3, 4, 5]" );
+        REQUIRE( r.run( "array(range(6, 2))" ) == "[]" );
+        REQUIRE( r.run( "array(map(range(0, 4), fn(x) { x * x }))" )
+                 == "[0, 1, 4, 9]" );
+        REQUIRE( r.run( "array(filter([5, 1, 7, 2], fn(x) { x > 3 }))" )
+                 == "[5, 7]" );
+        REQUIRE( r.run( "array(map(map(range(0, 3), fn(x) { x + 1 }), "
+                        "fn(x) { [x] }))" ) == "[[1], [2], [3]]" );
+        REQUIRE( r.run( "reduce(filter(range(0, 10), fn(x) { x / 2 * 2 == x }),"
+                        " 100, fn(a, b) { a - b })" ) == "80" );
+        REQUIRE( r.run( "reduce([], 7, fn(a, b) { a + b })" ) == "7" );
+        REQUIRE( r.run( "array(map([\"a\", \"bc\"], len))" ) == "[1, 2]" );
+        REQUIRE( r.run( "let s = filter(range(0, 10), fn(x) { x > 6 }); "
+                        "[len(s), s[0], s[5], first(s), last(s), rest(s)]" )
+                 == "[3, 7, null, 7, 9, [8, 9]]" );
+        REQUIRE( r.run( "push(range(0, 2), 5)" ) == "[0, 1, 5]" );
+        REQUIRE( r.run( "pmap(range(0, 3), fn(x) { x * 2 })" ) == "[0, 2, 4]" );
+        REQUIRE( r.run( "range(0, 3)" ) == "<sequence>" );
+
+        /// nothing past what is asked for runs
+        REQUIRE( r.run( picky + "first(map(range(0, 10), picky(5)))" ) == "0" );
+        REQUIRE( r.run( picky + "first(filter(map(range(0, 10), picky(5)), "
+                                "fn(x) { x > 3 }))" ) == "4" );
+        REQUIRE( r.run( picky + "len(map(range(0, 10), picky(5)))" ) == "10" );
+        REQUIRE( r.run( picky + "array(map(range(0, 10), picky(5)))" )
+                 == "error" );
+        REQUIRE( r.run( picky + "len(filter(range(0, 10), picky(5)))" )
+                 == "error" );
+        REQUIRE( r.run( picky + "map(range(0, 10), picky(5))[1]" ) == "error" );
+
+        REQUIRE( r.run( "range(0, true)" ) == "error" );
+        REQUIRE( r.run( "map(1, len)" ) == "error" );
+        REQUIRE( r.run( "filter([1], 2)" ) == "error" );
+        REQUIRE( r.run( "array(\"abc\")" ) == "error" );
+        REQUIRE( r.run( "reduce(range(0, 3), 0)" ) == "error" );
+        REQUIRE( r.run( "rest(map(range(0, 3), fn(a, b) { a }))" ) == "error" );
+    }
+}
+
+TEST_CASE( "lazy sequences", "[sequence]" ) {
+
+    SECTION( "Pipelines with tagged and boxed values", "[1]" ) {
+        check_scripts<eval::tagged_evaluator>( );
+        check_scripts<eval::evaluator<objects::boxed_value> >( );
+    }
+
+    SECTION( "Elements are made once and kept", "[2]" ) {
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        auto prog = parse( "let s = map(range(0, 100), fn(x) { [x] }); "
+                           "[s[3] == s[3], array(s) == array(s), s[99]]" );
+        REQUIRE( objects::inspect( evaluator.eval( prog ) )
+                 == "[true, true, [99]]" );
+
+        /// a stage over a sequence with a cache starts from the cache
+        prog = parse( "let t = map(s, fn(v) { v }); t[0] == s[0]" );
+        REQUIRE( evaluator.eval( prog ).as_bool( ) );
+    }
+
+    SECTION( "A pipeline makes no array of its own", "[3]" ) {
+
+        const std::string stages =
+            "let xs = map(filter(map(range(0, 20000), fn(x) { x * 3 }), "
+            "fn(x) { x / 2 * 2 == x }), fn(x) { x + 1 }); ";
+
+        gc::heap lazy;
+        eval::tagged_evaluator evaluator(lazy);
+        auto prog = parse( stages + "reduce(xs, 0, fn(a, b) { a + b })" );
+        REQUIRE( evaluator.eval( prog ).as_int( ) == 299980000 );
+        REQUIRE( lazy.get_stats( ).allocations < 100 );
+
+        /// an array holds every element once
+        gc::heap eager;
+        eval::tagged_evaluator other(eager);
+        prog = parse( stages + "len(array(xs))" );
+        REQUIRE( other.eval( prog ).as_int( ) == 10000 );
+        REQUIRE( eager.get_stats( ).allocations > 10000 / 32 );
+    }
+
+    SECTION( "Engines agree", "[4]" ) {
+
+        const char *scripts[] = {
+            "array(map(filter(range(0, 50), fn(x) { x / 3 * 3 == x }), "
+            "fn(x) { fn(y) { x + y } }))[4](1)",
+            "let k = 2; reduce(map(range(0, 10), fn(x) { x * k }), 0, "
+            "fn(a, b) { a + b })",
+            "let s = filter(range(0, 10), fn(x) { x > 6 }); [s[1], len(s)]",
+        };
+        for( auto s: scripts ) {
+            gc::heap heap;
+            eval::tagged_evaluator tree(heap);
+            engines::closure_engine<objects::value> closures(heap);
+            engines::vm_engine<objects::value>      vm(heap);
+
+            auto prog     = parse( s );
+            auto expected = objects::inspect( tree.eval( prog ) );
+            closures.load( prog );
+            REQUIRE( objects::inspect( closures.run( ) ) == expected );
+            vm.load( prog );
+            REQUIRE( objects::inspect( vm.run( ) ) == expected );
+        }
+    }
+
+    SECTION( "Stages survive both collectors", "[5]" ) {
+
+        for( auto mode: { gc::mode::THROUGHPUT, gc::mode::INCREMENTAL } ) {
+
+            gc::config conf;
+            conf.collection        = mode;
+            conf.initial_threshold = 16 * 1024;
+            conf.min_threshold     = 16 * 1024;
+            conf.step_bytes        = 1024;
+            gc::heap heap(conf);
+
+            engines::vm_engine<objects::value> vm(heap);
+            auto prog = parse(
+                "let s = map(filter(range(0, 3000), fn(x) { let t = [x]; "
+                "t[0] / 2 * 2 == x }), fn(x) { [x, \"n\" + \"-\"] }); "
+                "let all = array(s); "
+                "[len(all), all[0], s[1499], reduce(map(all, len), 0, "
+                "fn(a, b) { a + b })]" );
+            vm.load( prog );
+            REQUIRE( objects::inspect( vm.run( ) )
+                     == "[1500, [0, \"n-\"], [2998, \"n-\"], 3000]" );
+            REQUIRE( heap.get_stats( ).collections > 0 );
+        }
+    }
+
+    SECTION( "Stages burn the fuel of the run", "[6]" ) {
+
+        using status = engines::vm_engine<objects::value>::status;
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+
+        vm.load( parse( "reduce(map(range(0, 100), fn(x) { x * 2 }), 0, "
+                        "fn(a, b) { a + b })" ) );
+        REQUIRE( vm.start( 1000000 ) == status::DONE );
+        REQUIRE( objects::inspect( vm.result( ) ) == "9900" );
+        /// the 200 calls and what their bodies run are paid for
+        REQUIRE( vm.fuel_used( ) > 2 * 200 );
+
+        vm.load( parse( "reduce(range(0, 3000000), 0, fn(a, x) { a + x })" ) );
+        REQUIRE( vm.start( 1000 ) == status::FAILED );
+        REQUIRE( vm.fuel_used( ) < 1100 );
+        REQUIRE( vm.errors_.size( ) == 1 );
+        REQUIRE( vm.errors_[0].find( "out of fuel in a callback" ) == 0 );
+
+        /// without fuel the same pipeline runs to the end
+        vm.load( parse( "reduce(range(0, 3000), 0, fn(a, x) { a + x })" ) );
+        REQUIRE( objects::inspect( vm.run( ) ) == "4498500" );
+    }
+}
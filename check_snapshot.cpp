@@ -0,0 +1,251 @@
+#include <string>
+#include <cstdio>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "vm.h"
+#include "image.h"
+#include "snapshot.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    /// functions, closures over cells, a closure that reaches itself,
+    /// shared vectors, hashes, ropes, literals and big numbers
+    const char *prelude =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "let adder = fn(x) { fn(y) { x + y } }; "
+        "let add5 = adder(5); "
+        "let late = fn() { let x = 1; let g = fn() { x }; let x = 40; g }(); "
+        "let counter = fn() { let down = fn(n) { if (n == 0) { \"done\" } "
+        "else { down(n - 1) } }; down }(); "
+        "let v = [1, [2, 3], \"lit\"]; "
+        "let shared = [v, v]; "
+        "let h = {\"a\": 1, 2: [fib], true: \"yes\"}; "
+        "let rope = \"ab\" + \"cd\" + \"ef\"; "
+        "let big = 0x7FFFFFFFFFFFFFFF; "
+        "let nothing = if (false) { 1 }; "
+        "let first_of = first; ";
+
+    const char *script =
+        "[fib(10), add5(2), late(), counter(100), shared[1][1][1], "
+        "h[\"a\"], h[2][0](7), h[true], rope, len(rope), big, nothing, "
+        "first_of(v), rest(v), \"lit\" == v[2]]";
+
+    template <typename ValueT>
+    std::string run( engines::vm_engine<ValueT> &vm, const std::string &input )
+    {
+        auto prog = parse( input );
+        vm.load( prog );
+        auto res = objects::inspect( vm.run( ) );
+        return vm.errors_.empty( ) ? res : "error";
+    }
+
+    template <typename ValueT>
+    void check_restore( )
+    {
+        gc::heap heap;
+        engines::vm_engine<ValueT> warm(heap);
+        run( warm, prelude );
+        std::string err;
+        auto bytes = warm.save_snapshot( err );
+        REQUIRE( err.empty( ) );
+        REQUIRE_FALSE( bytes.empty( ) );
+
+        /// another heap, so nothing can be shared by accident
+        gc::heap other;
+        engines::vm_engine<ValueT> restored(other);
+        REQUIRE( restored.load_snapshot( bytes.data( ), bytes.size( ), err ) );
+        other.collect( );
+
+        auto expect = run( warm, script );
+        REQUIRE( expect != "error" );
+        REQUIRE( run( restored, script ) == expect );
+
+        /// and can be saved again
+        REQUIRE( restored.save_snapshot( err ).size( ) > 0 );
+    }
+}
+
+TEST_CASE( "heap snapshots", "[snapshot]" ) {
+
+    SECTION( "A restored engine has the globals of the saved one", "[1]" ) {
+        check_restore<objects::value>( );
+        check_restore<objects::boxed_value>( );
+    }
+
+    SECTION( "Programs from images and files are restored", "[2]" ) {
+
+        std::string err;
+        auto hash = image::hash( prelude );
+        auto img  = image::file::from_bytes(
+                        image::writer::write( parse( prelude ), hash ),
+                        hash, err );
+        REQUIRE( img );
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> warm(heap);
+        warm.load( img );
+        warm.run( );
+        REQUIRE( warm.save_snapshot( "check_snapshot.tmp", err ) );
+
+        engines::vm_engine<objects::value> restored(heap);
+        REQUIRE( restored.load_snapshot( "check_snapshot.tmp", err ) );
+        std::remove( "check_snapshot.tmp" );
+        REQUIRE( run( restored, script ) == run( warm, script ) );
+
+        REQUIRE_FALSE( restored.load_snapshot( "check_snapshot.tmp", err ) );
+    }
+
+    SECTION( "Damaged snapshots are refused", "[3]" ) {
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> warm(heap);
+        run( warm, prelude );
+        std::string err;
+        auto bytes = warm.save_snapshot( err );
+
+        engines::vm_engine<objects::value> vm(heap);
+        REQUIRE_FALSE( vm.load_snapshot( bytes.data( ), 3, err ) );
+        REQUIRE( err == "not a snapshot" );
+
+        auto flipped = bytes;
+        flipped[flipped.size( ) / 2] ^= 0x40;
+        REQUIRE_FALSE( vm.load_snapshot( flipped.data( ), flipped.size( ), err ) );
+        REQUIRE( err == "damaged snapshot" );
+
+        auto cut = bytes.substr( 0, bytes.size( ) - 1 );
+        REQUIRE_FALSE( vm.load_snapshot( cut.data( ), cut.size( ), err ) );
+
+        auto newer = bytes;
+        newer[8] = 2;
+        REQUIRE_FALSE( vm.load_snapshot( newer.data( ), newer.size( ), err ) );
+        REQUIRE( err == "snapshot of another version or byte order" );
+
+        /// nothing was set
+        REQUIRE( run( vm, "fib" ) == "error" );
+    }
+
+    SECTION( "Records that do not fit together are refused", "[4]" ) {
+
+        namespace snap = snapshot;
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        std::string err;
+
+        auto load = [&]( const std::vector<snap::object_rec> &objects ) -> bool {
+            snap::writer out;
+            out.u64( 0 );
+            out.u64( objects.size( ) );
+            for( auto &o: objects ) {
+                out.object( o );
+            }
+            snap::value_rec ref;
+            ref.tag = snap::value_tag::OBJECT;
+            out.u64( 1 );
+            out.str( "x" );
+            out.value( ref );
+            auto bytes = out.finish( );
+            return vm.load_snapshot( bytes.data( ), bytes.size( ), err );
+        };
+
+        snap::value_rec self;
+        self.tag = snap::value_tag::OBJECT;
+
+        snap::object_rec vec;
+        vec.tag = snap::object_tag::VECTOR;
+        REQUIRE( load( { vec } ) );
+        REQUIRE( run( vm, "x" ) == "[]" );
+
+        /// a vector cannot hold itself
+        vec.values.push_back( self );
+        REQUIRE_FALSE( load( { vec } ) );
+
+        snap::object_rec fn;
+        fn.tag = snap::object_tag::FUNCTION;
+        REQUIRE_FALSE( load( { fn } ) );
+
+        snap::object_rec hash;
+        hash.tag = snap::object_tag::HASH;
+        hash.values.push_back( snap::value_rec( ) );
+        hash.values.push_back( snap::value_rec( ) );
+        REQUIRE_FALSE( load( { hash } ) );
+
+        snap::object_rec bad;
+        bad.tag = static_cast<snap::object_tag>(100);
+        REQUIRE_FALSE( load( { bad } ) );
+        REQUIRE( err == "damaged snapshot" );
+    }
+
+    SECTION( "A refused snapshot leaves the engine as it was", "[5]" ) {
+
+        namespace snap = snapshot;
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        REQUIRE( run( vm, "let x = 7; x" ) == "7" );
+        std::string err;
+
+        /// the prelude as code, then a record the code does not have
+        auto load = [&]( const snap::object_rec &rec ) -> bool {
+            snap::writer out;
+            out.u64( 1 );
+            out.u64( 0 );
+            out.str( image::writer::write( parse( prelude ), 0 ) );
+            out.u64( 1 );
+            out.object( rec );
+            out.u64( 0 );
+            auto bytes = out.finish( );
+            return vm.load_snapshot( bytes.data( ), bytes.size( ), err );
+        };
+
+        snap::object_rec fn;
+        fn.tag = snap::object_tag::FUNCTION;
+        fn.b   = 1000;
+        REQUIRE_FALSE( load( fn ) );
+        REQUIRE( err == "damaged snapshot" );
+        REQUIRE( objects::inspect( vm.run( ) ) == "7" );
+
+        snap::value_rec self;
+        self.tag = snap::value_tag::OBJECT;
+        snap::object_rec vec;
+        vec.tag = snap::object_tag::VECTOR;
+        vec.values.push_back( self );
+        REQUIRE_FALSE( load( vec ) );
+        REQUIRE( objects::inspect( vm.run( ) ) == "7" );
+        REQUIRE( run( vm, "fib" ) == "error" );
+    }
+
+    SECTION( "Bound functions are found by name", "[6]" ) {
+
+        auto twice = +[ ]( std::int64_t x ) { return 2 * x; };
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> warm(heap);
+        warm.bind( "twice", twice );
+        run( warm, "let y = twice(4); let all = [twice, len];" );
+        std::string err;
+        auto bytes = warm.save_snapshot( err );
+        REQUIRE_FALSE( bytes.empty( ) );
+
+        engines::vm_engine<objects::value> restored(heap);
+        restored.bind( "other", +[ ]( std::int64_t x ) { return x; } );
+        restored.bind( "twice", twice );
+        REQUIRE( restored.load_snapshot( bytes.data( ), bytes.size( ), err ) );
+        REQUIRE( run( restored, "[y, all[0](5), twice(1), other(3)]" )
+                    == "[8, 10, 2, 3]" );
+
+        /// 'all' reaches a native this engine does not have
+        engines::vm_engine<objects::value> plain(heap);
+        REQUIRE_FALSE( plain.load_snapshot( bytes.data( ), bytes.size( ), err ) );
+        REQUIRE( err == "damaged snapshot" );
+
+        engines::vm_engine<objects::value> bare(heap);
+        bare.bind( "twice", twice );
+        run( bare, "let z = 1;" );
+        bytes = bare.save_snapshot( err );
+        REQUIRE( plain.load_snapshot( bytes.data( ), bytes.size( ), err ) );
+        REQUIRE( run( plain, "z" ) == "1" );
+    }
+}
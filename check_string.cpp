@@ -0,0 +1,133 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "eval.h"
+#include "closure.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    /// 'let s = s + "..."' n times; long enough to build ropes
+    std::string growing( int n )
+    {
+        std::string res = "let s = \"\"; ";
+        for( int i = 0; i < n; ++i ) {
+            res += "let s = s + \"0123456789\"; ";
+        }
+        return res;
+    }
+
+    template <typename EvalT>
+    void check_scripts( )
+    {
+        runner<EvalT> r;
+        REQUIRE( r.run( "\"ab\" + \"cd\"" ) == "\"abcd\"" );
+        REQUIRE( r.run( "\"ab\" + \"cd\" == \"abcd\"" ) == "true" );
+        REQUIRE( r.run( "\"ab\" != \"ab\"" ) == "false" );
+        REQUIRE( r.run( "\"ab\" == \"ba\"" ) == "false" );
+        REQUIRE( r.run( "\"abc\"[1]" ) == "\"b\"" );
+        REQUIRE( r.run( "[\"abc\"[3], \"abc\"[-1]]" ) == "[null, null]" );
+        REQUIRE( r.run( "len(\"\" + \"abc\")" ) == "3" );
+        REQUIRE( r.run( "\"a\" - \"b\"" ) == "error" );
+        REQUIRE( r.run( "\"a\" + 1" ) == "error" );
+
+        r.run( growing( 100 ) );
+        REQUIRE( r.run( "len(s)" ) == "1000" );
+        REQUIRE( r.run( "s[995]" ) == "\"5\"" );
+        REQUIRE( r.run( "let h = {s: 1}; h[s + \"\"]" ) == "1" );
+        REQUIRE( r.run( "s == s + \"x\"" ) == "false" );
+    }
+}
+
+TEST_CASE( "strings", "[string]" ) {
+
+    SECTION( "Concatenation, comparison and indexing", "[1]" ) {
+        check_scripts<eval::tagged_evaluator>( );
+        check_scripts<eval::boxed_evaluator>( );
+    }
+
+    SECTION( "Long concatenations are ropes until read", "[2]" ) {
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        auto prog = parse( growing( 10 ) + "s" );
+        auto res  = evaluator.eval( prog );
+        auto str  = static_cast<objects::string *>(res.as_object( ));
+
+        REQUIRE( str->is_rope( ) );
+        REQUIRE( str->size( ) == 100 );
+        REQUIRE( str->is_rope( ) );
+
+        auto copy = heap.make<objects::string>( str->str( ) );
+        REQUIRE_FALSE( str->is_rope( ) );
+        REQUIRE( str->equal( copy ) );
+        REQUIRE( str->hash( ) == copy->hash( ) );
+    }
+
+    SECTION( "Short concatenations are copied", "[3]" ) {
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        auto prog = parse( "\"ab\" + \"cd\"" );
+        auto res  = evaluator.eval( prog );
+        REQUIRE_FALSE(
+            static_cast<objects::string *>(res.as_object( ))->is_rope( ) );
+    }
+
+    SECTION( "Literals are interned once per runtime", "[4]" ) {
+
+        gc::heap heap;
+        eval::tagged_evaluator evaluator(heap);
+        auto prog = parse( "let a = \"lit\"; let b = \"lit\"; [a, b]" );
+        auto res  = evaluator.eval( prog );
+        auto vec  = static_cast<objects::vector *>(res.as_object( ));
+        REQUIRE( vec->get( 0 ).as_object( ) == vec->get( 1 ).as_object( ) );
+
+        auto again = evaluator.eval( prog );
+        auto vec2  = static_cast<objects::vector *>(again.as_object( ));
+        REQUIRE( vec2->get( 0 ).as_object( ) == vec->get( 0 ).as_object( ) );
+        REQUIRE( static_cast<objects::string *>(
+                    vec->get( 0 ).as_object( ) )->interned );
+
+        engines::closure_engine<objects::value> closures(heap);
+        closures.load( prog );
+        auto run1 = closures.run( );
+        auto run2 = closures.run( );
+        REQUIRE( static_cast<objects::vector *>(run1.as_object( ))
+                    ->get( 1 ).as_object( )
+              == static_cast<objects::vector *>(run2.as_object( ))
+                    ->get( 0 ).as_object( ) );
+    }
+
+    SECTION( "Deep ropes survive both collectors", "[5]" ) {
+
+        for( auto mode: { gc::mode::THROUGHPUT, gc::mode::INCREMENTAL } ) {
+
+            gc::config conf;
+            conf.collection        = mode;
+            conf.initial_threshold = 16 * 1024;
+            conf.min_threshold     = 16 * 1024;
+            conf.step_bytes        = 1024;
+            gc::heap heap(conf);
+
+            eval::tagged_evaluator evaluator(heap);
+            auto prog = parse( growing( 3000 ) + "len(s)" );
+            REQUIRE( evaluator.eval( prog ).as_int( ) == 30000 );
+            REQUIRE( heap.get_stats( ).collections > 0 );
+
+            prog = parse( "s" );
+            auto str = static_cast<objects::string *>(
+                            evaluator.eval( prog ).as_object( ) );
+            heap.collect( );
+            REQUIRE( str->is_rope( ) );
+            auto &flat = str->str( );
+            REQUIRE( flat.size( ) == 30000 );
+            for( std::size_t i = 0; i < flat.size( ); ++i ) {
+                REQUIRE( flat[i] == static_cast<char>('0' + i % 10) );
+            }
+        }
+    }
+}
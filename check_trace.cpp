@@ -0,0 +1,130 @@
+#include <string>
+#include <cstdint>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "vm.h"
+#include "closure.h"
+#include "trace.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const std::string script =
+        "let greet = fn(name) { \"hello, \" + name + \"! how are you?\" };\n"
+        "let add = fn(a, b) { a + b };\n"
+        "let xs = [1, 2, 3, add(4, 5)];\n"
+        "len(greet(\"monkey\")) + xs[3]\n";
+
+    std::string run( const std::string &input )
+    {
+        auto prog = parse( input );
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        vm.load( prog );
+        return objects::inspect( vm.run( ) );
+    }
+}
+
+TEST_CASE( "trace", "[trace]" ) {
+
+    SECTION( "Every phase of a script is recorded once", "[1]" ) {
+        trace::recorder rec;
+        {
+            trace::session s(rec);
+            REQUIRE( run( script ) == "36" );
+        }
+        auto &st = rec.stats( );
+        for( std::size_t i = 0; i < trace::phase_count; ++i ) {
+            REQUIRE( st.phases[i].calls == 1 );
+        }
+        REQUIRE( rec.events( ).size( ) == trace::phase_count );
+        REQUIRE( rec.events( )[0].phase == trace::phase::TABLE );
+        REQUIRE( rec.events( ).back( ).phase == trace::phase::EXECUTE );
+        for( std::size_t i = 1; i < rec.events( ).size( ); ++i ) {
+            auto &prev = rec.events( )[i - 1];
+            REQUIRE( rec.events( )[i].start >= prev.start + prev.nanos );
+        }
+    }
+
+    SECTION( "Tokens and nodes are counted in their phases", "[2]" ) {
+        trace::recorder rec;
+        {
+            trace::session s(rec);
+            run( script );
+        }
+        auto &st = rec.stats( );
+        REQUIRE( st[trace::phase::LEX].allocations > 0 );
+        /// the list and the literal that is longer than a small string
+        REQUIRE( st[trace::phase::LEX].bytes
+                 > 20 * sizeof(lexer::tokens::info) );
+        REQUIRE( st[trace::phase::PARSE].allocations > 20 );
+        REQUIRE( st[trace::phase::PARSE].bytes
+                 >= st[trace::phase::PARSE].allocations
+                  * sizeof(ast::node) );
+        REQUIRE( st[trace::phase::TABLE].allocations == 0 );
+        REQUIRE( st[trace::phase::EXECUTE].allocations == 0 );
+    }
+
+    SECTION( "Nothing is recorded without a session", "[3]" ) {
+        trace::recorder outer;
+        trace::recorder inner;
+        {
+            trace::session s(outer);
+            {
+                trace::session s2(inner);
+                run( "1 + 2" );
+            }
+            auto tt = lexer::tokens::all( );
+            (void)tt;
+        }
+        run( "3 + 4" );
+        REQUIRE( inner.events( ).size( ) == trace::phase_count );
+        REQUIRE( outer.events( ).size( ) == 1 );
+        REQUIRE( outer.stats( )[trace::phase::TABLE].calls == 1 );
+        REQUIRE( trace::current( ) == nullptr );
+    }
+
+    SECTION( "Nested phases count in their parent", "[4]" ) {
+        trace::recorder rec;
+        trace::session s(rec);
+        {
+            trace::scope outer(trace::phase::EXECUTE);
+            run( "1" );
+        }
+        auto &evs = rec.events( );
+        REQUIRE( evs.back( ).phase == trace::phase::EXECUTE );
+        REQUIRE( evs.back( ).depth == 0 );
+        REQUIRE( evs[0].depth == 1 );
+        REQUIRE( evs.back( ).counts.allocations
+                 >= rec.stats( )[trace::phase::PARSE].allocations );
+        REQUIRE( rec.stats( )[trace::phase::EXECUTE].calls == 2 );
+    }
+
+    SECTION( "Closure engine phases and the chrome trace", "[5]" ) {
+        auto prog = parse( "let f = fn(x) { x * 2 }; f(21)" );
+        trace::recorder rec;
+        trace::session s(rec);
+        gc::heap heap;
+        engines::closure_engine<objects::value> eng(heap);
+        eng.load( prog );
+        REQUIRE( objects::inspect( eng.run( ) ) == "42" );
+        REQUIRE( rec.events( ).size( ) == 2 );
+
+        auto json = rec.chrome_json( 7, 3 );
+        REQUIRE( json.find( "{\"traceEvents\": [" ) == 0 );
+        REQUIRE( json.find( "\"name\": \"compile\"" ) != std::string::npos );
+        REQUIRE( json.find( "\"name\": \"execute\"" ) != std::string::npos );
+        REQUIRE( json.find( "\"ph\": \"X\"" ) != std::string::npos );
+        REQUIRE( json.find( "\"pid\": 7, \"tid\": 3" ) != std::string::npos );
+
+        rec.keep_events( false );
+        eng.run( );
+        REQUIRE( rec.events( ).size( ) == 2 );
+        REQUIRE( rec.stats( )[trace::phase::EXECUTE].calls == 2 );
+        rec.clear( );
+        REQUIRE( rec.stats( )[trace::phase::EXECUTE].calls == 0 );
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef CHECK_UTIL_H
+#define CHECK_UTIL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "catch/catch.hpp"
+#include "parser.h"
+#include "objects.h"
+#include "gc.h"
+
+namespace mico { namespace check {
+
+    /// what the checks share
+
+    inline
+    parser::program parse( const std::string &input,
+                           std::vector<std::string> &errors )
+    {
+        auto tt  = lexer::tokens::all( );
+        auto lst = lexer::tokens::get_list( tt, input.begin( ), input.end( ) );
+        parser::token_reader reader(std::move(lst));
+        auto prog = reader.parse( );
+        errors = reader.errors_;
+        return prog;
+    }
+
+    inline
+    parser::program parse( const std::string &input )
+    {
+        std::vector<std::string> errors;
+        return parse( input, errors );
+    }
+
+    /// an evaluator with a heap of its own
+    template <typename EvalT>
+    struct runner {
+
+        runner( )
+            :evaluator(heap)
+        { }
+
+        typename EvalT::value eval( const std::string &input )
+        {
+            auto prog = parse( input, parse_errors );
+            return evaluator.eval( prog );
+        }
+
+        /// the result as the repl shows it, "error" if the script failed
+        std::string run( const std::string &input )
+        {
+            auto res = objects::inspect( eval( input ) );
+            return !evaluator.errors_.empty( ) ? "error" : res;
+        }
+
+        std::int64_t run_int( const std::string &input )
+        {
+            auto res = eval( input );
+            REQUIRE( res.is_int( ) );
+            return res.as_int( );
+        }
+
+        bool run_bool( const std::string &input )
+        {
+            auto res = eval( input );
+            REQUIRE( res.is_bool( ) );
+            return res.as_bool( );
+        }
+
+        gc::heap                 heap;
+        EvalT                    evaluator;
+        std::vector<std::string> parse_errors;
+    };
+
+}}
+
+#endif // CHECK_UTIL_H
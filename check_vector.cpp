@@ -0,0 +1,145 @@
+#include <vector>
+
+#include "catch/catch.hpp"
+#include "vector.h"
+
+using namespace mico;
+
+namespace {
+
+    using value = objects::value;
+    using ops   = objects::vector_ops;
+
+    objects::vector *build( gc::heap &heap, std::size_t n )
+    {
+        auto vec = ops::make( heap );
+        for( std::size_t i = 0; i < n; ++i ) {
+            vec = ops::push( heap, vec,
+                             value::from_int( static_cast<std::int64_t>(i) ) );
+        }
+        return vec;
+    }
+
+    bool holds_range( const objects::vector *vec, std::size_t n )
+    {
+        if( vec->size( ) != n ) {
+            return false;
+        }
+        for( std::size_t i = 0; i < n; ++i ) {
+            if( vec->get( i ).as_int( ) != static_cast<std::int64_t>(i) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+TEST_CASE( "persistent vector", "[vector]" ) {
+
+    gc::config conf;
+    conf.initial_threshold = 1024 * 1024 * 1024;
+    gc::heap heap(conf);
+
+    SECTION( "Elements survive growing the trie", "[1]" ) {
+
+        /// 32 * 32 + 32 moves a second level in
+        for( std::size_t n: { 0, 1, 31, 32, 33, 64, 1056, 1057, 40000 } ) {
+            REQUIRE( holds_range( build( heap, n ), n ) );
+        }
+    }
+
+    SECTION( "Older versions do not change", "[2]" ) {
+
+        for( std::size_t n: { 5, 32, 1024, 1056, 2000 } ) {
+            auto base = build( heap, n );
+            auto a = ops::push( heap, base, value::from_int( -1 ) );
+            auto b = ops::push( heap, base, value::from_int( -2 ) );
+            auto c = ops::push( heap, a, value::from_int( -3 ) );
+
+            REQUIRE( holds_range( base, n ) );
+            REQUIRE( a->size( ) == n + 1 );
+            REQUIRE( a->get( n ).as_int( ) == -1 );
+            REQUIRE( b->get( n ).as_int( ) == -2 );
+            REQUIRE( c->get( n ).as_int( ) == -1 );
+            REQUIRE( c->get( n + 1 ).as_int( ) == -3 );
+
+            for( std::size_t i = 0; i < 40; ++i ) {
+                b = ops::push( heap, b, value::from_int( -2 ) );
+            }
+            REQUIRE( a->get( n ).as_int( ) == -1 );
+            REQUIRE( c->get( n + 1 ).as_int( ) == -3 );
+            REQUIRE( holds_range( base, n ) );
+        }
+    }
+
+    SECTION( "Accumulating does not copy", "[3]" ) {
+
+        auto before = heap.get_stats( ).allocations;
+        build( heap, 10000 );
+        auto made = heap.get_stats( ).allocations - before;
+
+        /// one header per push, one leaf per 32 elements and the branches
+        REQUIRE( made < 10000 + 10000 / 16 );
+    }
+
+    SECTION( "Rest shares the elements", "[4]" ) {
+
+        auto vec  = build( heap, 100 );
+        auto tail = vec;
+        for( int i = 0; i < 99; ++i ) {
+            tail = ops::rest( heap, tail );
+        }
+        REQUIRE( tail->size( ) == 1 );
+        REQUIRE( tail->get( 0 ).as_int( ) == 99 );
+
+        tail = ops::push( heap, ops::rest( heap, tail ), value::from_int( 7 ) );
+        REQUIRE( tail->size( ) == 1 );
+        REQUIRE( tail->get( 0 ).as_int( ) == 7 );
+        REQUIRE( ops::rest( heap, ops::rest( heap, tail ) ) == nullptr );
+        REQUIRE( holds_range( vec, 100 ) );
+    }
+}
+
+TEST_CASE( "persistent vector and the collector", "[vector]" ) {
+
+    for( auto mode: { gc::mode::THROUGHPUT, gc::mode::INCREMENTAL } ) {
+
+        gc::config conf;
+        conf.collection        = mode;
+        conf.initial_threshold = 16 * 1024;
+        conf.min_threshold     = 16 * 1024;
+        conf.step_bytes        = 1024;
+        gc::heap heap(conf);
+
+        gc::value_stack stack;
+        heap.add_root( &stack );
+
+        stack.push( value::from_object( ops::make( heap ) ) );
+        auto other = ops::make( heap );
+        stack.push( value::from_object( other ) );
+
+        for( int i = 0; i < 5000; ++i ) {
+            auto str = heap.make<objects::string>( std::to_string( i ) );
+            stack.push( value::from_object( str ) );
+            auto vec = static_cast<objects::vector *>(
+                                    stack.values[0].as_object( ) );
+            stack.values[0] = value::from_object(
+                                    ops::push( heap, vec, stack.top( ) ) );
+            stack.pop( );
+            /// garbage versions that share nodes with the live one
+            ops::push( heap, vec, value::null( ) );
+        }
+
+        REQUIRE( heap.get_stats( ).collections > 0 );
+
+        heap.collect( );
+        auto vec = static_cast<objects::vector *>( stack.values[0].as_object( ) );
+        REQUIRE( vec->size( ) == 5000 );
+        for( int i = 0; i < 5000; ++i ) {
+            auto str = static_cast<objects::string *>(
+                                    vec->get( i ).as_object( ) );
+            REQUIRE( str->str( ) == std::to_string( i ) );
+        }
+        heap.remove_root( &stack );
+    }
+}
@@ -0,0 +1,241 @@
+#include <string>
+
+#include "catch/catch.hpp"
+#include "check_util.h"
+#include "engine.h"
+#include "vm.h"
+
+using namespace mico;
+using namespace mico::check;
+
+namespace {
+
+    const char *fib =
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "fib(15)";
+
+    const char *scripts[] = {
+        fib,
+        "let f = fn(a, b) { let c = a + b; c * 2 }; f(1, 2)",
+        "let g = 1; let g = g + 1; g",
+        "let f = fn(x) { if (!(x == 0)) { 1 } else { 2 } }; [f(0), f(5)]",
+        "let f = fn(x) { x; 7 }; f(1)",
+        "let f = fn(x) { if (x > 1) { if (x > 2) { 3 } else { 2 } } "
+        "else { 1 } }; [f(1), f(2), f(3)]",
+        "let f = fn(x) { if (x == \"a\") { 1 } else { 2 } }; [f(\"a\"), f(\"b\")]",
+        "let f = fn(x) { x < \"a\" }; f(1)",
+        "let f = fn(x) { x + 1 }; f(\"a\")",
+        "let count = fn(n, acc) { if (n == 0) { return acc; } "
+        "count(n - 1, acc + 1) }; count(1000, 0)",
+    };
+
+    template <typename ValueT>
+    std::string run( engines::vm_engine<ValueT> &vm, const std::string &input )
+    {
+        auto prog = parse( input );
+        vm.load( prog );
+        auto res = objects::inspect( vm.run( ) );
+        return vm.errors_.empty( ) ? res : "error";
+    }
+
+    template <typename ValueT>
+    void check_peephole( )
+    {
+        gc::heap heap;
+        engines::vm_engine<ValueT> plain(heap);
+        engines::vm_engine<ValueT> fused(heap);
+        plain.set_peephole( false );
+        for( auto s: scripts ) {
+            REQUIRE( run( plain, s ) == run( fused, s ) );
+        }
+    }
+
+    bool has( const bytecode::proto &p, bytecode::opcode op )
+    {
+        for( auto &ins: p.code ) {
+            if( ins.op == op ) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+TEST_CASE( "vm", "[vm]" ) {
+
+    SECTION( "The peephole pass does not change results", "[1]" ) {
+        check_peephole<objects::value>( );
+        check_peephole<objects::boxed_value>( );
+    }
+
+    SECTION( "Frequent sequences become superinstructions", "[2]" ) {
+
+        using bytecode::opcode;
+        auto prog = parse( fib );
+
+        auto mod  = bytecode::compiler::compile( prog );
+        REQUIRE( has( mod.protos[1], opcode::JUMP_IF_FALSE ) );
+        auto size = mod.protos[1].code.size( );
+
+        auto st = bytecode::peephole::optimize( mod );
+        auto &body = mod.protos[1];
+        REQUIRE( st.fused > 0 );
+        REQUIRE( body.code.size( ) < size );
+        REQUIRE( has( body, opcode::JUMP_UNLESS_LT_CONST ) );
+        REQUIRE( has( body, opcode::LOCAL_SUB_CONST ) );
+        REQUIRE_FALSE( has( body, opcode::JUMP_IF_FALSE ) );
+        REQUIRE( has( mod.protos[0], opcode::TEE_GLOBAL ) );
+    }
+
+    SECTION( "Jumps go straight to their final target", "[3]" ) {
+
+        using bytecode::opcode;
+        auto prog = parse( "let f = fn(x) { if (x) { if (x) { 1 } else { 2 } } "
+                           "else { 3 } }; let y = if (f) { 1 }; y" );
+        auto mod = bytecode::compiler::compile( prog );
+        bytecode::peephole::optimize( mod );
+
+        for( auto &p: mod.protos ) {
+            for( std::size_t i = 0; i < p.code.size( ); ++i ) {
+                auto &ins = p.code[i];
+                if( bytecode::is_jump( ins.op ) ) {
+                    REQUIRE( p.code[ins.a].op != opcode::JUMP );
+                }
+                if( ins.op == opcode::JUMP ) {
+                    REQUIRE( static_cast<std::size_t>(ins.a) != i + 1 );
+                }
+            }
+        }
+        /// both jumps out of the inner if end in the return of f
+        REQUIRE_FALSE( has( mod.protos[1], opcode::JUMP ) );
+    }
+
+    SECTION( "Opcode pairs are counted while profiling", "[4]" ) {
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> plain(heap);
+        engines::vm_engine<objects::value> fused(heap);
+        plain.set_peephole( false );
+        plain.set_profiling( true );
+        fused.set_profiling( true );
+
+        REQUIRE( run( plain, fib ) == "610" );
+        REQUIRE( run( fused, fib ) == "610" );
+        REQUIRE( fused.dispatches( ) < plain.dispatches( ) );
+
+        auto pairs = plain.opcode_pairs( );
+        REQUIRE_FALSE( pairs.empty( ) );
+        std::uint64_t total = 0;
+        for( std::size_t i = 0; i < pairs.size( ); ++i ) {
+            total += pairs[i].count;
+            if( i > 0 ) {
+                REQUIRE( pairs[i - 1].count >= pairs[i].count );
+            }
+        }
+        REQUIRE( total == plain.dispatches( ) );
+
+        plain.clear_profile( );
+        REQUIRE( plain.dispatches( ) == 0 );
+        REQUIRE( plain.opcode_pairs( ).empty( ) );
+    }
+
+    SECTION( "Call sites cache their callees", "[6]" ) {
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        REQUIRE( run( vm, "let add = fn(a, b) { a + b }; let five = 5; "
+                          "let ten = 10; let loop = fn(n, acc) { "
+                          "if (n == 0) { acc } "
+                          "else { loop(n - 1, acc + add(five, ten)) } }; "
+                          "loop(100, 0)" ) == "1500" );
+
+        /// a call gets its site after the calls in its arguments
+        auto sites = vm.call_sites( );
+        REQUIRE( sites.size( ) == 3 );
+        REQUIRE( sites[0].callee == "add" );
+        REQUIRE( sites[0].misses == 1 );
+        REQUIRE( sites[0].hits == 99 );
+        REQUIRE( sites[1].callee == "loop" );
+        REQUIRE( sites[1].misses == 1 );
+        REQUIRE( sites[1].hits == 99 );
+        REQUIRE( sites[2].misses == 1 );
+
+        REQUIRE( run( vm, "let apply = fn(f, x) { f(x) }; "
+                          "let fs = [fn(x) { 1 }, fn(x) { len(x) }, len]; "
+                          "let go = fn(i, acc) { if (i == 30) { acc } "
+                          "else { go(i + 1, acc + apply(fs[i - i / 3 * 3], "
+                          "[i])) } }; go(0, 0)" ) == "30" );
+        auto poly = vm.call_sites( );
+        REQUIRE( poly[0].callee == "f" );
+        REQUIRE( poly[0].misses == 3 );
+        REQUIRE( poly[0].hits + poly[0].poly_hits == 27 );
+
+        REQUIRE( run( vm, "let make = fn(k) { fn(x) { x + k } }; "
+                          "let call = fn(f) { f(1) }; "
+                          "[call(make(1)), call(make(2)), call(make(3)), "
+                          "call(make(4)), call(make(5)), call(make(6))]" )
+                    == "[2, 3, 4, 5, 6, 7]" );
+        bool mega = false;
+        for( auto &site: vm.call_sites( ) ) {
+            mega = mega || ( site.callee == "f" && site.megamorphic );
+        }
+        REQUIRE( mega );
+
+        REQUIRE( run( vm, "let f = fn(a) { a }; let call = fn(g) { g(1) }; "
+                          "[call(f), call(fn(a, b) { a })]" ) == "error" );
+        /// the first closure is only reachable from the cache; if it was
+        /// collected, the second could get its address
+        REQUIRE( run( vm, "let call = fn(f) { f(1) }; "
+                          "call(fn(x) { x + 1 })" ) == "2" );
+        heap.collect( );
+        REQUIRE( run( vm, "call(fn(x) { x * 10 })" ) == "10" );
+    }
+
+    SECTION( "Executions stop when they run out of fuel", "[7]" ) {
+
+        using status = engines::vm_engine<objects::value>::status;
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        vm.load( parse( fib ) );
+        REQUIRE( vm.start( 1000000 ) == status::DONE );
+        REQUIRE( objects::inspect( vm.result( ) ) == "610" );
+        auto total = vm.fuel_used( );
+
+        std::size_t slices = 1;
+        auto st = vm.start( 100 );
+        while( st == status::SUSPENDED ) {
+            REQUIRE( vm.suspended( ) );
+            /// the suspended frames are roots
+            heap.collect( );
+            st = vm.resume( 100 );
+            slices++;
+        }
+        REQUIRE( st == status::DONE );
+        REQUIRE( objects::inspect( vm.result( ) ) == "610" );
+        /// a paused instruction is paid for once
+        REQUIRE( vm.fuel_used( ) == total );
+        REQUIRE( slices > total / 200 );
+
+        /// tail calls do not nest, so this never ends on its own
+        vm.load( parse( "let spin = fn(n) { spin(n + 1) }; spin(0)" ) );
+        REQUIRE( vm.start( 5000 ) == status::SUSPENDED );
+        REQUIRE( vm.resume( 5000 ) == status::SUSPENDED );
+        REQUIRE( vm.fuel_used( ) >= 10000 );
+        vm.cancel( );
+        REQUIRE_FALSE( vm.suspended( ) );
+        REQUIRE( vm.depth( ) == 0 );
+
+        vm.load( parse( "unknown(1)" ) );
+        REQUIRE( vm.start( 10 ) == status::FAILED );
+    }
+
+    SECTION( "Calls do not use the C++ stack", "[5]" ) {
+
+        gc::heap heap;
+        engines::vm_engine<objects::value> vm(heap);
+        REQUIRE( run( vm, "let sum = fn(n) { if (n == 0) { 0 } "
+                          "else { n + sum(n - 1) } }; sum(50000)" )
+                    == "1250025000" );
+        REQUIRE( vm.depth( ) == 0 );
+    }
+}
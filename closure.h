@@ -0,0 +1,657 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "ast.h"
+#include "parser.h"
+#include "runtime.h"
+#include "engine.h"
+
+namespace mico { namespace engines {
+
+    /// Compiles a program once into a tree of C++ callables.
+    /// Every node is turned into a closure that is already specialized
+    /// on its node type and operator and holds its children,
+    /// so running the program never switches on node_type or on tokens
+    template <typename ValueT>
+    class closure_engine: public engine<ValueT>,
+                          public eval::runtime<ValueT> {
+
+        using base = eval::runtime<ValueT>;
+
+        using base::heap_;
+        using base::globals_;
+        using base::stack_;
+        using base::failed;
+        using base::error;
+
+    public:
+
+        using value       = typename base::value;
+        using environment = typename base::environment;
+        using type        = typename base::type;
+        using runtime     = typename engine<ValueT>::runtime;
+        using code        = std::function<value( )>;
+
+        closure_engine( gc::heap &heap )
+            :base(heap)
+        { }
+
+        const char *name( ) const
+        {
+            return "closure";
+        }
+
+        void load( const parser::program &prog )
+        {
+            trace::scope ts(trace::phase::COMPILE);
+            program_.clear( );
+            for( auto &s: prog.states ) {
+                program_.emplace_back( compile_statement( s.get( ) ) );
+            }
+        }
+
+        value run( )
+        {
+            trace::scope ts(trace::phase::EXECUTE);
+            base::reset( );
+            auto res = run_block( program_ );
+            returning_ = false;
+            stack_.clear( );
+            return res;
+        }
+
+        runtime &context( )
+        {
+            return *this;
+        }
+
+        void trace( objects::tracer &t )
+        {
+            base::trace( t );
+            for( auto &c: constants_ ) {
+                t.visit( c );
+            }
+        }
+
+    private:
+
+        struct add_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &h, std::int64_t a, std::int64_t b )
+            {
+                return value::from_int( h, eval::int_ops::add( a, b ) );
+            }
+        };
+
+        struct sub_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &h, std::int64_t a, std::int64_t b )
+            {
+                return value::from_int( h, eval::int_ops::sub( a, b ) );
+            }
+        };
+
+        struct mul_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &h, std::int64_t a, std::int64_t b )
+            {
+                return value::from_int( h, eval::int_ops::mul( a, b ) );
+            }
+        };
+
+        /// division by zero goes to the generic path, which reports it
+        struct div_op {
+            static bool valid( std::int64_t, std::int64_t b ) { return b != 0; }
+            static value apply( gc::heap &h, std::int64_t a, std::int64_t b )
+            {
+                return value::from_int( h, eval::int_ops::div( a, b ) );
+            }
+        };
+
+        struct lt_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &, std::int64_t a, std::int64_t b )
+            {
+                return value::from_bool( a < b );
+            }
+        };
+
+        struct gt_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &, std::int64_t a, std::int64_t b )
+            {
+                return value::from_bool( a > b );
+            }
+        };
+
+        struct eq_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &, std::int64_t a, std::int64_t b )
+            {
+                return value::from_bool( a == b );
+            }
+        };
+
+        struct not_eq_op {
+            static bool valid( std::int64_t, std::int64_t ) { return true; }
+            static value apply( gc::heap &, std::int64_t a, std::int64_t b )
+            {
+                return value::from_bool( a != b );
+            }
+        };
+
+        /// identifier load with a slot cache bound to one environment
+        struct load_ident {
+
+            value operator ( )( )
+            {
+                auto env = self->globals_;
+                if( owner != env->id ) {
+                    auto next = env->slot_of( name );
+                    if( next == environment::npos ) {
+                        return self->error( "Identifier not found: " + name );
+                    }
+                    owner = env->id;
+                    slot  = next;
+                }
+                return env->slots[slot];
+            }
+
+            closure_engine *self;
+            std::string     name;
+            std::uint64_t   owner;
+            std::size_t     slot;
+        };
+
+        code compile_error( const std::string &msg )
+        {
+            return [this, msg]( ) {
+                return error( msg );
+            };
+        }
+
+        /// the value of the last statement that ran
+        value run_block( const std::vector<code> &block )
+        {
+            value res = value::null( );
+            for( auto &c: block ) {
+                res = c( );
+                if( failed( ) || returning_ ) {
+                    break;
+                }
+            }
+            return res;
+        }
+
+        std::vector<code> compile_block(
+                        const std::vector<ast::statement::uptr> &states )
+        {
+            std::vector<code> res;
+            for( auto &s: states ) {
+                res.emplace_back( compile_statement( s.get( ) ) );
+            }
+            return res;
+        }
+
+        code compile_statement( const ast::statement *stmt )
+        {
+            switch( stmt->type( ) ) {
+            case ast::node_type::STATE_LET: {
+                auto let  = static_cast<const ast::let_statement *>(stmt);
+                auto expr = compile_expression( let->expr.get( ) );
+                if( let->ref.scope == ast::var_scope::LOCAL ) {
+                    auto ref = let->ref;
+                    return [this, expr, ref]( ) {
+                        auto val = expr( );
+                        if( failed( ) || returning_ ) {
+                            return val;
+                        }
+                        base::store( ref, val );
+                        return value::null( );
+                    };
+                }
+                auto name = let->ident->value;
+                return [this, expr, name]( ) {
+                    auto val = expr( );
+                    if( failed( ) || returning_ ) {
+                        return val;
+                    }
+                    base::set_global( name, val );
+                    return value::null( );
+                };
+            }
+            case ast::node_type::STATE_RETURN: {
+                auto ret  = static_cast<const ast::return_statement *>(stmt);
+                auto expr = compile_expression( ret->expr.get( ) );
+                return [this, expr]( ) {
+                    auto val = expr( );
+                    returning_ = true;
+                    return val;
+                };
+            }
+            case ast::node_type::STATE_EXPR:
+                return compile_expression(
+                    static_cast<const ast::expr_statement *>(stmt)->expr.get( ) );
+            case ast::node_type::STATE_BLOCK: {
+                auto block = compile_block(
+                    static_cast<const ast::block_statement *>(stmt)->states );
+                return [this, block]( ) {
+                    return run_block( block );
+                };
+            }
+            default:
+                break;
+            }
+            return compile_error( "Unknown statement: " + stmt->to_string( ) );
+        }
+
+        code compile_expression( const ast::expression *expr )
+        {
+            if( !expr ) {
+                return [ ]( ) {
+                    return value::null( );
+                };
+            }
+
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT: {
+                auto val = value::from_int( heap_,
+                    static_cast<const ast::int_expression *>(expr)->value );
+                /// promoted integers have to stay reachable
+                constants_.push_back( val );
+                return [val]( ) {
+                    return val;
+                };
+            }
+            case ast::node_type::EXPRESSION_BOOL: {
+                auto val = value::from_bool(
+                    static_cast<const ast::bool_expression *>(expr)->value );
+                return [val]( ) {
+                    return val;
+                };
+            }
+            case ast::node_type::EXPRESSION_IDENT:
+                return compile_ident(
+                    static_cast<const ast::ident_expression *>(expr) );
+            case ast::node_type::EXPRESSION_PREFIX:
+                return compile_prefix(
+                    static_cast<const ast::prefix_expression *>(expr) );
+            case ast::node_type::EXPRESSION_INFIX:
+                return compile_infix(
+                    static_cast<const ast::infix_expression *>(expr) );
+            case ast::node_type::EXPRESSION_ARRAY:
+                return compile_array(
+                    static_cast<const ast::array_expression *>(expr) );
+            case ast::node_type::EXPRESSION_INDEX:
+                return compile_index(
+                    static_cast<const ast::index_expression *>(expr) );
+            case ast::node_type::EXPRESSION_CALL:
+                return compile_call(
+                    static_cast<const ast::call_expression *>(expr) );
+            case ast::node_type::EXPRESSION_STRING: {
+                /// interned here; running it is a load of the table slot
+                auto slot = base::intern(
+                    static_cast<const ast::string_expression *>(expr)->value );
+                return [this, slot]( ) {
+                    return base::literal( slot );
+                };
+            }
+            case ast::node_type::EXPRESSION_HASH:
+                return compile_hash(
+                    static_cast<const ast::hash_expression *>(expr) );
+            case ast::node_type::EXPRESSION_IF:
+                return compile_if(
+                    static_cast<const ast::if_expression *>(expr) );
+            case ast::node_type::EXPRESSION_FUNCTION:
+                return compile_function(
+                    static_cast<const ast::function_expression *>(expr) );
+            default:
+                break;
+            }
+            return compile_error( "Unknown expression: " + expr->to_string( ) );
+        }
+
+        code compile_ident( const ast::ident_expression *ident )
+        {
+            auto ref = ident->ref;
+            switch( ref.scope ) {
+            case ast::var_scope::GLOBAL: {
+                load_ident res = { this, ident->value, 0, 0 };
+                return res;
+            }
+            case ast::var_scope::LOCAL:
+                if( !ref.cell ) {
+                    auto index = ref.index;
+                    return [this, index]( ) {
+                        return stack_[base::frame_.base + index];
+                    };
+                }
+                break;
+            default:
+                break;
+            }
+            return [this, ref]( ) {
+                return base::load( ref );
+            };
+        }
+
+        code compile_prefix( const ast::prefix_expression *pref )
+        {
+            auto expr = compile_expression( pref->expr.get( ) );
+            auto tok  = pref->token;
+
+            switch( tok ) {
+            case type::BANG:
+                return [this, expr]( ) {
+                    auto val = expr( );
+                    if( failed( ) ) {
+                        return value::null( );
+                    }
+                    return value::from_bool( !base::is_truthy( val ) );
+                };
+            case type::MINUS:
+                return [this, expr, tok]( ) {
+                    auto val = expr( );
+                    if( failed( ) ) {
+                        return value::null( );
+                    }
+                    if( val.is_int( ) ) {
+                        return value::from_int( heap_,
+                                    eval::int_ops::neg( val.as_int( ) ) );
+                    }
+                    return base::prefix( tok, val );
+                };
+            default:
+                break;
+            }
+
+            return [this, expr, tok]( ) {
+                auto val = expr( );
+                if( failed( ) ) {
+                    return value::null( );
+                }
+                return base::prefix( tok, val );
+            };
+        }
+
+        bool operands( const code &left, const code &right,
+                       value &lval, value &rval )
+        {
+            lval = left( );
+            if( failed( ) ) {
+                return false;
+            }
+
+            /// keeps 'lval' visible to the heap while 'right' allocates
+            bool rooted = ( lval.gc_object( ) != nullptr );
+            if( rooted ) {
+                stack_.push_back( lval );
+            }
+            rval = right( );
+            if( rooted ) {
+                lval = stack_.back( );
+                stack_.pop_back( );
+            }
+
+            return !failed( );
+        }
+
+        template <typename OpT>
+        code compile_int_op( code left, code right, type tok )
+        {
+            return [this, left, right, tok]( ) {
+                value lval;
+                value rval;
+                if( !operands( left, right, lval, rval ) ) {
+                    return value::null( );
+                }
+                if( lval.is_int( ) && rval.is_int( ) ) {
+                    auto a = lval.as_int( );
+                    auto b = rval.as_int( );
+                    if( OpT::valid( a, b ) ) {
+                        return OpT::apply( heap_, a, b );
+                    }
+                }
+                return base::infix( tok, lval, rval );
+            };
+        }
+
+        code compile_infix( const ast::infix_expression *inf )
+        {
+            auto left  = compile_expression( inf->left.get( ) );
+            auto right = compile_expression( inf->right.get( ) );
+            auto tok   = inf->token;
+
+            switch( tok ) {
+            case type::PLUS:
+                return compile_int_op<add_op>( left, right, tok );
+            case type::MINUS:
+                return compile_int_op<sub_op>( left, right, tok );
+            case type::ASTERISK:
+                return compile_int_op<mul_op>( left, right, tok );
+            case type::SLASH:
+                return compile_int_op<div_op>( left, right, tok );
+            case type::LT:
+                return compile_int_op<lt_op>( left, right, tok );
+            case type::GT:
+                return compile_int_op<gt_op>( left, right, tok );
+            case type::EQ:
+                return compile_int_op<eq_op>( left, right, tok );
+            case type::NOT_EQ:
+                return compile_int_op<not_eq_op>( left, right, tok );
+            default:
+                break;
+            }
+
+            return [this, left, right, tok]( ) {
+                value lval;
+                value rval;
+                if( !operands( left, right, lval, rval ) ) {
+                    return value::null( );
+                }
+                return base::infix( tok, lval, rval );
+            };
+        }
+
+        std::vector<code> compile_list(
+                        const std::vector<ast::expression::uptr> &exprs )
+        {
+            std::vector<code> res;
+            for( auto &e: exprs ) {
+                res.emplace_back( compile_expression( e.get( ) ) );
+            }
+            return res;
+        }
+
+        /// pushes the values to stack_
+        /// returns false if something failed
+        bool push_all( const std::vector<code> &list )
+        {
+            for( auto &c: list ) {
+                auto val = c( );
+                if( failed( ) ) {
+                    return false;
+                }
+                stack_.push_back( val );
+            }
+            return true;
+        }
+
+        code compile_array( const ast::array_expression *arr )
+        {
+            auto elements = compile_list( arr->elements );
+            return [this, elements]( ) {
+                auto first = stack_.size( );
+                value res  = value::null( );
+                if( push_all( elements ) ) {
+                    res = base::make_array( first );
+                }
+                stack_.resize( first );
+                return res;
+            };
+        }
+
+        code compile_hash( const ast::hash_expression *hash )
+        {
+            std::vector<code> list;
+            for( auto &p: hash->pairs ) {
+                list.emplace_back( compile_expression( p.first.get( ) ) );
+                list.emplace_back( compile_expression( p.second.get( ) ) );
+            }
+            return [this, list]( ) {
+                auto first = stack_.size( );
+                value res  = value::null( );
+                if( push_all( list ) ) {
+                    res = base::make_hash( first );
+                }
+                stack_.resize( first );
+                return res;
+            };
+        }
+
+        code compile_index( const ast::index_expression *idx )
+        {
+            auto left = compile_expression( idx->left.get( ) );
+            auto id   = compile_expression( idx->index.get( ) );
+            return [this, left, id]( ) {
+                value lval;
+                value ival;
+                if( !operands( left, id, lval, ival ) ) {
+                    return value::null( );
+                }
+                return base::index( lval, ival );
+            };
+        }
+
+        code compile_call( const ast::call_expression *call )
+        {
+            std::vector<code> list;
+            list.emplace_back( compile_expression( call->func.get( ) ) );
+            auto args = compile_list( call->args );
+            list.insert( list.end( ), args.begin( ), args.end( ) );
+
+            if( call->tail ) {
+                return [this, list]( ) {
+                    auto first = stack_.size( );
+                    value res  = value::null( );
+                    if( push_all( list ) ) {
+                        if( base::as_function( stack_[first] ) ) {
+                            /// left on the stack for call_function
+                            tail_from_ = first;
+                            returning_ = true;
+                            return res;
+                        }
+                        res = base::call( first );
+                    }
+                    stack_.resize( first );
+                    return res;
+                };
+            }
+
+            return [this, list]( ) {
+                auto first = stack_.size( );
+                value res  = value::null( );
+                if( push_all( list ) ) {
+                    res = base::as_function( stack_[first] )
+                        ? call_function( first )
+                        : base::call( first );
+                }
+                stack_.resize( first );
+                return res;
+            };
+        }
+
+        /// tail calls unwind to here and run in the same frame
+        value call_function( std::size_t first )
+        {
+            if( !base::push_frame( ) ) {
+                return value::null( );
+            }
+            value res = value::null( );
+            while( base::enter( first ) ) {
+                auto body = static_cast<const std::vector<code> *>(
+                                                base::frame_.fn->code );
+                if( !body ) {
+                    error( "function was made by another engine" );
+                    break;
+                }
+                res = run_block( *body );
+                returning_ = false;
+                if( failed( ) || tail_from_ == npos ) {
+                    tail_from_ = npos;
+                    break;
+                }
+                base::reuse_frame( first, tail_from_ );
+                tail_from_ = npos;
+            }
+            base::pop_frame( );
+            return res;
+        }
+
+        /// how pmap and the others call back into the script
+        value call_value( std::size_t first )
+        {
+            if( !base::as_function( stack_[first] ) ) {
+                return base::call_value( first );
+            }
+            auto res = call_function( first );
+            stack_.resize( first );
+            return res;
+        }
+
+        code compile_if( const ast::if_expression *cond )
+        {
+            auto test      = compile_expression( cond->cond.get( ) );
+            auto then_code = compile_block( cond->then_block->states );
+            std::vector<code> else_code;
+            if( cond->else_block ) {
+                else_code = compile_block( cond->else_block->states );
+            }
+            return [this, test, then_code, else_code]( ) {
+                auto val = test( );
+                if( failed( ) ) {
+                    return value::null( );
+                }
+                return run_block( base::is_truthy( val ) ? then_code
+                                                         : else_code );
+            };
+        }
+
+        /// the body is compiled once, here; every function value made
+        /// from the literal points to it
+        code compile_function( const ast::function_expression *fn )
+        {
+            std::unique_ptr<std::vector<code> > body(
+                        new std::vector<code>( compile_block( fn->info->body ) ) );
+            const void *ptr = body.get( );
+            bodies_.emplace_back( std::move(body) );
+
+            std::shared_ptr<const ast::function_info> info = fn->info;
+            return [this, info, ptr]( ) {
+                auto res  = base::make_function( info );
+                res->code = ptr;
+                return value::from_object( res );
+            };
+        }
+
+        std::vector<code>   program_;
+        /// both kept as long as the engine: functions made by a program
+        /// that was loaded before may still be called and still use
+        /// the constants their bodies captured
+        std::vector<value>  constants_;
+        std::vector<std::unique_ptr<std::vector<code> > > bodies_;
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        bool                returning_ = false;
+        /// a pending tail call; see compile_call
+        std::size_t         tail_from_ = npos;
+    };
+
+}}
+
+#endif // CLOSURE_H
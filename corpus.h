@@ -0,0 +1,289 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mico { namespace corpus {
+
+    /// What the statements of a generated script are like
+    ///  DEEP    lets of expressions nested 'depth' parentheses deep
+    ///  LETS    many short lets of integers and small functions
+    ///  STRINGS lets of string literals of about 'string_size' bytes,
+    ///          with escapes, and concatenations of them
+    ///  NUMBERS lets of arrays of integer literals in every base
+    ///  MIXED   any of them, statement by statement
+    enum class shape {
+        DEEP,
+        LETS,
+        STRINGS,
+        NUMBERS,
+        MIXED,
+    };
+
+    inline
+    const char *name( shape s )
+    {
+        switch( s ) {
+        case shape::DEEP:    return "deep";
+        case shape::LETS:    return "lets";
+        case shape::STRINGS: return "strings";
+        case shape::NUMBERS: return "numbers";
+        case shape::MIXED:   return "mixed";
+        }
+        return "none";
+    }
+
+    struct options {
+        shape         kind        = shape::MIXED;
+        /// the script stops at the first statement that reaches it
+        std::size_t   bytes       = 64 * 1024;
+        std::uint64_t seed        = 1;
+        std::size_t   depth       = 32;
+        std::size_t   string_size = 256;
+    };
+
+    /// splitmix64; the same on every platform, unlike the
+    /// distributions of <random>
+    class random {
+
+    public:
+
+        explicit random( std::uint64_t seed )
+            :state_(seed)
+        { }
+
+        std::uint64_t next( )
+        {
+            std::uint64_t z = ( state_ += 0x9E3779B97F4A7C15ull );
+            z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+            z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+            return z ^ ( z >> 31 );
+        }
+
+        /// in [0, n)
+        std::size_t below( std::size_t n )
+        {
+            return static_cast<std::size_t>( next( ) % n );
+        }
+
+        bool chance( std::size_t percent )
+        {
+            return below( 100 ) < percent;
+        }
+
+    private:
+        std::uint64_t state_;
+    };
+
+    /// A script the lexer, the parser and every engine take without
+    /// an error; the same options always give the same script.
+    /// Integers stay far from overflow: an expression names one
+    /// integer let at most, everything else in it is a small literal
+    class generator {
+
+    public:
+
+        explicit generator( const options &opts )
+            :opts_(opts)
+            ,rnd_(opts.seed)
+        { }
+
+        std::string script( )
+        {
+            while( out_.size( ) < opts_.bytes ) {
+                auto kind = opts_.kind;
+                if( kind == shape::MIXED ) {
+                    kind = static_cast<shape>( rnd_.below( 4 ) );
+                }
+                switch( kind ) {
+                case shape::DEEP:
+                    deep( );
+                    break;
+                case shape::LETS:
+                    let( );
+                    break;
+                case shape::STRINGS:
+                    string( );
+                    break;
+                default:
+                    numbers( );
+                    break;
+                }
+                out_ += ";\n";
+            }
+            std::string res;
+            res.swap( out_ );
+            return res;
+        }
+
+    private:
+
+        std::string fresh( const char *prefix )
+        {
+            return prefix + std::to_string( next_id_++ );
+        }
+
+        /// an integer let made before or a literal if there is none
+        std::string some_int( )
+        {
+            if( ints_.empty( ) ) {
+                return small( );
+            }
+            return ints_[rnd_.below( ints_.size( ) )];
+        }
+
+        std::string small( )
+        {
+            return std::to_string( 1 + rnd_.below( 99 ) );
+        }
+
+        /// a literal that is not bare "0"; the lexer reads a leading 0
+        /// as the start of an octal one
+        std::string number( )
+        {
+            std::uint64_t v = 1 + rnd_.below( 0x7FFFFFFF );
+            switch( rnd_.below( 5 ) ) {
+            case 0:
+                return "0x" + digits( v, 16 );
+            case 1:
+                return "0b" + digits( v & 0xFFFF, 2 );
+            case 2:
+                return "0" + digits( v, 8 );
+            case 3: {
+                /// thousands split with '_'
+                auto dec = std::to_string( v );
+                std::string res;
+                for( std::size_t i = 0; i < dec.size( ); ++i ) {
+                    if( i && ( dec.size( ) - i ) % 3 == 0 ) {
+                        res.push_back( '_' );
+                    }
+                    res.push_back( dec[i] );
+                }
+                return res;
+            }
+            default:
+                return std::to_string( v );
+            }
+        }
+
+        static
+        std::string digits( std::uint64_t v, std::uint64_t base )
+        {
+            static const char *all = "0123456789abcdef";
+            std::string res;
+            do {
+                res.insert( res.begin( ), all[v % base] );
+                v /= base;
+            } while( v );
+            return res;
+        }
+
+        void nested( std::size_t depth, bool named )
+        {
+            if( depth == 0 ) {
+                out_ += named ? some_int( ) : small( );
+                return;
+            }
+            const char *op = rnd_.chance( 50 ) ? " + " : " - ";
+            bool left = rnd_.chance( 50 );
+            out_ += rnd_.chance( 10 ) ? "-(" : "(";
+            if( left ) {
+                nested( depth - 1, named );
+                out_ += op;
+                out_ += small( );
+            } else {
+                out_ += small( );
+                out_ += op;
+                nested( depth - 1, named );
+            }
+            out_ += ")";
+        }
+
+        void deep( )
+        {
+            auto name = fresh( "d" );
+            out_ += "let " + name + " = ";
+            nested( 1 + rnd_.below( opts_.depth ), true );
+            ints_.push_back( name );
+        }
+
+        void let( )
+        {
+            if( !funcs_.empty( ) && rnd_.chance( 20 ) ) {
+                auto name = fresh( "v" );
+                out_ += "let " + name + " = "
+                      + funcs_[rnd_.below( funcs_.size( ) )]
+                      + "(" + some_int( ) + ")";
+                ints_.push_back( name );
+            } else if( rnd_.chance( 10 ) ) {
+                auto name = fresh( "f" );
+                out_ += "let " + name + " = fn(a) { if (a > " + small( )
+                      + ") { a - " + small( ) + " } else { a + "
+                      + small( ) + " } }";
+                funcs_.push_back( name );
+            } else {
+                auto name = fresh( "v" );
+                out_ += "let " + name + " = " + some_int( )
+                      + ( rnd_.chance( 50 ) ? " + " : " - " ) + small( );
+                ints_.push_back( name );
+            }
+        }
+
+        void string( )
+        {
+            static const char *escapes[] = { "\\n", "\\t", "\\\"", "\\\\" };
+            static const char *text =
+                "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                "0123456789 ,.:;!?-+*/()[]{}<>=";
+            static const std::size_t text_size =
+                std::char_traits<char>::length( text );
+
+            auto name = fresh( "s" );
+            out_ += "let " + name + " = ";
+            if( !strings_.empty( ) && rnd_.chance( 25 ) ) {
+                out_ += strings_[rnd_.below( strings_.size( ) )] + " + ";
+            }
+            out_ += "\"";
+            auto size = opts_.string_size / 2
+                      + rnd_.below( opts_.string_size + 1 );
+            for( std::size_t i = 0; i < size; ++i ) {
+                if( rnd_.chance( 2 ) ) {
+                    out_ += escapes[rnd_.below( 4 )];
+                } else {
+                    out_.push_back( text[rnd_.below( text_size )] );
+                }
+            }
+            out_ += "\"";
+            strings_.push_back( name );
+        }
+
+        void numbers( )
+        {
+            out_ += "let " + fresh( "n" ) + " = [";
+            auto size = 4 + rnd_.below( 29 );
+            for( std::size_t i = 0; i < size; ++i ) {
+                out_ += ( i ? ", " : "" ) + number( );
+            }
+            out_ += "]";
+        }
+
+        options                  opts_;
+        random                   rnd_;
+        std::string              out_;
+        std::size_t              next_id_ = 0;
+        std::vector<std::string> ints_;
+        std::vector<std::string> funcs_;
+        std::vector<std::string> strings_;
+    };
+
+    inline
+    std::string generate( const options &opts )
+    {
+        return generator( opts ).script( );
+    }
+
+}}
+
+#endif // CORPUS_H
@@ -0,0 +1,291 @@
+#ifndef DEPS_H
+#define DEPS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+
+#include "ast.h"
+#include "parser.h"
+
+namespace mico { namespace deps {
+
+    /// What one top level statement of a resolved program (see
+    /// scope::resolver) needs from the ones before it.
+    ///
+    /// 'reads' are the globals it names, in function literals too: a
+    /// function may run later, but then with the globals of that time,
+    /// so a statement that calls it needs them as well. 'needs' closes
+    /// 'reads' over that: with every name comes what the statement that
+    /// defines it reads
+    struct statement_info {
+        /// the name a plain let binds; empty for anything else
+        std::string              name;
+        /// every global a let in it may set, in ifs and blocks too
+        std::set<std::string>    defines;
+        std::set<std::string>    reads;
+        std::set<std::string>    needs;
+        /// a return outside of function literals; it may end the program
+        bool                     exits  = false;
+        /// nothing but a plain let or an expression; it sets one global
+        /// at most, the one in 'name'
+        bool                     simple = true;
+        /// the statement each name in 'needs' comes from, if one before
+        /// this one defines it
+        std::map<std::string, std::size_t> from;
+        /// the names in 'needs' no statement before this one defines
+        std::vector<std::string> outer;
+        /// the statements in 'from', in order
+        std::vector<std::size_t> after;
+        /// the longest chain of 'after' that ends here
+        std::size_t              level = 0;
+    };
+
+    /// The dependency graph of the top level statements. It is a DAG:
+    /// a statement depends only on the ones before it, and on the last
+    /// one before it that defines a name it needs; that one has the
+    /// value it reads when the program runs in order.
+    /// Statements of the same level do not depend on each other
+    class graph {
+
+    public:
+
+        static
+        graph build( const parser::program &prog )
+        {
+            graph res;
+            for( auto &s: prog.states ) {
+                statement_info next;
+                res.statement( s.get( ), next );
+                res.states_.emplace_back( std::move(next) );
+            }
+            for( std::size_t i = 0; i < res.states_.size( ); ++i ) {
+                res.close( i );
+            }
+            return res;
+        }
+
+        const std::vector<statement_info> &states( ) const
+        {
+            return states_;
+        }
+
+        std::size_t size( ) const
+        {
+            return states_.size( );
+        }
+
+        const statement_info &operator [ ]( std::size_t i ) const
+        {
+            return states_[i];
+        }
+
+        /// statements before the first one that exits
+        std::size_t prefix( ) const
+        {
+            std::size_t i = 0;
+            while( i < states_.size( ) && !states_[i].exits ) {
+                ++i;
+            }
+            return i;
+        }
+
+        /// the statements of every level, in order
+        std::vector<std::vector<std::size_t> > levels( ) const
+        {
+            std::vector<std::vector<std::size_t> > res;
+            for( std::size_t i = 0; i < states_.size( ); ++i ) {
+                auto lvl = states_[i].level;
+                if( res.size( ) <= lvl ) {
+                    res.resize( lvl + 1 );
+                }
+                res[lvl].push_back( i );
+            }
+            return res;
+        }
+
+    private:
+
+        /// the last statement before 'i' that defines 'name'; npos if
+        /// there is none
+        std::size_t defined_before( std::size_t i,
+                                    const std::string &name ) const
+        {
+            while( i-- > 0 ) {
+                if( states_[i].defines.count( name ) ) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+
+        void close( std::size_t i )
+        {
+            auto &st = states_[i];
+            std::vector<std::string> todo( st.reads.begin( ),
+                                           st.reads.end( ) );
+            st.needs = st.reads;
+            std::set<std::size_t> after;
+            while( !todo.empty( ) ) {
+                auto name = todo.back( );
+                todo.pop_back( );
+                auto def = defined_before( i, name );
+                if( def == npos ) {
+                    st.outer.push_back( name );
+                    continue;
+                }
+                st.from[name] = def;
+                if( !after.insert( def ).second ) {
+                    continue;
+                }
+                for( auto &r: states_[def].reads ) {
+                    if( st.needs.insert( r ).second ) {
+                        todo.push_back( r );
+                    }
+                }
+            }
+            std::sort( st.outer.begin( ), st.outer.end( ) );
+            st.after.assign( after.begin( ), after.end( ) );
+            for( auto a: st.after ) {
+                st.level = std::max( st.level, states_[a].level + 1 );
+            }
+        }
+
+        /// 'top' is false inside function literals
+        void statements( const std::vector<ast::statement::uptr> &states,
+                         statement_info &st, bool top )
+        {
+            for( auto &s: states ) {
+                walk( s.get( ), st, top );
+            }
+        }
+
+        void statement( const ast::statement *stmt, statement_info &st )
+        {
+            if( stmt->type( ) == ast::node_type::STATE_LET ) {
+                auto let = static_cast<const ast::let_statement *>(stmt);
+                st.name = let->ident->value;
+            } else if( stmt->type( ) != ast::node_type::STATE_EXPR ) {
+                st.simple = false;
+            }
+            walk( stmt, st, true );
+            if( st.defines.size( ) > ( st.name.empty( ) ? 0 : 1 ) ) {
+                st.simple = false;
+            }
+        }
+
+        void walk( const ast::statement *stmt, statement_info &st, bool top )
+        {
+            if( !stmt ) {
+                return;
+            }
+            switch( stmt->type( ) ) {
+            case ast::node_type::STATE_LET: {
+                auto let = static_cast<const ast::let_statement *>(stmt);
+                if( top ) {
+                    st.defines.insert( let->ident->value );
+                }
+                expression( let->expr.get( ), st, top );
+                break;
+            }
+            case ast::node_type::STATE_RETURN:
+                st.exits = st.exits || top;
+                expression( static_cast<const ast::return_statement *>(stmt)
+                           ->expr.get( ), st, top );
+                break;
+            case ast::node_type::STATE_EXPR:
+                expression( static_cast<const ast::expr_statement *>(stmt)
+                           ->expr.get( ), st, top );
+                break;
+            case ast::node_type::STATE_BLOCK:
+                statements( static_cast<const ast::block_statement *>(stmt)
+                           ->states, st, top );
+                break;
+            default:
+                break;
+            }
+        }
+
+        void expressions( const std::vector<ast::expression::uptr> &exprs,
+                          statement_info &st, bool top )
+        {
+            for( auto &e: exprs ) {
+                expression( e.get( ), st, top );
+            }
+        }
+
+        void expression( const ast::expression *expr, statement_info &st,
+                         bool top )
+        {
+            if( !expr ) {
+                return;
+            }
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_IDENT: {
+                auto ident = static_cast<const ast::ident_expression *>(expr);
+                if( ident->ref.scope == ast::var_scope::GLOBAL ) {
+                    st.reads.insert( ident->value );
+                }
+                break;
+            }
+            case ast::node_type::EXPRESSION_PREFIX:
+                expression( static_cast<const ast::prefix_expression *>(expr)
+                           ->expr.get( ), st, top );
+                break;
+            case ast::node_type::EXPRESSION_INFIX: {
+                auto inf = static_cast<const ast::infix_expression *>(expr);
+                expression( inf->left.get( ), st, top );
+                expression( inf->right.get( ), st, top );
+                break;
+            }
+            case ast::node_type::EXPRESSION_ARRAY:
+                expressions( static_cast<const ast::array_expression *>(expr)
+                            ->elements, st, top );
+                break;
+            case ast::node_type::EXPRESSION_INDEX: {
+                auto idx = static_cast<const ast::index_expression *>(expr);
+                expression( idx->left.get( ), st, top );
+                expression( idx->index.get( ), st, top );
+                break;
+            }
+            case ast::node_type::EXPRESSION_CALL: {
+                auto call = static_cast<const ast::call_expression *>(expr);
+                expression( call->func.get( ), st, top );
+                expressions( call->args, st, top );
+                break;
+            }
+            case ast::node_type::EXPRESSION_HASH:
+                for( auto &p: static_cast<const ast::hash_expression *>(expr)
+                              ->pairs )
+                {
+                    expression( p.first.get( ), st, top );
+                    expression( p.second.get( ), st, top );
+                }
+                break;
+            case ast::node_type::EXPRESSION_IF: {
+                auto cond = static_cast<const ast::if_expression *>(expr);
+                expression( cond->cond.get( ), st, top );
+                walk( cond->then_block.get( ), st, top );
+                walk( cond->else_block.get( ), st, top );
+                break;
+            }
+            case ast::node_type::EXPRESSION_FUNCTION:
+                statements( static_cast<const ast::function_expression *>(expr)
+                           ->info->body, st, false );
+                break;
+            default:
+                break;
+            }
+        }
+
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        std::vector<statement_info> states_;
+    };
+
+}}
+
+#endif // DEPS_H
@@ -0,0 +1,75 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "parser.h"
+#include "runtime.h"
+#include "eval.h"
+
+namespace mico { namespace engines {
+
+    /// One execution interface for every way of running a program.
+    /// 'load' prepares a program once (the engine may keep pointers into
+    /// it, so it has to outlive the engine), 'run' executes it against
+    /// the globals of the engine as many times as needed
+    template <typename ValueT>
+    struct engine {
+
+        using value   = ValueT;
+        using runtime = eval::runtime<ValueT>;
+
+        virtual ~engine( ) { }
+        virtual const char *name( ) const = 0;
+        virtual void load( const parser::program &prog ) = 0;
+        virtual value run( ) = 0;
+
+        /// errors, globals and the heap of the engine
+        virtual runtime &context( ) = 0;
+    };
+
+    /// walks the AST with eval::evaluator
+    template <typename ValueT>
+    class tree_engine: public engine<ValueT> {
+
+    public:
+
+        using value   = typename engine<ValueT>::value;
+        using runtime = typename engine<ValueT>::runtime;
+
+        tree_engine( gc::heap &heap )
+            :evaluator_(heap)
+        { }
+
+        const char *name( ) const
+        {
+            return "tree";
+        }
+
+        void load( const parser::program &prog )
+        {
+            prog_ = &prog;
+        }
+
+        value run( )
+        {
+            trace::scope ts(trace::phase::EXECUTE);
+            return evaluator_.eval( *prog_ );
+        }
+
+        runtime &context( )
+        {
+            return evaluator_;
+        }
+
+        eval::evaluator<ValueT> &evaluator( )
+        {
+            return evaluator_;
+        }
+
+    private:
+        eval::evaluator<ValueT>  evaluator_;
+        const parser::program   *prog_ = nullptr;
+    };
+
+}}
+
+#endif // ENGINE_H
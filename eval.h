@@ -0,0 +1,674 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "ast.h"
+#include "parser.h"
+#include "runtime.h"
+#include "jit.h"
+
+namespace mico { namespace eval {
+
+    template <typename ValueT>
+    class evaluator: public runtime<ValueT> {
+
+        using base = runtime<ValueT>;
+
+        using base::heap_;
+        using base::globals_;
+        using base::stack_;
+        using base::failed;
+        using base::error;
+        using base::prefix;
+        using base::infix;
+
+    public:
+
+        using value       = typename base::value;
+        using environment = typename base::environment;
+        using type        = typename base::type;
+
+        struct jit_stats {
+            std::size_t compiled = 0;
+            std::size_t calls    = 0;
+            std::size_t deopts   = 0;
+            std::size_t code     = 0;
+        };
+
+        evaluator( gc::heap &heap )
+            :base(heap)
+        { }
+
+        /// the result is not rooted; the caller has to keep it
+        /// somewhere visible to the heap if it allocates before using it
+        value eval( const parser::program &prog )
+        {
+            base::reset( );
+            value res = value::null( );
+            for( auto &s: prog.states ) {
+                res = eval_statement( s.get( ) );
+                if( failed( ) || returning_ ) {
+                    break;
+                }
+            }
+            returning_ = false;
+            stack_.clear( );
+            return res;
+        }
+
+        /// nodes rewrite themselves into specialized variants after the
+        /// first run. the tree is shared state: a program that is being
+        /// evaluated by one evaluator must not be evaluated by another
+        /// one at the same time
+        void set_quickening( bool enable )
+        {
+            quickening_ = enable;
+        }
+
+        /// statement level expressions that are int-only run as machine
+        /// code. a failed guard (a non-integer identifier, overflow,
+        /// division by zero) falls back to the interpreter for that run.
+        /// off by default; stays off where the platform is not supported
+        void set_jit( bool enable )
+        {
+            jit_ = enable && jit::compiler::available( );
+        }
+
+        bool jit_enabled( ) const
+        {
+            return jit_;
+        }
+
+        const jit_stats &get_jit_stats( ) const
+        {
+            return jit_stats_;
+        }
+
+    private:
+
+        struct native_code {
+            std::unique_ptr<jit::function> fn;
+            /// global slot of every function argument
+            std::vector<std::size_t>       slots;
+        };
+
+        value eval_statement( const ast::statement *stmt )
+        {
+            switch( stmt->type( ) ) {
+            case ast::node_type::STATE_LET:
+                return eval_let( static_cast<const ast::let_statement *>(stmt) );
+            case ast::node_type::STATE_RETURN: {
+                auto ret = static_cast<const ast::return_statement *>(stmt);
+                auto res = eval_root( ret->expr.get( ) );
+                returning_ = true;
+                return res;
+            }
+            case ast::node_type::STATE_EXPR:
+                return eval_root(
+                    static_cast<const ast::expr_statement *>(stmt)->expr.get( ) );
+            case ast::node_type::STATE_BLOCK:
+                return eval_block(
+                    static_cast<const ast::block_statement *>(stmt)->states );
+            default:
+                break;
+            }
+            return error( "Unknown statement: " + stmt->to_string( ) );
+        }
+
+        /// the value of the last statement that ran
+        value eval_block( const std::vector<ast::statement::uptr> &states )
+        {
+            value res = value::null( );
+            for( auto &s: states ) {
+                res = eval_statement( s.get( ) );
+                if( failed( ) || returning_ ) {
+                    break;
+                }
+            }
+            return res;
+        }
+
+        value eval_let( const ast::let_statement *let )
+        {
+            auto val = eval_root( let->expr.get( ) );
+            if( failed( ) ) {
+                return value::null( );
+            } else if( returning_ ) {
+                return val;
+            }
+            if( let->ref.scope == ast::var_scope::LOCAL ) {
+                base::store( let->ref, val );
+            } else {
+                base::set_global( let->ident->value, val );
+            }
+            return value::null( );
+        }
+
+        /// the expression of a statement; the only place native code runs
+        value eval_root( const ast::expression *expr )
+        {
+            if( jit_ && expr ) {
+                jit_compile( expr );
+                if( expr->quick == ast::quick_type::NATIVE
+                 && expr->cache_owner == globals_->id )
+                {
+                    return eval_native( expr );
+                }
+            }
+            return eval_expression( expr );
+        }
+
+        /// the decision is kept in the node: cache_owner is our globals
+        /// once the node was looked at, cache_slot is the index of the
+        /// code or npos if it can not be compiled.
+        /// compiled code lives as long as the evaluator
+        void jit_compile( const ast::expression *expr )
+        {
+            /// identifiers and literals keep their own data in the cache
+            if( expr->quick == ast::quick_type::GENERIC
+             || expr->type( ) == ast::node_type::EXPRESSION_IDENT
+             || expr->type( ) == ast::node_type::EXPRESSION_STRING )
+            {
+                return;
+            }
+
+            if( expr->cache_owner != globals_->id ) {
+                std::size_t index = jit::npos;
+                if( auto fn = jit::compiler::compile( expr, code_ ) ) {
+                    native_code code;
+                    for( auto &name: fn->names( ) ) {
+                        auto slot = globals_->slot_of( name );
+                        if( slot == environment::npos ) {
+                            /// not defined yet; the interpreter reports it
+                            return;
+                        }
+                        code.slots.push_back( slot );
+                    }
+                    code.fn = std::move(fn);
+                    index = native_.size( );
+                    native_.push_back( std::move(code) );
+                    ++jit_stats_.compiled;
+                    jit_stats_.code = code_.size( );
+                }
+                expr->cache_owner = globals_->id;
+                expr->cache_slot  = index;
+            }
+
+            if( expr->cache_slot != jit::npos ) {
+                expr->quick = ast::quick_type::NATIVE;
+            }
+        }
+
+        value eval_native( const ast::expression *expr )
+        {
+            auto &code = native_[expr->cache_slot];
+
+            bool deopt = false;
+            native_args_.resize( code.slots.size( ) );
+            for( std::size_t i = 0; i < code.slots.size( ); ++i ) {
+                auto &val = globals_->slots[code.slots[i]];
+                if( !val.is_int( ) ) {
+                    deopt = true;
+                    break;
+                }
+                native_args_[i] = val.as_int( );
+            }
+
+            std::int64_t res = 0;
+            if( !deopt ) {
+                ++jit_stats_.calls;
+                res = code.fn->call( native_args_.data( ), deopt );
+            }
+
+            if( deopt ) {
+                ++jit_stats_.deopts;
+                despecialize( expr );
+                return eval_expression( expr );
+            }
+
+            if( code.fn->result( ) == jit::function::result_type::BOOL ) {
+                return value::from_bool( res != 0 );
+            }
+            return value::from_int( heap_, res );
+        }
+
+        value eval_expression( const ast::expression *expr )
+        {
+            if( !expr ) {
+                return value::null( );
+            }
+
+            /// specialized nodes skip the generic dispatch
+            switch( quickening_ ? expr->quick : ast::quick_type::NONE ) {
+            case ast::quick_type::INT_ADD:
+                return quick_infix<ast::quick_type::INT_ADD>( expr );
+            case ast::quick_type::INT_SUB:
+                return quick_infix<ast::quick_type::INT_SUB>( expr );
+            case ast::quick_type::INT_MUL:
+                return quick_infix<ast::quick_type::INT_MUL>( expr );
+            case ast::quick_type::INT_DIV:
+                return quick_infix<ast::quick_type::INT_DIV>( expr );
+            case ast::quick_type::INT_LT:
+                return quick_infix<ast::quick_type::INT_LT>( expr );
+            case ast::quick_type::INT_GT:
+                return quick_infix<ast::quick_type::INT_GT>( expr );
+            case ast::quick_type::INT_EQ:
+                return quick_infix<ast::quick_type::INT_EQ>( expr );
+            case ast::quick_type::INT_NOT_EQ:
+                return quick_infix<ast::quick_type::INT_NOT_EQ>( expr );
+            case ast::quick_type::INT_NEG:
+                return quick_neg( expr );
+            case ast::quick_type::IDENT_SLOT:
+                return eval_ident(
+                    static_cast<const ast::ident_expression *>(expr) );
+            default:
+                break;
+            }
+
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+                return value::from_int( heap_,
+                    static_cast<const ast::int_expression *>(expr)->value );
+            case ast::node_type::EXPRESSION_BOOL:
+                return value::from_bool(
+                    static_cast<const ast::bool_expression *>(expr)->value );
+            case ast::node_type::EXPRESSION_IDENT:
+                return eval_ident(
+                    static_cast<const ast::ident_expression *>(expr) );
+            case ast::node_type::EXPRESSION_PREFIX:
+                return eval_prefix(
+                    static_cast<const ast::prefix_expression *>(expr) );
+            case ast::node_type::EXPRESSION_INFIX:
+                return eval_infix(
+                    static_cast<const ast::infix_expression *>(expr) );
+            case ast::node_type::EXPRESSION_ARRAY:
+                return eval_array(
+                    static_cast<const ast::array_expression *>(expr) );
+            case ast::node_type::EXPRESSION_INDEX:
+                return eval_index(
+                    static_cast<const ast::index_expression *>(expr) );
+            case ast::node_type::EXPRESSION_CALL:
+                return eval_call(
+                    static_cast<const ast::call_expression *>(expr) );
+            case ast::node_type::EXPRESSION_STRING:
+                return eval_string(
+                    static_cast<const ast::string_expression *>(expr) );
+            case ast::node_type::EXPRESSION_HASH:
+                return eval_hash(
+                    static_cast<const ast::hash_expression *>(expr) );
+            case ast::node_type::EXPRESSION_IF:
+                return eval_if(
+                    static_cast<const ast::if_expression *>(expr) );
+            case ast::node_type::EXPRESSION_FUNCTION:
+                return value::from_object( base::make_function(
+                    static_cast<const ast::function_expression *>(expr)->info ) );
+            default:
+                break;
+            }
+            return error( "Unknown expression: " + expr->to_string( ) );
+        }
+
+        void specialize( const ast::expression *expr, ast::quick_type qt )
+        {
+            if( quickening_ ) {
+                expr->quick = qt;
+            }
+        }
+
+        void despecialize( const ast::expression *expr )
+        {
+            if( ++expr->quick_misses >= ast::quick_limit ) {
+                expr->quick = ast::quick_type::GENERIC;
+            } else {
+                expr->quick = ast::quick_type::NONE;
+            }
+        }
+
+        static
+        ast::quick_type quick_for( type tok )
+        {
+            switch( tok ) {
+            case type::PLUS:
+                return ast::quick_type::INT_ADD;
+            case type::MINUS:
+                return ast::quick_type::INT_SUB;
+            case type::ASTERISK:
+                return ast::quick_type::INT_MUL;
+            case type::SLASH:
+                return ast::quick_type::INT_DIV;
+            case type::LT:
+                return ast::quick_type::INT_LT;
+            case type::GT:
+                return ast::quick_type::INT_GT;
+            case type::EQ:
+                return ast::quick_type::INT_EQ;
+            case type::NOT_EQ:
+                return ast::quick_type::INT_NOT_EQ;
+            default:
+                break;
+            }
+            return ast::quick_type::GENERIC;
+        }
+
+        value eval_ident( const ast::ident_expression *ident )
+        {
+            if( ident->ref.scope != ast::var_scope::GLOBAL ) {
+                return base::load( ident->ref );
+            }
+
+            auto env = globals_;
+            if( ident->quick == ast::quick_type::IDENT_SLOT ) {
+                if( ident->cache_owner == env->id ) {
+                    return env->slots[ident->cache_slot];
+                }
+                despecialize( ident );
+            }
+
+            auto slot = env->slot_of( ident->value );
+            if( slot == environment::npos ) {
+                return error( "Identifier not found: " + ident->value );
+            }
+
+            if( ident->quick == ast::quick_type::NONE ) {
+                ident->cache_owner = env->id;
+                ident->cache_slot  = slot;
+                specialize( ident, ast::quick_type::IDENT_SLOT );
+            }
+            return env->slots[slot];
+        }
+
+        value eval_prefix( const ast::prefix_expression *pref )
+        {
+            auto val = eval_expression( pref->expr.get( ) );
+            if( failed( ) ) {
+                return value::null( );
+            }
+
+            if( pref->quick == ast::quick_type::NONE ) {
+                if( pref->token == type::MINUS && val.is_int( ) ) {
+                    specialize( pref, ast::quick_type::INT_NEG );
+                } else {
+                    specialize( pref, ast::quick_type::GENERIC );
+                }
+            }
+
+            return prefix( pref->token, val );
+        }
+
+        value quick_neg( const ast::expression *expr )
+        {
+            auto pref = static_cast<const ast::prefix_expression *>(expr);
+            auto val  = eval_expression( pref->expr.get( ) );
+            if( failed( ) ) {
+                return value::null( );
+            }
+            if( val.is_int( ) ) {
+                return value::from_int( heap_, int_ops::neg( val.as_int( ) ) );
+            }
+            despecialize( pref );
+            return prefix( pref->token, val );
+        }
+
+        /// evaluates both operands of 'inf'
+        /// returns false if something failed
+        bool eval_operands( const ast::infix_expression *inf,
+                            value &left, value &right )
+        {
+            left = eval_expression( inf->left.get( ) );
+            if( failed( ) ) {
+                return false;
+            }
+
+            /// keeps 'left' visible to the heap while 'right' allocates
+            bool rooted = ( left.gc_object( ) != nullptr );
+            if( rooted ) {
+                stack_.push_back( left );
+            }
+            right = eval_expression( inf->right.get( ) );
+            if( rooted ) {
+                left = stack_.back( );
+                stack_.pop_back( );
+            }
+
+            return !failed( );
+        }
+
+        template <ast::quick_type QT>
+        value quick_infix( const ast::expression *expr )
+        {
+            auto inf = static_cast<const ast::infix_expression *>(expr);
+
+            value left;
+            value right;
+            if( !eval_operands( inf, left, right ) ) {
+                return value::null( );
+            }
+
+            if( left.is_int( ) && right.is_int( ) ) {
+                auto a = left.as_int( );
+                auto b = right.as_int( );
+                switch( QT ) {
+                case ast::quick_type::INT_ADD:
+                    return value::from_int( heap_, int_ops::add( a, b ) );
+                case ast::quick_type::INT_SUB:
+                    return value::from_int( heap_, int_ops::sub( a, b ) );
+                case ast::quick_type::INT_MUL:
+                    return value::from_int( heap_, int_ops::mul( a, b ) );
+                case ast::quick_type::INT_DIV:
+                    if( b != 0 ) {
+                        return value::from_int( heap_, int_ops::div( a, b ) );
+                    }
+                    /// the generic path reports the error
+                    return infix( inf->token, left, right );
+                case ast::quick_type::INT_LT:
+                    return value::from_bool( a < b );
+                case ast::quick_type::INT_GT:
+                    return value::from_bool( a > b );
+                case ast::quick_type::INT_EQ:
+                    return value::from_bool( a == b );
+                case ast::quick_type::INT_NOT_EQ:
+                    return value::from_bool( a != b );
+                default:
+                    break;
+                }
+            }
+
+            despecialize( inf );
+            return infix( inf->token, left, right );
+        }
+
+        /// the literal is interned the first time the node is seen;
+        /// cache_slot is its slot in the intern table of our runtime
+        value eval_string( const ast::string_expression *str )
+        {
+            if( str->cache_owner != globals_->id ) {
+                str->cache_slot  = base::intern( str->value );
+                str->cache_owner = globals_->id;
+            }
+            return base::literal( str->cache_slot );
+        }
+
+        value eval_infix( const ast::infix_expression *inf )
+        {
+            value left;
+            value right;
+            if( !eval_operands( inf, left, right ) ) {
+                return value::null( );
+            }
+
+            if( inf->quick == ast::quick_type::NONE ) {
+                if( left.is_int( ) && right.is_int( ) ) {
+                    specialize( inf, quick_for( inf->token ) );
+                } else {
+                    specialize( inf, ast::quick_type::GENERIC );
+                }
+            }
+
+            return infix( inf->token, left, right );
+        }
+
+        /// pushes the values of 'exprs' to stack_
+        /// returns false if something failed
+        bool eval_list( const std::vector<ast::expression::uptr> &exprs )
+        {
+            for( auto &e: exprs ) {
+                auto val = eval_expression( e.get( ) );
+                if( failed( ) ) {
+                    return false;
+                }
+                stack_.push_back( val );
+            }
+            return true;
+        }
+
+        value eval_array( const ast::array_expression *arr )
+        {
+            auto first = stack_.size( );
+            value res  = value::null( );
+            if( eval_list( arr->elements ) ) {
+                res = base::make_array( first );
+            }
+            stack_.resize( first );
+            return res;
+        }
+
+        value eval_hash( const ast::hash_expression *hash )
+        {
+            auto first = stack_.size( );
+            value res  = value::null( );
+            bool ok    = true;
+            for( auto &p: hash->pairs ) {
+                auto key = eval_expression( p.first.get( ) );
+                if( failed( ) ) {
+                    ok = false;
+                    break;
+                }
+                stack_.push_back( key );
+                auto val = eval_expression( p.second.get( ) );
+                if( failed( ) ) {
+                    ok = false;
+                    break;
+                }
+                stack_.push_back( val );
+            }
+            if( ok ) {
+                res = base::make_hash( first );
+            }
+            stack_.resize( first );
+            return res;
+        }
+
+        value eval_index( const ast::index_expression *idx )
+        {
+            auto first = stack_.size( );
+            value res  = value::null( );
+            auto left  = eval_expression( idx->left.get( ) );
+            if( !failed( ) ) {
+                stack_.push_back( left );
+                auto id = eval_expression( idx->index.get( ) );
+                if( !failed( ) ) {
+                    res = base::index( stack_[first], id );
+                }
+            }
+            stack_.resize( first );
+            return res;
+        }
+
+        value eval_call( const ast::call_expression *call )
+        {
+            auto first = stack_.size( );
+            value res  = value::null( );
+            auto fn    = eval_expression( call->func.get( ) );
+            if( !failed( ) ) {
+                stack_.push_back( fn );
+                if( eval_list( call->args ) ) {
+                    if( !base::as_function( fn ) ) {
+                        res = base::call( first );
+                    } else if( call->tail ) {
+                        /// the callee and its arguments stay where they
+                        /// are; call_function picks them up
+                        tail_from_ = first;
+                        returning_ = true;
+                        return value::null( );
+                    } else {
+                        res = call_function( first );
+                    }
+                }
+            }
+            stack_.resize( first );
+            return res;
+        }
+
+        /// tail calls unwind to here and run in the same frame
+        value call_function( std::size_t first )
+        {
+            if( !base::push_frame( ) ) {
+                return value::null( );
+            }
+            value res = value::null( );
+            while( base::enter( first ) ) {
+                res = eval_block( base::frame_.fn->info->body );
+                returning_ = false;
+                if( failed( ) || tail_from_ == npos ) {
+                    tail_from_ = npos;
+                    break;
+                }
+                base::reuse_frame( first, tail_from_ );
+                tail_from_ = npos;
+            }
+            base::pop_frame( );
+            return res;
+        }
+
+        /// how pmap and the others call back into the script
+        value call_value( std::size_t first )
+        {
+            if( !base::as_function( stack_[first] ) ) {
+                return base::call_value( first );
+            }
+            auto res = call_function( first );
+            stack_.resize( first );
+            return res;
+        }
+
+        value eval_if( const ast::if_expression *cond )
+        {
+            auto val = eval_expression( cond->cond.get( ) );
+            if( failed( ) ) {
+                return value::null( );
+            }
+            if( base::is_truthy( val ) ) {
+                return eval_block( cond->then_block->states );
+            } else if( cond->else_block ) {
+                return eval_block( cond->else_block->states );
+            }
+            return value::null( );
+        }
+
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        bool returning_  = false;
+        /// a pending tail call; see eval_call
+        std::size_t tail_from_ = npos;
+        bool quickening_ = true;
+        bool jit_        = false;
+
+        jit::code_cache           code_;
+        std::vector<native_code>  native_;
+        std::vector<std::int64_t> native_args_;
+        jit_stats                 jit_stats_;
+    };
+
+    /// 16-byte tagged union values
+    using tagged_evaluator = evaluator<objects::value>;
+
+    /// 8-byte pointer-tagged values with 63-bit small integers
+    using boxed_evaluator  = evaluator<objects::boxed_value>;
+
+}}
+
+#endif // EVAL_H
@@ -0,0 +1,145 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "lexer.h"
+#include "parser.h"
+#include "bytecode.h"
+#include "peephole.h"
+#include "image.h"
+#include "vm.h"
+#include "pool.h"
+
+namespace mico { namespace exec {
+
+    /// A compiled program that any number of threads can run at once:
+    /// the bytecode image with its constants and names. Nothing in it
+    /// changes after compile; every run builds its objects on the heap
+    /// of its own context.
+    /// The AST is not kept, its nodes carry the quickening state of the
+    /// tree engine
+    class program {
+
+    public:
+
+        using sptr = std::shared_ptr<const program>;
+
+        /// nullptr with 'err' set if the source does not parse. The
+        /// token table and the reader are local to the call
+        static
+        sptr compile( const std::string &source, std::string &err )
+        {
+            auto tt  = lexer::tokens::all( );
+            auto lst = lexer::tokens::get_list( tt, source.begin( ),
+                                                source.end( ) );
+            parser::token_reader reader(std::move(lst));
+            auto prog = reader.parse( );
+            if( !reader.errors_.empty( ) ) {
+                err = reader.errors_.front( );
+                return nullptr;
+            }
+            auto hash = image::hash( source );
+            auto img  = image::file::from_bytes(
+                            image::writer::write( prog, hash ), hash, err );
+            return img ? from_image( img ) : nullptr;
+        }
+
+        static
+        sptr from_image( image::file::sptr img )
+        {
+            return sptr(new program(std::move(img)));
+        }
+
+        const image::file::sptr &code( ) const
+        {
+            return img_;
+        }
+
+    private:
+        explicit program( image::file::sptr img )
+            :img_(std::move(img))
+        { }
+
+        image::file::sptr img_;
+    };
+
+    struct result {
+        /// objects::inspect of the value
+        std::string              value;
+        std::vector<std::string> errors;
+
+        bool ok( ) const
+        {
+            return errors.empty( );
+        }
+    };
+
+    /// What a worker owns: a heap no other thread touches. A run gets a
+    /// new engine on it, so runs see nothing of each other; what they
+    /// leave behind is collected with the rest of the garbage
+    class context {
+
+    public:
+
+        context( ) = default;
+        context( const context & ) = delete;
+        context &operator = ( const context & ) = delete;
+
+        result run( const program &prog )
+        {
+            engines::vm_engine<objects::value> vm(heap_);
+            /// the workers of the executor are the parallelism here
+            vm.set_parallel( 0 );
+            vm.load( prog.code( ) );
+            auto val = vm.run( );
+            result res;
+            res.value  = objects::inspect( val );
+            res.errors = vm.errors_;
+            ++runs_;
+            return res;
+        }
+
+        gc::heap &heap( )
+        {
+            return heap_;
+        }
+
+        std::uint64_t runs( ) const
+        {
+            return runs_;
+        }
+
+    private:
+        gc::heap      heap_;
+        std::uint64_t runs_ = 0;
+    };
+
+    /// The pool with a context per worker, and programs as jobs
+    class executor: public pool<context> {
+
+    public:
+
+        explicit executor( std::size_t threads = default_threads( ) )
+            :pool<exec::context>(threads)
+        { }
+
+        using pool<exec::context>::submit;
+
+        /// runs 'prog' and hands the result to 'done' on the same worker
+        void submit( program::sptr prog,
+                     std::function<void( const result & )> done )
+        {
+            submit( [prog, done]( exec::context &ctx ) {
+                done( ctx.run( *prog ) );
+            } );
+        }
+    };
+
+}}
+
+#endif // EXECUTOR_H
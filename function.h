@@ -0,0 +1,80 @@
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "ast.h"
+#include "objects.h"
+
+namespace mico { namespace objects {
+
+    /// a captured variable that can change after it was captured;
+    /// the frame and every closure that captured it share the cell
+    template <typename ValueT>
+    struct basic_cell: public object {
+
+        basic_cell( ) = default;
+        basic_cell( const ValueT &v )
+            :value(v)
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::CELL;
+        }
+
+        std::string inspect( ) const
+        {
+            return "<cell>";
+        }
+
+        void trace( tracer &t )
+        {
+            t.visit( value );
+        }
+
+        ValueT value;
+    };
+
+    /// Flat closure: the literal and a copy of every free variable it
+    /// uses, in the order of ast::function_info::captures. Nothing else
+    /// of the frame that made it is kept alive
+    template <typename ValueT>
+    struct basic_function: public object {
+
+        basic_function( std::shared_ptr<const ast::function_info> fn )
+            :info(std::move(fn))
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::FUNCTION;
+        }
+
+        std::string inspect( ) const
+        {
+            return info->to_string( );
+        }
+
+        void trace( tracer &t )
+        {
+            for( auto &v: captured ) {
+                t.visit( v );
+            }
+        }
+
+        std::shared_ptr<const ast::function_info> info;
+        std::vector<ValueT>                        captured;
+        /// compiled body for engines that compile; owned by the engine
+        /// that made the function
+        const void                                *code = nullptr;
+    };
+
+    using cell     = basic_cell<value>;
+    using function = basic_function<value>;
+
+}}
+
+#endif // FUNCTION_H
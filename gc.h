@@ -0,0 +1,633 @@
+#ifndef GC_H
+#define GC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <array>
+#include <new>
+#include <algorithm>
+
+#include "objects.h"
+
+namespace mico { namespace gc {
+
+    enum class mode {
+        /// whole collection in one pause
+        THROUGHPUT = 0,
+        /// tri-color marking and lazy sweeping sliced into bounded steps
+        INCREMENTAL,
+    };
+
+    struct config {
+        mode        collection        = mode::THROUGHPUT;
+        /// heap size that triggers the first collection
+        std::size_t initial_threshold = 1024 * 1024;
+        /// after a collection the heap may grow up to
+        /// live_bytes * growth_factor before the next one
+        double      growth_factor     = 2.0;
+        std::size_t min_threshold     = 256 * 1024;
+        /// size of one arena chunk for every size class
+        std::size_t arena_size        = 64 * 1024;
+
+        /// INCREMENTAL only. time budget of one step. A step may
+        /// overrun it by one scan of the roots, see stats::max_root_scan
+        std::chrono::microseconds max_pause = std::chrono::microseconds(1000);
+        /// INCREMENTAL only. bytes allocated between two steps
+        std::size_t step_bytes        = 64 * 1024;
+    };
+
+    struct stats {
+        using duration = std::chrono::nanoseconds;
+
+        /// bucket 'i' counts pauses shorter than 2^i microseconds;
+        /// the last one counts everything longer
+        using histogram = std::array<std::uint64_t, 16>;
+
+        std::uint64_t collections   = 0;
+        std::uint64_t steps         = 0;
+        std::uint64_t allocations   = 0;
+        std::uint64_t freed         = 0;
+        std::size_t   live_objects  = 0;
+        std::size_t   live_bytes    = 0;
+        /// memory reserved by arenas and large objects
+        std::size_t   heap_bytes    = 0;
+        std::size_t   threshold     = 0;
+
+        duration      last_pause  = duration::zero( );
+        duration      max_pause   = duration::zero( );
+        duration      total_pause = duration::zero( );
+        /// the longest scan of the roots; it is never sliced
+        duration      max_root_scan = duration::zero( );
+        histogram     pauses      = histogram( );
+    };
+
+    /// anything that holds values outside of the heap:
+    /// evaluator stacks, global environments, host handles
+    struct root {
+        virtual ~root( ) { }
+        virtual void trace( objects::tracer &t ) = 0;
+    };
+
+    template <typename ValueT>
+    struct basic_value_stack: public root {
+
+        void push( ValueT v )
+        {
+            values.push_back( v );
+        }
+
+        ValueT pop( )
+        {
+            auto res = values.back( );
+            values.pop_back( );
+            return res;
+        }
+
+        ValueT &top( )
+        {
+            return values.back( );
+        }
+
+        std::size_t size( ) const
+        {
+            return values.size( );
+        }
+
+        void trace( objects::tracer &t )
+        {
+            for( auto &v: values ) {
+                t.visit( v );
+            }
+        }
+
+        std::vector<ValueT> values;
+    };
+
+    using value_stack = basic_value_stack<objects::value>;
+
+    class heap: public objects::tracer {
+
+        using object = objects::object;
+        using color  = object::color;
+        using clock  = std::chrono::steady_clock;
+
+        static const std::uint8_t LARGE_CLASS = 0xFF;
+
+        static
+        const std::vector<std::size_t> &size_classes( )
+        {
+            static const std::vector<std::size_t> res = {
+                16, 32, 48, 64, 96, 128, 192, 256
+            };
+            return res;
+        }
+
+        static
+        std::uint8_t class_for( std::size_t len )
+        {
+            auto &cls = size_classes( );
+            for( std::size_t i = 0; i < cls.size( ); ++i ) {
+                if( len <= cls[i] ) {
+                    return static_cast<std::uint8_t>(i);
+                }
+            }
+            return LARGE_CLASS;
+        }
+
+        struct arena {
+
+            arena( std::size_t id, std::size_t cell, std::size_t total )
+                :index(id)
+                ,cell_size(cell)
+                ,count(total / cell)
+                ,memory(new char[cell * (total / cell)])
+                ,used(total / cell, false)
+            { }
+
+            object *at( std::size_t id )
+            {
+                return reinterpret_cast<object *>(&memory[id * cell_size]);
+            }
+
+            std::size_t             index;
+            std::size_t             cell_size;
+            std::size_t             count;
+            std::unique_ptr<char[]> memory;
+            std::vector<bool>       used;
+        };
+
+        struct size_class {
+            std::vector<std::unique_ptr<arena> > arenas;
+            /// (arena, cell) pairs ready for reuse
+            std::vector<std::pair<arena *, std::size_t> > free;
+        };
+
+        enum class phase {
+            IDLE = 0,
+            MARK,
+            SWEEP,
+        };
+
+        /// position of the lazy sweeper
+        struct sweep_cursor {
+            std::size_t cls   = 0;
+            std::size_t arena = 0;
+            std::size_t cell  = 0;
+            std::size_t large_read  = 0;
+            std::size_t large_write = 0;
+        };
+
+    public:
+
+        heap( const heap & ) = delete;
+        heap &operator = ( const heap & ) = delete;
+
+        heap( config conf = config( ) )
+            :conf_(conf)
+            ,classes_(size_classes( ).size( ))
+        {
+            stats_.threshold = conf_.initial_threshold;
+        }
+
+        ~heap( )
+        {
+            for( auto &cls: classes_ ) {
+                for( auto &a: cls.arenas ) {
+                    for( std::size_t i = 0; i < a->count; ++i ) {
+                        if( a->used[i] ) {
+                            a->at( i )->~object( );
+                        }
+                    }
+                }
+            }
+            for( auto &o: large_ ) {
+                o.first->~object( );
+                ::operator delete( o.first );
+            }
+        }
+
+        /// may collect before allocating;
+        /// objects passed in 'args' have to be reachable from a root.
+        /// stores into the object after it is made must go through
+        /// write_barrier
+        template <typename T, typename ...Args>
+        T *make( Args && ...args )
+        {
+            maybe_collect( sizeof(T) );
+
+            auto cls = class_for( sizeof(T) );
+            T *res = nullptr;
+            std::size_t len = 0;
+            bool swept = false;
+
+            if( cls == LARGE_CLASS ) {
+                void *mem = ::operator new( sizeof(T) );
+                try {
+                    res = new (mem) T(std::forward<Args>(args)...);
+                } catch( ... ) {
+                    ::operator delete( mem );
+                    throw;
+                }
+                large_.emplace_back( res, sizeof(T) );
+                len = sizeof(T);
+                stats_.heap_bytes += len;
+            } else {
+                auto cell = take_cell( cls );
+                try {
+                    res = new (cell.first->at(cell.second))
+                                T(std::forward<Args>(args)...);
+                } catch( ... ) {
+                    classes_[cls].free.push_back( cell );
+                    throw;
+                }
+                cell.first->used[cell.second] = true;
+                len = cell.first->cell_size;
+                swept = is_swept( cls, cell.first, cell.second );
+            }
+
+            res->gc_class = cls;
+            paint_new( res, swept );
+
+            stats_.allocations++;
+            stats_.live_objects++;
+            stats_.live_bytes += len;
+            if( phase_ != phase::IDLE ) {
+                step_debt_ += len;
+            }
+
+            return res;
+        }
+
+        void add_root( root *r )
+        {
+            roots_.push_back( r );
+        }
+
+        void remove_root( root *r )
+        {
+            roots_.erase( std::remove( roots_.begin( ), roots_.end( ), r ),
+                          roots_.end( ) );
+        }
+
+        /// has to be called after storing 'val' into 'owner'
+        /// (insertion barrier: a black object never points to a white one)
+        template <typename ValueT>
+        void write_barrier( object *owner, const ValueT &val )
+        {
+            if( phase_ == phase::MARK && owner->gc_color == color::BLACK ) {
+                visit( val );
+            }
+        }
+
+        /// full collection in one pause.
+        /// finishes the current incremental cycle first if there is one
+        void collect( )
+        {
+            auto start = clock::now( );
+
+            if( phase_ != phase::IDLE ) {
+                finish_cycle( );
+            }
+            begin_cycle( );
+            finish_cycle( );
+
+            add_pause( clock::now( ) - start );
+        }
+
+        /// one bounded slice of the current incremental cycle.
+        /// the host may call it while it is idle
+        void step( )
+        {
+            if( phase_ == phase::IDLE ) {
+                return;
+            }
+
+            auto start    = clock::now( );
+            auto deadline = start + conf_.max_pause;
+
+            if( phase_ == phase::MARK && remark( deadline ) ) {
+                finish_mark( );
+            }
+            if( phase_ == phase::SWEEP && sweep( deadline ) ) {
+                end_cycle( );
+            }
+
+            step_debt_ = 0;
+            stats_.steps++;
+            add_pause( clock::now( ) - start );
+        }
+
+        /// collects, or takes a step, if the heap is due. For loops
+        /// that allocate only inside no_collect and so never get there
+        /// on their own. Everything live has to be reachable from a root
+        void safe_point( )
+        {
+            maybe_collect( 0 );
+        }
+
+        bool in_cycle( ) const
+        {
+            return phase_ != phase::IDLE;
+        }
+
+        const stats &get_stats( ) const
+        {
+            return stats_;
+        }
+
+        const config &get_config( ) const
+        {
+            return conf_;
+        }
+
+        void visit( object *obj )
+        {
+            if( obj && obj->gc_color == color::WHITE ) {
+                obj->gc_color = color::GRAY;
+                gray_.push_back( obj );
+            }
+        }
+
+        using objects::tracer::visit;
+
+    private:
+
+        void maybe_collect( std::size_t len )
+        {
+            if( no_collect_ ) {
+                return;
+            }
+
+            bool over = ( stats_.live_bytes + len > stats_.threshold );
+
+            if( conf_.collection == mode::THROUGHPUT ) {
+                if( over ) {
+                    collect( );
+                }
+            } else if( phase_ == phase::IDLE ) {
+                if( over ) {
+                    auto start = clock::now( );
+                    begin_cycle( );
+                    add_pause( clock::now( ) - start );
+                }
+            } else if( stats_.live_bytes > stats_.threshold * 2 ) {
+                /// the mutator outruns the collector. give up on pauses
+                auto start = clock::now( );
+                finish_cycle( );
+                add_pause( clock::now( ) - start );
+            } else if( step_debt_ >= conf_.step_bytes ) {
+                step( );
+            }
+        }
+
+        void paint_new( object *obj, bool swept )
+        {
+            switch( phase_ ) {
+            case phase::IDLE:
+                obj->gc_color = color::WHITE;
+                break;
+            case phase::MARK:
+                /// fields of a new object are filled without barrier
+                obj->gc_color = color::GRAY;
+                gray_.push_back( obj );
+                break;
+            case phase::SWEEP:
+                /// cells the sweeper has not reached yet must survive it
+                obj->gc_color = swept ? color::WHITE : color::BLACK;
+                break;
+            }
+        }
+
+        bool is_swept( std::size_t cls, const arena *a, std::size_t cell ) const
+        {
+            if( phase_ != phase::SWEEP ) {
+                return false;
+            }
+            if( cls != cursor_.cls ) {
+                return cls < cursor_.cls;
+            }
+            if( a->index != cursor_.arena ) {
+                return a->index < cursor_.arena;
+            }
+            return cell < cursor_.cell;
+        }
+
+        std::pair<arena *, std::size_t> take_cell( std::uint8_t cls )
+        {
+            auto &sc = classes_[cls];
+            if( sc.free.empty( ) ) {
+                auto len = size_classes( )[cls];
+                std::unique_ptr<arena> next(
+                            new arena( sc.arenas.size( ), len,
+                                       std::max(conf_.arena_size, len) ));
+                for( std::size_t i = next->count; i > 0; --i ) {
+                    sc.free.emplace_back( next.get( ), i - 1 );
+                }
+                stats_.heap_bytes += next->count * len;
+                sc.arenas.emplace_back( std::move(next) );
+            }
+            auto res = sc.free.back( );
+            sc.free.pop_back( );
+            return res;
+        }
+
+        void begin_cycle( )
+        {
+            phase_ = phase::MARK;
+            step_debt_ = 0;
+            mark_roots( );
+        }
+
+        void mark_roots( )
+        {
+            auto start = clock::now( );
+            for( auto r: roots_ ) {
+                r->trace( *this );
+            }
+            auto len = std::chrono::duration_cast<stats::duration>(
+                            clock::now( ) - start );
+            stats_.max_root_scan = std::max( stats_.max_root_scan, len );
+        }
+
+        /// roots are not covered by the barrier, so they are scanned
+        /// again once nothing is gray. The mark is over when the scan
+        /// finds nothing new; returns false if the deadline comes first
+        bool remark( clock::time_point deadline )
+        {
+            while( drain( deadline ) ) {
+                mark_roots( );
+                if( gray_.empty( ) ) {
+                    return true;
+                }
+                if( clock::now( ) >= deadline ) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        void finish_mark( )
+        {
+            phase_  = phase::SWEEP;
+            cursor_ = sweep_cursor( );
+        }
+
+        void finish_cycle( )
+        {
+            if( phase_ == phase::MARK ) {
+                remark( clock::time_point::max( ) );
+                finish_mark( );
+            }
+            sweep( clock::time_point::max( ) );
+            end_cycle( );
+        }
+
+        void end_cycle( )
+        {
+            phase_ = phase::IDLE;
+            auto next = static_cast<std::size_t>( stats_.live_bytes
+                                                * conf_.growth_factor );
+            stats_.threshold = std::max( next, conf_.min_threshold );
+            stats_.collections++;
+        }
+
+        /// returns true when there is nothing gray left
+        bool drain( clock::time_point deadline )
+        {
+            std::size_t work = 0;
+            while( !gray_.empty( ) ) {
+                auto next = gray_.back( );
+                gray_.pop_back( );
+                next->gc_color = color::BLACK;
+                next->trace( *this );
+                if( (++work % 64) == 0 && clock::now( ) >= deadline ) {
+                    return gray_.empty( );
+                }
+            }
+            return true;
+        }
+
+        void release( object *obj, std::size_t len )
+        {
+            stats_.freed++;
+            stats_.live_objects--;
+            stats_.live_bytes -= len;
+            obj->~object( );
+        }
+
+        /// returns true when the whole heap is swept
+        bool sweep( clock::time_point deadline )
+        {
+            std::size_t work = 0;
+
+            for( ; cursor_.cls < classes_.size( ); ++cursor_.cls ) {
+                auto &sc = classes_[cursor_.cls];
+                for( ; cursor_.arena < sc.arenas.size( ); ++cursor_.arena ) {
+                    auto a = sc.arenas[cursor_.arena].get( );
+                    for( ; cursor_.cell < a->count; ++cursor_.cell ) {
+                        if( (++work % 256) == 0
+                          && clock::now( ) >= deadline )
+                        {
+                            return false;
+                        }
+                        auto i = cursor_.cell;
+                        if( !a->used[i] ) {
+                            continue;
+                        }
+                        auto obj = a->at( i );
+                        if( obj->gc_color == color::WHITE ) {
+                            release( obj, a->cell_size );
+                            a->used[i] = false;
+                            sc.free.emplace_back( a, i );
+                        } else {
+                            obj->gc_color = color::WHITE;
+                        }
+                    }
+                    cursor_.cell = 0;
+                }
+                cursor_.arena = 0;
+            }
+
+            for( ; cursor_.large_read < large_.size( ); ++cursor_.large_read ) {
+                if( (++work % 256) == 0 && clock::now( ) >= deadline ) {
+                    return false;
+                }
+                auto next = large_[cursor_.large_read];
+                if( next.first->gc_color == color::WHITE ) {
+                    release( next.first, next.second );
+                    stats_.heap_bytes -= next.second;
+                    ::operator delete( next.first );
+                } else {
+                    next.first->gc_color = color::WHITE;
+                    large_[cursor_.large_write++] = next;
+                }
+            }
+            large_.resize( cursor_.large_write );
+
+            return true;
+        }
+
+        void add_pause( clock::duration pause )
+        {
+            auto len = std::chrono::duration_cast<stats::duration>( pause );
+            stats_.last_pause   = len;
+            stats_.total_pause += len;
+            stats_.max_pause    = std::max( stats_.max_pause, len );
+
+            auto us = std::chrono::duration_cast<
+                            std::chrono::microseconds>( len ).count( );
+            std::size_t bucket = 0;
+            while( bucket + 1 < stats_.pauses.size( )
+                && (1LL << bucket) <= us )
+            {
+                ++bucket;
+            }
+            stats_.pauses[bucket]++;
+        }
+
+        config                   conf_;
+        stats                    stats_;
+        std::vector<size_class>  classes_;
+        std::vector<std::pair<object *, std::size_t> > large_;
+        std::vector<root *>      roots_;
+        std::vector<object *>    gray_;
+        phase                    phase_ = phase::IDLE;
+        sweep_cursor             cursor_;
+        std::size_t              step_debt_ = 0;
+        std::size_t              no_collect_ = 0;
+
+        friend class no_collect;
+    };
+
+    /// While one is alive the heap neither starts, steps nor finishes a
+    /// collection. Objects made in the scope can be linked to each other
+    /// without rooting them first; stores into objects that existed
+    /// before the scope still need write_barrier
+    class no_collect {
+
+    public:
+
+        no_collect( const no_collect & ) = delete;
+        no_collect &operator = ( const no_collect & ) = delete;
+
+        no_collect( heap &h )
+            :heap_(h)
+        {
+            ++heap_.no_collect_;
+        }
+
+        ~no_collect( )
+        {
+            --heap_.no_collect_;
+        }
+
+    private:
+        heap &heap_;
+    };
+
+}}
+
+#endif // GC_H
@@ -0,0 +1,308 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "objects.h"
+
+namespace mico { namespace objects {
+
+    /// Hashes of the values that can be used as keys:
+    /// integers, booleans and strings. Strings keep theirs
+    struct key_hash {
+
+        template <typename ValueT>
+        static
+        bool usable( const ValueT &val )
+        {
+            return val.is_int( ) || val.is_bool( )
+                || ( val.is_object( )
+                  && val.as_object( )->type( ) == object_type::STRING )
+                 ;
+        }
+
+        /// 'val' has to be usable( )
+        template <typename ValueT>
+        static
+        std::uint64_t get( const ValueT &val )
+        {
+            if( val.is_int( ) ) {
+                return mix( static_cast<std::uint64_t>(val.as_int( )) );
+            } else if( val.is_bool( ) ) {
+                return mix( val.as_bool( ) ? 0x1A : 0x0A );
+            }
+            return static_cast<const string *>(val.as_object( ))->hash( );
+        }
+
+        template <typename ValueT>
+        static
+        bool equal( const ValueT &a, const ValueT &b )
+        {
+            if( a.is_int( ) ) {
+                return b.is_int( ) && ( a.as_int( ) == b.as_int( ) );
+            } else if( a.is_bool( ) ) {
+                return b.is_bool( ) && ( a.as_bool( ) == b.as_bool( ) );
+            }
+            if( !b.is_object( )
+             || b.as_object( )->type( ) != object_type::STRING )
+            {
+                return false;
+            }
+            auto sa = static_cast<const string *>(a.as_object( ));
+            auto sb = static_cast<const string *>(b.as_object( ));
+            return sa->equal( sb );
+        }
+
+        /// murmur3 finalizer
+        static
+        std::uint64_t mix( std::uint64_t h )
+        {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+    };
+
+    /// 16 control bytes matched at once; SSE2 where available
+    struct hash_group {
+
+        static const std::size_t width = 16;
+
+        /// control byte of an empty slot; full slots hold 7 bits of hash
+        static const std::int8_t EMPTY = -128;
+
+        explicit hash_group( const std::int8_t *ctrl )
+#if defined(__SSE2__)
+            :ctrl_(_mm_loadu_si128( reinterpret_cast<const __m128i *>(ctrl) ))
+        { }
+#else
+            :ctrl_(ctrl)
+        { }
+#endif
+
+        /// bit i is set if slot i holds 'h2'
+        std::uint32_t match( std::int8_t h2 ) const
+        {
+#if defined(__SSE2__)
+            return static_cast<std::uint32_t>( _mm_movemask_epi8(
+                        _mm_cmpeq_epi8( _mm_set1_epi8( h2 ), ctrl_ ) ) );
+#else
+            std::uint32_t res = 0;
+            for( std::size_t i = 0; i < width; ++i ) {
+                if( ctrl_[i] == h2 ) {
+                    res |= std::uint32_t(1) << i;
+                }
+            }
+            return res;
+#endif
+        }
+
+        std::uint32_t match_empty( ) const
+        {
+            return match( EMPTY );
+        }
+
+        static
+        std::size_t lowest( std::uint32_t mask )
+        {
+#if defined(__GNUC__)
+            return static_cast<std::size_t>( __builtin_ctz( mask ) );
+#else
+            std::size_t res = 0;
+            while( !(mask & 1) ) {
+                mask >>= 1;
+                ++res;
+            }
+            return res;
+#endif
+        }
+
+    private:
+#if defined(__SSE2__)
+        __m128i ctrl_;
+#else
+        const std::int8_t *ctrl_;
+#endif
+    };
+
+    /// Open addressing table in the style of Swiss tables: one control
+    /// byte per slot, probed a group of 16 at a time. Hash values of the
+    /// language are immutable once built, so slots are never deleted
+    template <typename ValueT>
+    struct basic_hash: public object {
+
+        struct slot {
+            ValueT key;
+            ValueT value;
+        };
+
+        object_type type( ) const
+        {
+            return object_type::HASH;
+        }
+
+        std::string inspect( ) const
+        {
+            std::ostringstream oss;
+            oss << "{";
+            bool first = true;
+            for( std::size_t i = 0; i < slots_.size( ); ++i ) {
+                if( ctrl_[i] != hash_group::EMPTY ) {
+                    oss << ( first ? "" : ", " )
+                        << objects::inspect( slots_[i].key ) << ": "
+                        << objects::inspect( slots_[i].value );
+                    first = false;
+                }
+            }
+            oss << "}";
+            return oss.str( );
+        }
+
+        void trace( tracer &t )
+        {
+            for( std::size_t i = 0; i < slots_.size( ); ++i ) {
+                if( ctrl_[i] != hash_group::EMPTY ) {
+                    t.visit( slots_[i].key );
+                    t.visit( slots_[i].value );
+                }
+            }
+        }
+
+        std::size_t size( ) const
+        {
+            return size_;
+        }
+
+        /// 'key' has to be key_hash::usable( )
+        const ValueT *find( const ValueT &key ) const
+        {
+            if( size_ == 0 ) {
+                return nullptr;
+            }
+            auto h    = key_hash::get( key );
+            auto h2   = static_cast<std::int8_t>(h & 0x7F);
+            auto mask = groups( ) - 1;
+            auto g    = static_cast<std::size_t>(h >> 7) & mask;
+
+            for( std::size_t step = 1; ; ++step ) {
+                auto base = g * hash_group::width;
+                hash_group grp( &ctrl_[base] );
+                for( auto m = grp.match( h2 ); m; m &= m - 1 ) {
+                    auto &s = slots_[base + hash_group::lowest( m )];
+                    if( key_hash::equal( s.key, key ) ) {
+                        return &s.value;
+                    }
+                }
+                if( grp.match_empty( ) ) {
+                    return nullptr;
+                }
+                /// triangular steps visit every group of a power of 2
+                g = ( g + step ) & mask;
+            }
+        }
+
+        /// calls f( key, value ) for every pair, in slot order
+        template <typename FuncT>
+        void each( FuncT f ) const
+        {
+            for( std::size_t i = 0; i < slots_.size( ); ++i ) {
+                if( ctrl_[i] != hash_group::EMPTY ) {
+                    f( slots_[i].key, slots_[i].value );
+                }
+            }
+        }
+
+        /// replaces the value of an existing key.
+        /// the owner has to call gc::heap::write_barrier for both values
+        void insert( const ValueT &key, const ValueT &val )
+        {
+            if( auto found = find( key ) ) {
+                *const_cast<ValueT *>(found) = val;
+                return;
+            }
+            if( size_ + 1 > max_size( ) ) {
+                grow( );
+            }
+            place( key_hash::get( key ), key, val );
+            ++size_;
+        }
+
+        /// slots reserved for 'n' keys up front
+        void reserve( std::size_t n )
+        {
+            while( max_size( ) < n ) {
+                grow( );
+            }
+        }
+
+    private:
+
+        std::size_t groups( ) const
+        {
+            return slots_.size( ) / hash_group::width;
+        }
+
+        /// 7/8 load factor
+        std::size_t max_size( ) const
+        {
+            return slots_.size( ) - slots_.size( ) / 8;
+        }
+
+        void place( std::uint64_t h, const ValueT &key, const ValueT &val )
+        {
+            auto mask = groups( ) - 1;
+            auto g    = static_cast<std::size_t>(h >> 7) & mask;
+            for( std::size_t step = 1; ; ++step ) {
+                auto base = g * hash_group::width;
+                auto m = hash_group( &ctrl_[base] ).match_empty( );
+                if( m ) {
+                    auto pos = base + hash_group::lowest( m );
+                    ctrl_[pos]        = static_cast<std::int8_t>(h & 0x7F);
+                    slots_[pos].key   = key;
+                    slots_[pos].value = val;
+                    return;
+                }
+                g = ( g + step ) & mask;
+            }
+        }
+
+        void grow( )
+        {
+            std::vector<std::int8_t> ctrl;
+            std::vector<slot>        slots;
+            ctrl.swap( ctrl_ );
+            slots.swap( slots_ );
+
+            auto len = slots.empty( ) ? hash_group::width : slots.size( ) * 2;
+            std::int8_t empty = hash_group::EMPTY;
+            ctrl_.assign( len, empty );
+            slots_.resize( len );
+
+            for( std::size_t i = 0; i < slots.size( ); ++i ) {
+                if( ctrl[i] != hash_group::EMPTY ) {
+                    place( key_hash::get( slots[i].key ),
+                           slots[i].key, slots[i].value );
+                }
+            }
+        }
+
+        std::vector<std::int8_t> ctrl_;
+        std::vector<slot>        slots_;
+        std::size_t              size_ = 0;
+    };
+
+    using hash = basic_hash<value>;
+
+}}
+
+#endif // HASH_H
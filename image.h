@@ -0,0 +1,784 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iterator>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ast.h"
+#include "parser.h"
+#include "bytecode.h"
+#include "peephole.h"
+
+namespace mico { namespace image {
+
+    /// Binary image of a compiled program, meant to be mapped as it is.
+    ///
+    /// A header with the version, the hash of the source it was made from
+    /// and a checksum of the rest, then 8-aligned sections of fixed-size
+    /// records. Strings are (offset, size) references into one blob.
+    /// The code of every function is stored as bytecode::instr, so the vm
+    /// runs it from the mapping. Only the constants become values and the
+    /// function metadata becomes function_info when the image is loaded.
+    /// Images use the byte order of the machine that wrote them; another
+    /// one is rejected, like another version
+    static const std::uint32_t version    = 1;
+    static const std::uint32_t byte_order = 0x01020304;
+
+    /// FNV-1a
+    inline
+    std::uint64_t hash( const void *data, std::size_t size,
+                        std::uint64_t seed = 14695981039346656037ULL )
+    {
+        auto p = static_cast<const unsigned char *>(data);
+        auto h = seed;
+        for( std::size_t i = 0; i < size; ++i ) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    inline
+    std::uint64_t hash( const std::string &str )
+    {
+        return hash( str.data( ), str.size( ) );
+    }
+
+    enum class section: std::uint32_t {
+        STRINGS = 0,
+        CONSTANTS,
+        NAMES,
+        SITES,
+        PROTOS,
+        CODE,
+        PARAMS,
+        CELLS,
+        CAPTURES,
+        COUNT,
+    };
+
+    static const std::size_t section_count =
+                                static_cast<std::size_t>(section::COUNT);
+
+    struct section_rec {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct header {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t source_hash;
+        /// of the bytes after the header
+        std::uint64_t checksum;
+        std::uint64_t size;
+        section_rec   sections[section_count];
+    };
+
+    struct str_ref {
+        std::uint32_t offset;
+        std::uint32_t size;
+    };
+
+    struct constant_rec {
+        std::int64_t  num;
+        str_ref       str;
+        std::uint32_t kind;
+        std::uint32_t pad;
+    };
+
+    /// ranges are indexes into CODE, PARAMS, CELLS and CAPTURES.
+    /// 'function' is 0 for the top level, which has no function_info
+    struct proto_rec {
+        std::uint32_t code_first;
+        std::uint32_t code_count;
+        std::uint32_t params_first;
+        std::uint32_t params_count;
+        std::uint32_t cells_first;
+        std::uint32_t locals;
+        std::uint32_t captures_first;
+        std::uint32_t captures_count;
+        std::uint32_t function;
+        std::uint32_t pad;
+    };
+
+    struct capture_rec {
+        std::uint32_t index;
+        std::uint8_t  scope;
+        std::uint8_t  cell;
+        std::uint16_t pad;
+    };
+
+    static_assert( sizeof(bytecode::instr) == 12,
+                   "instructions are stored as they are" );
+
+    static const char magic[8] = { 'M', 'I', 'C', 'O', 'I', 'M', 'G', 0 };
+
+    /// builds the bytes of an image
+    class writer {
+
+    public:
+
+        static
+        std::string write( const bytecode::module &mod,
+                           std::uint64_t source_hash )
+        {
+            writer w;
+            for( auto &c: mod.constants ) {
+                constant_rec rec = { c.num, w.string( c.str ),
+                                     static_cast<std::uint32_t>(c.type), 0 };
+                w.constants_.push_back( rec );
+            }
+            for( auto &n: mod.names ) {
+                w.names_.push_back( w.string( n ) );
+            }
+            for( auto &s: mod.sites ) {
+                w.sites_.push_back( w.string( s ) );
+            }
+            for( auto &p: mod.protos ) {
+                w.proto( p );
+            }
+
+            header head;
+            std::memset( &head, 0, sizeof(head) );
+            std::memcpy( head.magic, magic, sizeof(magic) );
+            head.version     = version;
+            head.byte_order  = byte_order;
+            head.source_hash = source_hash;
+
+            std::string res( sizeof(head), '\0' );
+            w.add( res, head, section::STRINGS, w.strings_ );
+            w.add( res, head, section::CONSTANTS, w.constants_ );
+            w.add( res, head, section::NAMES, w.names_ );
+            w.add( res, head, section::SITES, w.sites_ );
+            w.add( res, head, section::PROTOS, w.protos_ );
+            w.add( res, head, section::CODE, w.code_ );
+            w.add( res, head, section::PARAMS, w.params_ );
+            w.add( res, head, section::CELLS, w.cells_ );
+            w.add( res, head, section::CAPTURES, w.captures_ );
+
+            head.size     = res.size( );
+            head.checksum = hash( res.data( ) + sizeof(head),
+                                  res.size( ) - sizeof(head) );
+            std::memcpy( &res[0], &head, sizeof(head) );
+            return res;
+        }
+
+        /// compiles 'prog' with the peephole pass
+        static
+        std::string write( const parser::program &prog,
+                           std::uint64_t source_hash )
+        {
+            auto mod = bytecode::compiler::compile( prog );
+            bytecode::peephole::optimize( mod );
+            return write( mod, source_hash );
+        }
+
+    private:
+
+        str_ref string( const std::string &str )
+        {
+            str_ref res = { static_cast<std::uint32_t>(strings_.size( )),
+                            static_cast<std::uint32_t>(str.size( )) };
+            strings_.insert( strings_.end( ), str.begin( ), str.end( ) );
+            return res;
+        }
+
+        void proto( const bytecode::proto &p )
+        {
+            proto_rec rec;
+            std::memset( &rec, 0, sizeof(rec) );
+            rec.code_first = static_cast<std::uint32_t>(code_.size( ));
+            rec.code_count = static_cast<std::uint32_t>(p.code.size( ));
+            for( auto &ins: p.code ) {
+                /// the padding is written as zeros, so the same program
+                /// always makes the same bytes
+                code_.resize( code_.size( ) + 1 );
+                auto &next = code_.back( );
+                std::memset( static_cast<void *>(&next), 0, sizeof(next) );
+                next.op = ins.op;
+                next.a  = ins.a;
+                next.b  = ins.b;
+            }
+
+            rec.params_first   = static_cast<std::uint32_t>(params_.size( ));
+            rec.cells_first    = static_cast<std::uint32_t>(cells_.size( ));
+            rec.captures_first = static_cast<std::uint32_t>(captures_.size( ));
+            if( auto info = p.info.get( ) ) {
+                rec.function       = 1;
+                rec.params_count   = static_cast<std::uint32_t>(
+                                                info->params.size( ) );
+                rec.locals         = static_cast<std::uint32_t>(info->locals);
+                rec.captures_count = static_cast<std::uint32_t>(
+                                                info->captures.size( ) );
+                for( auto &name: info->params ) {
+                    params_.push_back( string( name ) );
+                }
+                for( std::size_t i = 0; i < info->locals; ++i ) {
+                    cells_.push_back( info->cells[i] ? 1 : 0 );
+                }
+                for( auto &c: info->captures ) {
+                    capture_rec cap = {
+                        c.index, static_cast<std::uint8_t>(c.scope),
+                        static_cast<std::uint8_t>(c.cell ? 1 : 0), 0 };
+                    captures_.push_back( cap );
+                }
+            }
+            protos_.push_back( rec );
+        }
+
+        template <typename T>
+        void add( std::string &out, header &head, section id,
+                  const std::vector<T> &items )
+        {
+            out.resize( ( out.size( ) + 7 ) & ~std::size_t( 7 ), '\0' );
+            auto &rec  = head.sections[static_cast<std::size_t>(id)];
+            rec.offset = out.size( );
+            rec.count  = items.size( );
+            if( !items.empty( ) ) {
+                out.append( reinterpret_cast<const char *>(items.data( )),
+                            items.size( ) * sizeof(T) );
+            }
+        }
+
+        std::vector<char>             strings_;
+        std::vector<constant_rec>     constants_;
+        std::vector<str_ref>          names_;
+        std::vector<str_ref>          sites_;
+        std::vector<proto_rec>        protos_;
+        std::vector<bytecode::instr>  code_;
+        std::vector<str_ref>          params_;
+        std::vector<std::uint8_t>     cells_;
+        std::vector<capture_rec>      captures_;
+    };
+
+    inline
+    bool save( const std::string &path, const std::string &bytes )
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write( bytes.data( ), static_cast<std::streamsize>(bytes.size( )) );
+        return static_cast<bool>(out);
+    }
+
+    /// A file mapped read-only and private, so pages are shared until
+    /// someone writes. Read into memory where there is no mmap
+    class mapping {
+
+    public:
+
+        mapping( ) = default;
+        mapping( const mapping & ) = delete;
+        mapping &operator = ( const mapping & ) = delete;
+
+        ~mapping( )
+        {
+#if !defined(_WIN32)
+            if( mapped_ ) {
+                ::munmap( const_cast<char *>(data_), size_ );
+            }
+#endif
+        }
+
+        bool open( const std::string &path, std::string &err )
+        {
+#if !defined(_WIN32)
+            int fd = ::open( path.c_str( ), O_RDONLY );
+            if( fd < 0 ) {
+                err = "cannot open " + path;
+                return false;
+            }
+            struct stat st;
+            if( ::fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+                ::close( fd );
+                err = "cannot read " + path;
+                return false;
+            }
+            auto size = static_cast<std::size_t>(st.st_size);
+            void *ptr = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            ::close( fd );
+            if( ptr == MAP_FAILED ) {
+                err = "cannot map " + path;
+                return false;
+            }
+            data_   = static_cast<const char *>(ptr);
+            size_   = size;
+            mapped_ = true;
+            return true;
+#else
+            std::ifstream in(path, std::ios::binary);
+            if( !in ) {
+                err = "cannot open " + path;
+                return false;
+            }
+            buffer_.assign( std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>( ) );
+            data_ = buffer_.data( );
+            size_ = buffer_.size( );
+            return true;
+#endif
+        }
+
+        void assign( std::string bytes )
+        {
+            buffer_.swap( bytes );
+            data_ = buffer_.data( );
+            size_ = buffer_.size( );
+        }
+
+        const char *data( ) const
+        {
+            return data_;
+        }
+
+        std::size_t size( ) const
+        {
+            return size_;
+        }
+
+        bool mapped( ) const
+        {
+            return mapped_;
+        }
+
+    private:
+        const char  *data_   = nullptr;
+        std::size_t  size_   = 0;
+        bool         mapped_ = false;
+        std::string  buffer_;
+    };
+
+    /// A validated image, mapped read-only (or held in memory).
+    /// Accessors return pointers into the image; they stay valid as long
+    /// as the file object lives
+    class file {
+
+    public:
+
+        using sptr = std::shared_ptr<const file>;
+
+        file( const file & ) = delete;
+        file &operator = ( const file & ) = delete;
+
+        /// nullptr with 'err' set if the file cannot be read, is not an
+        /// image of this version, is damaged or was made from another
+        /// source
+        static
+        sptr open( const std::string &path, std::uint64_t source_hash,
+                   std::string &err )
+        {
+            sptr res(new file);
+            auto f = const_cast<file *>(res.get( ));
+            if( !f->map_.open( path, err ) ) {
+                return nullptr;
+            }
+            return f->check( source_hash, err ) ? res : nullptr;
+        }
+
+        static
+        sptr from_bytes( std::string bytes, std::uint64_t source_hash,
+                         std::string &err )
+        {
+            sptr res(new file);
+            auto f = const_cast<file *>(res.get( ));
+            f->map_.assign( std::move(bytes) );
+            return f->check( source_hash, err ) ? res : nullptr;
+        }
+
+        bool mapped( ) const
+        {
+            return map_.mapped( );
+        }
+
+        /// the whole image as it was written
+        const char *data( ) const
+        {
+            return map_.data( );
+        }
+
+        std::size_t size( ) const
+        {
+            return map_.size( );
+        }
+
+        std::uint64_t source_hash( ) const
+        {
+            return head( ).source_hash;
+        }
+
+        std::size_t protos( ) const
+        {
+            return count( section::PROTOS );
+        }
+
+        const bytecode::instr *code( std::size_t id ) const
+        {
+            return items<bytecode::instr>( section::CODE )
+                 + proto( id ).code_first;
+        }
+
+        std::size_t code_size( std::size_t id ) const
+        {
+            return proto( id ).code_count;
+        }
+
+        /// nullptr for the top level
+        std::shared_ptr<const ast::function_info> info( std::size_t id ) const
+        {
+            auto &rec = proto( id );
+            if( !rec.function ) {
+                return nullptr;
+            }
+            std::shared_ptr<ast::function_info> res(new ast::function_info);
+            auto params = items<str_ref>( section::PARAMS ) + rec.params_first;
+            for( std::uint32_t i = 0; i < rec.params_count; ++i ) {
+                res->params.push_back( string( params[i] ) );
+            }
+            res->locals = rec.locals;
+            auto cells  = items<std::uint8_t>( section::CELLS ) + rec.cells_first;
+            for( std::uint32_t i = 0; i < rec.locals; ++i ) {
+                res->cells.push_back( cells[i] != 0 );
+            }
+            auto caps = items<capture_rec>( section::CAPTURES )
+                      + rec.captures_first;
+            for( std::uint32_t i = 0; i < rec.captures_count; ++i ) {
+                ast::var_ref ref;
+                ref.scope = static_cast<ast::var_scope>(caps[i].scope);
+                ref.cell  = caps[i].cell != 0;
+                ref.index = caps[i].index;
+                res->captures.push_back( ref );
+            }
+            return res;
+        }
+
+        std::size_t constants( ) const
+        {
+            return count( section::CONSTANTS );
+        }
+
+        bool is_int( std::size_t id ) const
+        {
+            return constant( id ).kind
+                == static_cast<std::uint32_t>(bytecode::constant::kind::INT);
+        }
+
+        std::int64_t int_value( std::size_t id ) const
+        {
+            return constant( id ).num;
+        }
+
+        std::string string_value( std::size_t id ) const
+        {
+            return string( constant( id ).str );
+        }
+
+        std::vector<std::string> names( ) const
+        {
+            return strings( section::NAMES );
+        }
+
+        std::vector<std::string> sites( ) const
+        {
+            return strings( section::SITES );
+        }
+
+    private:
+
+        file( ) = default;
+
+        const header &head( ) const
+        {
+            return *reinterpret_cast<const header *>(map_.data( ));
+        }
+
+        std::size_t count( section id ) const
+        {
+            return static_cast<std::size_t>(
+                        head( ).sections[static_cast<std::size_t>(id)].count );
+        }
+
+        template <typename T>
+        const T *items( section id ) const
+        {
+            auto &rec = head( ).sections[static_cast<std::size_t>(id)];
+            return reinterpret_cast<const T *>(map_.data( ) + rec.offset);
+        }
+
+        const proto_rec &proto( std::size_t id ) const
+        {
+            return items<proto_rec>( section::PROTOS )[id];
+        }
+
+        const constant_rec &constant( std::size_t id ) const
+        {
+            return items<constant_rec>( section::CONSTANTS )[id];
+        }
+
+        std::string string( const str_ref &ref ) const
+        {
+            return std::string( items<char>( section::STRINGS ) + ref.offset,
+                                ref.size );
+        }
+
+        std::vector<std::string> strings( section id ) const
+        {
+            std::vector<std::string> res;
+            auto refs = items<str_ref>( id );
+            for( std::size_t i = 0; i < count( id ); ++i ) {
+                res.push_back( string( refs[i] ) );
+            }
+            return res;
+        }
+
+        template <typename T>
+        bool section_fits( section id ) const
+        {
+            auto &rec = head( ).sections[static_cast<std::size_t>(id)];
+            return rec.offset % alignof(T) == 0
+                && rec.offset <= size( )
+                && rec.count <= ( size( ) - rec.offset ) / sizeof(T);
+        }
+
+        static
+        bool range_fits( std::uint64_t first, std::uint64_t n,
+                         std::size_t total )
+        {
+            return first <= total && n <= total - first;
+        }
+
+        bool strings_fit( section id ) const
+        {
+            auto refs = items<str_ref>( id );
+            for( std::size_t i = 0; i < count( id ); ++i ) {
+                if( !range_fits( refs[i].offset, refs[i].size,
+                                 count( section::STRINGS ) ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static
+        bool index_fits( std::int32_t id, std::size_t total )
+        {
+            return id >= 0 && static_cast<std::size_t>(id) < total;
+        }
+
+        /// the captures of the proto 'id' are taken from the frame of
+        /// 'outer', the one that runs its CLOSURE
+        bool captures_fit( std::size_t id, const proto_rec &outer ) const
+        {
+            auto &p    = proto( id );
+            auto caps  = items<capture_rec>( section::CAPTURES );
+            auto cells = items<std::uint8_t>( section::CELLS );
+            for( std::uint32_t i = 0; i < p.captures_count; ++i ) {
+                auto &c = caps[p.captures_first + i];
+                bool cell = false;
+                if( c.scope == static_cast<std::uint8_t>(ast::var_scope::LOCAL)
+                 && c.index < outer.locals )
+                {
+                    cell = cells[outer.cells_first + c.index] != 0;
+                } else if( c.scope == static_cast<std::uint8_t>(
+                                            ast::var_scope::CAPTURE)
+                        && c.index < outer.captures_count )
+                {
+                    cell = caps[outer.captures_first + c.index].cell != 0;
+                } else {
+                    return false;
+                }
+                if( cell != ( c.cell != 0 ) ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// every operand is an index the vm reads without a check, so
+        /// it has to point into its section or into the frame
+        bool code_fits( std::size_t id ) const
+        {
+            using bytecode::opcode;
+
+            auto &p    = proto( id );
+            auto code  = items<bytecode::instr>( section::CODE ) + p.code_first;
+            auto cells = items<std::uint8_t>( section::CELLS ) + p.cells_first;
+            auto caps  = items<capture_rec>( section::CAPTURES )
+                       + p.captures_first;
+
+            /// the last one may not fall through
+            if( p.code_count == 0 ) {
+                return false;
+            }
+            auto last = code[p.code_count - 1].op;
+            if( last != opcode::RETURN && last != opcode::JUMP
+             && last != opcode::TAIL_CALL )
+            {
+                return false;
+            }
+
+            for( std::uint32_t i = 0; i < p.code_count; ++i ) {
+                auto &ins = code[i];
+                bool ok = true;
+                switch( ins.op ) {
+                case opcode::CONST:
+                case opcode::ADD_CONST:
+                case opcode::SUB_CONST:
+                case opcode::LT_CONST:
+                case opcode::GT_CONST:
+                case opcode::EQ_CONST:
+                    ok = index_fits( ins.a, constants( ) );
+                    break;
+                case opcode::GET_GLOBAL:
+                case opcode::SET_GLOBAL:
+                case opcode::TEE_GLOBAL:
+                    ok = index_fits( ins.a, count( section::NAMES ) );
+                    break;
+                case opcode::GET_LOCAL:
+                case opcode::SET_LOCAL:
+                case opcode::TEE_LOCAL:
+                    ok = index_fits( ins.a, p.locals );
+                    break;
+                case opcode::GET_LOCAL2:
+                    ok = index_fits( ins.a, p.locals )
+                      && index_fits( ins.b, p.locals );
+                    break;
+                case opcode::GET_LOCAL_CELL:
+                case opcode::SET_LOCAL_CELL:
+                    ok = index_fits( ins.a, p.locals ) && cells[ins.a] != 0;
+                    break;
+                case opcode::LOCAL_ADD_CONST:
+                case opcode::LOCAL_SUB_CONST:
+                    ok = index_fits( ins.a, p.locals )
+                      && index_fits( ins.b, constants( ) );
+                    break;
+                case opcode::GET_CAPTURE:
+                    ok = index_fits( ins.a, p.captures_count );
+                    break;
+                case opcode::GET_CAPTURE_CELL:
+                    ok = index_fits( ins.a, p.captures_count )
+                      && caps[ins.a].cell != 0;
+                    break;
+                case opcode::JUMP:
+                case opcode::JUMP_IF_FALSE:
+                case opcode::JUMP_IF_TRUE:
+                case opcode::JUMP_UNLESS_LT:
+                case opcode::JUMP_UNLESS_GT:
+                case opcode::JUMP_UNLESS_EQ:
+                    ok = index_fits( ins.a, p.code_count );
+                    break;
+                case opcode::JUMP_UNLESS_LT_CONST:
+                case opcode::JUMP_UNLESS_GT_CONST:
+                case opcode::JUMP_UNLESS_EQ_CONST:
+                    ok = index_fits( ins.a, p.code_count )
+                      && index_fits( ins.b, constants( ) );
+                    break;
+                case opcode::CALL:
+                case opcode::TAIL_CALL:
+                    ok = ins.a >= 0
+                      && index_fits( ins.b, count( section::SITES ) );
+                    break;
+                case opcode::ARRAY:
+                case opcode::HASH:
+                    ok = ins.a >= 0;
+                    break;
+                case opcode::CLOSURE:
+                    /// the top level is no function
+                    ok = index_fits( ins.a, protos( ) ) && ins.a > 0
+                      && proto( ins.a ).function != 0
+                      && captures_fit( ins.a, p );
+                    break;
+                default:
+                    ok = static_cast<std::size_t>(ins.op)
+                       < bytecode::opcode_count;
+                    break;
+                }
+                if( !ok ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool check( std::uint64_t source_hash, std::string &err )
+        {
+            if( size( ) < sizeof(header)
+             || std::memcmp( head( ).magic, magic, sizeof(magic) ) != 0 )
+            {
+                err = "not an image";
+                return false;
+            }
+            auto &h = head( );
+            if( h.version != version || h.byte_order != byte_order ) {
+                err = "image of another version or byte order";
+                return false;
+            }
+            if( h.size != size( )
+             || h.checksum != hash( data( ) + sizeof(header),
+                                    size( ) - sizeof(header) ) )
+            {
+                err = "damaged image";
+                return false;
+            }
+            if( h.source_hash != source_hash ) {
+                err = "image of another source";
+                return false;
+            }
+
+            bool fits = section_fits<char>( section::STRINGS )
+                     && section_fits<constant_rec>( section::CONSTANTS )
+                     && section_fits<str_ref>( section::NAMES )
+                     && section_fits<str_ref>( section::SITES )
+                     && section_fits<proto_rec>( section::PROTOS )
+                     && section_fits<bytecode::instr>( section::CODE )
+                     && section_fits<str_ref>( section::PARAMS )
+                     && section_fits<std::uint8_t>( section::CELLS )
+                     && section_fits<capture_rec>( section::CAPTURES )
+                     && count( section::PROTOS ) > 0
+                     && strings_fit( section::NAMES )
+                     && strings_fit( section::SITES )
+                     && strings_fit( section::PARAMS );
+
+            for( std::size_t i = 0; fits && i < constants( ); ++i ) {
+                fits = range_fits( constant( i ).str.offset,
+                                   constant( i ).str.size,
+                                   count( section::STRINGS ) );
+            }
+            for( std::size_t i = 0; fits && i < protos( ); ++i ) {
+                auto &p = proto( i );
+                fits = range_fits( p.code_first, p.code_count,
+                                   count( section::CODE ) )
+                    && range_fits( p.params_first, p.params_count,
+                                   count( section::PARAMS ) )
+                    && range_fits( p.cells_first, p.locals,
+                                   count( section::CELLS ) )
+                    && range_fits( p.captures_first, p.captures_count,
+                                   count( section::CAPTURES ) );
+            }
+            for( std::size_t i = 0; fits && i < protos( ); ++i ) {
+                fits = code_fits( i );
+            }
+            if( !fits ) {
+                err = "damaged image";
+            }
+            return fits;
+        }
+
+        mapping map_;
+    };
+
+}}
+
+#endif // IMAGE_H
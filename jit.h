@@ -0,0 +1,532 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "ast.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#   define MICO_JIT_X86_64 1
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+namespace mico { namespace jit {
+
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    /// Executable memory for compiled functions. Code is packed into
+    /// chunks so that many small functions share pages; a chunk is only
+    /// writable while code is copied into it (W^X)
+    class code_cache {
+
+    public:
+
+        static const std::size_t chunk_size = 64 * 1024;
+        static const std::size_t alignment  = 16;
+
+        code_cache( const code_cache & ) = delete;
+        code_cache &operator = ( const code_cache & ) = delete;
+
+        code_cache( ) = default;
+
+        ~code_cache( )
+        {
+#if MICO_JIT_X86_64
+            for( auto &c: chunks_ ) {
+                munmap( c.memory, c.length );
+            }
+#endif
+        }
+
+        /// nullptr if no executable memory could be mapped
+        void *add( const std::vector<std::uint8_t> &code )
+        {
+#if MICO_JIT_X86_64
+            auto size = ( (code.size( ) + alignment - 1) / alignment )
+                      * alignment;
+            if( chunks_.empty( )
+             || chunks_.back( ).used + size > chunks_.back( ).length )
+            {
+                auto page = page_size( );
+                auto length = ( size > chunk_size ) ? size : chunk_size;
+                length = ( (length + page - 1) / page ) * page;
+                void *mem = mmap( nullptr, length, PROT_READ | PROT_EXEC,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+                if( mem == MAP_FAILED ) {
+                    return nullptr;
+                }
+                chunks_.push_back( chunk { mem, length, 0 } );
+            }
+
+            /// only the pages the new code touches change protection
+            auto &c    = chunks_.back( );
+            auto base  = static_cast<std::uint8_t *>(c.memory);
+            auto res   = base + c.used;
+            auto first = base + ( c.used / page_size( ) ) * page_size( );
+            auto len   = static_cast<std::size_t>( res + size - first );
+            if( mprotect( first, len, PROT_READ | PROT_WRITE ) != 0 ) {
+                return nullptr;
+            }
+            std::memcpy( res, code.data( ), code.size( ) );
+            c.used += size;
+            if( mprotect( first, len, PROT_READ | PROT_EXEC ) != 0 ) {
+                return nullptr;
+            }
+            bytes_ += code.size( );
+            return res;
+#else
+            (void)code;
+            return nullptr;
+#endif
+        }
+
+        /// bytes of machine code; padding is not counted
+        std::size_t size( ) const
+        {
+            return bytes_;
+        }
+
+    private:
+
+#if MICO_JIT_X86_64
+        static
+        std::size_t page_size( )
+        {
+            static const auto page =
+                    static_cast<std::size_t>( sysconf( _SC_PAGESIZE ) );
+            return page;
+        }
+#endif
+
+        struct chunk {
+            void        *memory;
+            std::size_t  length;
+            std::size_t  used;
+        };
+
+        std::vector<chunk> chunks_;
+        std::size_t        bytes_ = 0;
+    };
+
+    /// Native code for one int-only expression.
+    ///   std::int64_t entry( const std::int64_t *slots, std::int64_t *deopt )
+    /// 'slots' are the values of the identifiers the expression reads,
+    /// in the order of names( ). *deopt is set to 1 when a guard fails
+    /// (overflow, division by zero, INT64_MIN / -1); the result is
+    /// meaningless then and the interpreter has to evaluate the expression.
+    /// The code lives in the code_cache it was compiled into
+    class function {
+
+    public:
+
+        using entry = std::int64_t (*)( const std::int64_t *, std::int64_t * );
+
+        enum class result_type {
+            INT,
+            BOOL,
+        };
+
+        std::int64_t call( const std::int64_t *slots, bool &deopt ) const
+        {
+            std::int64_t failed = 0;
+            auto res = entry_( slots, &failed );
+            deopt = ( failed != 0 );
+            return res;
+        }
+
+        const std::vector<std::string> &names( ) const
+        {
+            return names_;
+        }
+
+        result_type result( ) const
+        {
+            return result_;
+        }
+
+    private:
+
+        friend class compiler;
+
+        entry                    entry_  = nullptr;
+        std::vector<std::string> names_;
+        result_type              result_ = result_type::INT;
+    };
+
+    /// Template JIT: every node is emitted as a fixed instruction
+    /// sequence, the result of a node is left in rax.
+    /// Only expressions whose types are known to be INT or BOOL are
+    /// compiled; identifiers are assumed to be INT and are checked by the
+    /// caller before the call
+    class compiler {
+
+        using type        = lexer::tokens::type;
+        using result_type = function::result_type;
+
+    public:
+
+        static
+        bool available( )
+        {
+#if MICO_JIT_X86_64
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /// nullptr if the expression is not int-only,
+        /// is too trivial to be worth it, or the platform is not supported
+        static
+        std::unique_ptr<function> compile( const ast::expression *expr,
+                                           code_cache &cache )
+        {
+            std::unique_ptr<function> res;
+            if( !available( ) ) {
+                return res;
+            }
+
+            result_type rt;
+            std::vector<std::string> names;
+            std::size_t ops = 0;
+            if( !check( expr, rt, names, ops ) || ops == 0 ) {
+                return res;
+            }
+
+            compiler comp;
+            comp.names_ = std::move(names);
+            comp.prologue( );
+            comp.emit( expr );
+            comp.epilogue( );
+
+            auto mem = cache.add( comp.code_ );
+            if( !mem ) {
+                return res;
+            }
+            res.reset( new function );
+            res->entry_  = reinterpret_cast<function::entry>(mem);
+            res->names_  = std::move(comp.names_);
+            res->result_ = rt;
+            return res;
+        }
+
+    private:
+
+        static
+        std::size_t name_index( std::vector<std::string> &names,
+                                const std::string &name )
+        {
+            for( std::size_t i = 0; i < names.size( ); ++i ) {
+                if( names[i] == name ) {
+                    return i;
+                }
+            }
+            names.push_back( name );
+            return names.size( ) - 1;
+        }
+
+        /// static typing of the int-only subset
+        static
+        bool check( const ast::expression *expr, result_type &rt,
+                    std::vector<std::string> &names, std::size_t &ops )
+        {
+            if( !expr ) {
+                return false;
+            }
+
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+                rt = result_type::INT;
+                return true;
+            case ast::node_type::EXPRESSION_BOOL:
+                rt = result_type::BOOL;
+                return true;
+            case ast::node_type::EXPRESSION_IDENT: {
+                auto ident = static_cast<const ast::ident_expression *>(expr);
+                /// locals of functions live in frames, not in the globals
+                if( ident->ref.scope != ast::var_scope::GLOBAL ) {
+                    return false;
+                }
+                name_index( names, ident->value );
+                rt = result_type::INT;
+                return true;
+            }
+            case ast::node_type::EXPRESSION_PREFIX: {
+                auto pref = static_cast<const ast::prefix_expression *>(expr);
+                result_type sub;
+                if( !check( pref->expr.get( ), sub, names, ops ) ) {
+                    return false;
+                }
+                ++ops;
+                switch( pref->token ) {
+                case type::MINUS:
+                case type::PLUS:
+                    rt = result_type::INT;
+                    return sub == result_type::INT;
+                case type::BANG:
+                    rt = result_type::BOOL;
+                    return sub == result_type::BOOL;
+                default:
+                    break;
+                }
+                return false;
+            }
+            case ast::node_type::EXPRESSION_INFIX: {
+                auto inf = static_cast<const ast::infix_expression *>(expr);
+                result_type left;
+                result_type right;
+                if( !check( inf->left.get( ), left, names, ops )
+                 || !check( inf->right.get( ), right, names, ops ) )
+                {
+                    return false;
+                }
+                ++ops;
+                switch( inf->token ) {
+                case type::PLUS:
+                case type::MINUS:
+                case type::ASTERISK:
+                case type::SLASH:
+                    rt = result_type::INT;
+                    return left == result_type::INT
+                        && right == result_type::INT;
+                case type::LT:
+                case type::GT:
+                    rt = result_type::BOOL;
+                    return left == result_type::INT
+                        && right == result_type::INT;
+                case type::EQ:
+                case type::NOT_EQ:
+                    rt = result_type::BOOL;
+                    return left == right;
+                default:
+                    break;
+                }
+                return false;
+            }
+            default:
+                break;
+            }
+            return false;
+        }
+
+        void bytes( std::initializer_list<std::uint8_t> data )
+        {
+            code_.insert( code_.end( ), data.begin( ), data.end( ) );
+        }
+
+        void imm32( std::int32_t v )
+        {
+            auto u = static_cast<std::uint32_t>(v);
+            for( int i = 0; i < 4; ++i ) {
+                code_.push_back( static_cast<std::uint8_t>(u >> (i * 8)) );
+            }
+        }
+
+        void imm64( std::int64_t v )
+        {
+            auto u = static_cast<std::uint64_t>(v);
+            for( int i = 0; i < 8; ++i ) {
+                code_.push_back( static_cast<std::uint8_t>(u >> (i * 8)) );
+            }
+        }
+
+        /// jcc rel32 to the deopt exit; patched in epilogue( )
+        void jump_deopt( std::uint8_t cc )
+        {
+            bytes( { 0x0F, cc } );
+            deopts_.push_back( code_.size( ) );
+            imm32( 0 );
+        }
+
+        void prologue( )
+        {
+            bytes( { 0x55 } );                          /// push rbp
+            bytes( { 0x48, 0x89, 0xE5 } );              /// mov rbp, rsp
+        }
+
+        void epilogue( )
+        {
+            bytes( { 0x48, 0x89, 0xEC } );              /// mov rsp, rbp
+            bytes( { 0x5D } );                          /// pop rbp
+            bytes( { 0xC3 } );                          /// ret
+
+            auto exit = code_.size( );
+            bytes( { 0x48, 0xC7, 0x06 } );              /// mov qword [rsi], 1
+            imm32( 1 );
+            bytes( { 0x48, 0x89, 0xEC } );              /// mov rsp, rbp
+            bytes( { 0x5D } );                          /// pop rbp
+            bytes( { 0xC3 } );                          /// ret
+
+            for( auto pos: deopts_ ) {
+                auto rel = static_cast<std::int32_t>( exit - (pos + 4) );
+                auto u = static_cast<std::uint32_t>(rel);
+                for( int i = 0; i < 4; ++i ) {
+                    code_[pos + i] = static_cast<std::uint8_t>(u >> (i * 8));
+                }
+            }
+        }
+
+        enum reg: std::uint8_t {
+            RAX = 0,
+            RCX = 1,
+        };
+
+        static
+        bool is_leaf( const ast::expression *expr )
+        {
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+            case ast::node_type::EXPRESSION_BOOL:
+            case ast::node_type::EXPRESSION_IDENT:
+                return true;
+            default:
+                break;
+            }
+            return false;
+        }
+
+        void load_imm( reg r, std::int64_t v )
+        {
+            if( v >= INT32_MIN && v <= INT32_MAX ) {
+                bytes( { 0x48, 0xC7,
+                         static_cast<std::uint8_t>(0xC0 | r) } ); /// mov r, simm32
+                imm32( static_cast<std::int32_t>(v) );
+            } else {
+                bytes( { 0x48, static_cast<std::uint8_t>(0xB8 | r) } ); /// mov r, imm64
+                imm64( v );
+            }
+        }
+
+        void load_slot( reg r, std::size_t id )
+        {
+            auto disp = id * 8;
+            if( disp < 128 ) {                          /// mov r, [rdi + disp8]
+                bytes( { 0x48, 0x8B, static_cast<std::uint8_t>(0x47 | (r << 3)),
+                         static_cast<std::uint8_t>(disp) } );
+            } else {                                    /// mov r, [rdi + disp32]
+                bytes( { 0x48, 0x8B, static_cast<std::uint8_t>(0x87 | (r << 3)) } );
+                imm32( static_cast<std::int32_t>(disp) );
+            }
+        }
+
+        /// only for is_leaf( expr )
+        void emit_leaf( const ast::expression *expr, reg r )
+        {
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_INT:
+                load_imm( r, static_cast<const ast::int_expression *>(expr)->value );
+                break;
+            case ast::node_type::EXPRESSION_BOOL:
+                load_imm( r, static_cast<const ast::bool_expression *>(expr)->value
+                             ? 1 : 0 );
+                break;
+            case ast::node_type::EXPRESSION_IDENT:
+                load_slot( r, name_index( names_,
+                    static_cast<const ast::ident_expression *>(expr)->value ) );
+                break;
+            default:
+                break;
+            }
+        }
+
+        void emit( const ast::expression *expr )
+        {
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_PREFIX:
+                emit_prefix( static_cast<const ast::prefix_expression *>(expr) );
+                break;
+            case ast::node_type::EXPRESSION_INFIX:
+                emit_infix( static_cast<const ast::infix_expression *>(expr) );
+                break;
+            default:
+                emit_leaf( expr, RAX );
+                break;
+            }
+        }
+
+        void emit_prefix( const ast::prefix_expression *pref )
+        {
+            emit( pref->expr.get( ) );
+            switch( pref->token ) {
+            case type::MINUS:
+                bytes( { 0x48, 0xF7, 0xD8 } );          /// neg rax
+                jump_deopt( 0x80 );                     /// jo
+                break;
+            case type::BANG:
+                bytes( { 0x48, 0x83, 0xF0, 0x01 } );    /// xor rax, 1
+                break;
+            default:
+                break;
+            }
+        }
+
+        void emit_compare( std::uint8_t setcc )
+        {
+            bytes( { 0x48, 0x39, 0xC8 } );              /// cmp rax, rcx
+            bytes( { 0x0F, setcc, 0xC0 } );             /// setcc al
+            bytes( { 0x0F, 0xB6, 0xC0 } );              /// movzx eax, al
+        }
+
+        void emit_infix( const ast::infix_expression *inf )
+        {
+            emit( inf->left.get( ) );
+            if( is_leaf( inf->right.get( ) ) ) {
+                emit_leaf( inf->right.get( ), RCX );
+            } else {
+                bytes( { 0x50 } );                      /// push rax
+                emit( inf->right.get( ) );
+                bytes( { 0x48, 0x89, 0xC1 } );          /// mov rcx, rax
+                bytes( { 0x58 } );                      /// pop rax
+            }
+
+            switch( inf->token ) {
+            case type::PLUS:
+                bytes( { 0x48, 0x01, 0xC8 } );          /// add rax, rcx
+                jump_deopt( 0x80 );                     /// jo
+                break;
+            case type::MINUS:
+                bytes( { 0x48, 0x29, 0xC8 } );          /// sub rax, rcx
+                jump_deopt( 0x80 );                     /// jo
+                break;
+            case type::ASTERISK:
+                bytes( { 0x48, 0x0F, 0xAF, 0xC1 } );    /// imul rax, rcx
+                jump_deopt( 0x80 );                     /// jo
+                break;
+            case type::SLASH:
+                bytes( { 0x48, 0x85, 0xC9 } );          /// test rcx, rcx
+                jump_deopt( 0x84 );                     /// jz
+                bytes( { 0x48, 0x83, 0xF9, 0xFF } );    /// cmp rcx, -1
+                jump_deopt( 0x84 );                     /// je
+                bytes( { 0x48, 0x99 } );                /// cqo
+                bytes( { 0x48, 0xF7, 0xF9 } );          /// idiv rcx
+                break;
+            case type::LT:
+                emit_compare( 0x9C );                   /// setl
+                break;
+            case type::GT:
+                emit_compare( 0x9F );                   /// setg
+                break;
+            case type::EQ:
+                emit_compare( 0x94 );                   /// sete
+                break;
+            case type::NOT_EQ:
+                emit_compare( 0x95 );                   /// setne
+                break;
+            default:
+                break;
+            }
+        }
+
+        std::vector<std::uint8_t> code_;
+        std::vector<std::size_t>  deopts_;
+        std::vector<std::string>  names_;
+    };
+
+}}
+
+#endif // JIT_H
@@ -6,6 +6,7 @@
 #include <cstdint>
 
 #include "etool/trees/trie/base.h"
+#include "trace.h"
 
 namespace mico { namespace lexer {
 
@@ -148,6 +149,13 @@ namespace mico { namespace lexer {
             return "none";
         }
 
+        /// where a token starts in the source, from 1; 0 is unknown.
+        /// columns count bytes
+        struct position {
+            std::uint32_t line   = 0;
+            std::uint32_t column = 0;
+        };
+
         struct info {
 
             info( ) = default;
@@ -177,6 +185,7 @@ namespace mico { namespace lexer {
 
             type        name = type::ILLEGAL;
             std::string literal;
+            position    pos;
 
         };
 
@@ -393,6 +402,7 @@ namespace mico { namespace lexer {
         static
         table all( )
         {
+            trace::scope ts(trace::phase::TABLE);
             table res;
 
             static const
@@ -467,12 +477,41 @@ namespace mico { namespace lexer {
         static
         std::vector<info> get_list( table &t, IterT begin, IterT end )
         {
+            trace::scope ts(trace::phase::LEX);
             std::vector<info> res;
 
+            /// for the trace: the list counts when it grows, a token
+            /// when its literal does not fit into the string itself
+            auto counted = [&res]( std::size_t capacity ) {
+                if( res.capacity( ) != capacity ) {
+                    trace::count( res.capacity( ) * sizeof(info) );
+                }
+                trace::count( res.back( ).literal );
+            };
+
+            /// 'pos' is where 'at' is
+            position pos;
+            pos.line   = 1;
+            pos.column = 1;
+            auto at    = begin;
+            auto move  = [&]( IterT to ) {
+                for( ; at != to; ++at ) {
+                    if( *at == '\n' ) {
+                        pos.line++;
+                        pos.column = 1;
+                    } else {
+                        pos.column++;
+                    }
+                }
+            };
+
             begin = skip_whitespaces( begin, end );
 
             while( begin != end ) {
+                move( begin );
                 auto next = next_token( t, begin, end );
+                next.first.pos = pos;
+                auto capacity = res.capacity( );
                 if( next.first.name == type::ILLEGAL ) {
                     res.emplace_back( std::move(next.first) );
                     begin = end;
@@ -480,9 +519,14 @@ namespace mico { namespace lexer {
                     res.emplace_back( std::move(next.first) );
                     begin = skip_whitespaces(next.second, end);
                 }
+                counted( capacity );
             }
 
+            move( end );
+            auto capacity = res.capacity( );
             res.emplace_back( info(type::END_OF_FILE) );
+            res.back( ).pos = pos;
+            counted( capacity );
 
             return res;
         }
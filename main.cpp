@@ -9,6 +9,7 @@
 #include "lexer.h"
 
 #include "parser.h"
+#include "eval.h"
 
 using namespace mico;
 
@@ -45,6 +46,14 @@ int main(int argc, char *argv[])
                   << " " << l->to_string( ) << "\n";
     }
 
+    gc::heap heap;
+    eval::tagged_evaluator evaluator(heap);
+    auto res = evaluator.eval( prog );
+    for( auto &e: evaluator.errors_ ) {
+        std::cout << e << "\n";
+    }
+    std::cout << "result: " << objects::inspect( res ) << "\n";
+
 //    int result = Catch::Session( ).run( argc, argv );
 //    return ( result < 0xff ? result : 0xff );
 
@@ -1,10 +1,31 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += main.cpp \
-    check_lexer.cpp
+    check_lexer.cpp \
+    check_gc.cpp \
+    check_eval.cpp \
+    check_engine.cpp \
+    check_jit.cpp \
+    check_vector.cpp \
+    check_hash.cpp \
+    check_string.cpp \
+    check_function.cpp \
+    check_vm.cpp \
+    check_image.cpp \
+    check_snapshot.cpp \
+    check_executor.cpp \
+    check_scheduler.cpp \
+    check_batch.cpp \
+    check_parallel.cpp \
+    check_sequence.cpp \
+    check_lets.cpp \
+    check_native.cpp \
+    check_profile.cpp \
+    check_corpus.cpp \
+    check_trace.cpp
 
 INCLUDEPATH += etool/include/ \
                catch
@@ -12,5 +33,32 @@ INCLUDEPATH += etool/include/ \
 HEADERS += \
     lexer.h \
     parser.h \
-    ast.h
+    ast.h \
+    objects.h \
+    gc.h \
+    runtime.h \
+    native.h \
+    eval.h \
+    engine.h \
+    closure.h \
+    jit.h \
+    vector.h \
+    hash.h \
+    function.h \
+    sequence.h \
+    scope.h \
+    deps.h \
+    bytecode.h \
+    peephole.h \
+    vm.h \
+    profile.h \
+    trace.h \
+    corpus.h \
+    image.h \
+    snapshot.h \
+    pool.h \
+    executor.h \
+    scheduler.h \
+    batch.h \
+    check_util.h
 
@@ -0,0 +1,244 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "objects.h"
+#include "gc.h"
+
+namespace mico { namespace native {
+
+    /// How C++ functions bound with runtime::bind see script values.
+    ///
+    /// arg<T, ValueT> checks that a value can be a parameter of type T
+    /// and converts it; result<T, ValueT> makes a value of what the
+    /// function returns, false if it cannot be one. Both are picked at
+    /// compile time, so a call
+    /// costs the checks of its arguments and nothing else: no array of
+    /// arguments, no boxing. T is the parameter type without const and
+    /// reference; a const std::string & gets the text of the string
+    /// object itself.
+    ///
+    ///   integral types   INTEGER that T holds; neither an argument
+    ///                    nor a result is ever truncated
+    ///   bool             BOOLEAN
+    ///   std::string      STRING
+    ///   ValueT           anything, as it is
+    ///   void             null, as a result only
+    template <typename T, typename ValueT, typename Enable = void>
+    struct arg;
+
+    template <typename T, typename ValueT, typename Enable = void>
+    struct result;
+
+    template <typename T>
+    struct is_number {
+        static const bool value = std::is_integral<T>::value
+                               && !std::is_same<T, bool>::value;
+    };
+
+    /// 'val' is a value of T
+    template <typename T>
+    bool fits( std::int64_t val )
+    {
+        using limits = std::numeric_limits<T>;
+        if( std::is_signed<T>::value ) {
+            return val >= static_cast<std::int64_t>(limits::min( ))
+                && val <= static_cast<std::int64_t>(limits::max( ));
+        }
+        return val >= 0 && static_cast<std::uint64_t>(val)
+                            <= static_cast<std::uint64_t>(limits::max( ));
+    }
+
+    /// 'val' is a value of std::int64_t
+    template <typename T>
+    bool fits_int( T val )
+    {
+        return std::is_signed<T>::value
+            || static_cast<std::uint64_t>(val)
+                <= static_cast<std::uint64_t>(
+                        std::numeric_limits<std::int64_t>::max( ) );
+    }
+
+    template <typename T, typename ValueT>
+    struct arg<T, ValueT, typename std::enable_if<is_number<T>::value>::type> {
+
+        /// the range goes with it where T does not hold every integer
+        static const char *name( )
+        {
+            static const std::string res = make_name( );
+            return res.c_str( );
+        }
+
+        static bool is( const ValueT &val )
+        {
+            return val.is_int( ) && fits<T>( val.as_int( ) );
+        }
+
+        static T get( const ValueT &val )
+        {
+            return static_cast<T>(val.as_int( ));
+        }
+
+    private:
+
+        static std::string make_name( )
+        {
+            using limits = std::numeric_limits<T>;
+            if( fits<T>( std::numeric_limits<std::int64_t>::min( ) )
+             && fits<T>( std::numeric_limits<std::int64_t>::max( ) ) )
+            {
+                return "INTEGER";
+            }
+            return "INTEGER from " + std::to_string( limits::min( ) )
+                 + " to " + std::to_string( limits::max( ) );
+        }
+    };
+
+    template <typename ValueT>
+    struct arg<bool, ValueT> {
+
+        static const char *name( )
+        {
+            return "BOOLEAN";
+        }
+
+        static bool is( const ValueT &val )
+        {
+            return val.is_bool( );
+        }
+
+        static bool get( const ValueT &val )
+        {
+            return val.as_bool( );
+        }
+    };
+
+    template <typename ValueT>
+    struct arg<std::string, ValueT> {
+
+        static const char *name( )
+        {
+            return "STRING";
+        }
+
+        static bool is( const ValueT &val )
+        {
+            return !val.is_int( ) && val.is_object( )
+                && val.as_object( )->type( ) == objects::object_type::STRING;
+        }
+
+        static const std::string &get( const ValueT &val )
+        {
+            return static_cast<objects::string *>(val.as_object( ))->str( );
+        }
+    };
+
+    template <typename ValueT>
+    struct arg<ValueT, ValueT> {
+
+        static const char *name( )
+        {
+            return "any value";
+        }
+
+        static bool is( const ValueT & )
+        {
+            return true;
+        }
+
+        static const ValueT &get( const ValueT &val )
+        {
+            return val;
+        }
+    };
+
+    /// calls 'fn' and makes 'res' of what it returns
+    template <typename T, typename ValueT>
+    struct result<T, ValueT, typename std::enable_if<is_number<T>::value>::type> {
+
+        template <typename FnT, typename ...ArgsT>
+        static bool call( gc::heap &heap, ValueT &res,
+                          FnT fn, ArgsT &&...args )
+        {
+            auto val = fn( std::forward<ArgsT>(args)... );
+            if( !fits_int( val ) ) {
+                return false;
+            }
+            res = ValueT::from_int( heap, static_cast<std::int64_t>(val) );
+            return true;
+        }
+    };
+
+    template <typename ValueT>
+    struct result<bool, ValueT> {
+
+        template <typename FnT, typename ...ArgsT>
+        static bool call( gc::heap &, ValueT &res, FnT fn, ArgsT &&...args )
+        {
+            res = ValueT::from_bool( fn( std::forward<ArgsT>(args)... ) );
+            return true;
+        }
+    };
+
+    template <typename ValueT>
+    struct result<std::string, ValueT> {
+
+        template <typename FnT, typename ...ArgsT>
+        static bool call( gc::heap &heap, ValueT &res,
+                          FnT fn, ArgsT &&...args )
+        {
+            auto str = fn( std::forward<ArgsT>(args)... );
+            res = ValueT::from_object(
+                    heap.template make<objects::string>( std::move(str) ) );
+            return true;
+        }
+    };
+
+    template <typename ValueT>
+    struct result<ValueT, ValueT> {
+
+        template <typename FnT, typename ...ArgsT>
+        static bool call( gc::heap &, ValueT &res, FnT fn, ArgsT &&...args )
+        {
+            res = fn( std::forward<ArgsT>(args)... );
+            return true;
+        }
+    };
+
+    template <typename ValueT>
+    struct result<void, ValueT> {
+
+        template <typename FnT, typename ...ArgsT>
+        static bool call( gc::heap &, ValueT &res, FnT fn, ArgsT &&...args )
+        {
+            fn( std::forward<ArgsT>(args)... );
+            res = ValueT::null( );
+            return true;
+        }
+    };
+
+    /// 0, 1, ..., N - 1 as a pack
+    template <std::size_t ...I>
+    struct indices { };
+
+    template <std::size_t N, std::size_t ...I>
+    struct make_indices: make_indices<N - 1, N - 1, I...> { };
+
+    template <std::size_t ...I>
+    struct make_indices<0, I...> {
+        using type = indices<I...>;
+    };
+
+    template <typename T>
+    using plain = typename std::remove_cv<
+                            typename std::remove_reference<T>::type>::type;
+
+}}
+
+#endif // NATIVE_H
@@ -0,0 +1,645 @@
+#ifndef OBJECTS_H
+#define OBJECTS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <atomic>
+
+namespace mico { namespace objects {
+
+    enum class object_type: std::uint8_t {
+        NONE = 0,
+        INTEGER,
+        STRING,
+        ARRAY,
+        ENVIRONMENT,
+        VECTOR,
+        VECTOR_NODE,
+        BUILTIN,
+        HASH,
+        FUNCTION,
+        CELL,
+        SEQUENCE,
+    };
+
+    struct tracer;
+
+    struct object {
+
+        enum class color: std::uint8_t {
+            WHITE = 0,
+            GRAY,
+            BLACK,
+        };
+
+        virtual ~object( ) { }
+        virtual object_type type( ) const = 0;
+        virtual std::string inspect( ) const = 0;
+
+        /// must visit every object reachable from this one
+        virtual void trace( tracer & ) { }
+
+        /// collector state. managed by gc::heap only
+        color        gc_color = color::WHITE;
+        std::uint8_t gc_class = 0;
+    };
+
+    /// heap cell for integers that do not fit into a boxed_value
+    struct integer: public object {
+
+        integer( std::int64_t v )
+            :value(v)
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::INTEGER;
+        }
+
+        std::string inspect( ) const
+        {
+            return std::to_string( value );
+        }
+
+        std::int64_t value;
+    };
+
+    /// tagged union; 16 bytes
+    struct value {
+
+        enum class tag: std::uint8_t {
+            NUL = 0,
+            BOOLEAN,
+            INTEGER,
+            OBJECT,
+        };
+
+        value( ) = default;
+
+        static
+        value null( )
+        {
+            return value( );
+        }
+
+        static
+        value from_bool( bool v )
+        {
+            value res;
+            res.tag_ = tag::BOOLEAN;
+            res.boolean_ = v;
+            return res;
+        }
+
+        static
+        value from_int( std::int64_t v )
+        {
+            value res;
+            res.tag_ = tag::INTEGER;
+            res.integer_ = v;
+            return res;
+        }
+
+        /// every int64 fits; the heap is never touched
+        template <typename HeapT>
+        static
+        value from_int( HeapT &, std::int64_t v )
+        {
+            return from_int( v );
+        }
+
+        static
+        value from_object( object *v )
+        {
+            value res;
+            res.tag_ = v ? tag::OBJECT : tag::NUL;
+            res.object_ = v;
+            return res;
+        }
+
+        tag get_tag( ) const
+        {
+            return tag_;
+        }
+
+        bool is_null( ) const
+        {
+            return tag_ == tag::NUL;
+        }
+
+        bool is_bool( ) const
+        {
+            return tag_ == tag::BOOLEAN;
+        }
+
+        bool is_int( ) const
+        {
+            return tag_ == tag::INTEGER;
+        }
+
+        bool is_object( ) const
+        {
+            return tag_ == tag::OBJECT;
+        }
+
+        bool as_bool( ) const
+        {
+            return boolean_;
+        }
+
+        std::int64_t as_int( ) const
+        {
+            return integer_;
+        }
+
+        object *as_object( ) const
+        {
+            return object_;
+        }
+
+        /// the heap cell this value keeps alive, if any
+        object *gc_object( ) const
+        {
+            return is_object( ) ? object_ : nullptr;
+        }
+
+        bool same( const value &other ) const
+        {
+            if( tag_ != other.tag_ ) {
+                return false;
+            }
+            switch( tag_ ) {
+            case tag::NUL:
+                return true;
+            case tag::BOOLEAN:
+                return boolean_ == other.boolean_;
+            case tag::INTEGER:
+                return integer_ == other.integer_;
+            case tag::OBJECT:
+                return object_ == other.object_;
+            }
+            return false;
+        }
+
+    private:
+        tag tag_ = tag::NUL;
+        union {
+            bool         boolean_;
+            std::int64_t integer_;
+            object      *object_ = nullptr;
+        };
+    };
+
+    /// pointer tagging; 8 bytes
+    ///   ...iiii1  63-bit integer
+    ///   ...pp000  object pointer (cells are 16-byte aligned)
+    ///   00000010  null
+    ///   000b1010  boolean
+    /// integers outside of 63 bits are promoted to an 'integer' cell
+    struct boxed_value {
+
+        static const std::int64_t max_small = (std::int64_t(1) << 62) - 1;
+        static const std::int64_t min_small = -(std::int64_t(1) << 62);
+
+        boxed_value( ) = default;
+
+        static
+        boxed_value null( )
+        {
+            return boxed_value( );
+        }
+
+        static
+        boxed_value from_bool( bool v )
+        {
+            return boxed_value( v ? TRUE_BITS : FALSE_BITS );
+        }
+
+        static
+        bool fits_small( std::int64_t v )
+        {
+            return ( min_small <= v ) && ( v <= max_small );
+        }
+
+        /// only for values that pass 'fits_small'
+        static
+        boxed_value from_small( std::int64_t v )
+        {
+            return boxed_value( (static_cast<std::uint64_t>(v) << 1) | 1 );
+        }
+
+        template <typename HeapT>
+        static
+        boxed_value from_int( HeapT &heap, std::int64_t v )
+        {
+            if( fits_small( v ) ) {
+                return from_small( v );
+            }
+            return from_object( heap.template make<integer>( v ) );
+        }
+
+        static
+        boxed_value from_object( object *v )
+        {
+            return v ? boxed_value( reinterpret_cast<std::uintptr_t>(v) )
+                     : null( );
+        }
+
+        bool is_null( ) const
+        {
+            return bits_ == NULL_BITS;
+        }
+
+        bool is_bool( ) const
+        {
+            return ( bits_ == FALSE_BITS ) || ( bits_ == TRUE_BITS );
+        }
+
+        bool is_small( ) const
+        {
+            return (bits_ & 1) != 0;
+        }
+
+        bool is_int( ) const
+        {
+            return is_small( )
+                || ( is_pointer( )
+                  && pointer( )->type( ) == object_type::INTEGER )
+                 ;
+        }
+
+        bool is_object( ) const
+        {
+            return is_pointer( )
+                && ( pointer( )->type( ) != object_type::INTEGER )
+                 ;
+        }
+
+        bool as_bool( ) const
+        {
+            return bits_ == TRUE_BITS;
+        }
+
+        std::int64_t as_int( ) const
+        {
+            if( is_small( ) ) {
+                /// arithmetic shift keeps the sign
+                return static_cast<std::int64_t>(bits_) >> 1;
+            }
+            return static_cast<integer *>(pointer( ))->value;
+        }
+
+        object *as_object( ) const
+        {
+            return pointer( );
+        }
+
+        object *gc_object( ) const
+        {
+            return is_pointer( ) ? pointer( ) : nullptr;
+        }
+
+        bool same( const boxed_value &other ) const
+        {
+            if( bits_ == other.bits_ ) {
+                return true;
+            }
+            /// promoted integers are compared by value
+            return is_int( ) && other.is_int( )
+                && ( as_int( ) == other.as_int( ) )
+                 ;
+        }
+
+    private:
+
+        static const std::uint64_t NULL_BITS  = 0x02;
+        static const std::uint64_t FALSE_BITS = 0x0A;
+        static const std::uint64_t TRUE_BITS  = 0x1A;
+
+        explicit boxed_value( std::uint64_t bits )
+            :bits_(bits)
+        { }
+
+        bool is_pointer( ) const
+        {
+            return ( (bits_ & 7) == 0 ) && ( bits_ != 0 );
+        }
+
+        object *pointer( ) const
+        {
+            return reinterpret_cast<object *>(bits_);
+        }
+
+        std::uint64_t bits_ = NULL_BITS;
+    };
+
+    /// visitor passed to object::trace; the collector implements it
+    struct tracer {
+
+        virtual ~tracer( ) { }
+        virtual void visit( object *obj ) = 0;
+
+        void visit( const value &val )
+        {
+            if( auto obj = val.gc_object( ) ) {
+                visit( obj );
+            }
+        }
+
+        void visit( const boxed_value &val )
+        {
+            if( auto obj = val.gc_object( ) ) {
+                visit( obj );
+            }
+        }
+    };
+
+    /// Immutable string. The characters of a flat string are kept in a
+    /// std::string, so short ones sit in its inline buffer and need no
+    /// allocation besides the cell.
+    ///
+    /// A rope is the concatenation of two strings that has not been
+    /// built yet: it holds both halves and turns flat the first time its
+    /// characters are needed (indexing, comparing, hashing, printing).
+    /// Repeated 'let s = s + x' is linear instead of quadratic
+    struct string: public object {
+
+        string( ) = default;
+        string( std::string v )
+            :flat_(std::move(v))
+            ,length_(flat_.size( ))
+        { }
+
+        /// both halves must stay reachable until the node is traced
+        string( string *left, string *right )
+            :left_(left)
+            ,right_(right)
+            ,length_(left->size( ) + right->size( ))
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::STRING;
+        }
+
+        std::string inspect( ) const
+        {
+            return "\"" + str( ) + "\"";
+        }
+
+        void trace( tracer &t )
+        {
+            if( left_ ) {
+                t.visit( left_ );
+                t.visit( right_ );
+            }
+        }
+
+        std::size_t size( ) const
+        {
+            return length_;
+        }
+
+        bool is_rope( ) const
+        {
+            return left_ != nullptr;
+        }
+
+        const std::string &str( ) const
+        {
+            if( left_ ) {
+                flatten( );
+            }
+            return flat_;
+        }
+
+        /// computed on first use and kept
+        std::uint64_t hash( ) const
+        {
+            if( !hashed_ ) {
+                /// FNV-1a with a final avalanche for the low bits
+                std::uint64_t h = 0xcbf29ce484222325ULL;
+                for( auto c: str( ) ) {
+                    h ^= static_cast<unsigned char>(c);
+                    h *= 0x100000001b3ULL;
+                }
+                h ^= h >> 32;
+                h *= 0xd6e8feb86659fd93ULL;
+                h ^= h >> 32;
+                hash_   = h;
+                hashed_ = true;
+            }
+            return hash_;
+        }
+
+        bool equal( const string *other ) const
+        {
+            if( this == other ) {
+                return true;
+            }
+            /// there is one interned object per content
+            if( ( interned && other->interned )
+             || ( length_ != other->length_ ) )
+            {
+                return false;
+            }
+            if( hashed_ && other->hashed_ && hash_ != other->hash_ ) {
+                return false;
+            }
+            return str( ) == other->str( );
+        }
+
+        /// a literal owned by the runtime's intern table
+        bool interned = false;
+
+    private:
+
+        /// left to right without recursion; ropes built by a loop are
+        /// as deep as the loop was long. Dropping the halves afterwards
+        /// only removes references, so no write barrier is needed
+        void flatten( ) const
+        {
+            std::string res;
+            res.reserve( length_ );
+            std::vector<const string *> todo;
+            todo.push_back( right_ );
+            todo.push_back( left_ );
+            while( !todo.empty( ) ) {
+                auto next = todo.back( );
+                todo.pop_back( );
+                if( next->left_ ) {
+                    todo.push_back( next->right_ );
+                    todo.push_back( next->left_ );
+                } else {
+                    res += next->flat_;
+                }
+            }
+            flat_.swap( res );
+            left_  = nullptr;
+            right_ = nullptr;
+        }
+
+        mutable std::string   flat_;
+        mutable string       *left_   = nullptr;
+        mutable string       *right_  = nullptr;
+        std::size_t           length_ = 0;
+        mutable std::uint64_t hash_   = 0;
+        mutable bool          hashed_ = false;
+    };
+
+    template <typename ValueT>
+    std::string inspect( const ValueT &val )
+    {
+        if( val.is_null( ) ) {
+            return "null";
+        } else if( val.is_bool( ) ) {
+            return val.as_bool( ) ? "true" : "false";
+        } else if( val.is_int( ) ) {
+            return std::to_string( val.as_int( ) );
+        }
+        return val.as_object( )->inspect( );
+    }
+
+    template <typename ValueT>
+    struct basic_array: public object {
+
+        object_type type( ) const
+        {
+            return object_type::ARRAY;
+        }
+
+        std::string inspect( ) const
+        {
+            std::ostringstream oss;
+            oss << "[";
+            bool first = true;
+            for( auto &e: elements ) {
+                if( !first ) {
+                    oss << ", ";
+                }
+                oss << objects::inspect( e );
+                first = false;
+            }
+            oss << "]";
+            return oss.str( );
+        }
+
+        void trace( tracer &t )
+        {
+            for( auto &e: elements ) {
+                t.visit( e );
+            }
+        }
+
+        std::vector<ValueT> elements;
+    };
+
+    template <typename ValueT>
+    struct basic_environment: public object {
+
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        basic_environment( )
+            :id(next_id( ))
+        { }
+
+        basic_environment( basic_environment *par )
+            :id(next_id( ))
+            ,parent(par)
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::ENVIRONMENT;
+        }
+
+        std::string inspect( ) const
+        {
+            return "<environment>";
+        }
+
+        void trace( tracer &t )
+        {
+            t.visit( parent );
+            for( auto &v: slots ) {
+                t.visit( v );
+            }
+        }
+
+        /// slots are never removed, so an index stays valid
+        /// for as long as the environment lives
+        std::size_t slot_of( const std::string &name ) const
+        {
+            auto f = names.find( name );
+            return ( f != names.end( ) ) ? f->second : npos;
+        }
+
+        const ValueT *get( const std::string &name ) const
+        {
+            auto slot = slot_of( name );
+            if( slot != npos ) {
+                return &slots[slot];
+            }
+            return parent ? parent->get( name ) : nullptr;
+        }
+
+        std::size_t set( const std::string &name, ValueT val )
+        {
+            auto slot = slot_of( name );
+            if( slot == npos ) {
+                slot = slots.size( );
+                names[name] = slot;
+                slots.push_back( val );
+            } else {
+                slots[slot] = val;
+            }
+            return slot;
+        }
+
+        /// unique for the process lifetime, unlike the address
+        const std::uint64_t id;
+        basic_environment *parent = nullptr;
+        std::map<std::string, std::size_t> names;
+        std::vector<ValueT> slots;
+
+    private:
+
+        static
+        std::uint64_t next_id( )
+        {
+            static std::atomic<std::uint64_t> last(0);
+            return ++last;
+        }
+    };
+
+    /// function implemented by the runtime; 'id' is its index there
+    struct builtin: public object {
+
+        builtin( std::uint32_t i, std::string n )
+            :id(i)
+            ,name(std::move(n))
+        { }
+
+        object_type type( ) const
+        {
+            return object_type::BUILTIN;
+        }
+
+        std::string inspect( ) const
+        {
+            return "builtin function";
+        }
+
+        std::uint32_t id;
+        std::string   name;
+    };
+
+    using array       = basic_array<value>;
+    using environment = basic_environment<value>;
+
+}}
+
+#endif // OBJECTS_H
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "bench.h"
+#include "vm.h"
+
+using namespace mico;
+
+/// Runs a corpus of scripts on the vm and prints the opcode pairs that
+/// ran most often: the candidates for new superinstructions.
+///   monkey_opcode_pairs [-n count] [-O] [script ...]
+/// -O counts pairs after the peephole pass, to see what is left.
+/// Without scripts a small built-in corpus is used
+
+namespace {
+
+    const char *corpus[] = {
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; "
+        "fib(18)",
+
+        "let count = fn(n, acc) { if (n == 0) { return acc; } "
+        "count(n - 1, acc + 1) }; count(20000, 0)",
+
+        "let map = fn(a, f) { let go = fn(a, acc) { if (len(a) == 0) { acc } "
+        "else { go(rest(a), push(acc, f(first(a)))) } }; go(a, []) }; "
+        "let reduce = fn(a, acc, f) { if (len(a) == 0) { acc } "
+        "else { reduce(rest(a), f(acc, first(a)), f) } }; "
+        "let range = fn(n) { let go = fn(i, acc) { if (i == n) { acc } "
+        "else { go(i + 1, push(acc, i)) } }; go(0, []) }; "
+        "reduce(map(range(500), fn(x) { x * 2 }), 0, fn(s, x) { s + x })",
+
+        "let words = {\"a\": 1, \"b\": 2, \"c\": 3}; "
+        "let sum = fn(keys, i, acc) { if (i == len(keys)) { acc } "
+        "else { sum(keys, i + 1, acc + words[keys[i]]) } }; "
+        "sum([\"a\", \"b\", \"c\", \"a\"], 0, 0)",
+    };
+
+    std::string read_file( const std::string &path )
+    {
+        std::ifstream in(path);
+        if( !in ) {
+            std::cerr << "cannot read " << path << "\n";
+            return "";
+        }
+        return std::string( std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>( ) );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    std::size_t top = 20;
+    bool fused      = false;
+    std::vector<std::string> scripts;
+
+    for( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        if( arg == "-n" && i + 1 < argc ) {
+            top = static_cast<std::size_t>(std::stoul( argv[++i] ));
+        } else if( arg == "-O" ) {
+            fused = true;
+        } else {
+            scripts.push_back( read_file( arg ) );
+        }
+    }
+    if( scripts.empty( ) ) {
+        scripts.assign( std::begin( corpus ), std::end( corpus ) );
+    }
+
+    gc::heap heap;
+    engines::vm_engine<objects::value> vm(heap);
+    vm.set_peephole( fused );
+    vm.set_profiling( true );
+
+    for( auto &s: scripts ) {
+        auto prog = bench::parse( s );
+        vm.load( prog );
+        vm.run( );
+        for( auto &e: vm.errors_ ) {
+            std::cerr << "error: " << e << "\n";
+        }
+    }
+
+    auto pairs = vm.opcode_pairs( );
+    auto total = vm.dispatches( );
+    std::cout << "dispatches: " << total << "\n";
+    for( std::size_t i = 0; i < pairs.size( ) && i < top; ++i ) {
+        std::ostringstream name;
+        name << bytecode::name( pairs[i].first ) << " "
+             << bytecode::name( pairs[i].second );
+        bench::row( std::cout, name.str( ), pairs[i].count,
+                    std::to_string( pairs[i].count * 100 / total ) + "%" );
+    }
+    return 0;
+}
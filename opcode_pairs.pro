@@ -0,0 +1,28 @@
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = monkey_opcode_pairs
+
+SOURCES += opcode_pairs.cpp
+
+INCLUDEPATH += etool/include/
+
+HEADERS += \
+    bench.h \
+    lexer.h \
+    parser.h \
+    ast.h \
+    objects.h \
+    gc.h \
+    runtime.h \
+    vector.h \
+    hash.h \
+    function.h \
+    scope.h \
+    engine.h \
+    eval.h \
+    bytecode.h \
+    peephole.h \
+    vm.h
@@ -3,9 +3,11 @@
 
 #include <vector>
 #include <functional>
+#include <limits>
 
 #include "lexer.h"
 #include "ast.h"
+#include "scope.h"
 
 namespace mico { namespace parser {
 
@@ -40,6 +42,7 @@ namespace mico { namespace parser {
             ,PRODUCT // *
             ,PREFIX // -X or !X
             ,CALL // myFunction(X)
+            ,INDEX // array[index]
         };
         using precedence_map = std::map<type, precedence>;
 
@@ -86,22 +89,33 @@ namespace mico { namespace parser {
             return 10;
         }
 
+        /// literals have to fit into int64 whatever the base is;
+        /// 0xFFFFFFFFFFFFFFFF is out of range, not -1
         static
-        std::int64_t parse_int( std::string data, int s = 10 )
+        bool parse_int( const std::string &data, int s, std::int64_t &res )
         {
-            std::int64_t res = 0;
+            static const auto max = std::numeric_limits<std::int64_t>::max( );
+            res = 0;
             for( auto c: data ) {
-                res *= s;
                 auto next = char2value( c );
-                if( next < 0 ) {
-                    return -1;
+                if( next < 0 || next >= s ) {
+                    return false;
                 }
-                res += next;
+                if( res > (max - next) / s ) {
+                    return false;
+                }
+                res = res * s + next;
             }
-            return res;
+            return true;
         }
 
         token_reader( tokens_list tok )
+            :token_reader(std::move(tok), trace::scope(trace::phase::READER))
+        { }
+
+        /// the scope is a temporary of the call above, so it lives until
+        /// this returns and the initializers are traced too
+        token_reader( tokens_list tok, const trace::scope & )
             :tokens_(std::move(tok))
             ,current_(tokens_.begin( ))
             ,peek_(next_itr(current_, tokens_.end( )))
@@ -123,6 +137,31 @@ namespace mico { namespace parser {
                 return parse_int_expression( );
             };
 
+            prefix_calls_[type::TRUE] = [this]( ){
+                return parse_bool_expression( );
+            };
+            prefix_calls_[type::FALSE] = [this]( ){
+                return parse_bool_expression( );
+            };
+            prefix_calls_[type::LPAREN] = [this]( ){
+                return parse_group_expression( );
+            };
+            prefix_calls_[type::LBRACKET] = [this]( ){
+                return parse_array_expression( );
+            };
+            prefix_calls_[type::LBRACE] = [this]( ){
+                return parse_hash_expression( );
+            };
+            prefix_calls_[type::STRING] = [this]( ){
+                return parse_string_expression( );
+            };
+            prefix_calls_[type::IF] = [this]( ){
+                return parse_if_expression( );
+            };
+            prefix_calls_[type::FUNCTION] = [this]( ){
+                return parse_function_expression( );
+            };
+
             prefix_calls_[type::MINUS] = [this]( ) {
                 return parse_prefix( );
             };
@@ -145,6 +184,9 @@ namespace mico { namespace parser {
             precedences_[type::SLASH]    = precedence::PRODUCT;
             precedences_[type::ASTERISK] = precedence::PRODUCT;
 
+            precedences_[type::LPAREN]   = precedence::CALL;
+            precedences_[type::LBRACKET] = precedence::INDEX;
+
             postfix_call_[type::PLUS] = [this](ast::expression::uptr expr) {
                 return parse_postfix( std::move(expr) );
             };
@@ -169,6 +211,12 @@ namespace mico { namespace parser {
             postfix_call_[type::GT] = [this](ast::expression::uptr expr) {
                 return parse_postfix( std::move(expr) );
             };
+            postfix_call_[type::LPAREN] = [this](ast::expression::uptr expr) {
+                return parse_call( std::move(expr) );
+            };
+            postfix_call_[type::LBRACKET] = [this](ast::expression::uptr expr) {
+                return parse_index( std::move(expr) );
+            };
 
         }
 
@@ -247,12 +295,237 @@ namespace mico { namespace parser {
             std::unique_ptr<ast::int_expression>
                                 res(new ast::int_expression);
 
-            res->value = parse_int( current( ).literal,
-                                    intbase2int( current( ).name ) );
+            if( !parse_int( current( ).literal,
+                            intbase2int( current( ).name ), res->value ) )
+            {
+                std::ostringstream oss;
+                oss << "Integer literal is out of range: "
+                    << current( ).to_string( );
+                errors_.push_back( oss.str( ) );
+                return ast::expression::uptr( );
+            }
 
             return res;
         }
 
+        ast::expression::uptr parse_bool_expression( )
+        {
+            std::unique_ptr<ast::bool_expression>
+                                res(new ast::bool_expression);
+
+            res->value = current_is( type::TRUE );
+
+            return res;
+        }
+
+        ast::expression::uptr parse_group_expression( )
+        {
+            advance( );
+            auto res = parse_expression( precedence::LOWEST );
+            if( !expect_peek( type::RPAREN ) ) {
+                return ast::expression::uptr( );
+            }
+            return res;
+        }
+
+        /// comma separated expressions up to 'end';
+        /// current( ) is the opening token
+        bool parse_expression_list( type end,
+                                    std::vector<ast::expression::uptr> &res )
+        {
+            if( peek_is( end ) ) {
+                advance( );
+                return true;
+            }
+
+            advance( );
+            res.emplace_back( parse_expression( precedence::LOWEST ) );
+            while( peek_is( type::COMMA ) ) {
+                advance( );
+                advance( );
+                res.emplace_back( parse_expression( precedence::LOWEST ) );
+            }
+
+            for( auto &e: res ) {
+                if( !e ) {
+                    return false;
+                }
+            }
+            return expect_peek( end );
+        }
+
+        ast::expression::uptr parse_array_expression( )
+        {
+            std::unique_ptr<ast::array_expression>
+                                res(new ast::array_expression);
+
+            if( !parse_expression_list( type::RBRACKET, res->elements ) ) {
+                return ast::expression::uptr( );
+            }
+            return res;
+        }
+
+        ast::expression::uptr parse_hash_expression( )
+        {
+            std::unique_ptr<ast::hash_expression>
+                                res(new ast::hash_expression);
+
+            while( !peek_is( type::RBRACE ) ) {
+                advance( );
+                auto key = parse_expression( precedence::LOWEST );
+                if( !key || !expect_peek( type::COLON ) ) {
+                    return ast::expression::uptr( );
+                }
+                advance( );
+                auto val = parse_expression( precedence::LOWEST );
+                if( !val ) {
+                    return ast::expression::uptr( );
+                }
+                res->pairs.emplace_back( std::move(key), std::move(val) );
+                if( !peek_is( type::RBRACE ) && !expect_peek( type::COMMA ) ) {
+                    return ast::expression::uptr( );
+                }
+            }
+
+            if( !expect_peek( type::RBRACE ) ) {
+                return ast::expression::uptr( );
+            }
+            return res;
+        }
+
+        ast::expression::uptr parse_string_expression( )
+        {
+            std::unique_ptr<ast::string_expression>
+                                res(new ast::string_expression);
+
+            res->value = current( ).literal;
+
+            return res;
+        }
+
+        /// current( ) is LBRACE; stops at the matching RBRACE
+        std::unique_ptr<ast::block_statement> parse_block( )
+        {
+            std::unique_ptr<ast::block_statement>
+                                res(new ast::block_statement);
+            res->pos = current( ).pos;
+
+            advance( );
+            while( !current_is( type::RBRACE ) ) {
+                if( eof( ) ) {
+                    errors_.push_back( "Expected '}' but got end of file" );
+                    return std::unique_ptr<ast::block_statement>( );
+                }
+                if( auto stmt = parse_statement( ) ) {
+                    res->states.emplace_back( std::move(stmt) );
+                }
+                advance( );
+            }
+            return res;
+        }
+
+        ast::expression::uptr parse_if_expression( )
+        {
+            std::unique_ptr<ast::if_expression> res(new ast::if_expression);
+
+            if( !expect_peek( type::LPAREN ) ) {
+                return ast::expression::uptr( );
+            }
+            advance( );
+            res->cond = parse_expression( precedence::LOWEST );
+            if( !res->cond || !expect_peek( type::RPAREN )
+             || !expect_peek( type::LBRACE ) )
+            {
+                return ast::expression::uptr( );
+            }
+
+            res->then_block = parse_block( );
+            if( !res->then_block ) {
+                return ast::expression::uptr( );
+            }
+
+            if( peek_is( type::ELSE ) ) {
+                advance( );
+                if( !expect_peek( type::LBRACE ) ) {
+                    return ast::expression::uptr( );
+                }
+                res->else_block = parse_block( );
+                if( !res->else_block ) {
+                    return ast::expression::uptr( );
+                }
+            }
+            return res;
+        }
+
+        bool parse_params( std::vector<std::string> &res )
+        {
+            if( peek_is( type::RPAREN ) ) {
+                advance( );
+                return true;
+            }
+
+            if( !expect_peek( type::IDENT ) ) {
+                return false;
+            }
+            res.push_back( current( ).literal );
+            while( peek_is( type::COMMA ) ) {
+                advance( );
+                if( !expect_peek( type::IDENT ) ) {
+                    return false;
+                }
+                res.push_back( current( ).literal );
+            }
+            return expect_peek( type::RPAREN );
+        }
+
+        ast::expression::uptr parse_function_expression( )
+        {
+            std::unique_ptr<ast::function_expression>
+                                res(new ast::function_expression);
+            res->info = std::make_shared<ast::function_info>( );
+            res->info->pos = current( ).pos;
+
+            if( !expect_peek( type::LPAREN )
+             || !parse_params( res->info->params )
+             || !expect_peek( type::LBRACE ) )
+            {
+                return ast::expression::uptr( );
+            }
+
+            auto body = parse_block( );
+            if( !body ) {
+                return ast::expression::uptr( );
+            }
+            res->info->body = std::move(body->states);
+            return res;
+        }
+
+        ast::expression::uptr parse_call( ast::expression::uptr func )
+        {
+            std::unique_ptr<ast::call_expression>
+                                res(new ast::call_expression);
+
+            res->func = std::move(func);
+            if( !parse_expression_list( type::RPAREN, res->args ) ) {
+                return ast::expression::uptr( );
+            }
+            return res;
+        }
+
+        ast::expression::uptr parse_index( ast::expression::uptr left )
+        {
+            std::unique_ptr<ast::index_expression>
+                                res(new ast::index_expression);
+
+            res->left = std::move(left);
+            advance( );
+            res->index = parse_expression( precedence::LOWEST );
+            if( !res->index || !expect_peek( type::RBRACKET ) ) {
+                return ast::expression::uptr( );
+            }
+            return res;
+        }
+
         ast::expression::uptr parse_ident_expression( )
         {
             std::unique_ptr<ast::ident_expression>
@@ -270,12 +543,20 @@ namespace mico { namespace parser {
                 return std::unique_ptr<ast::expression>( );
             }
 
+            auto at   = current( ).pos;
             auto left = pref_call->second( );
+            if( left ) {
+                left->pos = at;
+            }
             while( (peek( ).name != type::SEMICOLON) && (p < peek_precedence( )) ) {
                 auto infix = postfix_call_.find( peek( ).name );
                 if( infix != postfix_call_.end( ) ) {
                     advance( );
+                    at   = current( ).pos;
                     left = infix->second(std::move(left));
+                    if( left ) {
+                        left->pos = at;
+                    }
                 } else {
                     return left;
                 }
@@ -289,7 +570,12 @@ namespace mico { namespace parser {
         {
             std::unique_ptr<ast::expr_statement> res(new ast::expr_statement);
             res->expr = parse_expression( p );
-            advance( );
+            if( peek_is( type::SEMICOLON ) ) {
+                advance( );
+            }
+            if( !res->expr ) {
+                return std::unique_ptr<ast::expr_statement>( );
+            }
             return res;
         }
 
@@ -346,7 +632,17 @@ namespace mico { namespace parser {
                 return std::unique_ptr<ast::let_statement>( );
             }
 
-            while( !eof( ) && !current_is( type::SEMICOLON ) ) {
+            advance( );
+            res->expr = parse_expression( precedence::LOWEST );
+            if( !res->expr ) {
+                return std::unique_ptr<ast::let_statement>( );
+            }
+            if( res->expr->type( ) == ast::node_type::EXPRESSION_FUNCTION ) {
+                static_cast<ast::function_expression *>(res->expr.get( ))
+                        ->info->name = res->ident->value;
+            }
+
+            if( peek_is( type::SEMICOLON ) ) {
                 advance( );
             }
 
@@ -358,35 +654,52 @@ namespace mico { namespace parser {
             advance( );
             std::unique_ptr<ast::return_statement>
                     res(new ast::return_statement);
-            while( !eof( ) && !current_is( type::SEMICOLON ) ) {
-                advance( );
+
+            if( !current_is( type::SEMICOLON ) ) {
+                res->expr = parse_expression( precedence::LOWEST );
+                if( peek_is( type::SEMICOLON ) ) {
+                    advance( );
+                }
             }
             return res;
         }
 
+        /// leaves current( ) on the last token of the statement
+        statement_ptr parse_statement( )
+        {
+            auto at = current( ).pos;
+            statement_ptr res;
+            switch( current( ).name ) {
+            case type::LET:
+                res = parse_let( );
+                break;
+            case type::RETURN:
+                res = parse_return( );
+                break;
+            default:
+                res = parse_state_expression( precedence::LOWEST );
+                break;
+            }
+            if( res ) {
+                res->pos = at;
+            }
+            return res;
+        }
+
+        /// identifiers of the result are resolved (scope::resolver)
         program parse( )
         {
+            trace::scope ts(trace::phase::PARSE);
             program res;
 
             while( !eof( ) ) {
-                statement_ptr stmt;
-                switch( current( ).name ) {
-                case type::LET:
-                    stmt = parse_let( );
-                    break;
-                case type::RETURN:
-                    stmt = parse_return( );
-                    break;
-                default:
-                    stmt = parse_state_expression( precedence::LOWEST );
-                    break;
-                }
-                if( stmt ) {
+                if( auto stmt = parse_statement( ) ) {
                     res.states.emplace_back( std::move(stmt) );
                 }
                 advance( );
             }
 
+            scope::resolver::resolve( res.states );
             return res;
         }
 
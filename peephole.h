@@ -0,0 +1,273 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace mico { namespace bytecode {
+
+    /// Rewrites the code of a module in place, until nothing changes:
+    ///  - jumps to jumps go to the final target, a jump to a RETURN
+    ///    becomes the RETURN, a jump to the next instruction goes away
+    ///  - a pure push followed by POP goes away
+    ///  - SET_x n; GET_x n becomes TEE_x n
+    ///  - frequent pairs become one superinstruction (see opcode),
+    ///    e.g. GET_LOCAL n; CONST 1; SUB is LOCAL_SUB_CONST n 1 and
+    ///    LT; JUMP_IF_FALSE t is JUMP_UNLESS_LT t.
+    /// Instructions are only merged if no jump goes into the middle of
+    /// them. The pairs were picked with the opcode_pairs tool
+    class peephole {
+
+    public:
+
+        struct stats {
+            std::size_t before   = 0;
+            std::size_t after    = 0;
+            std::size_t fused    = 0;
+            std::size_t removed  = 0;
+            std::size_t threaded = 0;
+        };
+
+        static
+        stats optimize( module &mod )
+        {
+            stats res;
+            for( auto &p: mod.protos ) {
+                res.before += p.code.size( );
+                optimize( p.code, p.lines, res );
+                res.after += p.code.size( );
+            }
+            return res;
+        }
+
+        /// 'lines' go along with the instructions they belong to; a
+        /// fused one is at the line of the first of its pair
+        static
+        void optimize( std::vector<instr> &code,
+                       std::vector<std::uint32_t> &lines, stats &st )
+        {
+            if( lines.size( ) != code.size( ) ) {
+                lines.clear( );
+            }
+            bool changed = true;
+            while( changed ) {
+                changed = thread( code, st );
+                changed = rewrite( code, lines, st ) || changed;
+            }
+        }
+
+    private:
+
+        static
+        instr make( opcode op, std::int32_t a = 0, std::int32_t b = 0 )
+        {
+            instr res;
+            res.op = op;
+            res.a  = a;
+            res.b  = b;
+            return res;
+        }
+
+        static
+        bool thread( std::vector<instr> &code, stats &st )
+        {
+            bool changed = false;
+            for( auto &ins: code ) {
+                if( !is_jump( ins.op ) ) {
+                    continue;
+                }
+                auto target = ins.a;
+                /// a loop of jumps never ends; stop after code.size( ) hops
+                for( std::size_t hops = 0;
+                     hops < code.size( )
+                       && code[target].op == opcode::JUMP
+                       && code[target].a != target;
+                     ++hops )
+                {
+                    target = code[target].a;
+                }
+                if( target != ins.a ) {
+                    ins.a = target;
+                    st.threaded++;
+                    changed = true;
+                }
+                if( ins.op == opcode::JUMP
+                 && code[target].op == opcode::RETURN )
+                {
+                    ins = code[target];
+                    st.threaded++;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        static
+        bool pure_push( opcode op )
+        {
+            switch( op ) {
+            case opcode::CONST:
+            case opcode::NIL:
+            case opcode::TRUE:
+            case opcode::FALSE:
+            case opcode::GET_LOCAL:
+            case opcode::GET_CAPTURE:
+                return true;
+            default:
+                break;
+            }
+            return false;
+        }
+
+        static
+        opcode with_const( opcode op )
+        {
+            switch( op ) {
+            case opcode::ADD: return opcode::ADD_CONST;
+            case opcode::SUB: return opcode::SUB_CONST;
+            case opcode::LT:  return opcode::LT_CONST;
+            case opcode::GT:  return opcode::GT_CONST;
+            case opcode::EQ:  return opcode::EQ_CONST;
+            default:
+                break;
+            }
+            return opcode::NOP;
+        }
+
+        static
+        opcode with_jump( opcode op )
+        {
+            switch( op ) {
+            case opcode::LT:       return opcode::JUMP_UNLESS_LT;
+            case opcode::GT:       return opcode::JUMP_UNLESS_GT;
+            case opcode::EQ:       return opcode::JUMP_UNLESS_EQ;
+            case opcode::LT_CONST: return opcode::JUMP_UNLESS_LT_CONST;
+            case opcode::GT_CONST: return opcode::JUMP_UNLESS_GT_CONST;
+            case opcode::EQ_CONST: return opcode::JUMP_UNLESS_EQ_CONST;
+            case opcode::NOT:      return opcode::JUMP_IF_TRUE;
+            default:
+                break;
+            }
+            return opcode::NOP;
+        }
+
+        /// 'x' and 'y' as one instruction; NOP if there is none
+        static
+        instr fuse( const instr &x, const instr &y )
+        {
+            auto op = with_const( y.op );
+            if( x.op == opcode::CONST && op != opcode::NOP ) {
+                return make( op, x.a );
+            }
+
+            op = with_jump( x.op );
+            if( y.op == opcode::JUMP_IF_FALSE && op != opcode::NOP ) {
+                /// the target stays in 'a', the constant moves to 'b'
+                return make( op, y.a, x.a );
+            }
+
+            switch( x.op ) {
+            case opcode::GET_LOCAL:
+                if( y.op == opcode::GET_LOCAL ) {
+                    return make( opcode::GET_LOCAL2, x.a, y.a );
+                } else if( y.op == opcode::ADD_CONST ) {
+                    return make( opcode::LOCAL_ADD_CONST, x.a, y.a );
+                } else if( y.op == opcode::SUB_CONST ) {
+                    return make( opcode::LOCAL_SUB_CONST, x.a, y.a );
+                }
+                break;
+            case opcode::SET_LOCAL:
+                if( y.op == opcode::GET_LOCAL && y.a == x.a ) {
+                    return make( opcode::TEE_LOCAL, x.a );
+                }
+                break;
+            case opcode::SET_GLOBAL:
+                if( y.op == opcode::GET_GLOBAL && y.a == x.a ) {
+                    return make( opcode::TEE_GLOBAL, x.a );
+                }
+                break;
+            default:
+                break;
+            }
+            return make( opcode::NOP );
+        }
+
+        static
+        bool rewrite( std::vector<instr> &code,
+                      std::vector<std::uint32_t> &lines, stats &st )
+        {
+            std::vector<bool> target( code.size( ) + 1, false );
+            for( auto &ins: code ) {
+                if( is_jump( ins.op ) ) {
+                    target[ins.a] = true;
+                }
+            }
+
+            /// where[i]: the new position of what was at i
+            std::vector<std::int32_t> where( code.size( ) + 1, 0 );
+            std::vector<instr> res;
+            res.reserve( code.size( ) );
+            std::vector<std::uint32_t> res_lines;
+            bool with_lines = !lines.empty( );
+            auto keep = [&]( const instr &ins, std::size_t from ) {
+                res.push_back( ins );
+                if( with_lines ) {
+                    res_lines.push_back( lines[from] );
+                }
+            };
+
+            std::size_t i = 0;
+            while( i < code.size( ) ) {
+                where[i] = static_cast<std::int32_t>(res.size( ));
+                auto &x  = code[i];
+
+                if( x.op == opcode::JUMP
+                 && static_cast<std::size_t>(x.a) == i + 1 )
+                {
+                    st.removed++;
+                    i += 1;
+                    continue;
+                }
+
+                bool pair = ( i + 1 < code.size( ) ) && !target[i + 1];
+                if( pair ) {
+                    auto &y = code[i + 1];
+                    if( pure_push( x.op ) && y.op == opcode::POP ) {
+                        where[i + 1] = where[i];
+                        st.removed += 2;
+                        i += 2;
+                        continue;
+                    }
+                    auto fused = fuse( x, y );
+                    if( fused.op != opcode::NOP ) {
+                        keep( fused, i );
+                        where[i + 1] = where[i];
+                        st.fused++;
+                        i += 2;
+                        continue;
+                    }
+                }
+
+                keep( x, i );
+                i += 1;
+            }
+            where[code.size( )] = static_cast<std::int32_t>(res.size( ));
+
+            for( auto &ins: res ) {
+                if( is_jump( ins.op ) ) {
+                    ins.a = where[ins.a];
+                }
+            }
+
+            bool changed = ( res.size( ) != code.size( ) );
+            code.swap( res );
+            lines.swap( res_lines );
+            return changed;
+        }
+    };
+
+}}
+
+#endif // PEEPHOLE_H
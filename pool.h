@@ -0,0 +1,215 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace mico { namespace exec {
+
+    /// Runs jobs on a fixed set of threads. Every worker has a deque and
+    /// a context. A job submitted by a job goes to the back of the deque
+    /// of its worker, others are dealt round robin. A worker takes from
+    /// the back of its own deque (the newest job, whose data is still in
+    /// cache) and, when that is empty, steals from the front of the
+    /// others (the oldest, which is likely to make more work).
+    /// ContextT is default constructed once per worker and handed to
+    /// every job that runs there. Jobs must not throw
+    template <typename ContextT>
+    class pool {
+
+    public:
+
+        using context_type = ContextT;
+        using job = std::function<void( context_type & )>;
+
+        struct worker_stats {
+            std::uint64_t executed = 0;
+            /// taken from the deque of another worker
+            std::uint64_t stolen   = 0;
+        };
+
+        explicit pool( std::size_t threads = default_threads( ) )
+        {
+            threads = threads ? threads : 1;
+            for( std::size_t i = 0; i < threads; ++i ) {
+                workers_.emplace_back( new worker );
+                workers_.back( )->owner = this;
+                workers_.back( )->id    = i;
+            }
+            for( auto &w: workers_ ) {
+                w->thread = std::thread( &pool::loop, this, w.get( ) );
+            }
+        }
+
+        pool( const pool & ) = delete;
+        pool &operator = ( const pool & ) = delete;
+
+        ~pool( )
+        {
+            wait( );
+            {
+                std::lock_guard<std::mutex> lck(lock_);
+                stop_ = true;
+            }
+            wake_.notify_all( );
+            for( auto &w: workers_ ) {
+                w->thread.join( );
+            }
+        }
+
+        static
+        std::size_t default_threads( )
+        {
+            auto res = std::thread::hardware_concurrency( );
+            return res ? res : 1;
+        }
+
+        std::size_t threads( ) const
+        {
+            return workers_.size( );
+        }
+
+        /// from any thread, a job too
+        void submit( job j )
+        {
+            auto self = current( );
+            worker *to = ( self && self->owner == this )
+                       ? self
+                       : workers_[next_++ % workers_.size( )].get( );
+            {
+                /// the only place that holds two locks; take( ) holds
+                /// one deque at a time and never lock_
+                std::lock_guard<std::mutex> lck(lock_);
+                std::lock_guard<std::mutex> deque_lck(to->lock);
+                to->jobs.emplace_back( std::move(j) );
+                ++queued_;
+                ++pending_;
+            }
+            wake_.notify_one( );
+        }
+
+        /// until every job submitted so far, and every job they
+        /// submitted, has run. Not from a job
+        void wait( )
+        {
+            std::unique_lock<std::mutex> lck(lock_);
+            idle_.wait( lck, [this]( ) { return pending_ == 0; } );
+        }
+
+        /// the context of worker 'id'; only while no job runs, after
+        /// wait( ) and before the next submit
+        context_type &context( std::size_t id )
+        {
+            return workers_[id]->ctx;
+        }
+
+        std::vector<worker_stats> stats( ) const
+        {
+            std::vector<worker_stats> res;
+            for( auto &w: workers_ ) {
+                worker_stats next;
+                next.executed = w->executed;
+                next.stolen   = w->stolen;
+                res.push_back( next );
+            }
+            return res;
+        }
+
+    private:
+
+        struct worker {
+            pool                       *owner = nullptr;
+            std::size_t                 id    = 0;
+            std::mutex                  lock;
+            std::deque<job>             jobs;
+            context_type                ctx;
+            std::thread                 thread;
+            std::atomic<std::uint64_t>  executed { 0 };
+            std::atomic<std::uint64_t>  stolen { 0 };
+        };
+
+        static
+        worker *&current( )
+        {
+            static thread_local worker *res = nullptr;
+            return res;
+        }
+
+        bool take( worker *self, job &res )
+        {
+            {
+                std::lock_guard<std::mutex> lck(self->lock);
+                if( !self->jobs.empty( ) ) {
+                    res = std::move(self->jobs.back( ));
+                    self->jobs.pop_back( );
+                    return true;
+                }
+            }
+            auto n = workers_.size( );
+            for( std::size_t i = 1; i < n; ++i ) {
+                auto victim = workers_[(self->id + i) % n].get( );
+                std::lock_guard<std::mutex> lck(victim->lock);
+                if( !victim->jobs.empty( ) ) {
+                    res = std::move(victim->jobs.front( ));
+                    victim->jobs.pop_front( );
+                    ++self->stolen;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void loop( worker *self )
+        {
+            current( ) = self;
+            for( ;; ) {
+                job next;
+                if( take( self, next ) ) {
+                    {
+                        std::lock_guard<std::mutex> lck(lock_);
+                        --queued_;
+                    }
+                    next( self->ctx );
+                    ++self->executed;
+                    bool idle = false;
+                    {
+                        std::lock_guard<std::mutex> lck(lock_);
+                        idle = ( --pending_ == 0 );
+                    }
+                    if( idle ) {
+                        idle_.notify_all( );
+                    }
+                    continue;
+                }
+                std::unique_lock<std::mutex> lck(lock_);
+                wake_.wait( lck, [this]( ) { return stop_ || queued_ > 0; } );
+                if( stop_ && queued_ == 0 ) {
+                    return;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<worker> > workers_;
+        std::atomic<std::size_t>              next_ { 0 };
+
+        std::mutex                            lock_;
+        std::condition_variable               wake_;
+        std::condition_variable               idle_;
+        /// jobs in some deque; a worker that took one counts it down
+        /// right after, so it can be too high for a moment, not too low
+        std::size_t                           queued_  = 0;
+        /// submitted and not finished
+        std::size_t                           pending_ = 0;
+        bool                                  stop_    = false;
+    };
+
+}}
+
+#endif // POOL_H
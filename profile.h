@@ -0,0 +1,218 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#define MICO_PROFILE_SIGNALS 1
+#else
+#define MICO_PROFILE_SIGNALS 0
+#endif
+
+namespace mico { namespace profile {
+
+    /// INSTRUMENT times every instruction and counts it; SAMPLE looks
+    /// at the running script every time the sampler ticks
+    enum class mode {
+        OFF,
+        INSTRUMENT,
+        SAMPLE,
+    };
+
+    /// executions and nanoseconds when instrumenting; samples and the
+    /// time they stand for when sampling
+    struct counter {
+        std::uint64_t count = 0;
+        std::uint64_t nanos = 0;
+    };
+
+    struct function_row {
+        std::string   name;
+        /// where the literal is; 0 for the top level
+        std::uint32_t line  = 0;
+        /// times it was entered; instrumenting only
+        std::uint64_t calls = 0;
+        /// in the function itself, not in what it calls
+        counter       self;
+    };
+
+    struct line_row {
+        std::uint32_t line = 0;
+        counter       self;
+    };
+
+    struct op_row {
+        std::string name;
+        counter     self;
+    };
+
+    /// What a profiled run found. Function names are the names lets
+    /// give their literals, fn@<line> for the others and main for the
+    /// top level. Instructions of programs loaded from an image have no
+    /// lines; they are at line 0
+    struct report {
+
+        profile::mode             mode = profile::mode::OFF;
+        std::uint64_t             samples = 0;
+        /// by self time, the largest first
+        std::vector<function_row> functions;
+        /// by line
+        std::vector<line_row>     lines;
+        /// by opcode; instrumenting only
+        std::vector<op_row>       ops;
+        /// the functions on the stack from the outermost one, joined
+        /// with ';', and the time or the samples spent right there
+        std::map<std::string, std::uint64_t> stacks;
+
+        /// the input of flamegraph.pl and the tools that read its format:
+        /// one "a;b;c <weight>" line per stack
+        std::string folded( ) const
+        {
+            std::ostringstream oss;
+            for( auto &s: stacks ) {
+                oss << s.first << " " << s.second << "\n";
+            }
+            return oss.str( );
+        }
+
+        std::string text( ) const
+        {
+            const char *what = ( mode == profile::mode::SAMPLE )
+                             ? "samples" : "count";
+            std::ostringstream oss;
+            oss << "functions:\n";
+            for( auto &f: functions ) {
+                oss << "  " << std::left << std::setw(24) << f.name
+                    << std::right << " line " << std::setw(5) << f.line
+                    << "  calls " << std::setw(10) << f.calls
+                    << "  " << what << " " << std::setw(10) << f.self.count
+                    << "  ms " << std::fixed << std::setprecision(3)
+                    << f.self.nanos / 1e6 << "\n";
+            }
+            oss << "lines:\n";
+            for( auto &l: lines ) {
+                oss << "  " << std::setw(5) << l.line
+                    << "  " << what << " " << std::setw(10) << l.self.count
+                    << "  ms " << std::fixed << std::setprecision(3)
+                    << l.self.nanos / 1e6 << "\n";
+            }
+            if( !ops.empty( ) ) {
+                oss << "ops:\n";
+            }
+            for( auto &o: ops ) {
+                oss << "  " << std::left << std::setw(24) << o.name
+                    << std::right << "  count " << std::setw(10)
+                    << o.self.count << "  ms " << std::fixed
+                    << std::setprecision(3) << o.self.nanos / 1e6 << "\n";
+            }
+            return oss.str( );
+        }
+    };
+
+    /// The ticks of the sampling mode: SIGPROF every 'micros' of CPU
+    /// time the process uses. The handler only raises a flag; the
+    /// engine takes the sample at its next instruction, where its
+    /// stacks are consistent. One sampler runs at a time in a process;
+    /// the handler and the timer it replaces, a host profiler's say,
+    /// are put back by stop( ). Without POSIX timers start( ) fails and
+    /// nothing is sampled
+    class sampler {
+
+    public:
+
+        static
+        bool start( std::uint32_t micros )
+        {
+#if MICO_PROFILE_SIGNALS
+            struct sigaction sa;
+            sa.sa_handler = &sampler::tick;
+            sigemptyset( &sa.sa_mask );
+            sa.sa_flags = SA_RESTART;
+            if( sigaction( SIGPROF, &sa, &saved( ).action ) != 0 ) {
+                return false;
+            }
+            flag( ) = 0;
+            if( !arm( micros, &saved( ).timer ) ) {
+                sigaction( SIGPROF, &saved( ).action, nullptr );
+                return false;
+            }
+            return true;
+#else
+            (void)micros;
+            return false;
+#endif
+        }
+
+        static
+        void stop( )
+        {
+#if MICO_PROFILE_SIGNALS
+            setitimer( ITIMER_PROF, &saved( ).timer, nullptr );
+            sigaction( SIGPROF, &saved( ).action, nullptr );
+            flag( ) = 0;
+#endif
+        }
+
+        /// a tick came since the last call
+        static
+        bool due( )
+        {
+            if( flag( ) ) {
+                flag( ) = 0;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+
+        static
+        volatile std::sig_atomic_t &flag( )
+        {
+            static volatile std::sig_atomic_t value = 0;
+            return value;
+        }
+
+        static
+        void tick( int )
+        {
+            flag( ) = 1;
+        }
+
+#if MICO_PROFILE_SIGNALS
+        /// what start( ) replaced
+        struct previous {
+            struct sigaction action;
+            struct itimerval timer;
+        };
+
+        static
+        previous &saved( )
+        {
+            static previous value;
+            return value;
+        }
+
+        static
+        bool arm( std::uint32_t micros, struct itimerval *old )
+        {
+            struct itimerval tv;
+            tv.it_interval.tv_sec  = micros / 1000000;
+            tv.it_interval.tv_usec = micros % 1000000;
+            tv.it_value            = tv.it_interval;
+            return setitimer( ITIMER_PROF, &tv, old ) == 0;
+        }
+#endif
+    };
+
+}}
+
+#endif // PROFILE_H
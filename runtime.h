@@ -0,0 +1,1216 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+
+#include "lexer.h"
+#include "objects.h"
+#include "gc.h"
+#include "vector.h"
+#include "hash.h"
+#include "function.h"
+#include "sequence.h"
+#include "native.h"
+
+namespace mico { namespace eval {
+
+    /// Integer arithmetic shared by every value encoding.
+    /// Results wrap around like int64; only the encoding of the result
+    /// depends on ValueT (boxed_value promotes big results to the heap)
+    struct int_ops {
+
+        static
+        std::int64_t wrap( std::uint64_t v )
+        {
+            return static_cast<std::int64_t>(v);
+        }
+
+        static
+        std::int64_t add( std::int64_t a, std::int64_t b )
+        {
+            return wrap( static_cast<std::uint64_t>(a)
+                       + static_cast<std::uint64_t>(b) );
+        }
+
+        static
+        std::int64_t sub( std::int64_t a, std::int64_t b )
+        {
+            return wrap( static_cast<std::uint64_t>(a)
+                       - static_cast<std::uint64_t>(b) );
+        }
+
+        static
+        std::int64_t mul( std::int64_t a, std::int64_t b )
+        {
+            return wrap( static_cast<std::uint64_t>(a)
+                       * static_cast<std::uint64_t>(b) );
+        }
+
+        static
+        std::int64_t neg( std::int64_t a )
+        {
+            return wrap( std::uint64_t(0) - static_cast<std::uint64_t>(a) );
+        }
+
+        /// b must not be 0
+        static
+        std::int64_t div( std::int64_t a, std::int64_t b )
+        {
+            if( b == -1 ) {
+                return neg( a );
+            }
+            return a / b;
+        }
+    };
+
+    /// State and operations shared by every execution engine:
+    /// the heap, globals, the root stack for temporaries and errors.
+    /// Engines derive from it and only decide how the program is walked
+    template <typename ValueT>
+    class runtime: public gc::root {
+
+    public:
+
+        using value       = ValueT;
+        using environment = objects::basic_environment<value>;
+        using type        = lexer::tokens::type;
+        using vector      = objects::basic_vector<value>;
+        using vector_ops  = objects::basic_vector_ops<value>;
+        using hash        = objects::basic_hash<value>;
+        using function    = objects::basic_function<value>;
+        using cell        = objects::basic_cell<value>;
+        using sequence    = objects::basic_sequence<value>;
+
+        /// the running function; its locals are stack_[base, ...).
+        /// fn is nullptr at the top level
+        struct frame {
+            function    *fn   = nullptr;
+            std::size_t  base = 0;
+        };
+
+        /// calls that are not in tail position still recurse on the C++
+        /// stack of the tree walker and the closure engine: 1 - 3KB per
+        /// call, more with sanitizers or without optimization.
+        /// stack_budget is what bounds them there
+        static const std::size_t default_max_depth = 10000;
+
+        /// the bytes of C++ stack nested calls may use in the engines
+        /// that recurse; 2MB of the 8MB a thread gets by default are
+        /// left to the host and to what a call does past the check
+        static const std::size_t default_stack_budget = 6 << 20;
+
+        enum class builtin_id: std::uint32_t {
+            LEN = 0,
+            FIRST,
+            LAST,
+            REST,
+            PUSH,
+            PMAP,
+            PFILTER,
+            PREDUCE,
+            RANGE,
+            MAP,
+            FILTER,
+            REDUCE,
+            ARRAY,
+        };
+
+        /// builtin ids from here on are functions added with bind
+        static const std::uint32_t native_base = 0x10000;
+
+        runtime( const runtime & ) = delete;
+        runtime &operator = ( const runtime & ) = delete;
+
+        runtime( gc::heap &heap )
+            :heap_(heap)
+        {
+            heap_.add_root( this );
+            reset_globals( );
+        }
+
+        virtual ~runtime( )
+        {
+            heap_.remove_root( this );
+        }
+
+        bool failed( ) const
+        {
+            return !errors_.empty( );
+        }
+
+        environment *globals( )
+        {
+            return globals_;
+        }
+
+        /// nested calls allowed before the script fails with a
+        /// stack overflow error. tail calls do not nest. In the engines
+        /// that recurse the depth is also clamped by the stack budget:
+        /// a call fails as well once the nested calls have used that
+        /// many bytes of the C++ stack, so no depth set here crashes
+        void set_max_depth( std::size_t depth )
+        {
+            max_depth_ = depth;
+        }
+
+        std::size_t max_depth( ) const
+        {
+            return max_depth_;
+        }
+
+        /// a host that runs scripts on threads with less than 8MB of
+        /// stack lowers it; 0 is no limit
+        void set_stack_budget( std::size_t bytes )
+        {
+            stack_budget_ = bytes;
+        }
+
+        std::size_t stack_budget( ) const
+        {
+            return stack_budget_;
+        }
+
+        std::size_t depth( ) const
+        {
+            return frames_.size( );
+        }
+
+        /// makes the C++ function 'fn' a builtin scripts call by 'name'.
+        /// Arity and parameter types come from its signature; the
+        /// arguments are checked and converted by code made for it here
+        /// (see native::arg), and a call site of the vm caches it like
+        /// any other builtin. It stays in the globals reset_globals
+        /// makes, and it never goes to the workers of pmap and parallel
+        /// lets. A lambda without captures binds with a unary plus:
+        ///
+        ///     rt.bind( "twice", +[ ]( std::int64_t x ) { return 2 * x; } );
+        template <typename R, typename ...Args>
+        void bind( const std::string &name, R (*fn)( Args... ) )
+        {
+            native_fn next;
+            next.name  = name;
+            next.arity = sizeof...(Args);
+            next.fn    = reinterpret_cast<void (*)( )>(fn);
+            next.call  = &runtime::template call_native<R, Args...>;
+            natives_.push_back( next );
+            add_native( natives_.size( ) - 1 );
+        }
+
+        gc::heap &heap( )
+        {
+            return heap_;
+        }
+
+        void trace( objects::tracer &t )
+        {
+            t.visit( globals_ );
+            for( auto &v: stack_ ) {
+                t.visit( v );
+            }
+            for( auto s: literals_ ) {
+                t.visit( s );
+            }
+        }
+
+        static
+        const char *type_name( const value &val )
+        {
+            if( val.is_null( ) ) {
+                return "NULL";
+            } else if( val.is_bool( ) ) {
+                return "BOOLEAN";
+            } else if( val.is_int( ) ) {
+                return "INTEGER";
+            }
+            switch( val.as_object( )->type( ) ) {
+            case objects::object_type::STRING:
+                return "STRING";
+            case objects::object_type::ARRAY:
+            case objects::object_type::VECTOR:
+                return "ARRAY";
+            case objects::object_type::BUILTIN:
+                return "BUILTIN";
+            case objects::object_type::HASH:
+                return "HASH";
+            case objects::object_type::FUNCTION:
+                return "FUNCTION";
+            case objects::object_type::SEQUENCE:
+                return "SEQUENCE";
+            default:
+                break;
+            }
+            return "OBJECT";
+        }
+
+        static
+        bool is_truthy( const value &val )
+        {
+            if( val.is_null( ) ) {
+                return false;
+            } else if( val.is_bool( ) ) {
+                return val.as_bool( );
+            }
+            return true;
+        }
+
+        std::vector<std::string> errors_;
+
+    private:
+
+        /// concatenations shorter than this are copied right away;
+        /// a rope node costs about as much as copying them
+        static const std::size_t flat_limit = 64;
+
+        static
+        objects::string *as_string( const value &val )
+        {
+            if( val.is_object( )
+             && val.as_object( )->type( ) == objects::object_type::STRING )
+            {
+                return static_cast<objects::string *>(val.as_object( ));
+            }
+            return nullptr;
+        }
+
+        static
+        vector *as_vector( const value &val )
+        {
+            if( val.is_object( )
+             && val.as_object( )->type( ) == objects::object_type::VECTOR )
+            {
+                return static_cast<vector *>(val.as_object( ));
+            }
+            return nullptr;
+        }
+
+        static
+        sequence *as_sequence( const value &val )
+        {
+            if( val.is_object( )
+             && val.as_object( )->type( ) == objects::object_type::SEQUENCE )
+            {
+                return static_cast<sequence *>(val.as_object( ));
+            }
+            return nullptr;
+        }
+
+        static
+        bool is_callable( const value &val )
+        {
+            return val.is_object( )
+                && ( val.as_object( )->type( ) == objects::object_type::FUNCTION
+                  || val.as_object( )->type( ) == objects::object_type::BUILTIN );
+        }
+
+        static
+        const char *builtin_name( builtin_id id )
+        {
+            static const char *names[] = {
+                "len", "first", "last", "rest", "push",
+                "pmap", "pfilter", "preduce",
+                "range", "map", "filter", "reduce", "array",
+            };
+            return names[static_cast<std::uint32_t>(id)];
+        }
+
+        static
+        std::size_t builtin_args( builtin_id id )
+        {
+            switch( id ) {
+            case builtin_id::PUSH:
+            case builtin_id::PMAP:
+            case builtin_id::PFILTER:
+            case builtin_id::RANGE:
+            case builtin_id::MAP:
+            case builtin_id::FILTER:
+                return 2;
+            case builtin_id::PREDUCE:
+            case builtin_id::REDUCE:
+                return 3;
+            default:
+                break;
+            }
+            return 1;
+        }
+
+        void add_builtins( )
+        {
+            auto last = static_cast<std::uint32_t>(builtin_id::ARRAY);
+            for( std::uint32_t i = 0; i <= last; ++i ) {
+                auto name = builtin_name( static_cast<builtin_id>(i) );
+                auto bi   = heap_.template make<objects::builtin>( i, name );
+                set_global( name, value::from_object( bi ) );
+            }
+            for( std::size_t i = 0; i < natives_.size( ); ++i ) {
+                add_native( i );
+            }
+        }
+
+        /// a function added with bind
+        struct native_fn {
+            std::string   name;
+            std::size_t   arity = 0;
+            /// the real type is in 'call'
+            void        (*fn)( ) = nullptr;
+            value       (runtime::*call)( const native_fn &, std::size_t );
+        };
+
+        void add_native( std::size_t i )
+        {
+            auto id = native_base + static_cast<std::uint32_t>(i);
+            auto bi = heap_.template make<objects::builtin>( id,
+                                                             natives_[i].name );
+            set_global( natives_[i].name, value::from_object( bi ) );
+        }
+
+        template <typename R, typename ...Args>
+        value call_native( const native_fn &nf, std::size_t first )
+        {
+            using all = typename native::make_indices<sizeof...(Args)>::type;
+            return unpack<R, Args...>( nf, first, all( ) );
+        }
+
+        /// arguments are stack_[first, first + sizeof...(Args))
+        template <typename R, typename ...Args, std::size_t ...I>
+        value unpack( const native_fn &nf, std::size_t first,
+                      native::indices<I...> )
+        {
+            (void)first;
+            const bool ok[] = { true, native::arg<native::plain<Args>,
+                                                  value>::is( stack_[first + I] )... };
+            for( std::size_t i = 1; i <= sizeof...(Args); ++i ) {
+                if( !ok[i] ) {
+                    const char *want[] = { "", native::arg<native::plain<Args>,
+                                                           value>::name( )... };
+                    std::ostringstream oss;
+                    oss << "argument " << i << " to `" << nf.name
+                        << "` must be " << want[i] << ", got "
+                        << type_name( stack_[first + i - 1] );
+                    return error( oss.str( ) );
+                }
+            }
+            auto fn = reinterpret_cast<R (*)( Args... )>(nf.fn);
+            value res;
+            if( !native::result<native::plain<R>, value>::call( heap_, res, fn,
+                    native::arg<native::plain<Args>, value>::get(
+                                                    stack_[first + I] )... ) )
+            {
+                return error( "result of `" + nf.name
+                            + "` is not an INTEGER" );
+            }
+            return res;
+        }
+
+        bool check_args( const char *name, std::size_t n, std::size_t want )
+        {
+            if( n != want ) {
+                std::ostringstream oss;
+                oss << "wrong number of arguments to `" << name
+                    << "`. got=" << n << ", want=" << want;
+                error( oss.str( ) );
+                return false;
+            }
+            return true;
+        }
+
+        value not_array( const char *name, const value &val )
+        {
+            return error( std::string( "argument to `" ) + name
+                        + "` must be ARRAY, got " + type_name( val ) );
+        }
+
+        value not_sequence( const char *name, const value &val )
+        {
+            return error( std::string( "argument to `" ) + name
+                        + "` must be ARRAY or SEQUENCE, got "
+                        + type_name( val ) );
+        }
+
+        /// where an iteration over an array or a sequence is. A sequence
+        /// with a cache is walked like the array it is
+        struct cursor {
+            sequence    *seq = nullptr;
+            vector      *vec = nullptr;
+            std::size_t  pos = 0;
+        };
+
+        /// 'val' is an array or a sequence
+        static
+        cursor iterate( const value &val )
+        {
+            cursor res;
+            res.seq = as_sequence( val );
+            res.vec = as_vector( val );
+            if( res.seq && res.seq->cache ) {
+                res.vec = res.seq->cache;
+                res.seq = nullptr;
+            }
+            return res;
+        }
+
+        /// the next element that comes out of every stage; false at the
+        /// end or when a stage failed. What the cursor walks has to be
+        /// rooted by the caller
+        bool next( cursor &c, value &res )
+        {
+            if( !c.seq ) {
+                if( c.pos < c.vec->size( ) ) {
+                    res = c.vec->get( c.pos++ );
+                    return true;
+                }
+                return false;
+            }
+
+            auto seq = c.seq;
+            auto n   = seq->source_size( );
+            while( c.pos < n ) {
+                /// the stages may allocate only arrays, which never
+                /// collect; whatever the caller kept is rooted by now
+                heap_.safe_point( );
+                auto val = seq->items
+                         ? seq->items->get( c.pos )
+                         : value::from_int( heap_, int_ops::add( seq->from,
+                                    static_cast<std::int64_t>(c.pos) ) );
+                ++c.pos;
+                bool keep = true;
+                for( auto &st: seq->stages ) {
+                    stack_.push_back( st.fn );
+                    stack_.push_back( val );
+                    auto out = call_value( stack_.size( ) - 2 );
+                    if( failed( ) ) {
+                        return false;
+                    }
+                    if( st.kind == sequence::stage_kind::MAP ) {
+                        val = out;
+                    } else if( !is_truthy( out ) ) {
+                        keep = false;
+                        break;
+                    }
+                }
+                if( keep ) {
+                    res = val;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// every element of 'seq', kept in it for the next time; nullptr
+        /// if a stage failed. 'seq' has to be rooted. The array grows
+        /// one element at a time, so nothing else holds all of them
+        vector *materialize( sequence *seq )
+        {
+            if( seq->cache ) {
+                return seq->cache;
+            }
+            auto res  = vector_ops::make( heap_ );
+            auto slot = stack_.size( );
+            stack_.push_back( value::from_object( res ) );
+            auto c = iterate( value::from_object( seq ) );
+            value val;
+            while( next( c, val ) ) {
+                vector_ops::append_new( heap_, res, val );
+            }
+            stack_.resize( slot );
+            if( failed( ) ) {
+                return nullptr;
+            }
+            seq->cache = res;
+            heap_.write_barrier( seq, value::from_object( res ) );
+            return res;
+        }
+
+        value make_range( std::size_t first )
+        {
+            auto from = stack_[first];
+            auto to   = stack_[first + 1];
+            if( !from.is_int( ) || !to.is_int( ) ) {
+                return error( std::string( "arguments to `range` must be "
+                                           "INTEGER, got " )
+                            + type_name( from ) + " and " + type_name( to ) );
+            }
+            auto res  = heap_.template make<sequence>( );
+            res->from = from.as_int( );
+            res->to   = to.as_int( );
+            return value::from_object( res );
+        }
+
+        /// map or filter: the source of the first argument with one
+        /// stage more
+        value adapt( builtin_id id, std::size_t first )
+        {
+            auto name = builtin_name( id );
+            auto src  = stack_[first];
+            auto fn   = stack_[first + 1];
+            auto seq  = as_sequence( src );
+            auto vec  = as_vector( src );
+            if( !seq && !vec ) {
+                return not_sequence( name, src );
+            }
+            if( !is_callable( fn ) ) {
+                return error( std::string( "argument to `" ) + name
+                            + "` must be FUNCTION, got " + type_name( fn ) );
+            }
+
+            /// both arguments are rooted as arguments
+            auto res = heap_.template make<sequence>( );
+            if( seq && seq->cache ) {
+                res->items  = seq->cache;
+            } else if( seq ) {
+                res->from   = seq->from;
+                res->to     = seq->to;
+                res->items  = seq->items;
+                res->stages = seq->stages;
+            } else {
+                res->items  = vec;
+            }
+            typename sequence::stage st;
+            st.kind = ( id == builtin_id::MAP )
+                    ? sequence::stage_kind::MAP
+                    : sequence::stage_kind::FILTER;
+            st.fn   = fn;
+            res->stages.push_back( st );
+            return value::from_object( res );
+        }
+
+        /// folds from the left without an array in between
+        value reduce( std::size_t first )
+        {
+            auto src = stack_[first];
+            if( !as_sequence( src ) && !as_vector( src ) ) {
+                return not_sequence( "reduce", src );
+            }
+            auto fn = stack_[first + 2];
+            /// the accumulator is rooted here while the stages run
+            auto acc  = stack_.size( );
+            auto init = stack_[first + 1];
+            stack_.push_back( init );
+            auto c = iterate( src );
+            value val;
+            while( next( c, val ) ) {
+                auto cur = stack_[acc];
+                stack_.push_back( fn );
+                stack_.push_back( cur );
+                stack_.push_back( val );
+                auto res = call_value( stack_.size( ) - 3 );
+                if( failed( ) ) {
+                    break;
+                }
+                stack_[acc] = res;
+            }
+            auto res = failed( ) ? value::null( ) : stack_[acc];
+            stack_.resize( acc );
+            return res;
+        }
+
+    protected:
+
+        /// arguments are stack_[first, first + n)
+        value call_builtin( builtin_id id, std::size_t first, std::size_t n )
+        {
+            auto num = static_cast<std::uint32_t>(id);
+            if( num >= native_base ) {
+                if( num - native_base >= natives_.size( ) ) {
+                    /// from a snapshot of an engine that had it
+                    return error( "builtin is not bound here" );
+                }
+                auto &nf = natives_[num - native_base];
+                if( !check_args( nf.name.c_str( ), n, nf.arity ) ) {
+                    return value::null( );
+                }
+                return ( this->*nf.call )( nf, first );
+            }
+            auto name = builtin_name( id );
+            if( !check_args( name, n, builtin_args( id ) ) ) {
+                return value::null( );
+            }
+
+            auto arg = stack_[first];
+            auto seq = as_sequence( arg );
+            switch( id ) {
+            case builtin_id::RANGE:
+                return make_range( first );
+            case builtin_id::MAP:
+            case builtin_id::FILTER:
+                return adapt( id, first );
+            case builtin_id::REDUCE:
+                return reduce( first );
+            case builtin_id::LEN:
+                if( seq && !seq->cache && seq->counted( ) ) {
+                    return value::from_int( heap_,
+                        static_cast<std::int64_t>(seq->source_size( )) );
+                }
+                break;
+            case builtin_id::FIRST:
+                if( seq && !seq->cache ) {
+                    auto c = iterate( arg );
+                    value res;
+                    return next( c, res ) ? res : value::null( );
+                }
+                break;
+            default:
+                break;
+            }
+
+            /// the others need every element of a sequence
+            if( seq ) {
+                auto all = materialize( seq );
+                if( !all ) {
+                    return value::null( );
+                }
+                arg = value::from_object( all );
+                stack_[first] = arg;
+            }
+            auto vec = as_vector( arg );
+
+            switch( id ) {
+            case builtin_id::LEN:
+                if( vec ) {
+                    return value::from_int( heap_,
+                                static_cast<std::int64_t>(vec->size( )) );
+                }
+                if( auto str = as_string( arg ) ) {
+                    /// known without flattening a rope
+                    return value::from_int( heap_,
+                                static_cast<std::int64_t>(str->size( )) );
+                }
+                return error( std::string( "argument to `len` not supported, "
+                                           "got " ) + type_name( arg ) );
+            case builtin_id::FIRST:
+                if( !vec ) {
+                    return not_array( name, arg );
+                }
+                return vec->size( ) ? vec->get( 0 ) : value::null( );
+            case builtin_id::LAST:
+                if( !vec ) {
+                    return not_array( name, arg );
+                }
+                return vec->size( ) ? vec->get( vec->size( ) - 1 )
+                                    : value::null( );
+            case builtin_id::REST:
+                if( !vec ) {
+                    return not_array( name, arg );
+                }
+                return value::from_object( vector_ops::rest( heap_, vec ) );
+            case builtin_id::PUSH:
+                if( !vec ) {
+                    return not_array( name, arg );
+                }
+                return value::from_object(
+                        vector_ops::push( heap_, vec, stack_[first + 1] ) );
+            case builtin_id::PMAP:
+            case builtin_id::PFILTER:
+            case builtin_id::PREDUCE:
+                if( !vec ) {
+                    return not_array( name, arg );
+                }
+                return parallel( id, first );
+            case builtin_id::ARRAY:
+                if( !vec ) {
+                    return not_sequence( name, arg );
+                }
+                return arg;
+            case builtin_id::RANGE:
+            case builtin_id::MAP:
+            case builtin_id::FILTER:
+            case builtin_id::REDUCE:
+                break;
+            }
+            return value::null( );
+        }
+
+        /// stack_[first] is a function or a builtin, the arguments
+        /// follow it and are popped. Engines that can call functions
+        /// override it
+        virtual value call_value( std::size_t first )
+        {
+            auto res = call( first );
+            stack_.resize( first );
+            return res;
+        }
+
+        /// pmap, pfilter or preduce with the arguments at stack_[first];
+        /// the first one is an array. An engine that can spread the
+        /// calls over threads overrides it, and comes back here when it
+        /// cannot
+        virtual value parallel( builtin_id id, std::size_t first )
+        {
+            return sequential( id, first );
+        }
+
+        /// one element after the other. preduce folds from the left,
+        /// starting with its second argument
+        value sequential( builtin_id id, std::size_t first )
+        {
+            auto vec = as_vector( stack_[first] );
+            auto n   = vec->size( );
+            if( id == builtin_id::PREDUCE ) {
+                auto fn  = stack_[first + 2];
+                auto acc = stack_[first + 1];
+                for( std::size_t i = 0; i < n && !failed( ); ++i ) {
+                    stack_.push_back( fn );
+                    stack_.push_back( acc );
+                    stack_.push_back( vec->get( i ) );
+                    acc = call_value( stack_.size( ) - 3 );
+                }
+                return failed( ) ? value::null( ) : acc;
+            }
+
+            /// the results are rooted here until the array is made
+            auto fn  = stack_[first + 1];
+            auto out = stack_.size( );
+            for( std::size_t i = 0; i < n; ++i ) {
+                auto elem = vec->get( i );
+                stack_.push_back( fn );
+                stack_.push_back( elem );
+                auto res = call_value( stack_.size( ) - 2 );
+                if( failed( ) ) {
+                    stack_.resize( out );
+                    return value::null( );
+                }
+                if( id == builtin_id::PMAP ) {
+                    stack_.push_back( res );
+                } else if( is_truthy( res ) ) {
+                    stack_.push_back( elem );
+                }
+            }
+            auto res = make_array( out );
+            stack_.resize( out );
+            return res;
+        }
+
+        /// new globals with the builtins only; the old ones are left as
+        /// they are
+        void reset_globals( )
+        {
+            globals_ = heap_.template make<environment>( );
+            add_builtins( );
+        }
+
+        void reset( )
+        {
+            errors_.clear( );
+            stack_.clear( );
+            frames_.clear( );
+            frame_ = frame( );
+        }
+
+        value error( const std::string &msg )
+        {
+            errors_.push_back( msg );
+            return value::null( );
+        }
+
+        void set_global( const std::string &name, const value &val )
+        {
+            globals_->set( name, val );
+            heap_.write_barrier( globals_, val );
+        }
+
+        value prefix( type tok, const value &val )
+        {
+            switch( tok ) {
+            case type::BANG:
+                return value::from_bool( !is_truthy( val ) );
+            case type::MINUS:
+                if( val.is_int( ) ) {
+                    return value::from_int( heap_,
+                                            int_ops::neg( val.as_int( ) ) );
+                }
+                break;
+            case type::PLUS:
+                if( val.is_int( ) ) {
+                    return val;
+                }
+                break;
+            default:
+                break;
+            }
+
+            std::ostringstream oss;
+            oss << "Unknown operator: " << tok << type_name( val );
+            return error( oss.str( ) );
+        }
+
+        value infix( type tok, const value &left, const value &right )
+        {
+            if( left.is_int( ) && right.is_int( ) ) {
+                return infix_int( tok, left.as_int( ), right.as_int( ) );
+            }
+
+            auto ls = as_string( left );
+            auto rs = as_string( right );
+            if( ls && rs ) {
+                switch( tok ) {
+                case type::PLUS:
+                    return concat( ls, rs );
+                case type::EQ:
+                    return value::from_bool( ls->equal( rs ) );
+                case type::NOT_EQ:
+                    return value::from_bool( !ls->equal( rs ) );
+                default:
+                    break;
+                }
+            }
+
+            switch( tok ) {
+            case type::EQ:
+                return value::from_bool( left.same( right ) );
+            case type::NOT_EQ:
+                return value::from_bool( !left.same( right ) );
+            default:
+                break;
+            }
+
+            std::ostringstream oss;
+            oss << ( ( type_name( left ) == type_name( right ) )
+                        ? "Unknown operator: "
+                        : "Type mismatch: " )
+                << type_name( left ) << " " << tok << " "
+                << type_name( right );
+            return error( oss.str( ) );
+        }
+
+        value infix_int( type tok, std::int64_t left, std::int64_t right )
+        {
+            switch( tok ) {
+            case type::PLUS:
+                return value::from_int( heap_, int_ops::add( left, right ) );
+            case type::MINUS:
+                return value::from_int( heap_, int_ops::sub( left, right ) );
+            case type::ASTERISK:
+                return value::from_int( heap_, int_ops::mul( left, right ) );
+            case type::SLASH:
+                if( right == 0 ) {
+                    return error( "Division by zero" );
+                }
+                return value::from_int( heap_, int_ops::div( left, right ) );
+            case type::LT:
+                return value::from_bool( left < right );
+            case type::GT:
+                return value::from_bool( left > right );
+            case type::EQ:
+                return value::from_bool( left == right );
+            case type::NOT_EQ:
+                return value::from_bool( left != right );
+            default:
+                break;
+            }
+            std::ostringstream oss;
+            oss << "Unknown operator: INTEGER " << tok << " INTEGER";
+            return error( oss.str( ) );
+        }
+
+        /// array of stack_[first, stack_.size( ))
+        value make_array( std::size_t first )
+        {
+            return value::from_object(
+                vector_ops::make( heap_, stack_.data( ) + first,
+                                  stack_.size( ) - first ) );
+        }
+
+        value make_string( const std::string &str )
+        {
+            return value::from_object(
+                heap_.template make<objects::string>( str ) );
+        }
+
+        /// slot of the literal 'str' in the intern table; the object is
+        /// created once per runtime and lives as long as the runtime
+        std::size_t intern( const std::string &str )
+        {
+            auto found = literal_ids_.find( str );
+            if( found != literal_ids_.end( ) ) {
+                return found->second;
+            }
+            auto res = heap_.template make<objects::string>( str );
+            res->interned = true;
+            literals_.push_back( res );
+            literal_ids_[str] = literals_.size( ) - 1;
+            return literals_.size( ) - 1;
+        }
+
+        value literal( std::size_t slot ) const
+        {
+            return value::from_object( literals_[slot] );
+        }
+
+        /// short results are copied, long ones become a rope
+        value concat( objects::string *left, objects::string *right )
+        {
+            if( left->size( ) == 0 ) {
+                return value::from_object( right );
+            } else if( right->size( ) == 0 ) {
+                return value::from_object( left );
+            } else if( left->size( ) + right->size( ) < flat_limit ) {
+                return make_string( left->str( ) + right->str( ) );
+            }
+            stack_.push_back( value::from_object( left ) );
+            stack_.push_back( value::from_object( right ) );
+            auto res = heap_.template make<objects::string>( left, right );
+            stack_.resize( stack_.size( ) - 2 );
+            return value::from_object( res );
+        }
+
+        /// keys and values alternate in stack_[first, stack_.size( ))
+        value make_hash( std::size_t first )
+        {
+            for( auto i = first; i < stack_.size( ); i += 2 ) {
+                if( !objects::key_hash::usable( stack_[i] ) ) {
+                    return error( std::string( "unusable as hash key: " )
+                                + type_name( stack_[i] ) );
+                }
+            }
+            /// the only allocation; nothing has to be barriered
+            auto res = heap_.template make<hash>( );
+            res->reserve( ( stack_.size( ) - first ) / 2 );
+            for( auto i = first; i < stack_.size( ); i += 2 ) {
+                res->insert( stack_[i], stack_[i + 1] );
+            }
+            return value::from_object( res );
+        }
+
+        value index( const value &left, const value &id )
+        {
+            if( left.is_object( )
+             && left.as_object( )->type( ) == objects::object_type::HASH )
+            {
+                if( !objects::key_hash::usable( id ) ) {
+                    return error( std::string( "unusable as hash key: " )
+                                + type_name( id ) );
+                }
+                auto found = static_cast<hash *>(left.as_object( ))->find( id );
+                return found ? *found : value::null( );
+            }
+
+            auto str = as_string( left );
+            if( str && id.is_int( ) ) {
+                auto pos = id.as_int( );
+                if( pos < 0 || static_cast<std::uint64_t>(pos) >= str->size( ) ) {
+                    return value::null( );
+                }
+                return make_string( std::string( 1,
+                            str->str( )[static_cast<std::size_t>(pos)] ) );
+            }
+
+            if( auto seq = as_sequence( left ) ) {
+                /// copies: both may be on the stack, which grows while
+                /// the stages run and roots the sequence
+                auto self = left;
+                auto pos  = id;
+                stack_.push_back( self );
+                auto all = materialize( seq );
+                stack_.pop_back( );
+                if( !all ) {
+                    return value::null( );
+                }
+                return index( value::from_object( all ), pos );
+            }
+
+            auto vec = as_vector( left );
+            if( vec && id.is_int( ) ) {
+                auto pos = id.as_int( );
+                if( pos < 0 || static_cast<std::uint64_t>(pos) >= vec->size( ) ) {
+                    return value::null( );
+                }
+                return vec->get( static_cast<std::size_t>(pos) );
+            }
+            return error( std::string( "index operator not supported: " )
+                        + type_name( left ) );
+        }
+
+        static
+        function *as_function( const value &val )
+        {
+            if( val.is_object( )
+             && val.as_object( )->type( ) == objects::object_type::FUNCTION )
+            {
+                return static_cast<function *>(val.as_object( ));
+            }
+            return nullptr;
+        }
+
+        /// 'ref' is LOCAL or CAPTURE in the running function
+        value load( const ast::var_ref &ref ) const
+        {
+            const value &val = ( ref.scope == ast::var_scope::LOCAL )
+                             ? stack_[frame_.base + ref.index]
+                             : frame_.fn->captured[ref.index];
+            if( ref.cell ) {
+                return static_cast<cell *>(val.as_object( ))->value;
+            }
+            return val;
+        }
+
+        /// 'ref' is LOCAL in the running function
+        void store( const ast::var_ref &ref, const value &val )
+        {
+            auto &slot = stack_[frame_.base + ref.index];
+            if( ref.cell ) {
+                auto c = static_cast<cell *>(slot.as_object( ));
+                c->value = val;
+                heap_.write_barrier( c, val );
+            } else {
+                slot = val;
+            }
+        }
+
+        /// copies the captured values (or their cells) out of the
+        /// running frame; they are rooted there, and nothing allocates
+        /// after the function is made
+        function *make_function(
+                    const std::shared_ptr<const ast::function_info> &info )
+        {
+            auto res = heap_.template make<function>( info );
+            res->captured.reserve( info->captures.size( ) );
+            for( auto &c: info->captures ) {
+                res->captured.push_back(
+                    ( c.scope == ast::var_scope::LOCAL )
+                        ? stack_[frame_.base + c.index]
+                        : frame_.fn->captured[c.index] );
+            }
+            return res;
+        }
+
+        /// saves the running frame before a call
+        bool push_frame( )
+        {
+            if( frames_.size( ) >= max_depth_ ) {
+                std::ostringstream oss;
+                oss << "stack overflow: more than " << max_depth_
+                    << " nested calls";
+                error( oss.str( ) );
+                return false;
+            }
+            /// the outermost call marks where the stack starts
+            if( recurses_ && frames_.empty( ) ) {
+                mark_stack( );
+            } else if( recurses_ && !stack_left( ) ) {
+                return false;
+            }
+            frames_.push_back( frame_ );
+            return true;
+        }
+
+        /// where stack_left measures from
+        void mark_stack( )
+        {
+            char here = 0;
+            stack_base_ = reinterpret_cast<std::uintptr_t>(&here);
+        }
+
+        /// false with a stack overflow error once the C++ stack used
+        /// since mark_stack is past the budget
+        bool stack_left( )
+        {
+            char here = 0;
+            auto at   = reinterpret_cast<std::uintptr_t>(&here);
+            auto used = ( stack_base_ > at ) ? stack_base_ - at
+                                             : at - stack_base_;
+            if( stack_budget_ && used > stack_budget_ ) {
+                std::ostringstream oss;
+                oss << "stack overflow: " << frames_.size( )
+                    << " nested calls used more than " << stack_budget_
+                    << " bytes of stack";
+                error( oss.str( ) );
+                return false;
+            }
+            return true;
+        }
+
+        void pop_frame( )
+        {
+            frame_ = frames_.back( );
+            frames_.pop_back( );
+        }
+
+        /// a tail call left the callee and its arguments at
+        /// stack_[from, ...); they replace the running call at 'first'
+        void reuse_frame( std::size_t first, std::size_t from )
+        {
+            std::move( stack_.begin( ) + from, stack_.end( ),
+                       stack_.begin( ) + first );
+            stack_.resize( first + ( stack_.size( ) - from ) );
+        }
+
+        /// stack_[first] is a function, the arguments follow it.
+        /// makes it the running frame: the arguments are the first
+        /// locals, the other locals start as null, cells are made.
+        /// the caller pushes the frame before and pops it after
+        bool enter( std::size_t first )
+        {
+            auto fn    = static_cast<function *>(stack_[first].as_object( ));
+            auto &info = *fn->info;
+            auto n     = stack_.size( ) - first - 1;
+            if( n != info.params.size( ) ) {
+                std::ostringstream oss;
+                oss << "wrong number of arguments: want="
+                    << info.params.size( ) << ", got=" << n;
+                error( oss.str( ) );
+                return false;
+            }
+
+            open_frame( fn, first, true );
+            return true;
+        }
+
+        /// the layout part of enter, for callers that checked the
+        /// arguments already. 'cells': some local of 'fn' is a cell
+        void open_frame( function *fn, std::size_t first, bool cells )
+        {
+            auto &info  = *fn->info;
+            frame_.fn   = fn;
+            frame_.base = first + 1;
+            stack_.resize( frame_.base + info.locals, value::null( ) );
+            if( !cells ) {
+                return;
+            }
+            for( std::size_t i = 0; i < info.locals; ++i ) {
+                if( info.cells[i] ) {
+                    auto c = heap_.template make<cell>( stack_[frame_.base + i] );
+                    stack_[frame_.base + i] = value::from_object( c );
+                }
+            }
+        }
+
+        /// stack_[first] is the function, the arguments follow it
+        value call( std::size_t first )
+        {
+            auto fn = stack_[first];
+            if( fn.is_object( )
+             && fn.as_object( )->type( ) == objects::object_type::BUILTIN )
+            {
+                auto bi = static_cast<objects::builtin *>(fn.as_object( ));
+                return call_builtin( static_cast<builtin_id>(bi->id),
+                                     first + 1, stack_.size( ) - first - 1 );
+            }
+            return error( std::string( "not a function: " ) + type_name( fn ) );
+        }
+
+        gc::heap           &heap_;
+        environment        *globals_ = nullptr;
+        /// temporaries that have to survive an allocation
+        std::vector<value>  stack_;
+        frame               frame_;
+        /// the callers of frame_
+        std::vector<frame>  frames_;
+        std::size_t         max_depth_ = default_max_depth;
+        std::size_t         stack_budget_ = default_stack_budget;
+        /// the C++ stack at the outermost call, see push_frame
+        std::uintptr_t      stack_base_ = 0;
+        /// calls recurse on the C++ stack, so push_frame checks it
+        bool                recurses_ = true;
+
+        std::vector<native_fn>                       natives_;
+        std::vector<objects::string *>               literals_;
+        std::unordered_map<std::string, std::size_t> literal_ids_;
+    };
+
+}}
+
+#endif // RUNTIME_H
@@ -0,0 +1,173 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "parser.h"
+#include "vm.h"
+
+namespace mico { namespace exec {
+
+    /// Interleaves many scripts on a few threads. Every script has its
+    /// own heap and vm engine and runs in slices of fuel (see
+    /// vm_engine::start); a script that is not done after its slice goes
+    /// to the back of one run queue that all threads take from. A script
+    /// that loops forever only gets its turns, and is stopped once it
+    /// has burnt its max_fuel. One that loops in a callback of a
+    /// builtin fails at the end of its slice, see vm_engine::start
+    class scheduler {
+
+    public:
+
+        struct report {
+            /// objects::inspect of the value, once it is done
+            std::string              value;
+            std::vector<std::string> errors;
+            std::uint64_t            fuel   = 0;
+            std::uint64_t            slices = 0;
+            bool                     done   = false;
+        };
+
+        explicit scheduler( std::size_t threads, std::uint64_t slice = 10000 )
+            :threads_(threads ? threads : 1)
+            ,slice_(slice ? slice : 1)
+        { }
+
+        scheduler( const scheduler & ) = delete;
+        scheduler &operator = ( const scheduler & ) = delete;
+
+        /// compiles 'prog' into a new task; 0 is no limit. The program
+        /// is not needed afterwards
+        std::size_t add( const parser::program &prog,
+                         std::uint64_t max_fuel = 0 )
+        {
+            std::unique_ptr<task> next(new task);
+            next->vm.reset( new engine(next->heap) );
+            next->vm->set_parallel( 0 );
+            next->vm->load( prog );
+            next->max_fuel = max_fuel;
+            tasks_.emplace_back( std::move(next) );
+            return tasks_.size( ) - 1;
+        }
+
+        /// every task added since the last run, to the end
+        void run( )
+        {
+            for( auto &t: tasks_ ) {
+                if( !t->finished ) {
+                    queue_.push_back( t.get( ) );
+                }
+            }
+            std::vector<std::thread> pool;
+            for( std::size_t i = 0; i < threads_; ++i ) {
+                pool.emplace_back( &scheduler::loop, this );
+            }
+            for( auto &th: pool ) {
+                th.join( );
+            }
+        }
+
+        const report &get( std::size_t id ) const
+        {
+            return tasks_[id]->rep;
+        }
+
+        std::size_t size( ) const
+        {
+            return tasks_.size( );
+        }
+
+    private:
+
+        using engine = engines::vm_engine<objects::value>;
+        using status = engine::status;
+
+        struct task {
+            gc::heap                heap;
+            std::unique_ptr<engine> vm;
+            std::uint64_t           max_fuel = 0;
+            bool                    started  = false;
+            bool                    finished = false;
+            report                  rep;
+        };
+
+        /// one slice of 't'; false once it is finished
+        bool step( task *t )
+        {
+            auto fuel = slice_;
+            if( t->max_fuel ) {
+                fuel = std::min( fuel, t->max_fuel - t->rep.fuel );
+            }
+            auto st = t->started ? t->vm->resume( fuel )
+                                 : t->vm->start( fuel );
+            t->started = true;
+            t->rep.slices++;
+            t->rep.fuel = t->vm->fuel_used( );
+
+            if( st == status::SUSPENDED ) {
+                if( !t->max_fuel || t->rep.fuel < t->max_fuel ) {
+                    return true;
+                }
+                t->vm->cancel( );
+                t->rep.errors.push_back( "out of fuel after "
+                                       + std::to_string( t->rep.fuel )
+                                       + " instructions" );
+            } else {
+                t->rep.value  = objects::inspect( t->vm->result( ) );
+                t->rep.errors = t->vm->errors_;
+                t->rep.done   = ( st == status::DONE );
+            }
+            t->finished = true;
+            return false;
+        }
+
+        void loop( )
+        {
+            std::unique_lock<std::mutex> lck(lock_);
+            for( ;; ) {
+                wake_.wait( lck, [this]( ) {
+                    return !queue_.empty( ) || running_ == 0;
+                } );
+                if( queue_.empty( ) ) {
+                    /// nothing queued and nothing that could come back
+                    wake_.notify_all( );
+                    return;
+                }
+                auto next = queue_.front( );
+                queue_.pop_front( );
+                ++running_;
+                lck.unlock( );
+
+                bool again = step( next );
+
+                lck.lock( );
+                --running_;
+                if( again ) {
+                    queue_.push_back( next );
+                }
+                wake_.notify_one( );
+            }
+        }
+
+        std::size_t                          threads_;
+        std::uint64_t                        slice_;
+        std::vector<std::unique_ptr<task> >  tasks_;
+
+        std::mutex                           lock_;
+        std::condition_variable              wake_;
+        std::deque<task *>                   queue_;
+        /// tasks taken off the queue and still in a slice
+        std::size_t                          running_ = 0;
+    };
+
+}}
+
+#endif // SCHEDULER_H
@@ -0,0 +1,342 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "ast.h"
+
+namespace mico { namespace scope {
+
+    /// Resolves every identifier and let of a program to a global, a
+    /// slot of the frame of the enclosing function or a captured value
+    /// (see ast::var_ref). A function captures only the free variables
+    /// it uses, each one copied into a flat array when the literal runs.
+    ///
+    /// Scopes are lexical: a name is local to a function from its first
+    /// let (or parameter) to the end of the body; blocks do not open new
+    /// scopes. Top level names are globals and are never captured.
+    /// A captured variable gets a cell when the copy could go stale: it
+    /// is assigned more than once or captured before its value is set
+    /// (let f = fn( ) { f( ) }).
+    /// A local that is read before its let has run reads null.
+    ///
+    /// Calls in tail position of a function (return f( x ), or the last
+    /// statement of the body or of an if in tail position) are marked,
+    /// so engines can reuse the frame
+    class resolver {
+
+    public:
+
+        static
+        void resolve( std::vector<ast::statement::uptr> &states )
+        {
+            resolver r;
+            r.statements( states );
+        }
+
+    private:
+
+        struct variable {
+            std::uint32_t slot     = 0;
+            unsigned      assigned = 0;
+            bool          captured = false;
+            bool          early    = false;
+            /// everything that has to know about a cell
+            std::vector<ast::var_ref *> refs;
+        };
+
+        struct function_scope {
+            ast::function_info                     *info   = nullptr;
+            function_scope                         *parent = nullptr;
+            std::vector<std::unique_ptr<variable> > vars;
+            std::map<std::string, variable *>       locals;
+            std::map<std::string, std::uint32_t>    captures;
+            /// the variable every capture comes from in the end
+            std::vector<variable *>                 sources;
+        };
+
+        static
+        variable *declare( function_scope *sc, const std::string &name )
+        {
+            auto found = sc->locals.find( name );
+            if( found != sc->locals.end( ) ) {
+                return found->second;
+            }
+            std::unique_ptr<variable> var(new variable);
+            var->slot = static_cast<std::uint32_t>(sc->vars.size( ));
+            auto res  = var.get( );
+            sc->vars.emplace_back( std::move(var) );
+            sc->locals[name] = res;
+            return res;
+        }
+
+        /// returns nullptr for a global
+        static
+        variable *lookup( function_scope *sc, const std::string &name,
+                          ast::var_ref &res )
+        {
+            res = ast::var_ref( );
+            if( !sc ) {
+                return nullptr;
+            }
+
+            auto local = sc->locals.find( name );
+            if( local != sc->locals.end( ) ) {
+                res.scope = ast::var_scope::LOCAL;
+                res.index = local->second->slot;
+                return local->second;
+            }
+
+            auto cap = sc->captures.find( name );
+            if( cap != sc->captures.end( ) ) {
+                res.scope = ast::var_scope::CAPTURE;
+                res.index = cap->second;
+                return sc->sources[cap->second];
+            }
+
+            ast::var_ref outer;
+            auto var = lookup( sc->parent, name, outer );
+            if( !var ) {
+                return nullptr;
+            }
+
+            auto index = static_cast<std::uint32_t>(sc->info->captures.size( ));
+            sc->info->captures.push_back( outer );
+            sc->captures[name] = index;
+            sc->sources.push_back( var );
+            var->captured = true;
+            if( var->assigned == 0 ) {
+                var->early = true;
+            }
+
+            res.scope = ast::var_scope::CAPTURE;
+            res.index = index;
+            return var;
+        }
+
+        void statements( std::vector<ast::statement::uptr> &states )
+        {
+            for( auto &s: states ) {
+                statement( s.get( ) );
+            }
+        }
+
+        void statement( ast::statement *stmt )
+        {
+            if( !stmt ) {
+                return;
+            }
+            switch( stmt->type( ) ) {
+            case ast::node_type::STATE_LET:
+                let( static_cast<ast::let_statement *>(stmt) );
+                break;
+            case ast::node_type::STATE_RETURN:
+                expression( static_cast<ast::return_statement *>(stmt)
+                           ->expr.get( ) );
+                break;
+            case ast::node_type::STATE_EXPR:
+                expression( static_cast<ast::expr_statement *>(stmt)
+                           ->expr.get( ) );
+                break;
+            case ast::node_type::STATE_BLOCK:
+                statements( static_cast<ast::block_statement *>(stmt)->states );
+                break;
+            default:
+                break;
+            }
+        }
+
+        /// a new local is visible in its own value only if that is a
+        /// function literal; let x = x + 1 reads the outer x
+        void let( ast::let_statement *let )
+        {
+            if( !current_ ) {
+                expression( let->expr.get( ) );
+                return;
+            }
+
+            auto &name = let->ident->value;
+            bool early = let->expr
+                      && let->expr->type( )
+                                == ast::node_type::EXPRESSION_FUNCTION;
+
+            variable *var = nullptr;
+            if( early || current_->locals.count( name ) ) {
+                var = declare( current_, name );
+                expression( let->expr.get( ) );
+            } else {
+                expression( let->expr.get( ) );
+                var = declare( current_, name );
+            }
+
+            var->assigned++;
+            let->ref.scope = ast::var_scope::LOCAL;
+            let->ref.index = var->slot;
+            var->refs.push_back( &let->ref );
+        }
+
+        void expressions( std::vector<ast::expression::uptr> &exprs )
+        {
+            for( auto &e: exprs ) {
+                expression( e.get( ) );
+            }
+        }
+
+        void expression( ast::expression *expr )
+        {
+            if( !expr ) {
+                return;
+            }
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_IDENT: {
+                auto ident = static_cast<ast::ident_expression *>(expr);
+                if( auto var = lookup( current_, ident->value, ident->ref ) ) {
+                    var->refs.push_back( &ident->ref );
+                }
+                break;
+            }
+            case ast::node_type::EXPRESSION_PREFIX:
+                expression( static_cast<ast::prefix_expression *>(expr)
+                           ->expr.get( ) );
+                break;
+            case ast::node_type::EXPRESSION_INFIX: {
+                auto inf = static_cast<ast::infix_expression *>(expr);
+                expression( inf->left.get( ) );
+                expression( inf->right.get( ) );
+                break;
+            }
+            case ast::node_type::EXPRESSION_ARRAY:
+                expressions( static_cast<ast::array_expression *>(expr)
+                            ->elements );
+                break;
+            case ast::node_type::EXPRESSION_INDEX: {
+                auto idx = static_cast<ast::index_expression *>(expr);
+                expression( idx->left.get( ) );
+                expression( idx->index.get( ) );
+                break;
+            }
+            case ast::node_type::EXPRESSION_CALL: {
+                auto call = static_cast<ast::call_expression *>(expr);
+                expression( call->func.get( ) );
+                expressions( call->args );
+                break;
+            }
+            case ast::node_type::EXPRESSION_HASH:
+                for( auto &p: static_cast<ast::hash_expression *>(expr)->pairs ) {
+                    expression( p.first.get( ) );
+                    expression( p.second.get( ) );
+                }
+                break;
+            case ast::node_type::EXPRESSION_IF: {
+                auto cond = static_cast<ast::if_expression *>(expr);
+                expression( cond->cond.get( ) );
+                statement( cond->then_block.get( ) );
+                statement( cond->else_block.get( ) );
+                break;
+            }
+            case ast::node_type::EXPRESSION_FUNCTION:
+                function( static_cast<ast::function_expression *>(expr) );
+                break;
+            default:
+                break;
+            }
+        }
+
+        void function( ast::function_expression *fn )
+        {
+            function_scope sc;
+            sc.info   = fn->info.get( );
+            sc.parent = current_;
+
+            for( auto &p: sc.info->params ) {
+                declare( &sc, p )->assigned++;
+            }
+
+            current_ = &sc;
+            statements( sc.info->body );
+            current_ = sc.parent;
+
+            finish( sc );
+            tail_block( sc.info->body, true );
+        }
+
+        /// 'tail': the value of the block is what the function returns
+        static
+        void tail_block( std::vector<ast::statement::uptr> &states, bool tail )
+        {
+            for( std::size_t i = 0; i < states.size( ); ++i ) {
+                auto stmt = states[i].get( );
+                if( !stmt ) {
+                    continue;
+                }
+                bool last = ( i + 1 == states.size( ) );
+                if( stmt->type( ) == ast::node_type::STATE_RETURN ) {
+                    tail_expression( static_cast<ast::return_statement *>(
+                                                stmt )->expr.get( ), true );
+                } else if( stmt->type( ) == ast::node_type::STATE_EXPR ) {
+                    tail_expression( static_cast<ast::expr_statement *>(
+                                                stmt )->expr.get( ),
+                                     tail && last );
+                }
+            }
+        }
+
+        /// looks into ifs for returns even where the if is not in tail
+        /// position itself
+        static
+        void tail_expression( ast::expression *expr, bool tail )
+        {
+            if( !expr ) {
+                return;
+            }
+            switch( expr->type( ) ) {
+            case ast::node_type::EXPRESSION_CALL:
+                static_cast<ast::call_expression *>(expr)->tail = tail;
+                break;
+            case ast::node_type::EXPRESSION_IF: {
+                auto cond = static_cast<ast::if_expression *>(expr);
+                tail_block( cond->then_block->states, tail );
+                if( cond->else_block ) {
+                    tail_block( cond->else_block->states, tail );
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        /// the captures of 'sc' are final now; the cells of its own
+        /// variables are known because every use has been seen
+        static
+        void finish( function_scope &sc )
+        {
+            auto info = sc.info;
+            for( std::size_t i = 0; i < info->captures.size( ); ++i ) {
+                sc.sources[i]->refs.push_back( &info->captures[i] );
+            }
+
+            info->locals = sc.vars.size( );
+            info->cells.assign( info->locals, false );
+            for( auto &var: sc.vars ) {
+                bool cell = var->captured
+                         && ( var->assigned > 1 || var->early );
+                if( cell ) {
+                    info->cells[var->slot] = true;
+                    for( auto r: var->refs ) {
+                        r->cell = true;
+                    }
+                }
+            }
+        }
+
+        function_scope *current_ = nullptr;
+    };
+
+}}
+
+#endif // SCOPE_H
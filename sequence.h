@@ -0,0 +1,92 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "objects.h"
+#include "vector.h"
+
+namespace mico { namespace objects {
+
+    /// Lazy sequence: a source and the map and filter stages its
+    /// elements go through, in order. The source is the integers
+    /// [from, to) or the elements of a vector.
+    ///
+    /// Adapters do not nest: map and filter over a sequence make a new
+    /// one with the same source and one stage more, so a pipeline is a
+    /// single loop that takes one element through every stage before it
+    /// looks at the next one, and no stage has an array of its own.
+    /// A sequence never changes after it is made, except for 'cache'
+    template <typename ValueT>
+    struct basic_sequence: public object {
+
+        using vector = basic_vector<ValueT>;
+
+        enum class stage_kind: std::uint8_t {
+            MAP,
+            FILTER,
+        };
+
+        struct stage {
+            stage_kind kind;
+            ValueT     fn;
+        };
+
+        object_type type( ) const
+        {
+            return object_type::SEQUENCE;
+        }
+
+        std::string inspect( ) const
+        {
+            return "<sequence>";
+        }
+
+        void trace( tracer &t )
+        {
+            t.visit( items );
+            t.visit( cache );
+            for( auto &s: stages ) {
+                t.visit( s.fn );
+            }
+        }
+
+        std::size_t source_size( ) const
+        {
+            if( items ) {
+                return items->size( );
+            }
+            /// in unsigned, where it cannot overflow
+            return ( to > from )
+                 ? static_cast<std::size_t>( static_cast<std::uint64_t>(to)
+                                           - static_cast<std::uint64_t>(from) )
+                 : 0;
+        }
+
+        /// its length is known without calling anything
+        bool counted( ) const
+        {
+            for( auto &s: stages ) {
+                if( s.kind == stage_kind::FILTER ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::int64_t       from  = 0;
+        std::int64_t       to    = 0;
+        /// the source if it is not a range
+        vector            *items = nullptr;
+        std::vector<stage> stages;
+        /// every element, once something needed all of them
+        vector            *cache = nullptr;
+    };
+
+    using sequence = basic_sequence<value>;
+
+}}
+
+#endif // SEQUENCE_H
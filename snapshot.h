@@ -0,0 +1,300 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+namespace mico { namespace snapshot {
+
+    /// Layout of a heap snapshot; see vm_engine::save_snapshot.
+    ///
+    /// A header, then a stream of records in the byte order of the
+    /// writer. Objects refer to each other by their index in the
+    /// snapshot, never by address, so a snapshot can be restored into
+    /// any heap:
+    ///   units:   count, then (source hash, image bytes) for each
+    ///   objects: count, then one record per object
+    ///   globals: count, then (name, value) for each
+    /// A value is a tag, then a bool, an int or an object index
+    static const std::uint32_t version = 1;
+
+    static const char magic[8] = { 'M', 'I', 'C', 'O', 'S', 'N', 'P', 0 };
+
+    struct header {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        /// of the bytes after the header
+        std::uint64_t checksum;
+        std::uint64_t size;
+    };
+
+    enum class value_tag: std::uint8_t {
+        NUL = 0,
+        BOOL,
+        INT,
+        OBJECT,
+    };
+
+    enum class object_tag: std::uint8_t {
+        STRING = 0,
+        /// a string literal; restored through the intern table
+        LITERAL,
+        VECTOR,
+        HASH,
+        FUNCTION,
+        CELL,
+        BUILTIN,
+    };
+
+    struct value_rec {
+        value_tag     tag  = value_tag::NUL;
+        /// the bool, the int or the object index
+        std::uint64_t bits = 0;
+    };
+
+    /// every object has the same fields; what they mean depends on 'tag':
+    ///   STRING, LITERAL  text
+    ///   VECTOR           values
+    ///   HASH             values, key then value
+    ///   FUNCTION         a: unit, b: proto, values: the captured ones
+    ///   CELL             values: the one it holds
+    ///   BUILTIN          a: id, text: name
+    struct object_rec {
+        object_tag             tag = object_tag::STRING;
+        std::uint64_t          a   = 0;
+        std::uint64_t          b   = 0;
+        std::string            text;
+        std::vector<value_rec> values;
+    };
+
+    class writer {
+
+    public:
+
+        writer( )
+            :out_(sizeof(header), '\0')
+        { }
+
+        void u8( std::uint8_t v )
+        {
+            out_.push_back( static_cast<char>(v) );
+        }
+
+        void u64( std::uint64_t v )
+        {
+            out_.append( reinterpret_cast<const char *>(&v), sizeof(v) );
+        }
+
+        void bytes( const char *data, std::size_t size )
+        {
+            u64( size );
+            out_.append( data, size );
+        }
+
+        void str( const std::string &v )
+        {
+            bytes( v.data( ), v.size( ) );
+        }
+
+        void value( const value_rec &v )
+        {
+            u8( static_cast<std::uint8_t>(v.tag) );
+            switch( v.tag ) {
+            case value_tag::NUL:
+                break;
+            case value_tag::BOOL:
+                u8( v.bits ? 1 : 0 );
+                break;
+            case value_tag::INT:
+            case value_tag::OBJECT:
+                u64( v.bits );
+                break;
+            }
+        }
+
+        void object( const object_rec &obj )
+        {
+            u8( static_cast<std::uint8_t>(obj.tag) );
+            u64( obj.a );
+            u64( obj.b );
+            str( obj.text );
+            u64( obj.values.size( ) );
+            for( auto &v: obj.values ) {
+                value( v );
+            }
+        }
+
+        std::string finish( )
+        {
+            header head;
+            std::memset( &head, 0, sizeof(head) );
+            std::memcpy( head.magic, magic, sizeof(magic) );
+            head.version    = version;
+            head.byte_order = image::byte_order;
+            head.size       = out_.size( );
+            head.checksum   = image::hash( out_.data( ) + sizeof(head),
+                                           out_.size( ) - sizeof(head) );
+            std::memcpy( &out_[0], &head, sizeof(head) );
+            std::string res;
+            res.swap( out_ );
+            return res;
+        }
+
+    private:
+        std::string out_;
+    };
+
+    /// reads what writer wrote; every read past the end fails and
+    /// makes ok( ) false for good
+    class reader {
+
+    public:
+
+        /// checks the header; 'err' says why it failed
+        bool open( const char *data, std::size_t size, std::string &err )
+        {
+            data_ = data;
+            size_ = size;
+            pos_  = sizeof(header);
+
+            header head;
+            if( size < sizeof(head) ) {
+                err = "not a snapshot";
+                return false;
+            }
+            std::memcpy( &head, data, sizeof(head) );
+            if( std::memcmp( head.magic, magic, sizeof(magic) ) != 0 ) {
+                err = "not a snapshot";
+                return false;
+            }
+            if( head.version != version
+             || head.byte_order != image::byte_order )
+            {
+                err = "snapshot of another version or byte order";
+                return false;
+            }
+            if( head.size != size
+             || head.checksum != image::hash( data + sizeof(head),
+                                              size - sizeof(head) ) )
+            {
+                err = "damaged snapshot";
+                return false;
+            }
+            ok_ = true;
+            return true;
+        }
+
+        bool ok( ) const
+        {
+            return ok_;
+        }
+
+        bool at_end( ) const
+        {
+            return pos_ == size_;
+        }
+
+        std::uint8_t u8( )
+        {
+            if( !need( 1 ) ) {
+                return 0;
+            }
+            return static_cast<std::uint8_t>(data_[pos_++]);
+        }
+
+        std::uint64_t u64( )
+        {
+            std::uint64_t res = 0;
+            if( need( sizeof(res) ) ) {
+                std::memcpy( &res, data_ + pos_, sizeof(res) );
+                pos_ += sizeof(res);
+            }
+            return res;
+        }
+
+        /// a count of things that take at least 'each' bytes; a larger
+        /// one than the rest of the data can hold fails
+        std::size_t count( std::size_t each = 1 )
+        {
+            auto res = u64( );
+            if( res > ( size_ - pos_ ) / each ) {
+                ok_ = false;
+                return 0;
+            }
+            return static_cast<std::size_t>(res);
+        }
+
+        std::string str( )
+        {
+            auto n = count( );
+            if( !need( n ) ) {
+                return std::string( );
+            }
+            std::string res( data_ + pos_, n );
+            pos_ += n;
+            return res;
+        }
+
+        value_rec value( )
+        {
+            value_rec res;
+            auto tag = u8( );
+            if( tag > static_cast<std::uint8_t>(value_tag::OBJECT) ) {
+                ok_ = false;
+                return res;
+            }
+            res.tag = static_cast<value_tag>(tag);
+            switch( res.tag ) {
+            case value_tag::NUL:
+                break;
+            case value_tag::BOOL:
+                res.bits = u8( );
+                break;
+            case value_tag::INT:
+            case value_tag::OBJECT:
+                res.bits = u64( );
+                break;
+            }
+            return res;
+        }
+
+        /// the tag is not checked; the reader of the object knows them
+        object_rec object( )
+        {
+            object_rec res;
+            res.tag  = static_cast<object_tag>(u8( ));
+            res.a    = u64( );
+            res.b    = u64( );
+            res.text = str( );
+            res.values.resize( count( ) );
+            for( auto &v: res.values ) {
+                v = value( );
+            }
+            return res;
+        }
+
+    private:
+
+        bool need( std::size_t n )
+        {
+            if( !ok_ || n > size_ - pos_ ) {
+                ok_ = false;
+                return false;
+            }
+            return true;
+        }
+
+        const char  *data_ = nullptr;
+        std::size_t  size_ = 0;
+        std::size_t  pos_  = 0;
+        bool         ok_   = false;
+    };
+
+}}
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,324 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+/// Build with MICO_TRACE defined to 0 and every trace::scope is empty,
+/// the allocation hooks count nothing and the phases cost nothing.
+/// With it on, a phase costs one thread-local load unless a recorder
+/// is installed on the thread
+#ifndef MICO_TRACE
+#define MICO_TRACE 1
+#endif
+
+namespace mico { namespace trace {
+
+    /// The steps a script goes through
+    ///  TABLE    lexer::tokens::all
+    ///  LEX      lexer::tokens::get_list
+    ///  READER   the constructor of parser::token_reader
+    ///  PARSE    parser::token_reader::parse
+    ///  COMPILE  load( ) of the vm and the closure engine
+    ///  EXECUTE  run( ) of the engines
+    enum class phase: std::uint8_t {
+        TABLE = 0,
+        LEX,
+        READER,
+        PARSE,
+        COMPILE,
+        EXECUTE,
+        LAST,
+    };
+
+    static const std::size_t phase_count =
+                                    static_cast<std::size_t>(phase::LAST);
+
+    inline
+    const char *name( phase p )
+    {
+        switch( p ) {
+        case phase::TABLE:   return "tokens::all";
+        case phase::LEX:     return "tokens::get_list";
+        case phase::READER:  return "token_reader";
+        case phase::PARSE:   return "parse";
+        case phase::COMPILE: return "compile";
+        case phase::EXECUTE: return "execute";
+        case phase::LAST:    break;
+        }
+        return "none";
+    }
+
+    /// what the hooks counted on this thread; see allocated( )
+    struct counts {
+        std::uint64_t allocations = 0;
+        std::uint64_t bytes       = 0;
+    };
+
+    /// The times a phase ran and what it took. 'allocations' and
+    /// 'bytes' are the ones of the tokens the lexer made and the AST
+    /// nodes, not every allocation of the phase; nested phases count
+    /// in their parent too
+    struct phase_stats {
+        std::uint64_t calls       = 0;
+        std::uint64_t nanos       = 0;
+        std::uint64_t allocations = 0;
+        std::uint64_t bytes       = 0;
+    };
+
+    struct stats {
+
+        phase_stats &operator [ ]( phase p )
+        {
+            return phases[static_cast<std::size_t>(p)];
+        }
+
+        const phase_stats &operator [ ]( phase p ) const
+        {
+            return phases[static_cast<std::size_t>(p)];
+        }
+
+        std::string text( ) const
+        {
+            std::ostringstream oss;
+            for( std::size_t i = 0; i < phase_count; ++i ) {
+                auto &p = phases[i];
+                if( p.calls == 0 ) {
+                    continue;
+                }
+                oss << "  " << std::left << std::setw(18)
+                    << name( static_cast<phase>(i) ) << std::right
+                    << "  calls " << std::setw(8) << p.calls
+                    << "  ms " << std::setw(10) << std::fixed
+                    << std::setprecision(3) << p.nanos / 1e6
+                    << "  allocations " << std::setw(10) << p.allocations
+                    << "  bytes " << std::setw(12) << p.bytes << "\n";
+            }
+            return oss.str( );
+        }
+
+        phase_stats phases[phase_count];
+    };
+
+    /// one finished phase; times are from the start of the recorder
+    struct event {
+        trace::phase  phase = trace::phase::LAST;
+        std::uint64_t start = 0;
+        std::uint64_t nanos = 0;
+        std::uint32_t depth = 0;
+        trace::counts counts;
+    };
+
+    inline
+    counts &allocated( )
+    {
+        static thread_local counts value;
+        return value;
+    }
+
+    /// the hooks; lexer::tokens::get_list and ast::node call them
+    inline
+    void count( std::size_t bytes )
+    {
+#if MICO_TRACE
+        auto &c = allocated( );
+        c.allocations++;
+        c.bytes += bytes;
+#else
+        (void)bytes;
+#endif
+    }
+
+    /// a string that did not fit into itself; the small ones cost nothing
+    inline
+    void count( const std::string &str )
+    {
+#if MICO_TRACE
+        auto data = str.data( );
+        auto self = reinterpret_cast<const char *>(&str);
+        if( data < self || data >= self + sizeof(str) ) {
+            count( str.capacity( ) + 1 );
+        }
+#else
+        (void)str;
+#endif
+    }
+
+    /// Collects the phases that run on the thread it is installed on
+    /// (see session). Not thread safe; a thread records into its own
+    class recorder {
+
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        recorder( )
+            :start_(clock::now( ))
+        { }
+
+        void add( const event &ev )
+        {
+            auto &s = stats_[ev.phase];
+            s.calls++;
+            s.nanos       += ev.nanos;
+            s.allocations += ev.counts.allocations;
+            s.bytes       += ev.counts.bytes;
+            if( keep_events_ ) {
+                events_.push_back( ev );
+            }
+        }
+
+        std::uint64_t now( ) const
+        {
+            return static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now( ) - start_ ).count( ) );
+        }
+
+        /// without events only the stats are kept; for long lived hosts
+        void keep_events( bool on )
+        {
+            keep_events_ = on;
+        }
+
+        const trace::stats &stats( ) const
+        {
+            return stats_;
+        }
+
+        const std::vector<event> &events( ) const
+        {
+            return events_;
+        }
+
+        void clear( )
+        {
+            stats_ = trace::stats( );
+            events_.clear( );
+        }
+
+        /// The events in the Trace Event Format chrome://tracing and
+        /// Perfetto open: complete ("X") events in microseconds with the
+        /// allocations in their args
+        std::string chrome_json( std::uint32_t pid = 1,
+                                 std::uint32_t tid = 1 ) const
+        {
+            std::ostringstream oss;
+            oss << "{\"traceEvents\": [\n";
+            for( std::size_t i = 0; i < events_.size( ); ++i ) {
+                auto &e = events_[i];
+                oss << "  {\"name\": \"" << name( e.phase )
+                    << "\", \"cat\": \"mico\", \"ph\": \"X\", \"ts\": "
+                    << std::fixed << std::setprecision(3) << e.start / 1e3
+                    << ", \"dur\": " << e.nanos / 1e3
+                    << ", \"pid\": " << pid << ", \"tid\": " << tid
+                    << ", \"args\": {\"allocations\": "
+                    << e.counts.allocations << ", \"bytes\": "
+                    << e.counts.bytes << "}}"
+                    << ( i + 1 < events_.size( ) ? "," : "" ) << "\n";
+            }
+            oss << "], \"displayTimeUnit\": \"ns\"}\n";
+            return oss.str( );
+        }
+
+        /// of the phases open now
+        std::uint32_t depth_ = 0;
+
+    private:
+        clock::time_point  start_;
+        bool               keep_events_ = true;
+        trace::stats       stats_;
+        std::vector<event> events_;
+    };
+
+    inline
+    recorder *&current( )
+    {
+        static thread_local recorder *value = nullptr;
+        return value;
+    }
+
+    /// Installs 'rec' on the thread for its lifetime and puts back the
+    /// one that was there before
+    class session {
+
+    public:
+
+        explicit session( recorder &rec )
+            :prev_(current( ))
+        {
+            current( ) = &rec;
+        }
+
+        ~session( )
+        {
+            current( ) = prev_;
+        }
+
+        session( const session & ) = delete;
+        session &operator = ( const session & ) = delete;
+
+    private:
+        recorder *prev_;
+    };
+
+#if MICO_TRACE
+
+    /// Times a phase and counts what the hooks see during it, if a
+    /// recorder is installed when it starts
+    class scope {
+
+    public:
+
+        explicit scope( phase p )
+            :rec_(current( ))
+        {
+            if( rec_ ) {
+                ev_.phase = p;
+                ev_.depth = rec_->depth_++;
+                ev_.counts = allocated( );
+                ev_.start = rec_->now( );
+            }
+        }
+
+        ~scope( )
+        {
+            if( rec_ ) {
+                ev_.nanos = rec_->now( ) - ev_.start;
+                auto &c = allocated( );
+                ev_.counts.allocations = c.allocations
+                                       - ev_.counts.allocations;
+                ev_.counts.bytes = c.bytes - ev_.counts.bytes;
+                rec_->depth_--;
+                rec_->add( ev_ );
+            }
+        }
+
+        scope( const scope & ) = delete;
+        scope &operator = ( const scope & ) = delete;
+
+    private:
+        recorder *rec_;
+        event     ev_;
+    };
+
+#else
+
+    class scope {
+    public:
+        explicit scope( phase )
+        { }
+        scope( const scope & ) = delete;
+        scope &operator = ( const scope & ) = delete;
+    };
+
+#endif
+
+}}
+
+#endif // TRACE_H
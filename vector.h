@@ -0,0 +1,344 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+
+#include "objects.h"
+#include "gc.h"
+
+namespace mico { namespace objects {
+
+    namespace vector_bits {
+        static const unsigned    bits  = 5;
+        static const std::size_t width = 32;
+        static const std::size_t mask  = 31;
+    }
+
+    template <typename ValueT>
+    struct basic_vector_leaf: public object {
+
+        object_type type( ) const
+        {
+            return object_type::VECTOR_NODE;
+        }
+
+        std::string inspect( ) const
+        {
+            return "<vector leaf>";
+        }
+
+        void trace( tracer &t )
+        {
+            for( std::size_t i = 0; i < used; ++i ) {
+                t.visit( values[i] );
+            }
+        }
+
+        ValueT        values[vector_bits::width];
+        std::uint8_t  used = 0;
+    };
+
+    struct vector_branch: public object {
+
+        object_type type( ) const
+        {
+            return object_type::VECTOR_NODE;
+        }
+
+        std::string inspect( ) const
+        {
+            return "<vector branch>";
+        }
+
+        void trace( tracer &t )
+        {
+            for( std::size_t i = 0; i < used; ++i ) {
+                t.visit( children[i] );
+            }
+        }
+
+        object       *children[vector_bits::width] = { };
+        std::uint8_t  used = 0;
+    };
+
+    /// Persistent vector: a 32-way trie of leaves plus a tail leaf that
+    /// is not in the trie yet (Bagwell / Clojure).
+    ///
+    /// Every node records in 'used' how many of its slots any vector has
+    /// claimed. A vector whose extent ends exactly at 'used' may claim
+    /// the next slot in place; an older version sharing the node never
+    /// looks that far, so it is not affected. Accumulating into the
+    /// newest version (let a = push(a, x)) does not copy the tail, any
+    /// other version falls back to path copying.
+    ///
+    /// 'start' makes rest( ) O(1); the dropped prefix stays alive as long
+    /// as the vector does
+    template <typename ValueT>
+    struct basic_vector: public object {
+
+        using leaf = basic_vector_leaf<ValueT>;
+
+        object_type type( ) const
+        {
+            return object_type::VECTOR;
+        }
+
+        std::string inspect( ) const
+        {
+            std::ostringstream oss;
+            oss << "[";
+            for( std::size_t i = 0; i < size( ); ++i ) {
+                if( i != 0 ) {
+                    oss << ", ";
+                }
+                oss << objects::inspect( get( i ) );
+            }
+            oss << "]";
+            return oss.str( );
+        }
+
+        void trace( tracer &t )
+        {
+            t.visit( root );
+            t.visit( tail );
+        }
+
+        std::size_t size( ) const
+        {
+            return count - start;
+        }
+
+        /// 'id' has to be less than size( )
+        const ValueT &get( std::size_t id ) const
+        {
+            auto pos = start + id;
+            if( pos >= tail_offset( ) ) {
+                return tail->values[pos & vector_bits::mask];
+            }
+            object *node = root;
+            for( auto level = shift; level > 0; level -= vector_bits::bits ) {
+                node = static_cast<vector_branch *>(node)
+                      ->children[(pos >> level) & vector_bits::mask];
+            }
+            return static_cast<leaf *>(node)->values[pos & vector_bits::mask];
+        }
+
+        /// first position that is in the tail
+        std::size_t tail_offset( ) const
+        {
+            return ( count < vector_bits::width )
+                 ? 0
+                 : ( (count - 1) >> vector_bits::bits ) << vector_bits::bits;
+        }
+
+        vector_branch *root  = nullptr;
+        leaf          *tail  = nullptr;
+        std::size_t    start = 0;
+        std::size_t    count = 0;
+        unsigned       shift = vector_bits::bits;
+    };
+
+    /// Operations allocate their nodes inside gc::no_collect, so
+    /// arguments only have to be reachable when the call starts
+    template <typename ValueT>
+    struct basic_vector_ops {
+
+        using vector = basic_vector<ValueT>;
+        using leaf   = basic_vector_leaf<ValueT>;
+        using branch = vector_branch;
+
+        static
+        vector *make( gc::heap &heap )
+        {
+            return heap.make<vector>( );
+        }
+
+        /// 'values' do not have to be rooted; nothing is collected
+        static
+        vector *make( gc::heap &heap, const ValueT *values, std::size_t n )
+        {
+            gc::no_collect guard(heap);
+            auto res = heap.make<vector>( );
+            for( std::size_t i = 0; i < n; ++i ) {
+                append( heap, res, values[i] );
+            }
+            return res;
+        }
+
+        static
+        vector *push( gc::heap &heap, const vector *vec, const ValueT &val )
+        {
+            gc::no_collect guard(heap);
+            auto res = copy( heap, vec );
+            append( heap, res, val );
+            return res;
+        }
+
+        /// grows 'vec' in place; only for a vector nobody else has seen
+        /// yet, one that is being built. 'vec' has to be rooted
+        static
+        void append_new( gc::heap &heap, vector *vec, const ValueT &val )
+        {
+            gc::no_collect guard(heap);
+            append( heap, vec, val );
+            heap.write_barrier( vec, vec->root );
+            heap.write_barrier( vec, vec->tail );
+        }
+
+        /// nullptr for an empty vector
+        static
+        vector *rest( gc::heap &heap, const vector *vec )
+        {
+            if( vec->size( ) == 0 ) {
+                return nullptr;
+            }
+            auto res = copy( heap, vec );
+            res->start++;
+            return res;
+        }
+
+    private:
+
+        static
+        vector *copy( gc::heap &heap, const vector *vec )
+        {
+            auto res   = heap.make<vector>( );
+            res->root  = vec->root;
+            res->tail  = vec->tail;
+            res->start = vec->start;
+            res->count = vec->count;
+            res->shift = vec->shift;
+            return res;
+        }
+
+        /// 'vec' is owned by the caller; nodes are claimed or copied
+        static
+        void append( gc::heap &heap, vector *vec, const ValueT &val )
+        {
+            auto in_tail = vec->count - vec->tail_offset( );
+
+            if( in_tail < vector_bits::width ) {
+                vec->tail = claim_leaf( heap, vec->tail, in_tail, val );
+                vec->count++;
+                return;
+            }
+
+            /// the tail is full; it moves into the trie
+            auto offset = vec->count - vector_bits::width;
+            auto capacity = std::size_t(1) << (vec->shift + vector_bits::bits);
+            if( !vec->root ) {
+                vec->root = heap.make<branch>( );
+            }
+
+            if( offset == capacity ) {
+                auto up = heap.make<branch>( );
+                up->children[0] = vec->root;
+                up->children[1] = new_path( heap, vec->shift, vec->tail );
+                up->used        = 2;
+                vec->root   = up;
+                vec->shift += vector_bits::bits;
+            } else {
+                vec->root = push_tail( heap, vec->shift, vec->root,
+                                       vec->tail, offset );
+            }
+
+            vec->tail = claim_leaf( heap, nullptr, 0, val );
+            vec->count++;
+        }
+
+        /// stores 'val' at 'pos' of 'node', which is known to hold 'pos'
+        /// entries for the caller
+        static
+        leaf *claim_leaf( gc::heap &heap, leaf *node, std::size_t pos,
+                          const ValueT &val )
+        {
+            if( node && node->used == pos ) {
+                node->values[pos] = val;
+                node->used++;
+                heap.write_barrier( node, val );
+                return node;
+            }
+            auto res = heap.make<leaf>( );
+            for( std::size_t i = 0; i < pos; ++i ) {
+                res->values[i] = node->values[i];
+            }
+            res->values[pos] = val;
+            res->used = static_cast<std::uint8_t>(pos + 1);
+            return res;
+        }
+
+        static
+        branch *claim_branch( gc::heap &heap, branch *node, std::size_t pos,
+                              object *child )
+        {
+            if( node->used == pos ) {
+                node->children[pos] = child;
+                node->used++;
+                heap.write_barrier( node, child );
+                return node;
+            }
+            auto res = heap.make<branch>( );
+            for( std::size_t i = 0; i < pos; ++i ) {
+                res->children[i] = node->children[i];
+            }
+            res->children[pos] = child;
+            res->used = static_cast<std::uint8_t>(pos + 1);
+            return res;
+        }
+
+        static
+        object *new_path( gc::heap &heap, unsigned level, leaf *node )
+        {
+            if( level == 0 ) {
+                return node;
+            }
+            auto res = heap.make<branch>( );
+            res->children[0] = new_path( heap, level - vector_bits::bits, node );
+            res->used = 1;
+            return res;
+        }
+
+        /// puts 'node' at position 'offset' of the subtree 'parent';
+        /// returns the parent to use from now on
+        static
+        branch *push_tail( gc::heap &heap, unsigned level, branch *parent,
+                           leaf *node, std::size_t offset )
+        {
+            auto sub = (offset >> level) & vector_bits::mask;
+
+            if( level == vector_bits::bits ) {
+                return claim_branch( heap, parent, sub, node );
+            }
+
+            auto below = level - vector_bits::bits;
+            bool exists = ( offset & ((std::size_t(1) << level) - 1) ) != 0;
+            if( !exists ) {
+                return claim_branch( heap, parent, sub,
+                                     new_path( heap, below, node ) );
+            }
+
+            auto child = static_cast<branch *>(parent->children[sub]);
+            auto next  = push_tail( heap, below, child, node, offset );
+            if( next == child ) {
+                return parent;
+            }
+
+            /// the slot is shared with other versions; copy the path
+            auto res = heap.make<branch>( );
+            for( std::size_t i = 0; i < sub; ++i ) {
+                res->children[i] = parent->children[i];
+            }
+            res->children[sub] = next;
+            res->used = static_cast<std::uint8_t>(sub + 1);
+            return res;
+        }
+    };
+
+    using vector     = basic_vector<value>;
+    using vector_ops = basic_vector_ops<value>;
+
+}}
+
+#endif // VECTOR_H
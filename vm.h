@@ -0,0 +1,2965 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "parser.h"
+#include "runtime.h"
+#include "engine.h"
+#include "bytecode.h"
+#include "peephole.h"
+#include "image.h"
+#include "snapshot.h"
+#include "pool.h"
+#include "deps.h"
+#include "profile.h"
+#include "trace.h"
+
+namespace mico { namespace engines {
+
+    /// Compiles a program into bytecode (see bytecode::compiler) and runs
+    /// it on a stack machine. The operand stack is stack_ of the runtime,
+    /// above the locals of the running frame, so every temporary is a
+    /// root. Calls do not recurse on the C++ stack.
+    /// The peephole pass is on by default; it has to be set before load.
+    ///
+    /// Every call site has an inline cache of the callees it has seen
+    /// (up to poly_size). A hit skips the type check of the callee, the
+    /// arity check and the scan for cells in the new frame. A site that
+    /// sees more callees stays on the generic path. Cached callees are
+    /// kept alive by the engine; their addresses identify them
+    ///
+    /// A snapshot (see save_snapshot) holds the code of every program
+    /// loaded and the globals with everything they reach. Restoring it
+    /// is an initialized engine without running the programs again
+    ///
+    /// start/resume run with a fuel budget: every instruction costs one,
+    /// and at a call or a backward jump past the budget the execution
+    /// stops where it is and can be resumed later, on any thread, as
+    /// long as one thread at a time uses the engine and its heap
+    ///
+    /// pmap, pfilter and preduce spread large arrays over a pool of
+    /// workers (see set_parallel). A worker is an engine of its own with
+    /// the same programs loaded; the function and the elements are
+    /// copied to it and the results copied back. Only functions that
+    /// cannot store into a global (the one thing a script can change
+    /// that others see) and whose values can all be copied go there;
+    /// the others run one element after the other
+    ///
+    /// With parallel lets on (see set_parallel_lets) run( ) takes the
+    /// top level statements of the last program apart (see deps::graph)
+    /// and runs the ones that do not depend on each other on the same
+    /// workers at once, each with new globals that hold only the values
+    /// it reads. Their globals are set here in program order, and the
+    /// error is the one of the first statement that fails; the
+    /// statements after it may have run, but nothing they did is seen.
+    /// A statement that reads a global the program does not define
+    /// (other than a builtin), and everything from the first return
+    /// at the top level on, runs here after all the statements before it
+    ///
+    /// The profiler (see set_profiler) finds where a script spends its
+    /// time by function, by source line and by stack. Instrumenting
+    /// times every instruction; sampling only looks at the one that
+    /// runs when the sampler ticks, so it costs little but needs a
+    /// longer run to say something. Code that runs on the workers is
+    /// not seen
+    template <typename ValueT>
+    class vm_engine: public engine<ValueT>,
+                     public eval::runtime<ValueT> {
+
+        using base = eval::runtime<ValueT>;
+
+        using base::heap_;
+        using base::globals_;
+        using base::stack_;
+        using base::failed;
+        using base::error;
+
+    public:
+
+        using value       = typename base::value;
+        using environment = typename base::environment;
+        using type        = typename base::type;
+        using function    = typename base::function;
+        using cell        = typename base::cell;
+        using vector      = typename base::vector;
+        using hash        = typename base::hash;
+        using runtime     = typename engine<ValueT>::runtime;
+        using opcode      = bytecode::opcode;
+
+        /// a frame costs a few words of stack_ and calls_ here, not C++
+        /// stack; the limit only keeps runaway recursion from eating
+        /// the memory
+        static const std::size_t vm_max_depth = 100000;
+
+        static const std::size_t poly_size = 4;
+
+        /// smaller arrays are not worth waking the workers for
+        static const std::size_t default_parallel_min = 2048;
+
+        struct pair_count {
+            opcode        first;
+            opcode        second;
+            std::uint64_t count;
+        };
+
+        enum class status {
+            DONE,
+            SUSPENDED,
+            FAILED,
+        };
+
+        struct site_stats {
+            std::string   callee;
+            /// the first callee the site saw
+            std::uint64_t hits        = 0;
+            /// one of the others
+            std::uint64_t poly_hits   = 0;
+            std::uint64_t misses      = 0;
+            bool          megamorphic = false;
+        };
+
+        vm_engine( gc::heap &heap )
+            :base(heap)
+            ,pairs_(bytecode::opcode_count * bytecode::opcode_count, 0)
+        {
+            base::set_max_depth( vm_max_depth );
+            /// only call_value recurses here, and it checks the stack
+            /// itself; a suspended run may go on on another thread
+            base::recurses_ = false;
+            auto hw = std::thread::hardware_concurrency( );
+            parallel_threads_ = hw ? hw : 1;
+            prof_.ops.resize( bytecode::opcode_count );
+        }
+
+        ~vm_engine( )
+        {
+            if( prof_.mode == profile::mode::SAMPLE ) {
+                profile::sampler::stop( );
+            }
+        }
+
+        const char *name( ) const
+        {
+            return "vm";
+        }
+
+        void set_peephole( bool on )
+        {
+            peephole_ = on;
+        }
+
+        void set_call_caches( bool on )
+        {
+            call_caches_ = on;
+        }
+
+        /// counts executed opcode pairs; see opcode_pairs
+        void set_profiling( bool on )
+        {
+            profiling_ = on;
+        }
+
+        /// profiles what runs from now on; see profile::report. Turning
+        /// a mode on drops what was collected before, turning it off
+        /// keeps it. SAMPLE ticks every 'interval' microseconds of CPU
+        /// time the process uses; one engine at a time can sample, and
+        /// it fails without a timer for it
+        bool set_profiler( profile::mode m, std::uint32_t interval = 1000 )
+        {
+            if( prof_.mode == profile::mode::SAMPLE ) {
+                profile::sampler::stop( );
+            }
+            prof_.mode = m;
+            if( m == profile::mode::OFF ) {
+                return true;
+            }
+            clear_profiler( );
+            prof_.collected = m;
+            prof_.interval  = interval;
+            if( m == profile::mode::SAMPLE
+             && !profile::sampler::start( interval ) )
+            {
+                prof_.mode = profile::mode::OFF;
+                return false;
+            }
+            return true;
+        }
+
+        profile::report profile_report( ) const
+        {
+            profile::report res;
+            res.mode    = prof_.collected;
+            res.samples = prof_.samples;
+            for( auto &f: prof_.functions ) {
+                auto &fp = f.second;
+                if( fp.calls == 0 && fp.self.count == 0 ) {
+                    continue;
+                }
+                profile::function_row next;
+                next.name  = fp.name;
+                next.line  = fp.line;
+                next.calls = fp.calls;
+                next.self  = fp.self;
+                res.functions.push_back( next );
+            }
+            std::sort( res.functions.begin( ), res.functions.end( ),
+                [ ]( const profile::function_row &a,
+                     const profile::function_row &b )
+                {
+                    if( a.self.nanos != b.self.nanos ) {
+                        return a.self.nanos > b.self.nanos;
+                    }
+                    if( a.self.count != b.self.count ) {
+                        return a.self.count > b.self.count;
+                    }
+                    return a.name < b.name;
+                } );
+            for( std::size_t i = 0; i < prof_.lines.size( ); ++i ) {
+                if( prof_.lines[i].count ) {
+                    profile::line_row next;
+                    next.line = static_cast<std::uint32_t>(i);
+                    next.self = prof_.lines[i];
+                    res.lines.push_back( next );
+                }
+            }
+            for( std::size_t i = 0; i < prof_.ops.size( ); ++i ) {
+                if( prof_.ops[i].count ) {
+                    profile::op_row next;
+                    next.name = bytecode::name( static_cast<opcode>(i) );
+                    next.self = prof_.ops[i];
+                    res.ops.push_back( next );
+                }
+            }
+            std::stable_sort( res.ops.begin( ), res.ops.end( ),
+                [ ]( const profile::op_row &a, const profile::op_row &b ) {
+                    return a.self.nanos > b.self.nanos;
+                } );
+            for( auto &n: prof_.nodes ) {
+                if( !n.weight ) {
+                    continue;
+                }
+                std::string key = n.fn->name;
+                for( auto p = n.parent; p != no_node;
+                          p = prof_.nodes[p].parent )
+                {
+                    key = prof_.nodes[p].fn->name + ";" + key;
+                }
+                res.stacks[key] += n.weight;
+            }
+            return res;
+        }
+
+        /// workers for pmap, pfilter and preduce over arrays of at least
+        /// 'min_size'; below 2 they always run on the calling thread.
+        /// The workers start with the first call that uses them
+        void set_parallel( std::size_t threads,
+                           std::size_t min_size = default_parallel_min )
+        {
+            if( threads != parallel_threads_ ) {
+                pool_.reset( );
+            }
+            parallel_threads_ = threads;
+            parallel_min_     = min_size;
+        }
+
+        /// calls that went to the workers
+        std::uint64_t parallel_runs( ) const
+        {
+            return parallel_runs_;
+        }
+
+        /// run( ) evaluates independent top level statements of the
+        /// programs loaded from now on on the workers of set_parallel.
+        /// start( ) runs them one after the other still
+        void set_parallel_lets( bool on )
+        {
+            parallel_lets_ = on;
+        }
+
+        /// groups of statements that went to the workers
+        std::uint64_t let_waves( ) const
+        {
+            return let_waves_;
+        }
+
+        void load( const parser::program &prog )
+        {
+            trace::scope ts(trace::phase::COMPILE);
+            plan_.reset( );
+            if( !parallel_lets_ ) {
+                add_unit( bytecode::compiler::compile( prog ) );
+                return;
+            }
+            auto graph = deps::graph::build( prog );
+            auto steps = graph.prefix( );
+            std::unique_ptr<plan> next(new plan);
+            for( std::size_t i = 0; i < steps; ++i ) {
+                auto &info = graph[i];
+                step st;
+                st.code     = add_unit( bytecode::compiler::compile(
+                                                        prog, i, i + 1 ) );
+                st.name     = info.simple ? info.name : std::string( );
+                st.in_order = !info.simple;
+                st.outer    = info.outer;
+                st.after    = info.after;
+                for( auto &f: info.from ) {
+                    /// what it has from an if or a block is known only
+                    /// to the globals here
+                    st.in_order = st.in_order || !graph[f.second].simple;
+                    st.inputs.push_back( f );
+                }
+                next->steps.push_back( st );
+            }
+            if( steps < graph.size( ) ) {
+                step tail;
+                tail.code     = add_unit( bytecode::compiler::compile(
+                                                prog, steps, graph.size( ) ) );
+                tail.in_order = true;
+                next->steps.push_back( tail );
+            }
+            next->whole = add_unit( bytecode::compiler::compile( prog ) );
+            plan_ = std::move(next);
+        }
+
+        /// runs the code in the image where it is; module( ) is empty
+        void load( const image::file::sptr &img )
+        {
+            plan_.reset( );
+            std::unique_ptr<unit> next(new unit);
+            auto u = next.get( );
+            u->id  = units_.size( );
+            units_.emplace_back( std::move(next) );
+
+            stats_        = bytecode::peephole::stats( );
+            u->img        = img;
+            u->names      = img->names( );
+            u->site_names = img->sites( );
+            for( std::size_t i = 0; i < img->protos( ); ++i ) {
+                entry e = { u, img->code( i ), img->code_size( i ),
+                            img->info( i ), nullptr };
+                u->entries.push_back( e );
+            }
+            prepare( u );
+            for( std::size_t i = 0; i < img->constants( ); ++i ) {
+                u->constants.push_back( img->is_int( i )
+                    ? value::from_int( heap_, img->int_value( i ) )
+                    : base::literal( base::intern( img->string_value( i ) ) ) );
+            }
+        }
+
+        /// the bytes of a snapshot; empty with 'err' set if some global
+        /// reaches an object the snapshot cannot hold
+        std::string save_snapshot( std::string &err ) const
+        {
+            namespace snap = mico::snapshot;
+
+            std::unordered_map<const entry *, std::size_t> units;
+            for( std::size_t i = 0; i < units_.size( ); ++i ) {
+                for( auto &e: units_[i]->entries ) {
+                    units[&e] = i;
+                }
+            }
+
+            object_ids ids;
+            std::vector<std::pair<std::string, snap::value_rec> > globals;
+            for( auto &n: globals_->names ) {
+                /// the engine that loads it binds its own
+                if( is_native( globals_->slots[n.second] ) ) {
+                    continue;
+                }
+                globals.emplace_back( n.first,
+                    save_value( globals_->slots[n.second], ids ) );
+            }
+
+            /// ids grows while the objects are written
+            std::vector<snap::object_rec> records;
+            for( std::size_t i = 0; i < ids.order.size( ); ++i ) {
+                snap::object_rec rec;
+                auto obj = ids.order[i];
+                switch( obj->type( ) ) {
+                case objects::object_type::STRING: {
+                    auto str = static_cast<objects::string *>(obj);
+                    rec.tag  = str->interned ? snap::object_tag::LITERAL
+                                             : snap::object_tag::STRING;
+                    rec.text = str->str( );
+                    break;
+                }
+                case objects::object_type::VECTOR: {
+                    auto vec = static_cast<vector *>(obj);
+                    rec.tag  = snap::object_tag::VECTOR;
+                    for( std::size_t j = 0; j < vec->size( ); ++j ) {
+                        rec.values.push_back( save_value( vec->get( j ), ids ) );
+                    }
+                    break;
+                }
+                case objects::object_type::HASH: {
+                    rec.tag = snap::object_tag::HASH;
+                    static_cast<hash *>(obj)->each(
+                        [&]( const value &k, const value &v ) {
+                            rec.values.push_back( save_value( k, ids ) );
+                            rec.values.push_back( save_value( v, ids ) );
+                        } );
+                    break;
+                }
+                case objects::object_type::FUNCTION: {
+                    auto fn = static_cast<function *>(obj);
+                    auto e  = static_cast<const entry *>(fn->code);
+                    auto u  = units.find( e );
+                    if( u == units.end( ) ) {
+                        err = "a function of another engine: "
+                            + fn->inspect( );
+                        return std::string( );
+                    }
+                    rec.tag = snap::object_tag::FUNCTION;
+                    rec.a   = u->second;
+                    rec.b   = static_cast<std::uint64_t>(
+                                e - units_[u->second]->entries.data( ) );
+                    for( auto &v: fn->captured ) {
+                        rec.values.push_back( save_value( v, ids ) );
+                    }
+                    break;
+                }
+                case objects::object_type::CELL:
+                    rec.tag = snap::object_tag::CELL;
+                    rec.values.push_back(
+                        save_value( static_cast<cell *>(obj)->value, ids ) );
+                    break;
+                case objects::object_type::BUILTIN: {
+                    auto bi  = static_cast<objects::builtin *>(obj);
+                    rec.tag  = snap::object_tag::BUILTIN;
+                    rec.a    = bi->id;
+                    rec.text = bi->name;
+                    break;
+                }
+                default:
+                    err = "cannot save " + obj->inspect( );
+                    return std::string( );
+                }
+                records.emplace_back( std::move(rec) );
+            }
+
+            snap::writer out;
+            out.u64( units_.size( ) );
+            for( auto &u: units_ ) {
+                if( u->img ) {
+                    out.u64( u->img->source_hash( ) );
+                    out.bytes( u->img->data( ), u->img->size( ) );
+                } else {
+                    out.u64( 0 );
+                    out.str( image::writer::write( u->mod, 0 ) );
+                }
+            }
+            out.u64( records.size( ) );
+            for( auto &o: records ) {
+                out.object( o );
+            }
+            out.u64( globals.size( ) );
+            for( auto &g: globals ) {
+                out.str( g.first );
+                out.value( g.second );
+            }
+            return out.finish( );
+        }
+
+        bool save_snapshot( const std::string &path, std::string &err ) const
+        {
+            auto bytes = save_snapshot( err );
+            if( bytes.empty( ) ) {
+                return false;
+            }
+            if( !image::save( path, bytes ) ) {
+                err = "cannot write " + path;
+                return false;
+            }
+            return true;
+        }
+
+        /// adds the programs of the snapshot and sets its globals; a
+        /// global of the same name is replaced. false with 'err' set if
+        /// the snapshot is not one of this version or is damaged
+        bool load_snapshot( const char *data, std::size_t size,
+                            std::string &err )
+        {
+            namespace snap = mico::snapshot;
+
+            snap::reader in;
+            if( !in.open( data, size, err ) ) {
+                return false;
+            }
+
+            std::vector<image::file::sptr> images( in.count( ) );
+            for( auto &img: images ) {
+                auto source = in.u64( );
+                auto bytes  = in.str( );
+                if( !in.ok( ) ) {
+                    break;
+                }
+                img = image::file::from_bytes( std::move(bytes), source, err );
+                if( !img ) {
+                    return false;
+                }
+            }
+            std::vector<snap::object_rec> records( in.count( ) );
+            for( auto &o: records ) {
+                o = in.object( );
+            }
+            std::vector<std::pair<std::string, snap::value_rec> > globals(
+                                                                in.count( ) );
+            for( auto &g: globals ) {
+                g.first  = in.str( );
+                g.second = in.value( );
+            }
+            if( !in.ok( ) || !in.at_end( ) ) {
+                err = "damaged snapshot";
+                return false;
+            }
+
+            /// a unit that no global reaches is only code; loading the
+            /// images first lets the objects be checked against them.
+            /// A refused snapshot takes them out again, so the engine
+            /// runs what it ran before
+            auto first = units_.size( );
+            auto plan  = std::move(plan_);
+            auto stats = stats_;
+            auto undo  = [&]( ) {
+                units_.resize( first );
+                plan_  = std::move(plan);
+                stats_ = stats;
+                return false;
+            };
+            for( auto &img: images ) {
+                load( img );
+            }
+            if( !check_snapshot( records, first, globals, err ) ) {
+                return undo( );
+            }
+
+            gc::no_collect guard(heap_);
+            std::vector<objects::object *> made( records.size( ), nullptr );
+            for( std::size_t i = 0; i < records.size( ); ++i ) {
+                auto &rec = records[i];
+                switch( rec.tag ) {
+                case snap::object_tag::STRING:
+                    made[i] = heap_.template make<objects::string>( rec.text );
+                    break;
+                case snap::object_tag::LITERAL:
+                    made[i] = base::literal( base::intern( rec.text ) )
+                                 .as_object( );
+                    break;
+                case snap::object_tag::BUILTIN: {
+                    /// a native is found by its name
+                    auto id = rec.a < base::native_base
+                            ? static_cast<std::uint32_t>(rec.a)
+                            : base::native_base
+                              + static_cast<std::uint32_t>(
+                                                find_native( rec.text ) );
+                    made[i] = heap_.template make<objects::builtin>(
+                                id, rec.text );
+                    break;
+                }
+                case snap::object_tag::CELL:
+                    made[i] = heap_.template make<cell>( );
+                    break;
+                case snap::object_tag::FUNCTION: {
+                    auto &e  = units_[first + rec.a]->entries[rec.b];
+                    auto fn  = heap_.template make<function>( e.info );
+                    fn->code = &e;
+                    made[i]  = fn;
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+
+            /// vectors and hashes cannot change, so they only hold what
+            /// was made before them; cells and functions are filled after
+            std::vector<bool> open( records.size( ), false );
+            for( std::size_t i = 0; i < records.size( ); ++i ) {
+                if( !restore_immutable( records, i, made, open, err ) ) {
+                    return undo( );
+                }
+            }
+            for( std::size_t i = 0; i < records.size( ); ++i ) {
+                auto &rec = records[i];
+                if( rec.tag == snap::object_tag::CELL ) {
+                    static_cast<cell *>(made[i])->value =
+                        load_value( rec.values[0], made );
+                } else if( rec.tag == snap::object_tag::FUNCTION ) {
+                    auto fn = static_cast<function *>(made[i]);
+                    for( auto &v: rec.values ) {
+                        fn->captured.push_back( load_value( v, made ) );
+                    }
+                }
+            }
+            for( auto &g: globals ) {
+                base::set_global( g.first, load_value( g.second, made ) );
+            }
+            return true;
+        }
+
+        /// the file is mapped, not read
+        bool load_snapshot( const std::string &path, std::string &err )
+        {
+            image::mapping map;
+            if( !map.open( path, err ) ) {
+                return false;
+            }
+            return load_snapshot( map.data( ), map.size( ), err );
+        }
+
+        /// drops an execution that is suspended
+        value run( )
+        {
+            trace::scope ts(trace::phase::EXECUTE);
+            suspended_ = false;
+            if( units_.empty( ) ) {
+                return value::null( );
+            }
+            base::reset( );
+            if( plan_ && plan_->whole == units_.back( ).get( )
+             && parallel_threads_ >= 2 )
+            {
+                auto res = run_plan( );
+                finish( );
+                return res;
+            }
+            state s;
+            jump_to( s, &units_.back( )->entries[0], 0 );
+            auto res = profiled( ) ? execute<true, false>( s )
+                                   : execute<false, false>( s );
+            finish( );
+            return res;
+        }
+
+        /// runs the last program loaded like run( ) with 'fuel' to burn;
+        /// the value is result( ) once it is DONE. The callbacks of a
+        /// builtin like map or reduce burn the same fuel, but they
+        /// cannot be suspended: the run FAILS if they outlast it
+        status start( std::uint64_t fuel )
+        {
+            suspended_ = false;
+            result_    = value::null( );
+            used_      = 0;
+            if( units_.empty( ) ) {
+                return status::DONE;
+            }
+            base::reset( );
+            state s;
+            jump_to( s, &units_.back( )->entries[0], 0 );
+            return slice( s, fuel );
+        }
+
+        /// goes on with a SUSPENDED execution
+        status resume( std::uint64_t fuel )
+        {
+            if( !suspended_ ) {
+                return failed( ) ? status::FAILED : status::DONE;
+            }
+            suspended_ = false;
+            return slice( paused_, fuel );
+        }
+
+        /// drops a SUSPENDED execution
+        void cancel( )
+        {
+            suspended_ = false;
+            finish( );
+        }
+
+        bool suspended( ) const
+        {
+            return suspended_;
+        }
+
+        value result( ) const
+        {
+            return result_;
+        }
+
+        /// instructions the execution started last has run
+        std::uint64_t fuel_used( ) const
+        {
+            return used_;
+        }
+
+        runtime &context( )
+        {
+            return *this;
+        }
+
+        /// the last program loaded, if it was compiled here
+        const bytecode::module &module( ) const
+        {
+            return units_.back( )->mod;
+        }
+
+        /// what the peephole pass did to the last program loaded
+        const bytecode::peephole::stats &peephole_stats( ) const
+        {
+            return stats_;
+        }
+
+        /// the call sites of the last program loaded
+        std::vector<site_stats> call_sites( ) const
+        {
+            std::vector<site_stats> res;
+            auto u = units_.back( ).get( );
+            for( std::size_t i = 0; i < u->sites.size( ); ++i ) {
+                auto &site = u->sites[i];
+                site_stats next;
+                next.callee      = u->site_names[i];
+                next.hits        = site.hits;
+                next.poly_hits   = site.poly_hits;
+                next.misses      = site.misses;
+                next.megamorphic = site.megamorphic;
+                res.push_back( next );
+            }
+            return res;
+        }
+
+        /// instructions executed while profiling was on
+        std::uint64_t dispatches( ) const
+        {
+            return dispatches_;
+        }
+
+        /// pairs that ran, most frequent first
+        std::vector<pair_count> opcode_pairs( ) const
+        {
+            std::vector<pair_count> res;
+            auto n = bytecode::opcode_count;
+            for( std::size_t i = 0; i < pairs_.size( ); ++i ) {
+                if( pairs_[i] ) {
+                    pair_count next = { static_cast<opcode>(i / n),
+                                        static_cast<opcode>(i % n),
+                                        pairs_[i] };
+                    res.push_back( next );
+                }
+            }
+            std::stable_sort( res.begin( ), res.end( ),
+                [ ]( const pair_count &a, const pair_count &b ) {
+                    return a.count > b.count;
+                } );
+            return res;
+        }
+
+        /// the opcode pairs and what the profiler collected
+        void clear_profile( )
+        {
+            std::fill( pairs_.begin( ), pairs_.end( ), 0 );
+            dispatches_ = 0;
+            clear_profiler( );
+        }
+
+        void trace( objects::tracer &t )
+        {
+            base::trace( t );
+            t.visit( result_ );
+            for( auto &u: units_ ) {
+                for( auto &c: u->constants ) {
+                    t.visit( c );
+                }
+                for( auto &site: u->sites ) {
+                    for( std::size_t i = 0; i < site.count; ++i ) {
+                        t.visit( site.entries[i].callee );
+                    }
+                }
+            }
+        }
+
+    private:
+
+        struct unit;
+        struct lane;
+
+        using builtin_id = typename base::builtin_id;
+
+        /// what function::code points to
+        struct entry {
+            unit                                      *owner;
+            const bytecode::instr                     *code;
+            std::size_t                                size;
+            std::shared_ptr<const ast::function_info>  info;
+            /// the source line of every instruction; nullptr if the
+            /// program came from an image
+            const std::uint32_t                       *lines;
+        };
+
+        /// what a call site knows about one callee
+        struct site_entry {
+            objects::object *callee  = nullptr;
+            /// nullptr for a builtin
+            const entry     *target  = nullptr;
+            std::uint32_t    builtin = 0;
+            bool             cells   = false;
+        };
+
+        struct call_site {
+            site_entry    entries[poly_size];
+            std::size_t   count       = 0;
+            bool          megamorphic = false;
+            std::uint64_t hits        = 0;
+            std::uint64_t poly_hits   = 0;
+            std::uint64_t misses      = 0;
+        };
+
+        /// a loaded program. kept as long as the engine: functions made
+        /// by a program that was loaded before may still be called
+        struct unit {
+            /// its place in units_
+            std::size_t              id = 0;
+            /// empty if the program came from an image
+            bytecode::module         mod;
+            image::file::sptr        img;
+            /// what the workers load if img is empty; made once
+            image::file::sptr        shared;
+            std::vector<std::string> names;
+            std::vector<std::string> site_names;
+            std::vector<value>       constants;
+            /// global slot of every name, npos until it is known
+            std::vector<std::size_t> slots;
+            std::vector<entry>       entries;
+            std::vector<call_site>   sites;
+        };
+
+        static
+        void prepare( unit *u )
+        {
+            u->slots.assign( u->names.size( ),
+                             std::size_t( environment::npos ) );
+            u->sites.resize( u->site_names.size( ) );
+        }
+
+        unit *add_unit( bytecode::module mod )
+        {
+            std::unique_ptr<unit> next(new unit);
+            auto u = next.get( );
+            u->id  = units_.size( );
+            units_.emplace_back( std::move(next) );
+
+            u->mod = std::move(mod);
+            stats_ = bytecode::peephole::stats( );
+            if( peephole_ ) {
+                stats_ = bytecode::peephole::optimize( u->mod );
+            }
+
+            u->names      = u->mod.names;
+            u->site_names = u->mod.sites;
+            for( auto &p: u->mod.protos ) {
+                /// the peephole pass keeps lines in step with the code
+                auto lines = ( p.lines.size( ) == p.code.size( ) )
+                           ? p.lines.data( ) : nullptr;
+                entry e = { u, p.code.data( ), p.code.size( ), p.info,
+                            lines };
+                u->entries.push_back( e );
+            }
+            prepare( u );
+            /// the unit is traced already; allocating here is fine
+            for( auto &c: u->mod.constants ) {
+                u->constants.push_back(
+                    ( c.type == bytecode::constant::kind::INT )
+                        ? value::from_int( heap_, c.num )
+                        : base::literal( base::intern( c.str ) ) );
+            }
+            return u;
+        }
+
+        /// objects of a snapshot in the order they were found
+        struct object_ids {
+            std::unordered_map<objects::object *, std::uint64_t> index;
+            std::vector<objects::object *>                        order;
+        };
+
+        static
+        mico::snapshot::value_rec save_value( const value &val,
+                                              object_ids &ids )
+        {
+            using tag = mico::snapshot::value_tag;
+            mico::snapshot::value_rec res;
+            if( val.is_null( ) ) {
+                res.tag = tag::NUL;
+            } else if( val.is_bool( ) ) {
+                res.tag  = tag::BOOL;
+                res.bits = val.as_bool( ) ? 1 : 0;
+            } else if( val.is_int( ) ) {
+                res.tag  = tag::INT;
+                res.bits = static_cast<std::uint64_t>(val.as_int( ));
+            } else {
+                auto obj = val.as_object( );
+                auto ins = ids.index.emplace( obj, ids.order.size( ) );
+                if( ins.second ) {
+                    ids.order.push_back( obj );
+                }
+                res.tag  = tag::OBJECT;
+                res.bits = ins.first->second;
+            }
+            return res;
+        }
+
+        value load_value( const mico::snapshot::value_rec &rec,
+                          const std::vector<objects::object *> &made )
+        {
+            using tag = mico::snapshot::value_tag;
+            switch( rec.tag ) {
+            case tag::BOOL:
+                return value::from_bool( rec.bits != 0 );
+            case tag::INT:
+                return value::from_int( heap_,
+                                        static_cast<std::int64_t>(rec.bits) );
+            case tag::OBJECT:
+                return value::from_object( made[rec.bits] );
+            default:
+                break;
+            }
+            return value::null( );
+        }
+
+        /// a function added with bind
+        static
+        bool is_native( const value &val )
+        {
+            if( !val.is_object( )
+             || val.as_object( )->type( ) != objects::object_type::BUILTIN )
+            {
+                return false;
+            }
+            return static_cast<objects::builtin *>(val.as_object( ))->id
+                        >= base::native_base;
+        }
+
+        /// the index of the native 'name' of this engine;
+        /// natives_.size( ) if there is none
+        std::size_t find_native( const std::string &name ) const
+        {
+            std::size_t i = 0;
+            while( i < base::natives_.size( )
+                && base::natives_[i].name != name )
+            {
+                ++i;
+            }
+            return i;
+        }
+
+        static
+        bool is_immutable( const mico::snapshot::object_rec &rec )
+        {
+            return rec.tag == mico::snapshot::object_tag::VECTOR
+                || rec.tag == mico::snapshot::object_tag::HASH;
+        }
+
+        /// every reference is in range, every function is code that
+        /// was loaded with the right number of captured values
+        bool check_snapshot(
+            const std::vector<mico::snapshot::object_rec> &records,
+            std::size_t first,
+            const std::vector<std::pair<std::string,
+                                        mico::snapshot::value_rec> > &globals,
+            std::string &err ) const
+        {
+            using tag = mico::snapshot::object_tag;
+            auto valid = [&]( const mico::snapshot::value_rec &v ) {
+                return v.tag != mico::snapshot::value_tag::OBJECT
+                    || v.bits < records.size( );
+            };
+            /// the same keys runtime::make_hash takes
+            auto key = [&]( const mico::snapshot::value_rec &v ) -> bool {
+                if( v.tag != mico::snapshot::value_tag::OBJECT ) {
+                    return v.tag != mico::snapshot::value_tag::NUL;
+                }
+                return records[v.bits].tag == tag::STRING
+                    || records[v.bits].tag == tag::LITERAL;
+            };
+            auto last = static_cast<std::uint32_t>(base::builtin_id::ARRAY);
+
+            bool ok = true;
+            for( auto &rec: records ) {
+                switch( rec.tag ) {
+                case tag::STRING:
+                case tag::LITERAL:
+                case tag::VECTOR:
+                    break;
+                case tag::HASH:
+                    ok = ok && ( rec.values.size( ) % 2 == 0 );
+                    for( std::size_t i = 0; ok && i < rec.values.size( );
+                                            i += 2 )
+                    {
+                        ok = valid( rec.values[i] ) && key( rec.values[i] );
+                    }
+                    break;
+                case tag::FUNCTION: {
+                    ok = ok && ( rec.a < units_.size( ) - first );
+                    if( !ok ) {
+                        break;
+                    }
+                    auto &entries = units_[first + rec.a]->entries;
+                    /// entry 0 is the top level and has no info
+                    ok = ( rec.b > 0 ) && ( rec.b < entries.size( ) )
+                      && ( entries[rec.b].info->captures.size( )
+                            == rec.values.size( ) );
+                    break;
+                }
+                case tag::CELL:
+                    ok = ok && ( rec.values.size( ) == 1 );
+                    break;
+                case tag::BUILTIN:
+                    ok = ok && ( rec.a <= last
+                              || ( rec.a >= base::native_base
+                                && find_native( rec.text )
+                                    < base::natives_.size( ) ) );
+                    break;
+                default:
+                    ok = false;
+                    break;
+                }
+                for( auto &v: rec.values ) {
+                    ok = ok && valid( v );
+                }
+                if( !ok ) {
+                    break;
+                }
+            }
+            for( auto &g: globals ) {
+                ok = ok && valid( g.second );
+            }
+            if( !ok ) {
+                err = "damaged snapshot";
+            }
+            return ok;
+        }
+
+        /// makes the vector or hash 'id' after the ones it holds,
+        /// without recursion; a cycle between them is a damaged snapshot
+        bool restore_immutable(
+                    const std::vector<mico::snapshot::object_rec> &records,
+                    std::size_t id, std::vector<objects::object *> &made,
+                    std::vector<bool> &open, std::string &err )
+        {
+            using tag = mico::snapshot::value_tag;
+            if( made[id] || !is_immutable( records[id] ) ) {
+                return true;
+            }
+            std::vector<std::size_t> todo( 1, id );
+            while( !todo.empty( ) ) {
+                auto cur = todo.back( );
+                if( made[cur] ) {
+                    todo.pop_back( );
+                    continue;
+                }
+                open[cur]  = true;
+                bool ready = true;
+                for( auto &v: records[cur].values ) {
+                    if( v.tag != tag::OBJECT || made[v.bits]
+                     || !is_immutable( records[v.bits] ) )
+                    {
+                        continue;
+                    }
+                    /// an unfinished one above 'cur' is its ancestor
+                    if( open[v.bits] ) {
+                        err = "damaged snapshot";
+                        return false;
+                    }
+                    ready = false;
+                    todo.push_back( v.bits );
+                }
+                if( !ready ) {
+                    continue;
+                }
+
+                std::vector<value> values;
+                values.reserve( records[cur].values.size( ) );
+                for( auto &v: records[cur].values ) {
+                    values.push_back( load_value( v, made ) );
+                }
+                if( records[cur].tag == mico::snapshot::object_tag::VECTOR ) {
+                    made[cur] = base::vector_ops::make( heap_, values.data( ),
+                                                        values.size( ) );
+                } else {
+                    auto res = heap_.template make<hash>( );
+                    res->reserve( values.size( ) / 2 );
+                    for( std::size_t i = 0; i < values.size( ); i += 2 ) {
+                        res->insert( values[i], values[i + 1] );
+                    }
+                    made[cur] = res;
+                }
+                todo.pop_back( );
+            }
+            return true;
+        }
+
+        /// copies objects of an engine with the same programs loaded
+        /// into this one; what is shared there is shared here. Cells
+        /// and functions are filled after they are made (see fill), so
+        /// a cycle through them ends
+        struct copier {
+            std::unordered_map<objects::object *, objects::object *> made;
+            std::vector<std::pair<objects::object *,
+                                  objects::object *> >            open;
+        };
+
+        /// the heap must not collect until the copy is rooted
+        value copy_value( const value &val, copier &c )
+        {
+            if( val.is_int( ) ) {
+                return value::from_int( heap_, val.as_int( ) );
+            } else if( !val.is_object( ) ) {
+                return val;
+            }
+            auto src   = val.as_object( );
+            auto found = c.made.find( src );
+            if( found != c.made.end( ) ) {
+                return value::from_object( found->second );
+            }
+
+            objects::object *res = nullptr;
+            switch( src->type( ) ) {
+            case objects::object_type::STRING: {
+                auto str = static_cast<objects::string *>(src);
+                res = str->interned
+                    ? base::literal( base::intern( str->str( ) ) ).as_object( )
+                    : heap_.template make<objects::string>( str->str( ) );
+                break;
+            }
+            case objects::object_type::VECTOR: {
+                auto vec = static_cast<vector *>(src);
+                std::vector<value> values;
+                values.reserve( vec->size( ) );
+                for( std::size_t i = 0; i < vec->size( ); ++i ) {
+                    values.push_back( copy_value( vec->get( i ), c ) );
+                }
+                res = base::vector_ops::make( heap_, values.data( ),
+                                              values.size( ) );
+                break;
+            }
+            case objects::object_type::HASH: {
+                auto h = heap_.template make<hash>( );
+                static_cast<hash *>(src)->each(
+                    [&]( const value &k, const value &v ) {
+                        auto key = copy_value( k, c );
+                        h->insert( key, copy_value( v, c ) );
+                    } );
+                res = h;
+                break;
+            }
+            case objects::object_type::FUNCTION: {
+                auto e   = static_cast<const entry *>(
+                                static_cast<function *>(src)->code );
+                auto &to = units_[e->owner->id]->entries[
+                                e - e->owner->entries.data( )];
+                auto fn  = heap_.template make<function>( to.info );
+                fn->code = &to;
+                res      = fn;
+                c.open.emplace_back( src, res );
+                break;
+            }
+            case objects::object_type::CELL:
+                res = heap_.template make<cell>( );
+                c.open.emplace_back( src, res );
+                break;
+            case objects::object_type::BUILTIN: {
+                auto bi = static_cast<objects::builtin *>(src);
+                res = heap_.template make<objects::builtin>( bi->id, bi->name );
+                break;
+            }
+            default:
+                /// shareable( ) lets nothing else through
+                return value::null( );
+            }
+            c.made[src] = res;
+            return value::from_object( res );
+        }
+
+        void fill( copier &c )
+        {
+            while( !c.open.empty( ) ) {
+                auto next = c.open.back( );
+                c.open.pop_back( );
+                if( next.first->type( ) == objects::object_type::CELL ) {
+                    auto val = copy_value(
+                                static_cast<cell *>(next.first)->value, c );
+                    static_cast<cell *>(next.second)->value = val;
+                } else {
+                    auto from = static_cast<function *>(next.first);
+                    auto to   = static_cast<function *>(next.second);
+                    for( auto &v: from->captured ) {
+                        auto val = copy_value( v, c );
+                        to->captured.push_back( val );
+                    }
+                }
+            }
+        }
+
+        /// what pmap and the others hand to the workers, and the globals
+        /// its code reads
+        struct sharing {
+            std::unordered_set<objects::object *> seen;
+            std::vector<objects::object *>        todo;
+            std::unordered_set<const entry *>     scanned;
+            std::unordered_set<std::string>       names;
+            std::vector<std::string>              globals;
+            /// false if the globals code reads are known already
+            bool                                  code = true;
+        };
+
+        void share( const value &val, sharing &sh )
+        {
+            if( val.is_int( ) || !val.is_object( ) ) {
+                return;
+            }
+            if( sh.seen.insert( val.as_object( ) ).second ) {
+                sh.todo.push_back( val.as_object( ) );
+            }
+        }
+
+        /// 'e' is code of this engine; a function of another one points
+        /// at something else
+        bool owns( const entry *e ) const
+        {
+            std::less<const entry *> less;
+            for( auto &u: units_ ) {
+                auto &all = u->entries;
+                if( !all.empty( ) && !less( e, all.data( ) )
+                 && less( e, all.data( ) + all.size( ) ) )
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// no global is stored into by 'e' or by the functions it makes;
+        /// the ones it reads are shared
+        bool scan_code( const entry *e, sharing &sh )
+        {
+            if( !sh.scanned.insert( e ).second ) {
+                return true;
+            }
+            auto owner = e->owner;
+            for( std::size_t i = 0; i < e->size; ++i ) {
+                auto &ins = e->code[i];
+                switch( ins.op ) {
+                case opcode::SET_GLOBAL:
+                case opcode::TEE_GLOBAL:
+                    return false;
+                case opcode::GET_GLOBAL: {
+                    auto &name = owner->names[ins.a];
+                    if( !sh.names.insert( name ).second ) {
+                        break;
+                    }
+                    auto slot = globals_->slot_of( name );
+                    if( slot == environment::npos ) {
+                        /// the calling thread reports it
+                        return false;
+                    }
+                    sh.globals.push_back( name );
+                    share( globals_->slots[slot], sh );
+                    break;
+                }
+                case opcode::CLOSURE:
+                    if( !scan_code( &owner->entries[ins.a], sh ) ) {
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            return true;
+        }
+
+        /// everything share( ) was given, and all it reaches, can be
+        /// copied. Strings are flattened and hashed here, so the
+        /// workers only ever read the objects of this engine
+        bool shareable( sharing &sh )
+        {
+            while( !sh.todo.empty( ) ) {
+                auto obj = sh.todo.back( );
+                sh.todo.pop_back( );
+                switch( obj->type( ) ) {
+                case objects::object_type::STRING: {
+                    auto str = static_cast<objects::string *>(obj);
+                    str->str( );
+                    str->hash( );
+                    break;
+                }
+                case objects::object_type::VECTOR: {
+                    auto vec = static_cast<vector *>(obj);
+                    for( std::size_t i = 0; i < vec->size( ); ++i ) {
+                        share( vec->get( i ), sh );
+                    }
+                    break;
+                }
+                case objects::object_type::HASH:
+                    static_cast<hash *>(obj)->each(
+                        [&]( const value &k, const value &v ) {
+                            share( k, sh );
+                            share( v, sh );
+                        } );
+                    break;
+                case objects::object_type::CELL:
+                    share( static_cast<cell *>(obj)->value, sh );
+                    break;
+                case objects::object_type::BUILTIN:
+                    /// the workers have no functions added with bind
+                    if( static_cast<objects::builtin *>(obj)->id
+                            >= base::native_base )
+                    {
+                        return false;
+                    }
+                    break;
+                case objects::object_type::FUNCTION: {
+                    auto fn = static_cast<function *>(obj);
+                    auto e  = static_cast<const entry *>(fn->code);
+                    if( !e || !owns( e )
+                     || ( sh.code && !scan_code( e, sh ) ) )
+                    {
+                        return false;
+                    }
+                    for( auto &v: fn->captured ) {
+                        share( v, sh );
+                    }
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// copies back from 'l'. What it got from here comes back as
+        /// the object it was made from: the workers cannot change it (a
+        /// function stores only into cells of its own frame), and the
+        /// results of all the workers share what they shared here
+        copier &returning( std::unordered_map<lane *, copier> &back,
+                           lane *l )
+        {
+            auto found = back.find( l );
+            if( found != back.end( ) ) {
+                return found->second;
+            }
+            auto &res = back[l];
+            for( auto &m: l->in.made ) {
+                res.made[m.second] = m.first;
+            }
+            return res;
+        }
+
+        /// the code of 'u' for the workers to load
+        image::file::sptr shared_image( unit *u )
+        {
+            if( u->img ) {
+                return u->img;
+            }
+            if( !u->shared ) {
+                std::string err;
+                u->shared = image::file::from_bytes(
+                                image::writer::write( u->mod, 0 ), 0, err );
+            }
+            return u->shared;
+        }
+
+        /// starts the workers and loads what they do not have yet; false
+        /// if some program cannot go there
+        bool open_lanes( )
+        {
+            std::vector<image::file::sptr> code;
+            for( auto &u: units_ ) {
+                code.push_back( shared_image( u.get( ) ) );
+                if( !code.back( ) ) {
+                    return false;
+                }
+            }
+            if( !pool_ ) {
+                pool_.reset( new exec::pool<lane>( parallel_threads_ ) );
+            }
+            for( std::size_t i = 0; i < pool_->threads( ); ++i ) {
+                auto &l = pool_->context( i );
+                for( auto j = l.vm.units_.size( ); j < code.size( ); ++j ) {
+                    l.vm.load( code[j] );
+                }
+            }
+            return true;
+        }
+
+        /// what the workers made is garbage now
+        void close_lanes( )
+        {
+            for( std::size_t i = 0; i < pool_->threads( ); ++i ) {
+                auto &l = pool_->context( i );
+                l.vm.finish( );
+                l.vm.errors_.clear( );
+                l.in = copier( );
+            }
+        }
+
+        /// what one job did. pmap leaves copy and result of every
+        /// element on the stack of the worker from 'at' on, preduce
+        /// its partial result at 'at'
+        struct piece {
+            lane                      *where = nullptr;
+            std::size_t                at    = 0;
+            std::vector<std::uint8_t>  keep;
+            std::string                error;
+        };
+
+        /// elements [from, to) of 'vec' on the worker 'l'; false with
+        /// pc.error set if a call failed. Runs on the thread of 'l' and
+        /// only reads this engine
+        bool run_piece( lane &l, std::uint64_t call, builtin_id id,
+                        const value &fn, const sharing &sh,
+                        const vector *vec, std::size_t from, std::size_t to,
+                        piece &pc )
+        {
+            auto &vm = l.vm;
+            if( l.ready != call ) {
+                vm.finish( );
+                vm.errors_.clear( );
+                vm.set_max_depth( base::max_depth( ) );
+                l.in    = copier( );
+                l.ready = call;
+                gc::no_collect guard(l.heap);
+                for( auto &name: sh.globals ) {
+                    auto slot = globals_->slot_of( name );
+                    vm.base::set_global( name,
+                            vm.copy_value( globals_->slots[slot], l.in ) );
+                }
+                vm.stack_.push_back( vm.copy_value( fn, l.in ) );
+                vm.fill( l.in );
+            }
+
+            pc.where = &l;
+            pc.at    = vm.stack_.size( );
+            auto callee = vm.stack_[0];
+            for( auto i = from; i < to; ++i ) {
+                value elem;
+                {
+                    gc::no_collect guard(l.heap);
+                    elem = vm.copy_value( vec->get( i ), l.in );
+                    vm.fill( l.in );
+                    vm.stack_.push_back( elem );
+                }
+                if( id == builtin_id::PREDUCE && i == from ) {
+                    continue;
+                }
+                vm.stack_.push_back( callee );
+                if( id == builtin_id::PREDUCE ) {
+                    auto acc = vm.stack_[pc.at];
+                    vm.stack_.push_back( acc );
+                }
+                vm.stack_.push_back( elem );
+                auto first = vm.stack_.size( )
+                           - ( id == builtin_id::PREDUCE ? 3 : 2 );
+                auto res   = vm.call_value( first );
+                if( vm.failed( ) ) {
+                    pc.error = vm.errors_.front( );
+                    vm.errors_.clear( );
+                    return false;
+                }
+                if( id == builtin_id::PMAP ) {
+                    vm.stack_.push_back( res );
+                } else if( id == builtin_id::PFILTER ) {
+                    pc.keep.push_back( base::is_truthy( res ) ? 1 : 0 );
+                } else {
+                    vm.stack_[pc.at] = res;
+                }
+            }
+            return true;
+        }
+
+        /// pmap and the others on the workers; false, with nothing
+        /// done, if they cannot take the call. preduce folds every
+        /// piece on its own and the pieces here, so its function has to
+        /// be associative
+        bool spread( builtin_id id, std::size_t first, value &res )
+        {
+            auto vec    = static_cast<vector *>(stack_[first].as_object( ));
+            auto n      = vec->size( );
+            bool reduce = ( id == builtin_id::PREDUCE );
+            auto fn     = stack_[first + ( reduce ? 2 : 1 )];
+            /// the workers burn no fuel, so a fueled run stays here
+            if( parallel_threads_ < 2 || n < parallel_min_ || n < 2
+             || fueled_ || !base::as_function( fn ) )
+            {
+                return false;
+            }
+
+            sharing sh;
+            share( fn, sh );
+            for( std::size_t i = 0; i < n; ++i ) {
+                share( vec->get( i ), sh );
+            }
+            if( !shareable( sh ) ) {
+                return false;
+            }
+            if( !open_lanes( ) ) {
+                return false;
+            }
+            auto lanes = pool_->threads( );
+
+            auto chunk  = std::max<std::size_t>( n / ( lanes * 4 ), 32 );
+            auto chunks = ( n + chunk - 1 ) / chunk;
+            auto call   = ++parallel_calls_;
+            std::vector<piece> pieces( chunks );
+            /// the first piece that failed; the ones after it are
+            /// skipped, the ones before it still run, so the error is
+            /// the one of the first element that fails
+            std::atomic<std::size_t> failed_at( chunks );
+            for( std::size_t p = 0; p < chunks; ++p ) {
+                pool_->submit( [&, p]( lane &l ) {
+                    if( failed_at.load( ) < p ) {
+                        return;
+                    }
+                    auto from = p * chunk;
+                    auto to   = std::min( n, from + chunk );
+                    if( !run_piece( l, call, id, fn, sh, vec, from, to,
+                                    pieces[p] ) )
+                    {
+                        auto cur = failed_at.load( );
+                        while( p < cur
+                            && !failed_at.compare_exchange_weak( cur, p ) )
+                        { }
+                    }
+                } );
+            }
+            pool_->wait( );
+            ++parallel_runs_;
+
+            if( failed_at.load( ) < chunks ) {
+                error( pieces[failed_at.load( )].error );
+                res = value::null( );
+            } else if( reduce ) {
+                /// the partial results are rooted here while they fold
+                auto partials = stack_.size( );
+                {
+                    gc::no_collect guard(heap_);
+                    std::unordered_map<lane *, copier> back;
+                    for( auto &pc: pieces ) {
+                        auto &c = returning( back, pc.where );
+                        stack_.push_back( copy_value(
+                                pc.where->vm.stack_[pc.at], c ) );
+                        fill( c );
+                    }
+                }
+                auto acc = stack_[first + 1];
+                for( std::size_t p = 0; p < chunks && !failed( ); ++p ) {
+                    auto part = stack_[partials + p];
+                    stack_.push_back( fn );
+                    stack_.push_back( acc );
+                    stack_.push_back( part );
+                    acc = call_value( stack_.size( ) - 3 );
+                }
+                stack_.resize( partials );
+                res = failed( ) ? value::null( ) : acc;
+            } else {
+                gc::no_collect guard(heap_);
+                std::unordered_map<lane *, copier> back;
+                std::vector<value> values;
+                for( std::size_t p = 0; p < chunks; ++p ) {
+                    auto &pc   = pieces[p];
+                    auto from  = p * chunk;
+                    auto count = std::min( n, from + chunk ) - from;
+                    auto &c    = returning( back, pc.where );
+                    for( std::size_t k = 0; k < count; ++k ) {
+                        if( id == builtin_id::PMAP ) {
+                            values.push_back( copy_value(
+                                pc.where->vm.stack_[pc.at + 2 * k + 1], c ) );
+                        } else if( pc.keep[k] ) {
+                            values.push_back( vec->get( from + k ) );
+                        }
+                    }
+                }
+                for( auto &c: back ) {
+                    fill( c.second );
+                }
+                res = value::from_object( base::vector_ops::make(
+                                heap_, values.data( ), values.size( ) ) );
+            }
+
+            close_lanes( );
+            return true;
+        }
+
+        value parallel( builtin_id id, std::size_t first )
+        {
+            value res;
+            if( spread( id, first, res ) ) {
+                return res;
+            }
+            return base::sequential( id, first );
+        }
+
+        /// a top level statement of a program loaded with parallel lets
+        struct step {
+            unit                    *code     = nullptr;
+            /// the global it binds if it is a plain let; its value is
+            /// what the statement gives the others
+            std::string              name;
+            /// runs here with the globals of the program so far
+            bool                     in_order = false;
+            /// the steps the values of the globals it needs come from
+            std::vector<std::pair<std::string, std::size_t> > inputs;
+            /// globals it needs from before the program
+            std::vector<std::string> outer;
+            std::vector<std::size_t> after;
+        };
+
+        struct plan {
+            /// the program as load( ) without parallel lets makes it
+            unit             *whole = nullptr;
+            std::vector<step> steps;
+        };
+
+        /// what a worker did with one step; its value is on the stack of
+        /// the worker at 'at'
+        struct let_job {
+            lane        *where  = nullptr;
+            std::size_t  at     = 0;
+            bool         failed = false;
+            std::string  error;
+        };
+
+        /// how far a plan gets: nothing from 'limit' on is seen, the
+        /// step there failed with 'error'
+        struct outcome {
+            std::size_t limit;
+            std::string error;
+
+            void fail( std::size_t i, const std::string &err )
+            {
+                if( i < limit ) {
+                    limit = i;
+                    error = err;
+                }
+            }
+        };
+
+        /// the code of 'u' on top of what is on the stack, which stays;
+        /// null if it fails
+        value run_unit( unit *u )
+        {
+            auto mark = stack_.size( );
+            state s;
+            jump_to( s, &u->entries[0], 0 );
+            auto res = profiled( ) ? execute<true, false>( s )
+                                   : execute<false, false>( s );
+            calls_.clear( );
+            base::frames_.clear( );
+            base::frame_ = typename base::frame( );
+            stack_.resize( mark );
+            return failed( ) ? value::null( ) : res;
+        }
+
+        value global( const std::string &name ) const
+        {
+            auto slot = globals_->slot_of( name );
+            return ( slot == environment::npos ) ? value::null( )
+                                                 : globals_->slots[slot];
+        }
+
+        void prepare_all( )
+        {
+            for( auto &u: units_ ) {
+                prepare( u.get( ) );
+            }
+        }
+
+        /// the value of the step 'st' run on the worker 'l' with new
+        /// globals; the values of the steps it needs are at stack_[at]
+        /// and on. Runs on the thread of 'l' and only reads this engine
+        void run_step( lane &l, std::uint64_t call, const step &st,
+                       std::size_t at, let_job &job )
+        {
+            auto &vm = l.vm;
+            if( l.ready != call ) {
+                vm.finish( );
+                vm.errors_.clear( );
+                vm.set_max_depth( base::max_depth( ) );
+                l.in    = copier( );
+                l.ready = call;
+            }
+            vm.reset_globals( );
+            vm.prepare_all( );
+            {
+                /// the copies stay on the stack: the next step on this
+                /// worker may get them again from l.in
+                gc::no_collect guard(l.heap);
+                for( auto &in: st.inputs ) {
+                    auto val = vm.copy_value( stack_[at + in.second], l.in );
+                    vm.stack_.push_back( val );
+                    vm.base::set_global( in.first, val );
+                }
+                vm.fill( l.in );
+            }
+            auto res = vm.run_unit( vm.units_[st.code->id].get( ) );
+            if( vm.failed( ) ) {
+                job.failed = true;
+                job.error  = vm.errors_.front( );
+                vm.errors_.clear( );
+                return;
+            }
+            job.where = &l;
+            job.at    = vm.stack_.size( );
+            vm.stack_.push_back( st.name.empty( ) ? res
+                                                  : vm.global( st.name ) );
+        }
+
+        /// the step 'st' here, with globals that hold what it needs only
+        value run_apart( const step &st, std::size_t at )
+        {
+            auto saved = stack_.size( );
+            stack_.push_back( value::from_object( globals_ ) );
+            base::reset_globals( );
+            for( auto &in: st.inputs ) {
+                base::set_global( in.first, stack_[at + in.second] );
+            }
+            prepare_all( );
+            auto res = run_unit( st.code );
+            if( !failed( ) && !st.name.empty( ) ) {
+                res = global( st.name );
+            }
+            globals_ = static_cast<environment *>(stack_[saved].as_object( ));
+            stack_.resize( saved );
+            prepare_all( );
+            return res;
+        }
+
+        /// 'name' holds what the workers have anyway: a builtin of the
+        /// same name, or nothing at all
+        bool plain_global( const std::string &name ) const
+        {
+            auto slot = globals_->slot_of( name );
+            if( slot == environment::npos ) {
+                return true;
+            }
+            auto &val = globals_->slots[slot];
+            if( val.is_int( ) || !val.is_object( )
+             || val.as_object( )->type( ) != objects::object_type::BUILTIN )
+            {
+                return false;
+            }
+            auto bi = static_cast<objects::builtin *>(val.as_object( ));
+            return bi->id < base::native_base && bi->name == name;
+        }
+
+        /// the steps of plan_, waves of the ones whose inputs are ready
+        /// on the workers and the others here. The value of every step
+        /// is on the stack from 'at' on until the globals are set
+        value run_plan( )
+        {
+            auto &steps = plan_->steps;
+            auto n      = steps.size( );
+            auto at     = stack_.size( );
+            if( n == 0 ) {
+                return value::null( );
+            }
+            stack_.resize( at + n, value::null( ) );
+
+            std::vector<std::uint8_t> in_order( n, 0 );
+            std::vector<std::uint8_t> done( n, 0 );
+            std::vector<std::uint8_t> set( n, 0 );
+            for( std::size_t i = 0; i < n; ++i ) {
+                in_order[i] = steps[i].in_order;
+                for( auto &name: steps[i].outer ) {
+                    in_order[i] = in_order[i] || !plain_global( name );
+                }
+            }
+            bool lanes = open_lanes( );
+
+            outcome out;
+            out.limit = n;
+            /// the globals of the steps before 'to', in order
+            auto commit = [&]( std::size_t to ) {
+                for( std::size_t i = 0; i < to; ++i ) {
+                    if( done[i] && !set[i] && !steps[i].name.empty( ) ) {
+                        base::set_global( steps[i].name, stack_[at + i] );
+                    }
+                    set[i] = set[i] || done[i];
+                }
+            };
+
+            for( ;; ) {
+                std::size_t first = 0;
+                while( first < out.limit && done[first] ) {
+                    ++first;
+                }
+                if( first == out.limit ) {
+                    break;
+                }
+                if( in_order[first] ) {
+                    commit( first );
+                    auto res = run_unit( steps[first].code );
+                    if( failed( ) ) {
+                        out.fail( first, base::errors_.front( ) );
+                        base::errors_.clear( );
+                    } else {
+                        stack_[at + first] = steps[first].name.empty( )
+                                           ? res
+                                           : global( steps[first].name );
+                    }
+                    done[first] = 1;
+                    set[first]  = 1;
+                    continue;
+                }
+
+                /// every step before 'first' is done, so that one is
+                /// in the wave
+                std::vector<std::size_t> wave;
+                for( auto i = first; i < out.limit; ++i ) {
+                    bool ready = !done[i] && !in_order[i];
+                    for( auto a: steps[i].after ) {
+                        ready = ready && done[a];
+                    }
+                    if( ready ) {
+                        wave.push_back( i );
+                    }
+                }
+                run_wave( wave, lanes, at, out );
+                for( auto i: wave ) {
+                    done[i] = 1;
+                }
+            }
+
+            commit( out.limit );
+            if( out.limit < n ) {
+                error( out.error );
+                return value::null( );
+            }
+            return steps.back( ).name.empty( ) ? stack_[at + n - 1]
+                                               : value::null( );
+        }
+
+        /// the steps of 'wave' need nothing from each other. One alone,
+        /// or one whose values cannot be copied, runs here
+        void run_wave( const std::vector<std::size_t> &wave, bool lanes,
+                       std::size_t at, outcome &out )
+        {
+            auto &steps = plan_->steps;
+            std::vector<std::uint8_t> apart( wave.size( ), 1 );
+            std::vector<let_job>      jobs( wave.size( ) );
+            if( lanes && wave.size( ) > 1 ) {
+                auto call = ++parallel_calls_;
+                for( std::size_t j = 0; j < wave.size( ); ++j ) {
+                    sharing sh;
+                    sh.code = false;
+                    for( auto &in: steps[wave[j]].inputs ) {
+                        share( stack_[at + in.second], sh );
+                    }
+                    if( !shareable( sh ) ) {
+                        continue;
+                    }
+                    apart[j] = 0;
+                    pool_->submit( [&, j, call]( lane &l ) {
+                        run_step( l, call, steps[wave[j]], at, jobs[j] );
+                    } );
+                }
+                pool_->wait( );
+                ++let_waves_;
+            }
+
+            std::unordered_map<lane *, copier> back;
+            for( std::size_t j = 0; j < wave.size( ); ++j ) {
+                auto i    = wave[j];
+                auto &job = jobs[j];
+                if( i > out.limit ) {
+                    continue;
+                }
+                if( !apart[j] && job.failed ) {
+                    out.fail( i, job.error );
+                    continue;
+                }
+                if( !apart[j] ) {
+                    auto &vm = job.where->vm;
+                    auto val = vm.stack_[job.at];
+                    sharing sh;
+                    sh.code = false;
+                    vm.share( val, sh );
+                    if( vm.shareable( sh ) ) {
+                        gc::no_collect guard(heap_);
+                        auto &c = returning( back, job.where );
+                        stack_[at + i] = copy_value( val, c );
+                        fill( c );
+                        continue;
+                    }
+                }
+                auto res = run_apart( steps[i], at );
+                if( failed( ) ) {
+                    out.fail( i, base::errors_.front( ) );
+                    base::errors_.clear( );
+                } else {
+                    stack_[at + i] = res;
+                }
+            }
+            if( lanes ) {
+                close_lanes( );
+            }
+        }
+
+        /// how pmap and the others call back into the script: the
+        /// function runs to its return on an execute of its own. In a
+        /// run started with fuel every call costs one instruction, and
+        /// the execute burns the same fuel, see pause
+        value call_value( std::size_t first )
+        {
+            if( fueled_ && ++used_ > limit_ ) {
+                stack_.resize( first );
+                return out_of_fuel( );
+            }
+            if( !base::as_function( stack_[first] ) ) {
+                return base::call_value( first );
+            }
+            /// a nested execute never suspends, so the stack it runs
+            /// on stays where the outermost one marked it
+            if( callbacks_ == 0 ) {
+                base::mark_stack( );
+            }
+            if( ( callbacks_ > 0 && !base::stack_left( ) )
+             || !base::push_frame( ) )
+            {
+                stack_.resize( first );
+                return value::null( );
+            }
+            ++callbacks_;
+            auto frames = base::frames_.size( );
+            auto floor  = floor_;
+            auto nested = nested_;
+            floor_  = calls_.size( );
+            nested_ = true;
+            bool outer = prof_.mode != profile::mode::OFF && prof_.at;
+            if( outer ) {
+                prof_frame pf = { floor_, prof_.at };
+                prof_.outer.push_back( pf );
+            }
+
+            value res = value::null( );
+            state s;
+            if( enter_function( s, first ) ) {
+                if( fueled_ ) {
+                    res = profiled( ) ? execute<true, true>( s )
+                                      : execute<false, true>( s );
+                } else {
+                    res = profiled( ) ? execute<true, false>( s )
+                                      : execute<false, false>( s );
+                }
+            }
+            if( outer ) {
+                prof_.at = prof_.outer.back( ).at;
+                prof_.outer.pop_back( );
+            }
+            calls_.resize( floor_ );
+            base::frames_.resize( frames );
+            floor_  = floor;
+            nested_ = nested;
+            --callbacks_;
+            base::pop_frame( );
+            stack_.resize( first );
+            return failed( ) ? value::null( ) : res;
+        }
+
+        /// the caller of a frame
+        struct call_info {
+            const entry *from;
+            std::size_t  pc;
+        };
+
+        struct state {
+            const entry           *cur    = nullptr;
+            const bytecode::instr *code   = nullptr;
+            const value           *consts = nullptr;
+            std::size_t            pc     = 0;
+        };
+
+        static
+        void jump_to( state &s, const entry *e, std::size_t pc )
+        {
+            s.cur    = e;
+            s.code   = e->code;
+            s.consts = e->owner->constants.data( );
+            s.pc     = pc;
+        }
+
+        /// 'Tok' is a constant, so the switch folds away
+        template <type Tok>
+        bool int_op( std::int64_t a, std::int64_t b, value &res )
+        {
+            switch( Tok ) {
+            case type::PLUS:
+                res = value::from_int( heap_, eval::int_ops::add( a, b ) );
+                return true;
+            case type::MINUS:
+                res = value::from_int( heap_, eval::int_ops::sub( a, b ) );
+                return true;
+            case type::ASTERISK:
+                res = value::from_int( heap_, eval::int_ops::mul( a, b ) );
+                return true;
+            case type::SLASH:
+                if( b == 0 ) {
+                    return false;
+                }
+                res = value::from_int( heap_, eval::int_ops::div( a, b ) );
+                return true;
+            case type::LT:
+                res = value::from_bool( a < b );
+                return true;
+            case type::GT:
+                res = value::from_bool( a > b );
+                return true;
+            case type::EQ:
+                res = value::from_bool( a == b );
+                return true;
+            case type::NOT_EQ:
+                res = value::from_bool( a != b );
+                return true;
+            default:
+                break;
+            }
+            return false;
+        }
+
+        /// the operands have to be rooted by the caller
+        template <type Tok>
+        bool apply( value left, value right, value &res )
+        {
+            if( left.is_int( ) && right.is_int( )
+             && int_op<Tok>( left.as_int( ), right.as_int( ), res ) )
+            {
+                return true;
+            }
+            res = base::infix( Tok, left, right );
+            return !failed( );
+        }
+
+        /// pops two operands, pushes the result
+        template <type Tok>
+        bool binary( )
+        {
+            value res;
+            if( !apply<Tok>( stack_[stack_.size( ) - 2], stack_.back( ), res ) ) {
+                return false;
+            }
+            stack_.pop_back( );
+            stack_.back( ) = res;
+            return true;
+        }
+
+        /// the top of the stack and a constant
+        template <type Tok>
+        bool binary_const( const value &right )
+        {
+            value res;
+            if( !apply<Tok>( stack_.back( ), right, res ) ) {
+                return false;
+            }
+            stack_.back( ) = res;
+            return true;
+        }
+
+        /// pops the operands of a compare-and-jump
+        template <type Tok>
+        bool test( std::size_t n, const value *right, bool &res )
+        {
+            auto rval = right ? *right : stack_.back( );
+            auto lval = stack_[stack_.size( ) - n];
+            if( lval.is_int( ) && rval.is_int( ) ) {
+                switch( Tok ) {
+                case type::LT:
+                    res = lval.as_int( ) < rval.as_int( );
+                    break;
+                case type::GT:
+                    res = lval.as_int( ) > rval.as_int( );
+                    break;
+                default:
+                    res = lval.as_int( ) == rval.as_int( );
+                    break;
+                }
+            } else {
+                value val;
+                if( !apply<Tok>( lval, rval, val ) ) {
+                    return false;
+                }
+                res = base::is_truthy( val );
+            }
+            stack_.resize( stack_.size( ) - n );
+            return true;
+        }
+
+        bool get_global( const entry *e, std::int32_t id )
+        {
+            auto &slot = e->owner->slots[id];
+            if( slot == environment::npos ) {
+                slot = globals_->slot_of( e->owner->names[id] );
+                if( slot == environment::npos ) {
+                    error( "Identifier not found: " + e->owner->names[id] );
+                    return false;
+                }
+            }
+            stack_.push_back( globals_->slots[slot] );
+            return true;
+        }
+
+        void set_global( const entry *e, std::int32_t id, const value &val )
+        {
+            auto &slot = e->owner->slots[id];
+            if( slot == environment::npos ) {
+                slot = globals_->set( e->owner->names[id], val );
+            } else {
+                globals_->slots[slot] = val;
+            }
+            heap_.write_barrier( globals_, val );
+        }
+
+        cell *local_cell( std::int32_t id )
+        {
+            return static_cast<cell *>(
+                stack_[base::frame_.base + id].as_object( ));
+        }
+
+        /// stack_[first] is a function made by this engine
+        bool enter_function( state &s, std::size_t first )
+        {
+            auto fn   = static_cast<function *>(stack_[first].as_object( ));
+            auto next = static_cast<const entry *>(fn->code);
+            if( !next ) {
+                error( "function was made by another engine" );
+                return false;
+            }
+            if( !base::enter( first ) ) {
+                return false;
+            }
+            jump_to( s, next, 0 );
+            return true;
+        }
+
+        /// the cache entry for the callee at stack_[first], learning it
+        /// if there is room; nullptr sends the call the generic way
+        const site_entry *cached( call_site &site, std::size_t first )
+        {
+            auto &callee = stack_[first];
+            if( !callee.is_object( ) ) {
+                site.misses++;
+                return nullptr;
+            }
+            auto obj = callee.as_object( );
+            if( site.count && site.entries[0].callee == obj ) {
+                site.hits++;
+                return &site.entries[0];
+            }
+            for( std::size_t i = 1; i < site.count; ++i ) {
+                if( site.entries[i].callee == obj ) {
+                    site.poly_hits++;
+                    return &site.entries[i];
+                }
+            }
+            site.misses++;
+            if( site.megamorphic || !call_caches_ ) {
+                return nullptr;
+            }
+
+            site_entry next;
+            next.callee = obj;
+            auto argc   = stack_.size( ) - first - 1;
+            if( auto fn = base::as_function( callee ) ) {
+                next.target = static_cast<const entry *>(fn->code);
+                auto &info  = *fn->info;
+                if( !next.target || info.params.size( ) != argc ) {
+                    /// the generic path reports it
+                    return nullptr;
+                }
+                next.cells = std::find( info.cells.begin( ), info.cells.end( ),
+                                        true ) != info.cells.end( );
+            } else if( obj->type( ) == objects::object_type::BUILTIN ) {
+                next.builtin = static_cast<objects::builtin *>(obj)->id;
+            } else {
+                return nullptr;
+            }
+
+            if( site.count == poly_size ) {
+                site.megamorphic = true;
+                return nullptr;
+            }
+            site.entries[site.count] = next;
+            return &site.entries[site.count++];
+        }
+
+        /// a cached builtin; the result replaces callee and arguments
+        bool call_builtin( const site_entry *e, std::size_t first )
+        {
+            auto res = base::call_builtin(
+                            static_cast<typename base::builtin_id>(e->builtin),
+                            first + 1, stack_.size( ) - first - 1 );
+            stack_.resize( first );
+            stack_.push_back( res );
+            return !failed( );
+        }
+
+        /// a cached function; stack_[first] is the callee
+        void enter_cached( state &s, const site_entry *e, std::size_t first )
+        {
+            base::open_frame( static_cast<function *>(e->callee), first,
+                              e->cells );
+            jump_to( s, e->target, 0 );
+        }
+
+        /// the value on top goes to the caller; false at the top level,
+        /// or at the function call_value runs
+        bool leave( state &s )
+        {
+            if( calls_.size( ) == floor_ ) {
+                return false;
+            }
+            auto res = stack_.back( );
+            stack_.resize( base::frame_.base - 1 );
+            stack_.push_back( res );
+            base::pop_frame( );
+            jump_to( s, calls_.back( ).from, calls_.back( ).pc );
+            calls_.pop_back( );
+            return true;
+        }
+
+        /// a builtin, or something that is not a function at all
+        bool call_other( std::size_t first )
+        {
+            auto res = base::call( first );
+            stack_.resize( first );
+            stack_.push_back( res );
+            return !failed( );
+        }
+
+        value abort( )
+        {
+            return value::null( );
+        }
+
+        /// keeps 's' at the instruction that ran out of fuel; it runs
+        /// again, and is paid for again, when the execution resumes
+        value pause( state &s )
+        {
+            if( callbacks_ > 0 ) {
+                return out_of_fuel( );
+            }
+            s.pc--;
+            used_--;
+            profile_charge( );
+            paused_    = s;
+            suspended_ = true;
+            return value::null( );
+        }
+
+        /// the builtin that runs a callback is on the C++ stack, so
+        /// the run cannot wait for its next slice there; it fails
+        value out_of_fuel( )
+        {
+            return error( "out of fuel in a callback after "
+                        + std::to_string( used_ ) + " instructions" );
+        }
+
+        void finish( )
+        {
+            profile_charge( );
+            calls_.clear( );
+            base::frames_.clear( );
+            base::frame_ = typename base::frame( );
+            stack_.clear( );
+        }
+
+        status slice( const state &s, std::uint64_t fuel )
+        {
+            limit_   = used_ + fuel;
+            fueled_  = true;
+            auto res = profiled( ) ? execute<true, true>( s )
+                                   : execute<false, true>( s );
+            fueled_  = false;
+            if( suspended_ ) {
+                return status::SUSPENDED;
+            }
+            result_ = res;
+            finish( );
+            return failed( ) ? status::FAILED : status::DONE;
+        }
+
+        using prof_clock = std::chrono::steady_clock;
+
+        /// what the profiler knows of a function
+        struct fn_profile {
+            std::string      name;
+            std::uint32_t    line  = 0;
+            std::uint64_t    calls = 0;
+            profile::counter self;
+        };
+
+        /// a function that called a builtin that calls back, like map;
+        /// its callers are calls_ below 'floor'
+        struct prof_frame {
+            std::size_t  floor;
+            const entry *at;
+        };
+
+        /// 'weight' is the time or the samples of the stack that ends
+        /// here; the root has no parent
+        struct prof_node {
+            std::size_t    parent;
+            fn_profile    *fn;
+            std::uint64_t  weight;
+        };
+
+        struct profiler {
+            profile::mode  mode      = profile::mode::OFF;
+            /// the mode of what is collected
+            profile::mode  collected = profile::mode::OFF;
+            std::uint32_t  interval  = 0;
+            std::uint64_t  samples   = 0;
+            std::unordered_map<const entry *, fn_profile>   functions;
+            /// by line and by opcode
+            std::vector<profile::counter>                   lines;
+            std::vector<profile::counter>                   ops;
+            /// the call tree; a node is a function and its callers
+            std::vector<prof_node>                          nodes;
+            std::map<std::pair<std::size_t, const entry *>,
+                     std::size_t>                           children;
+
+            /// the function of the last instruction; and the ones that
+            /// wait for the execute of call_value to return
+            const entry              *at = nullptr;
+            std::vector<prof_frame>   outer;
+
+            /// the place 'fn' and 'node' are of; they change only with
+            /// a call or a return. 'frames' is the stack there from the
+            /// outermost function, 'path' their nodes
+            const entry               *cur   = nullptr;
+            std::size_t                depth = 0;
+            std::size_t                nest  = 0;
+            fn_profile                *fn    = nullptr;
+            std::size_t                node  = 0;
+            std::vector<const entry *> frames;
+            std::vector<std::size_t>   path;
+
+            /// the instruction that runs since 'last'; it is charged
+            /// when the next one starts
+            bool               pending = false;
+            std::uint32_t      line    = 0;
+            std::size_t        op      = 0;
+            prof_clock::time_point last;
+        };
+
+        bool profiled( ) const
+        {
+            return profiling_ || prof_.mode != profile::mode::OFF;
+        }
+
+        void clear_profiler( )
+        {
+            prof_.samples = 0;
+            prof_.functions.clear( );
+            prof_.lines.clear( );
+            std::fill( prof_.ops.begin( ), prof_.ops.end( ),
+                       profile::counter( ) );
+            prof_.nodes.clear( );
+            prof_.children.clear( );
+            prof_.at      = nullptr;
+            prof_.outer.clear( );
+            prof_.cur     = nullptr;
+            prof_.fn      = nullptr;
+            prof_.frames.clear( );
+            prof_.path.clear( );
+            prof_.pending = false;
+        }
+
+        fn_profile *profile_function( const entry *e )
+        {
+            auto ins = prof_.functions.emplace( e, fn_profile( ) );
+            auto &res = ins.first->second;
+            if( ins.second ) {
+                res.line = e->info ? e->info->pos.line : 0;
+                if( e == &e->owner->entries[0] ) {
+                    res.name = "main";
+                } else if( e->info && !e->info->name.empty( ) ) {
+                    res.name = e->info->name;
+                } else {
+                    res.name = "fn@" + std::to_string( res.line );
+                }
+            }
+            return &res;
+        }
+
+        static const std::size_t no_node = static_cast<std::size_t>(-1);
+
+        std::size_t profile_node( std::size_t parent, const entry *e )
+        {
+            auto ins = prof_.children.emplace( std::make_pair( parent, e ),
+                                               prof_.nodes.size( ) );
+            if( ins.second ) {
+                prof_node next = { parent, profile_function( e ), 0 };
+                prof_.nodes.push_back( next );
+            }
+            return ins.first->second;
+        }
+
+        /// the stack is the callers in calls_, with the outer ones in
+        /// their places, and s.cur. Between two instructions there is
+        /// one call or return at most, and a frame below the top does
+        /// not change without a return to it: when every instruction
+        /// comes here, only the top of the stack is new
+        void profile_place( const state &s, bool every )
+        {
+            if( every && s.cur == prof_.cur && calls_.size( ) == prof_.depth
+             && prof_.outer.size( ) == prof_.nest && prof_.fn )
+            {
+                return;
+            }
+            auto size = calls_.size( ) + prof_.outer.size( ) + 1;
+            std::size_t from = 0;
+            if( every && prof_.fn && prof_.nest == 0
+             && prof_.outer.empty( ) )
+            {
+                from = std::min( prof_.frames.size( ), size ) - 1;
+            }
+            prof_.cur   = s.cur;
+            prof_.depth = calls_.size( );
+            prof_.nest  = prof_.outer.size( );
+            prof_.frames.resize( size );
+            prof_.path.resize( size );
+
+            if( prof_.outer.empty( ) ) {
+                for( auto i = from; i < calls_.size( ); ++i ) {
+                    prof_.frames[i] = calls_[i].from;
+                }
+            } else {
+                std::size_t j = 0;
+                std::size_t n = 0;
+                for( std::size_t i = 0; i <= calls_.size( ); ++i ) {
+                    for( ; j < prof_.outer.size( )
+                        && prof_.outer[j].floor == i; ++j )
+                    {
+                        prof_.frames[n++] = prof_.outer[j].at;
+                    }
+                    if( i < calls_.size( ) ) {
+                        prof_.frames[n++] = calls_[i].from;
+                    }
+                }
+            }
+            prof_.frames[size - 1] = s.cur;
+
+            for( auto i = from; i < size; ++i ) {
+                prof_.path[i] = profile_node( i ? prof_.path[i - 1] : no_node,
+                                              prof_.frames[i] );
+            }
+            prof_.node = prof_.path[size - 1];
+            prof_.fn   = prof_.nodes[prof_.node].fn;
+        }
+
+        profile::counter &profile_line( std::uint32_t line )
+        {
+            if( prof_.lines.size( ) <= line ) {
+                prof_.lines.resize( line + 1 );
+            }
+            return prof_.lines[line];
+        }
+
+        static
+        void charge( profile::counter &c, std::uint64_t nanos )
+        {
+            c.count++;
+            c.nanos += nanos;
+        }
+
+        /// the time since the last instruction started goes to it
+        void profile_charge( prof_clock::time_point now = prof_clock::now( ) )
+        {
+            if( !prof_.pending ) {
+                return;
+            }
+            auto nanos = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - prof_.last ).count( ) );
+            charge( prof_.fn->self, nanos );
+            charge( profile_line( prof_.line ), nanos );
+            charge( prof_.ops[prof_.op], nanos );
+            prof_.nodes[prof_.node].weight += nanos;
+            prof_.pending = false;
+        }
+
+        /// 'ins' is about to run
+        void profile_step( const state &s, const bytecode::instr &ins )
+        {
+            prof_.at  = s.cur;
+            if( prof_.mode == profile::mode::SAMPLE
+             && !profile::sampler::due( ) )
+            {
+                return;
+            }
+            auto pc   = s.pc - 1;
+            auto line = s.cur->lines ? s.cur->lines[pc] : 0;
+            if( prof_.mode == profile::mode::SAMPLE ) {
+                std::uint64_t nanos = prof_.interval * 1000ull;
+                profile_place( s, false );
+                charge( prof_.fn->self, nanos );
+                charge( profile_line( line ), nanos );
+                prof_.nodes[prof_.node].weight += 1;
+                prof_.samples++;
+                return;
+            }
+            auto now = prof_clock::now( );
+            profile_charge( now );
+            profile_place( s, true );
+            if( pc == 0 ) {
+                prof_.fn->calls++;
+            }
+            prof_.line    = line;
+            prof_.op      = static_cast<std::size_t>(ins.op);
+            prof_.pending = true;
+            prof_.last    = now;
+        }
+
+        /// 'Fuel' counts instructions and stops at calls and backward
+        /// jumps once they pass limit_
+        template <bool Profile, bool Fuel>
+        value execute( state s )
+        {
+            std::size_t prev = 0;
+
+            for( ;; ) {
+                auto &ins = s.code[s.pc++];
+                if( Fuel ) {
+                    used_++;
+                }
+                if( Profile && profiling_ ) {
+                    auto op = static_cast<std::size_t>(ins.op);
+                    pairs_[prev * bytecode::opcode_count + op]++;
+                    dispatches_++;
+                    prev = op;
+                }
+                if( Profile && prof_.mode != profile::mode::OFF ) {
+                    profile_step( s, ins );
+                }
+
+                switch( ins.op ) {
+                case opcode::NOP:
+                    break;
+                case opcode::CONST:
+                    stack_.push_back( s.consts[ins.a] );
+                    break;
+                case opcode::NIL:
+                    stack_.push_back( value::null( ) );
+                    break;
+                case opcode::TRUE:
+                    stack_.push_back( value::from_bool( true ) );
+                    break;
+                case opcode::FALSE:
+                    stack_.push_back( value::from_bool( false ) );
+                    break;
+                case opcode::POP:
+                    stack_.pop_back( );
+                    break;
+
+                case opcode::GET_GLOBAL:
+                    if( !get_global( s.cur, ins.a ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::SET_GLOBAL:
+                    set_global( s.cur, ins.a, stack_.back( ) );
+                    stack_.pop_back( );
+                    break;
+                case opcode::TEE_GLOBAL:
+                    set_global( s.cur, ins.a, stack_.back( ) );
+                    break;
+                case opcode::GET_LOCAL: {
+                    auto val = stack_[base::frame_.base + ins.a];
+                    stack_.push_back( val );
+                    break;
+                }
+                case opcode::GET_LOCAL2: {
+                    auto a = stack_[base::frame_.base + ins.a];
+                    auto b = stack_[base::frame_.base + ins.b];
+                    stack_.push_back( a );
+                    stack_.push_back( b );
+                    break;
+                }
+                case opcode::SET_LOCAL:
+                    stack_[base::frame_.base + ins.a] = stack_.back( );
+                    stack_.pop_back( );
+                    break;
+                case opcode::TEE_LOCAL:
+                    stack_[base::frame_.base + ins.a] = stack_.back( );
+                    break;
+                case opcode::GET_LOCAL_CELL: {
+                    auto val = local_cell( ins.a )->value;
+                    stack_.push_back( val );
+                    break;
+                }
+                case opcode::SET_LOCAL_CELL: {
+                    auto c = local_cell( ins.a );
+                    c->value = stack_.back( );
+                    heap_.write_barrier( c, c->value );
+                    stack_.pop_back( );
+                    break;
+                }
+                case opcode::GET_CAPTURE:
+                    stack_.push_back( base::frame_.fn->captured[ins.a] );
+                    break;
+                case opcode::GET_CAPTURE_CELL:
+                    stack_.push_back( static_cast<cell *>(
+                        base::frame_.fn->captured[ins.a].as_object( ))->value );
+                    break;
+
+                case opcode::ADD:
+                    if( !binary<type::PLUS>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::SUB:
+                    if( !binary<type::MINUS>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::MUL:
+                    if( !binary<type::ASTERISK>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::DIV:
+                    if( !binary<type::SLASH>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::LT:
+                    if( !binary<type::LT>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::GT:
+                    if( !binary<type::GT>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::EQ:
+                    if( !binary<type::EQ>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::NOT_EQ:
+                    if( !binary<type::NOT_EQ>( ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::ADD_CONST:
+                    if( !binary_const<type::PLUS>( s.consts[ins.a] ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::SUB_CONST:
+                    if( !binary_const<type::MINUS>( s.consts[ins.a] ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::LT_CONST:
+                    if( !binary_const<type::LT>( s.consts[ins.a] ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::GT_CONST:
+                    if( !binary_const<type::GT>( s.consts[ins.a] ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::EQ_CONST:
+                    if( !binary_const<type::EQ>( s.consts[ins.a] ) ) {
+                        return abort( );
+                    }
+                    break;
+                case opcode::LOCAL_ADD_CONST: {
+                    auto val = stack_[base::frame_.base + ins.a];
+                    stack_.push_back( val );
+                    if( !binary_const<type::PLUS>( s.consts[ins.b] ) ) {
+                        return abort( );
+                    }
+                    break;
+                }
+                case opcode::LOCAL_SUB_CONST: {
+                    auto val = stack_[base::frame_.base + ins.a];
+                    stack_.push_back( val );
+                    if( !binary_const<type::MINUS>( s.consts[ins.b] ) ) {
+                        return abort( );
+                    }
+                    break;
+                }
+
+                case opcode::NEG: {
+                    auto val = stack_.back( );
+                    stack_.back( ) = val.is_int( )
+                        ? value::from_int( heap_,
+                                           eval::int_ops::neg( val.as_int( ) ) )
+                        : base::prefix( type::MINUS, val );
+                    if( failed( ) ) {
+                        return abort( );
+                    }
+                    break;
+                }
+                case opcode::PLUS: {
+                    auto val = stack_.back( );
+                    stack_.back( ) = base::prefix( type::PLUS, val );
+                    if( failed( ) ) {
+                        return abort( );
+                    }
+                    break;
+                }
+                case opcode::NOT:
+                    stack_.back( ) = value::from_bool(
+                                        !base::is_truthy( stack_.back( ) ) );
+                    break;
+
+                case opcode::JUMP:
+                    /// the only jump that can go back; conditional ones
+                    /// always go forward
+                    if( Fuel && static_cast<std::size_t>(ins.a) < s.pc
+                     && used_ > limit_ )
+                    {
+                        return pause( s );
+                    }
+                    s.pc = ins.a;
+                    break;
+                case opcode::JUMP_IF_FALSE: {
+                    bool truth = base::is_truthy( stack_.back( ) );
+                    stack_.pop_back( );
+                    if( !truth ) {
+                        s.pc = ins.a;
+                    }
+                    break;
+                }
+                case opcode::JUMP_IF_TRUE: {
+                    bool truth = base::is_truthy( stack_.back( ) );
+                    stack_.pop_back( );
+                    if( truth ) {
+                        s.pc = ins.a;
+                    }
+                    break;
+                }
+                case opcode::JUMP_UNLESS_LT:
+                case opcode::JUMP_UNLESS_GT:
+                case opcode::JUMP_UNLESS_EQ:
+                case opcode::JUMP_UNLESS_LT_CONST:
+                case opcode::JUMP_UNLESS_GT_CONST:
+                case opcode::JUMP_UNLESS_EQ_CONST: {
+                    bool truth = false;
+                    bool ok    = false;
+                    switch( ins.op ) {
+                    case opcode::JUMP_UNLESS_LT:
+                        ok = test<type::LT>( 2, nullptr, truth );
+                        break;
+                    case opcode::JUMP_UNLESS_GT:
+                        ok = test<type::GT>( 2, nullptr, truth );
+                        break;
+                    case opcode::JUMP_UNLESS_EQ:
+                        ok = test<type::EQ>( 2, nullptr, truth );
+                        break;
+                    case opcode::JUMP_UNLESS_LT_CONST:
+                        ok = test<type::LT>( 1, &s.consts[ins.b], truth );
+                        break;
+                    case opcode::JUMP_UNLESS_GT_CONST:
+                        ok = test<type::GT>( 1, &s.consts[ins.b], truth );
+                        break;
+                    default:
+                        ok = test<type::EQ>( 1, &s.consts[ins.b], truth );
+                        break;
+                    }
+                    if( !ok ) {
+                        return abort( );
+                    }
+                    if( !truth ) {
+                        s.pc = ins.a;
+                    }
+                    break;
+                }
+
+                case opcode::ARRAY: {
+                    auto first = stack_.size( ) - ins.a;
+                    auto res   = base::make_array( first );
+                    stack_.resize( first );
+                    stack_.push_back( res );
+                    break;
+                }
+                case opcode::HASH: {
+                    auto first = stack_.size( ) - ins.a;
+                    auto res   = base::make_hash( first );
+                    if( failed( ) ) {
+                        return abort( );
+                    }
+                    stack_.resize( first );
+                    stack_.push_back( res );
+                    break;
+                }
+                case opcode::INDEX: {
+                    auto res = base::index( stack_[stack_.size( ) - 2],
+                                            stack_.back( ) );
+                    if( failed( ) ) {
+                        return abort( );
+                    }
+                    stack_.pop_back( );
+                    stack_.back( ) = res;
+                    break;
+                }
+
+                case opcode::CALL: {
+                    if( Fuel && used_ > limit_ ) {
+                        return pause( s );
+                    }
+                    auto first = stack_.size( ) - ins.a - 1;
+                    auto e     = cached( s.cur->owner->sites[ins.b], first );
+                    if( e && !e->target ) {
+                        if( !call_builtin( e, first ) ) {
+                            return abort( );
+                        }
+                        break;
+                    } else if( e ) {
+                        if( !base::push_frame( ) ) {
+                            return abort( );
+                        }
+                        call_info ci = { s.cur, s.pc };
+                        calls_.push_back( ci );
+                        enter_cached( s, e, first );
+                        break;
+                    }
+                    if( !base::as_function( stack_[first] ) ) {
+                        if( !call_other( first ) ) {
+                            return abort( );
+                        }
+                        break;
+                    }
+                    if( !base::push_frame( ) ) {
+                        return abort( );
+                    }
+                    call_info ci = { s.cur, s.pc };
+                    calls_.push_back( ci );
+                    if( !enter_function( s, first ) ) {
+                        return abort( );
+                    }
+                    break;
+                }
+                case opcode::TAIL_CALL: {
+                    if( Fuel && used_ > limit_ ) {
+                        return pause( s );
+                    }
+                    auto first = stack_.size( ) - ins.a - 1;
+                    auto e     = cached( s.cur->owner->sites[ins.b], first );
+                    if( e && e->target ) {
+                        auto target = base::frame_.base - 1;
+                        base::reuse_frame( target, first );
+                        enter_cached( s, e, target );
+                        break;
+                    } else if( e ) {
+                        if( !call_builtin( e, first ) ) {
+                            return abort( );
+                        }
+                        if( !leave( s ) ) {
+                            return stack_.back( );
+                        }
+                        break;
+                    }
+                    if( base::as_function( stack_[first] )
+                     && ( nested_ || !calls_.empty( ) ) )
+                    {
+                        auto target = base::frame_.base - 1;
+                        base::reuse_frame( target, first );
+                        if( !enter_function( s, target ) ) {
+                            return abort( );
+                        }
+                        break;
+                    }
+                    if( !call_other( first ) ) {
+                        return abort( );
+                    }
+                    if( !leave( s ) ) {
+                        return stack_.back( );
+                    }
+                    break;
+                }
+                case opcode::RETURN:
+                    if( !leave( s ) ) {
+                        return stack_.back( );
+                    }
+                    break;
+                case opcode::CLOSURE: {
+                    auto owner = s.cur->owner;
+                    auto res   = base::make_function( owner->entries[ins.a].info );
+                    res->code  = &owner->entries[ins.a];
+                    stack_.push_back( value::from_object( res ) );
+                    break;
+                }
+
+                default:
+                    error( std::string( "bad opcode: " )
+                         + bytecode::name( ins.op ) );
+                    return abort( );
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<unit> > units_;
+        std::vector<call_info>              calls_;
+        /// calls_ below it belong to the execute that call_value is in
+        std::size_t                         floor_  = 0;
+        bool                                nested_ = false;
+        /// executes of call_value that have not returned
+        std::size_t                         callbacks_ = 0;
+
+        state                               paused_;
+        bool                                suspended_ = false;
+        value                               result_;
+        std::uint64_t                       used_      = 0;
+        std::uint64_t                       limit_     = 0;
+        /// a slice of start( ) or resume( ) is running
+        bool                                fueled_    = false;
+
+        bool                                peephole_    = true;
+        bool                                profiling_   = false;
+        bool                                call_caches_ = true;
+        bytecode::peephole::stats           stats_;
+        std::vector<std::uint64_t>          pairs_;
+        std::uint64_t                       dispatches_ = 0;
+        profiler                            prof_;
+
+        std::unique_ptr<exec::pool<lane> >  pool_;
+        std::size_t                         parallel_threads_ = 1;
+        std::size_t                         parallel_min_ = default_parallel_min;
+        std::uint64_t                       parallel_runs_ = 0;
+        std::uint64_t                       parallel_calls_ = 0;
+
+        bool                                parallel_lets_ = false;
+        std::unique_ptr<plan>               plan_;
+        std::uint64_t                       let_waves_ = 0;
+    };
+
+    /// a worker of pmap and the others
+    template <typename ValueT>
+    struct vm_engine<ValueT>::lane {
+
+        lane( )
+            :vm(heap)
+        {
+            vm.set_parallel( 0 );
+        }
+
+        gc::heap      heap;
+        vm_engine     vm;
+        /// the call it has the function and the globals of
+        std::uint64_t ready = 0;
+        /// what it has copied in that call; all of it is rooted on
+        /// the stack of vm until the call ends
+        copier        in;
+    };
+
+}}
+
+#endif // VM_H